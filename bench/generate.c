@@ -0,0 +1,712 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file generate.c
+ *
+ * Synthetic StrongHelp Manual Generator, implementation.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "string.h"
+
+#include "generate.h"
+
+/* Magic Words used in file blocks. */
+
+#define GENERATE_FILE_WORD (0x504c4548)
+#define GENERATE_DIR_WORD (0x24524944)
+#define GENERATE_DATA_WORD (0x41544144)
+#define GENERATE_FREE_WORD (0x45455246)
+
+/* The StrongHelp version number to write into the header. */
+
+#define GENERATE_VERSION (275)
+
+/* Object attribute flags. */
+
+#define GENERATE_ATTRIBUTES_FILE (0x000b)
+#define GENERATE_ATTRIBUTES_DIRECTORY (0x010b)
+
+/* The sizes of the fixed parts of the blocks. */
+
+#define GENERATE_HEADER_SIZE (16)
+#define GENERATE_DIR_HEADER_SIZE (12)
+#define GENERATE_DIR_ENTRY_SIZE (24)
+#define GENERATE_DATA_HEADER_SIZE (8)
+#define GENERATE_FREE_HEADER_SIZE (12)
+
+/* The maximum length of an object name, including the terminator. */
+
+#define GENERATE_MAX_NAME (16)
+
+/* The maximum number of directories that a manual can contain. */
+
+#define GENERATE_MAX_DIRECTORIES (10000000)
+
+/* Salts used to derive the different properties of each file. */
+
+#define GENERATE_SALT_SIZE (0x53495a45)
+#define GENERATE_SALT_TYPE (0x54595045)
+#define GENERATE_SALT_CONTENT (0x434f4e54)
+#define GENERATE_SALT_CHANGED (0x4348414e)
+#define GENERATE_SALT_RENAMED (0x52454e41)
+#define GENERATE_SALT_FREE (0x46524545)
+
+/**
+ * A manual under construction in memory.
+ */
+
+struct generate_buffer {
+	int8_t				*data;		/**< Pointer to the manual data.			*/
+	size_t				length;		/**< The length of the manual so far.			*/
+	size_t				size;		/**< The size of the buffer holding the data.		*/
+};
+
+/**
+ * The state of a manual generation.
+ */
+
+struct generate_state {
+	struct generate_params		*params;	/**< The parameters for the manual.			*/
+	struct generate_buffer		buffer;		/**< The manual under construction.			*/
+	struct generate_summary		summary;	/**< The details of the manual so far.			*/
+	unsigned			total_files;	/**< The number of files which the manual will hold.	*/
+	unsigned			free_blocks;	/**< The number of free blocks written so far.		*/
+	size_t				last_free;	/**< The offset of the word linking to the next free block.	*/
+};
+
+/**
+ * An entry in a directory being generated.
+ */
+
+struct generate_entry {
+	char				name[GENERATE_MAX_NAME];	/**< The name of the object.		*/
+	bool				directory;	/**< True if the object is a directory.			*/
+	unsigned			id;		/**< The file number, from which its details are derived.	*/
+	uint32_t			filetype;	/**< The filetype of a file.				*/
+	size_t				size;		/**< The size of a file.				*/
+	size_t				offset;		/**< The offset of the entry within the manual.		*/
+};
+
+/* Static Function Prototypes. */
+
+static bool generate_directory(struct generate_state *state, unsigned level, size_t *offset, size_t *size);
+static bool generate_file(struct generate_state *state, struct generate_entry *entry, size_t *offset, size_t *size);
+static bool generate_free_block(struct generate_state *state);
+static int generate_compare_entries(const void *a, const void *b);
+static void generate_file_details(struct generate_params *params, struct generate_entry *entry);
+static size_t generate_file_size(struct generate_params *params, unsigned id);
+static unsigned generate_bits(size_t value);
+static bool generate_append(struct generate_buffer *buffer, size_t length, size_t *offset);
+static void generate_write_word(struct generate_buffer *buffer, size_t offset, uint32_t value);
+static uint32_t generate_hash(uint32_t seed, uint32_t value, uint32_t salt);
+
+/**
+ * Initialise a set of parameters to the default values.
+ *
+ * \param *params	Pointer to the parameters to initialise.
+ */
+
+void generate_initialise_params(struct generate_params *params)
+{
+	if (params == NULL)
+		return;
+
+	params->depth = 2;
+	params->fanout = 8;
+	params->files = 100;
+	params->min_size = 0;
+	params->max_size = 65536;
+	params->distribution = GENERATE_DISTRIBUTION_LOG;
+	params->free_blocks = 16;
+	params->seed = 1;
+	params->changed = 0;
+	params->renamed = 0;
+}
+
+/**
+ * Read any generator parameters from a set of command line options,
+ * ignoring those which don't apply.
+ *
+ * \param *options	Pointer to the command line options.
+ * \param *params	Pointer to the parameters to update.
+ * \return		True if successful; False if the options are invalid.
+ */
+
+bool generate_read_params(struct args_option *options, struct generate_params *params)
+{
+	bool success = true;
+
+	if (params == NULL)
+		return false;
+
+	while (options != NULL) {
+		if (options->data == NULL) {
+			options = options->next;
+			continue;
+		}
+
+		if (strcmp(options->name, "dist") == 0 && options->data->value.string != NULL) {
+			if (string_nocase_strcmp(options->data->value.string, "uniform") == 0)
+				params->distribution = GENERATE_DISTRIBUTION_UNIFORM;
+			else if (string_nocase_strcmp(options->data->value.string, "log") == 0)
+				params->distribution = GENERATE_DISTRIBUTION_LOG;
+			else
+				success = false;
+		} else if (options->type == ARGS_TYPE_INT && options->data->value.integer < 0) {
+			success = false;
+		} else if (strcmp(options->name, "changed") == 0) {
+			params->changed = options->data->value.integer;
+		} else if (strcmp(options->name, "depth") == 0) {
+			params->depth = options->data->value.integer;
+		} else if (strcmp(options->name, "fanout") == 0) {
+			params->fanout = options->data->value.integer;
+		} else if (strcmp(options->name, "files") == 0) {
+			params->files = options->data->value.integer;
+		} else if (strcmp(options->name, "free") == 0) {
+			params->free_blocks = options->data->value.integer;
+		} else if (strcmp(options->name, "max") == 0) {
+			params->max_size = options->data->value.integer;
+		} else if (strcmp(options->name, "min") == 0) {
+			params->min_size = options->data->value.integer;
+		} else if (strcmp(options->name, "renamed") == 0) {
+			params->renamed = options->data->value.integer;
+		} else if (strcmp(options->name, "seed") == 0) {
+			params->seed = options->data->value.integer;
+		}
+
+		options = options->next;
+	}
+
+	if (params->min_size > params->max_size)
+		success = false;
+
+	return success;
+}
+
+/**
+ * Print a description of the generator parameters, for use in the help
+ * text of a command line tool.
+ */
+
+void generate_print_params(void)
+{
+	printf(" -changed <n>           Change the contents of <n> percent of the files.\n");
+	printf(" -depth <n>             Nest directories <n> levels below the root.\n");
+	printf(" -dist uniform|log      Spread file sizes evenly, or by order of magnitude.\n");
+	printf(" -fanout <n>            Place <n> subdirectories in each directory.\n");
+	printf(" -files <n>             Place <n> files in each directory.\n");
+	printf(" -free <n>              Include <n> blocks in the free space list.\n");
+	printf(" -max <n>               Make the largest file <n> bytes.\n");
+	printf(" -min <n>               Make the smallest file <n> bytes.\n");
+	printf(" -renamed <n>           Give <n> percent of the files different names.\n");
+	printf(" -seed <n>              Derive the contents from the seed <n>.\n");
+}
+
+/**
+ * Generate a StrongHelp manual and write it to disc.
+ *
+ * \param *params	Pointer to the parameters for the manual.
+ * \param *filename	Pointer to the name of the file to write.
+ * \param *summary	Pointer to a block to take details of the manual,
+ *			or NULL if not required.
+ * \return		True if successful; False on failure.
+ */
+
+bool generate_manual(struct generate_params *params, char *filename, struct generate_summary *summary)
+{
+	struct generate_state state;
+	size_t header, root, offset, size;
+	unsigned directories = 1, level;
+	bool success;
+	FILE *out;
+
+	if (params == NULL || filename == NULL || params->min_size > params->max_size || params->max_size > INT32_MAX / 2)
+		return false;
+
+	/* Work out how many directories and files the manual will contain. */
+
+	for (level = 0; level < params->depth; level++) {
+		if (params->fanout > 0 && directories > GENERATE_MAX_DIRECTORIES / params->fanout) {
+			fprintf(stderr, "Too many directories in the manual.\n");
+			return false;
+		}
+
+		directories = directories * params->fanout + 1;
+	}
+
+	state.params = params;
+	state.buffer.data = NULL;
+	state.buffer.length = 0;
+	state.buffer.size = 0;
+	state.summary.length = 0;
+	state.summary.directories = 0;
+	state.summary.files = 0;
+	state.summary.data = 0;
+	state.total_files = directories * params->files;
+	state.free_blocks = 0;
+
+	/* Write the file header and the root directory entry. */
+
+	success = generate_append(&(state.buffer), GENERATE_HEADER_SIZE, &header) &&
+			generate_append(&(state.buffer), GENERATE_DIR_ENTRY_SIZE + 4, &root);
+
+	if (success) {
+		generate_write_word(&(state.buffer), header, GENERATE_FILE_WORD);
+		generate_write_word(&(state.buffer), header + 4, GENERATE_HEADER_SIZE + GENERATE_DIR_ENTRY_SIZE + 4);
+		generate_write_word(&(state.buffer), header + 8, GENERATE_VERSION);
+		generate_write_word(&(state.buffer), header + 12, (uint32_t) -1);
+		strcpy((char *) state.buffer.data + root + GENERATE_DIR_ENTRY_SIZE, "$");
+
+		state.last_free = header + 12;
+	}
+
+	/* Write the contents, then any free blocks which remain. */
+
+	if (success)
+		success = generate_directory(&state, 0, &offset, &size);
+
+	while (success && state.free_blocks < params->free_blocks)
+		success = generate_free_block(&state);
+
+	if (success) {
+		generate_write_word(&(state.buffer), root, offset);
+		generate_write_word(&(state.buffer), root + 12, size);
+		generate_write_word(&(state.buffer), root + 16, GENERATE_ATTRIBUTES_DIRECTORY);
+	}
+
+	/* Save the manual to disc. */
+
+	if (success) {
+		out = fopen(filename, "wb");
+
+		if (out == NULL) {
+			fprintf(stderr, "Failed to open '%s' for writing.\n", filename);
+			success = false;
+		} else {
+			if (fwrite(state.buffer.data, 1, state.buffer.length, out) != state.buffer.length)
+				success = false;
+
+			if (fclose(out) != 0)
+				success = false;
+
+			if (!success)
+				fprintf(stderr, "Failed to write '%s'.\n", filename);
+		}
+	}
+
+	state.summary.length = state.buffer.length;
+
+	if (summary != NULL)
+		*summary = state.summary;
+
+	free(state.buffer.data);
+
+	return success;
+}
+
+/**
+ * Generate a directory and its contents, appending them to the manual.
+ *
+ * \param *state	Pointer to the generation state.
+ * \param level		The level of the directory, with the root at zero.
+ * \param *offset	Pointer to a variable to take the offset of the
+ *			directory block.
+ * \param *size		Pointer to a variable to take the size of the
+ *			directory block.
+ * \return		True if successful; False on failure.
+ */
+
+static bool generate_directory(struct generate_state *state, unsigned level, size_t *offset, size_t *size)
+{
+	struct generate_entry *entries;
+	unsigned count, directories, i;
+	size_t block, entry, child_offset, child_size;
+	bool success = true;
+
+	directories = (level < state->params->depth) ? state->params->fanout : 0;
+	count = state->params->files + directories;
+
+	entries = malloc((count > 0 ? count : 1) * sizeof(struct generate_entry));
+	if (entries == NULL) {
+		fprintf(stderr, "No memory.\n");
+		return false;
+	}
+
+	/* Set up the entries, with the file numbers allocated before any
+	 * subdirectories are visited so that each file has the same number
+	 * whatever names its neighbours are given.
+	 */
+
+	for (i = 0; i < state->params->files; i++) {
+		entries[i].directory = false;
+		entries[i].id = state->summary.files++;
+		generate_file_details(state->params, &(entries[i]));
+	}
+
+	for (i = 0; i < directories; i++) {
+		entries[state->params->files + i].directory = true;
+		entries[state->params->files + i].id = 0;
+		snprintf(entries[state->params->files + i].name, GENERATE_MAX_NAME, "dir%03u", i);
+	}
+
+	qsort(entries, count, sizeof(struct generate_entry), generate_compare_entries);
+
+	state->summary.directories++;
+
+	/* Write the directory block. */
+
+	*size = GENERATE_DIR_HEADER_SIZE;
+
+	for (i = 0; i < count; i++)
+		*size += (GENERATE_DIR_ENTRY_SIZE + 4 + strlen(entries[i].name)) & ~3;
+
+	if (!generate_append(&(state->buffer), *size, offset)) {
+		free(entries);
+		return false;
+	}
+
+	block = *offset;
+
+	generate_write_word(&(state->buffer), block, GENERATE_DIR_WORD);
+	generate_write_word(&(state->buffer), block + 4, *size);
+	generate_write_word(&(state->buffer), block + 8, *size);
+
+	entry = block + GENERATE_DIR_HEADER_SIZE;
+
+	for (i = 0; i < count; i++) {
+		entries[i].offset = entry;
+		strcpy((char *) state->buffer.data + entry + GENERATE_DIR_ENTRY_SIZE, entries[i].name);
+		entry += (GENERATE_DIR_ENTRY_SIZE + 4 + strlen(entries[i].name)) & ~3;
+	}
+
+	/* Write the objects, filling in their entries as we go. */
+
+	for (i = 0; success && i < count; i++) {
+		if (entries[i].directory)
+			success = generate_directory(state, level + 1, &child_offset, &child_size);
+		else
+			success = generate_file(state, &(entries[i]), &child_offset, &child_size);
+
+		if (!success)
+			break;
+
+		entry = entries[i].offset;
+
+		generate_write_word(&(state->buffer), entry, child_offset);
+		generate_write_word(&(state->buffer), entry + 4, (entries[i].directory) ? 0 : 0xfff00000 | (entries[i].filetype << 8));
+		generate_write_word(&(state->buffer), entry + 8, 0);
+		generate_write_word(&(state->buffer), entry + 12, child_size);
+		generate_write_word(&(state->buffer), entry + 16, (entries[i].directory) ?
+				GENERATE_ATTRIBUTES_DIRECTORY : GENERATE_ATTRIBUTES_FILE);
+		generate_write_word(&(state->buffer), entry + 20, 0);
+	}
+
+	free(entries);
+
+	return success;
+}
+
+/**
+ * Generate the contents of a file, appending its data block to the manual
+ * followed by any free blocks which are due.
+ *
+ * \param *state	Pointer to the generation state.
+ * \param *entry	Pointer to the directory entry for the file.
+ * \param *offset	Pointer to a variable to take the offset of the
+ *			data block.
+ * \param *size		Pointer to a variable to take the size of the
+ *			data block.
+ * \return		True if successful; False on failure.
+ */
+
+static bool generate_file(struct generate_state *state, struct generate_entry *entry, size_t *offset, size_t *size)
+{
+	uint32_t random, changed;
+	int8_t *data;
+	size_t i;
+
+	if (!generate_append(&(state->buffer), GENERATE_DATA_HEADER_SIZE + ((entry->size + 3) & ~3), offset))
+		return false;
+
+	*size = GENERATE_DATA_HEADER_SIZE + entry->size;
+
+	generate_write_word(&(state->buffer), *offset, GENERATE_DATA_WORD);
+	generate_write_word(&(state->buffer), *offset + 4, *size);
+
+	/* Fill the file, with text for text files and noise for the rest. */
+
+	data = state->buffer.data + *offset + GENERATE_DATA_HEADER_SIZE;
+	random = generate_hash(state->params->seed, entry->id, GENERATE_SALT_CONTENT) | 1;
+
+	for (i = 0; i < entry->size; i++) {
+		random ^= random << 13;
+		random ^= random >> 17;
+		random ^= random << 5;
+
+		if (entry->filetype != 0xfff)
+			data[i] = random & 0xff;
+		else if ((random & 0x3f) == 0)
+			data[i] = '\n';
+		else if ((random & 0x07) == 0)
+			data[i] = ' ';
+		else
+			data[i] = 'a' + (random >> 8) % 26;
+	}
+
+	/* Change a byte in the file if required; empty files are left alone. */
+
+	changed = generate_hash(state->params->seed, entry->id, GENERATE_SALT_CHANGED);
+
+	if (entry->size > 0 && changed % 100 < state->params->changed)
+		data[(changed >> 8) % entry->size] ^= 0x01;
+
+	state->summary.data += entry->size;
+
+	/* Spread the free blocks evenly through the file data. */
+
+	while (state->free_blocks < state->params->free_blocks &&
+			(uint64_t) state->summary.files * state->params->free_blocks > (uint64_t) state->free_blocks * state->total_files) {
+		if (!generate_free_block(state))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Append a free block to the manual, linking it on to the end of the
+ * free space list.
+ *
+ * \param *state	Pointer to the generation state.
+ * \return		True if successful; False on failure.
+ */
+
+static bool generate_free_block(struct generate_state *state)
+{
+	size_t offset, size;
+
+	size = GENERATE_FREE_HEADER_SIZE + 4 + 4 * (generate_hash(state->params->seed, state->free_blocks, GENERATE_SALT_FREE) % 64);
+
+	if (!generate_append(&(state->buffer), size, &offset))
+		return false;
+
+	generate_write_word(&(state->buffer), offset, GENERATE_FREE_WORD);
+	generate_write_word(&(state->buffer), offset + 4, size);
+	generate_write_word(&(state->buffer), offset + 8, (uint32_t) -1);
+
+	generate_write_word(&(state->buffer), state->last_free, offset);
+	state->last_free = offset + 8;
+
+	state->free_blocks++;
+
+	return true;
+}
+
+/**
+ * Compare two directory entries by name, for sorting with qsort().
+ *
+ * \param *a		Pointer to the first entry.
+ * \param *b		Pointer to the second entry.
+ * \return		The result of comparing the two names.
+ */
+
+static int generate_compare_entries(const void *a, const void *b)
+{
+	return strcmp(((struct generate_entry *) a)->name, ((struct generate_entry *) b)->name);
+}
+
+/**
+ * Work out the name, type and size of a file from its number.
+ *
+ * \param *params	Pointer to the parameters for the manual.
+ * \param *entry	Pointer to the entry to fill in.
+ */
+
+static void generate_file_details(struct generate_params *params, struct generate_entry *entry)
+{
+	uint32_t type;
+	bool renamed;
+
+	renamed = generate_hash(params->seed, entry->id, GENERATE_SALT_RENAMED) % 100 < params->renamed;
+	snprintf(entry->name, GENERATE_MAX_NAME, (renamed) ? "item%05u" : "page%05u", entry->id);
+
+	type = generate_hash(params->seed, entry->id, GENERATE_SALT_TYPE) % 10;
+	entry->filetype = (type < 6) ? 0xfff : (type < 8) ? 0xff9 : 0xffd;
+
+	entry->size = generate_file_size(params, entry->id);
+}
+
+/**
+ * Work out the size of a file from its number, following the requested
+ * distribution.
+ *
+ * \param *params	Pointer to the parameters for the manual.
+ * \param id		The number of the file.
+ * \return		The size of the file.
+ */
+
+static size_t generate_file_size(struct generate_params *params, unsigned id)
+{
+	uint64_t random;
+	size_t low, high;
+	unsigned bits, low_bits, high_bits;
+
+	random = ((uint64_t) generate_hash(params->seed, id, GENERATE_SALT_SIZE) << 32) |
+			generate_hash(params->seed, ~id, GENERATE_SALT_SIZE);
+
+	low = params->min_size;
+	high = params->max_size;
+
+	/* For a logarithmic spread, pick the number of bits in the size
+	 * first, and then a size with that many bits.
+	 */
+
+	if (params->distribution == GENERATE_DISTRIBUTION_LOG) {
+		low_bits = generate_bits(low);
+		high_bits = generate_bits(high);
+
+		bits = low_bits + (random >> 48) % (high_bits - low_bits + 1);
+		random &= 0xffffffffffff;
+
+		if (bits > low_bits)
+			low = (size_t) 1 << (bits - 1);
+
+		if (bits < high_bits)
+			high = ((size_t) 1 << bits) - 1;
+	}
+
+	return low + random % (high - low + 1);
+}
+
+/**
+ * Count the number of bits needed to hold a value.
+ *
+ * \param value		The value to test.
+ * \return		The number of bits required.
+ */
+
+static unsigned generate_bits(size_t value)
+{
+	unsigned bits = 0;
+
+	while (value > 0) {
+		bits++;
+		value >>= 1;
+	}
+
+	return bits;
+}
+
+/**
+ * Extend the manual by a block of zeros, expanding the buffer if needed.
+ *
+ * \param *buffer	Pointer to the manual buffer.
+ * \param length	The length of the block to add, which should be a
+ *			multiple of four.
+ * \param *offset	Pointer to a variable to take the offset of the block.
+ * \return		True if successful; False on failure.
+ */
+
+static bool generate_append(struct generate_buffer *buffer, size_t length, size_t *offset)
+{
+	int8_t *data;
+	size_t size;
+
+	if (buffer->length + length > INT32_MAX) {
+		fprintf(stderr, "The manual is too large.\n");
+		return false;
+	}
+
+	if (buffer->length + length > buffer->size) {
+		size = (buffer->size > 0) ? buffer->size : 65536;
+
+		while (size < buffer->length + length)
+			size *= 2;
+
+		data = realloc(buffer->data, size);
+		if (data == NULL) {
+			fprintf(stderr, "No memory.\n");
+			return false;
+		}
+
+		buffer->data = data;
+		buffer->size = size;
+	}
+
+	memset(buffer->data + buffer->length, 0, length);
+
+	*offset = buffer->length;
+	buffer->length += length;
+
+	return true;
+}
+
+/**
+ * Write a little-endian word into the manual.
+ *
+ * \param *buffer	Pointer to the manual buffer.
+ * \param offset	The offset at which to write the word.
+ * \param value		The value to write.
+ */
+
+static void generate_write_word(struct generate_buffer *buffer, size_t offset, uint32_t value)
+{
+	uint8_t *word = (uint8_t *) buffer->data + offset;
+
+	word[0] = value & 0xff;
+	word[1] = (value >> 8) & 0xff;
+	word[2] = (value >> 16) & 0xff;
+	word[3] = (value >> 24) & 0xff;
+}
+
+/**
+ * Derive a pseudo-random value from a seed, a value and a salt.
+ *
+ * \param seed		The seed for the manual.
+ * \param value		The value to hash.
+ * \param salt		The salt identifying the property required.
+ * \return		The pseudo-random value.
+ */
+
+static uint32_t generate_hash(uint32_t seed, uint32_t value, uint32_t salt)
+{
+	uint32_t hash = seed ^ (value * 0x9e3779b9) ^ salt;
+
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
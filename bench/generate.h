@@ -0,0 +1,122 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file generate.h
+ *
+ * Synthetic StrongHelp Manual Generator, Interface.
+ *
+ * Builds StrongHelp manuals with a regular tree of directories and a
+ * pseudo-random spread of file sizes and types, for benchmarking. The
+ * contents are derived from a seed, so the same parameters always give
+ * the same manual; variants with a proportion of the files changed or
+ * renamed can be generated from the same seed to exercise updates.
+ */
+
+#ifndef STRONGEX_GENERATE_H
+#define STRONGEX_GENERATE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "args.h"
+
+/**
+ * The distribution of file sizes within a generated manual.
+ */
+
+enum generate_distribution {
+	GENERATE_DISTRIBUTION_UNIFORM,			/**< Sizes are evenly spread between the limits.	*/
+	GENERATE_DISTRIBUTION_LOG			/**< Sizes are spread evenly by order of magnitude.	*/
+};
+
+/**
+ * The parameters describing a manual to be generated.
+ */
+
+struct generate_params {
+	unsigned			depth;		/**< The number of levels of directories below the root.	*/
+	unsigned			fanout;		/**< The number of subdirectories in each directory.		*/
+	unsigned			files;		/**< The number of files in each directory.			*/
+	size_t				min_size;	/**< The size of the smallest file, in bytes.			*/
+	size_t				max_size;	/**< The size of the largest file, in bytes.			*/
+	enum generate_distribution	distribution;	/**< The distribution of file sizes.				*/
+	unsigned			free_blocks;	/**< The number of blocks in the free space list.		*/
+	uint32_t			seed;		/**< The seed from which the contents are derived.		*/
+	unsigned			changed;	/**< The percentage of files to have their contents changed.	*/
+	unsigned			renamed;	/**< The percentage of files to be given a different name.	*/
+};
+
+/**
+ * Details of a generated manual.
+ */
+
+struct generate_summary {
+	size_t				length;		/**< The length of the manual in bytes.				*/
+	unsigned			directories;	/**< The number of directories, including the root.		*/
+	unsigned			files;		/**< The number of files.					*/
+	size_t				data;		/**< The total size of the files' contents.			*/
+};
+
+/**
+ * Initialise a set of parameters to the default values.
+ *
+ * \param *params	Pointer to the parameters to initialise.
+ */
+
+void generate_initialise_params(struct generate_params *params);
+
+/**
+ * Read any generator parameters from a set of command line options,
+ * ignoring those which don't apply.
+ *
+ * \param *options	Pointer to the command line options.
+ * \param *params	Pointer to the parameters to update.
+ * \return		True if successful; False if the options are invalid.
+ */
+
+bool generate_read_params(struct args_option *options, struct generate_params *params);
+
+/**
+ * Print a description of the generator parameters, for use in the help
+ * text of a command line tool.
+ */
+
+void generate_print_params(void);
+
+/**
+ * Generate a StrongHelp manual and write it to disc.
+ *
+ * \param *params	Pointer to the parameters for the manual.
+ * \param *filename	Pointer to the name of the file to write.
+ * \param *summary	Pointer to a block to take details of the manual,
+ *			or NULL if not required.
+ * \return		True if successful; False on failure.
+ */
+
+bool generate_manual(struct generate_params *params, char *filename, struct generate_summary *summary);
+
+#endif
+
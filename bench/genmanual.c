@@ -0,0 +1,83 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file genmanual.c
+ *
+ * Synthetic StrongHelp Manual Generator, command line front end.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "args.h"
+
+#include "generate.h"
+
+int main(int argc, char *argv[])
+{
+	struct args_option *options, *option;
+	struct generate_params params;
+	struct generate_summary summary;
+	char *filename = NULL;
+	bool param_error = false;
+
+	generate_initialise_params(&params);
+
+	options = args_process_line(argc, argv,
+			"out/A,changed/I,depth/I,dist/K,fanout/I,files/I,free/I,max/I,min/I,renamed/I,seed/I,help/S");
+
+	if (options == NULL || !generate_read_params(options, &params))
+		param_error = true;
+
+	for (option = options; option != NULL; option = option->next) {
+		if (option->data == NULL)
+			continue;
+
+		if (strcmp(option->name, "out") == 0)
+			filename = option->data->value.string;
+		else if (strcmp(option->name, "help") == 0)
+			param_error = true;
+	}
+
+	if (param_error || filename == NULL) {
+		printf("Synthetic StrongHelp Manual Generator -- Usage:\n");
+		printf("genmanual <outfile> [<options>]\n\n");
+
+		generate_print_params();
+		printf(" -help                  Produce this help information.\n");
+
+		return EXIT_FAILURE;
+	}
+
+	if (!generate_manual(&params, filename, &summary))
+		return EXIT_FAILURE;
+
+	printf("Wrote %s: %zu bytes, %u directories, %u files, %zu bytes of data.\n",
+			filename, summary.length, summary.directories, summary.files, summary.data);
+
+	return EXIT_SUCCESS;
+}
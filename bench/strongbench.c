@@ -0,0 +1,458 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file strongbench.c
+ *
+ * Strong Extract Benchmark Harness.
+ *
+ * Generates a set of synthetic manuals, and then times each phase of
+ * processing them against an output folder in a number of scenarios:
+ * a cold extraction into an empty folder, a resync with nothing to do,
+ * an update with a few files changed, and an update with many files
+ * renamed. The phases are run in-process in the same order as in
+ * strongex_process_manual(), so that each can be timed on its own.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "args.h"
+#include "disc.h"
+#include "files.h"
+#include "msg.h"
+#include "objectdb.h"
+#include "stronghelp.h"
+
+#include "generate.h"
+
+/* The maximum length of a path within the work folder. */
+
+#define BENCH_MAX_PATH 1024
+
+/* The maximum number of runs of each scenario. */
+
+#define BENCH_MAX_RUNS 100
+
+/**
+ * The phases of processing a manual.
+ */
+
+enum bench_phase {
+	BENCH_PHASE_LOAD = 0,
+	BENCH_PHASE_PARSE,
+	BENCH_PHASE_SCAN,
+	BENCH_PHASE_COMPARE,
+	BENCH_PHASE_REPORT,
+	BENCH_PHASE_UPDATE,
+	BENCH_PHASE_COUNT
+};
+
+/**
+ * The names of the phases, in the same order as enum bench_phase.
+ */
+
+static char *bench_phase_names[] = {
+	"Load",
+	"Parse",
+	"Scan",
+	"Compare",
+	"Report",
+	"Update"
+};
+
+/**
+ * The manuals generated for the benchmark.
+ */
+
+enum bench_manual {
+	BENCH_MANUAL_BASE = 0,
+	BENCH_MANUAL_CHANGED,
+	BENCH_MANUAL_RENAMED,
+	BENCH_MANUAL_COUNT
+};
+
+/**
+ * A benchmark scenario.
+ */
+
+struct bench_scenario {
+	char			*name;		/**< The name of the scenario.					*/
+	enum bench_manual	manual;		/**< The manual to process.					*/
+	bool			empty;		/**< True to start from an empty folder; False to start
+						 *   from a copy of the base manual.				*/
+};
+
+/**
+ * The scenarios to be run, in order.
+ */
+
+static struct bench_scenario bench_scenarios[] = {
+	{"Cold extraction",	BENCH_MANUAL_BASE,	true},
+	{"No-op resync",	BENCH_MANUAL_BASE,	false},
+	{"Files changed",	BENCH_MANUAL_CHANGED,	false},
+	{"Mass rename",		BENCH_MANUAL_RENAMED,	false}
+};
+
+#define BENCH_SCENARIO_COUNT (sizeof(bench_scenarios) / sizeof(struct bench_scenario))
+
+/**
+ * The options which apply to the processing of each manual.
+ */
+
+struct bench_options {
+	int			threads;	/**< The number of threads to use.				*/
+	bool			batch_io;	/**< Should file access be batched through io_uring.		*/
+	int			readahead;	/**< The number of files to prefetch ahead of comparisons.	*/
+};
+
+/* Static Function Prototypes. */
+
+static bool bench_run(char *manual_file, char *output_folder, struct bench_options *options, double *times);
+static double bench_get_time(void);
+static bool bench_clear_folder(char *path);
+static int bench_remove_object(const char *path, const struct stat *info, int flag, struct FTW *ftw);
+static int bench_compare_times(const void *a, const void *b);
+
+int main(int argc, char *argv[])
+{
+	struct args_option *options, *option;
+	struct generate_params params, variant;
+	struct generate_summary summary;
+	struct bench_options process_options;
+	char *work = NULL, manuals[BENCH_MANUAL_COUNT][BENCH_MAX_PATH], folder[BENCH_MAX_PATH], log[BENCH_MAX_PATH];
+	double times[BENCH_SCENARIO_COUNT][BENCH_PHASE_COUNT + 1][BENCH_MAX_RUNS];
+	int runs = 5, scenario, phase, run, log_file;
+	bool param_error = false, success = true;
+
+	/* Read the parameters, with a few of the files changed and most
+	 * renamed in the variant manuals by default.
+	 */
+
+	generate_initialise_params(&params);
+	params.changed = 1;
+	params.renamed = 100;
+
+	process_options.threads = 1;
+	process_options.batch_io = false;
+	process_options.readahead = 0;
+
+	options = args_process_line(argc, argv,
+			"work/A,changed/I,depth/I,dist/K,fanout/I,files/I,free/I,max/I,min/I,readahead/I,renamed/I,runs/I,seed/I,threads/I,uring/S,help/S");
+
+	if (options == NULL || !generate_read_params(options, &params))
+		param_error = true;
+
+	for (option = options; option != NULL; option = option->next) {
+		if (option->data == NULL)
+			continue;
+
+		if (strcmp(option->name, "work") == 0) {
+			work = option->data->value.string;
+		} else if (strcmp(option->name, "readahead") == 0) {
+			process_options.readahead = option->data->value.integer;
+			if (process_options.readahead < 0)
+				param_error = true;
+		} else if (strcmp(option->name, "runs") == 0) {
+			runs = option->data->value.integer;
+			if (runs < 1 || runs > BENCH_MAX_RUNS)
+				param_error = true;
+		} else if (strcmp(option->name, "threads") == 0) {
+			process_options.threads = option->data->value.integer;
+			if (process_options.threads < 1)
+				param_error = true;
+		} else if (strcmp(option->name, "uring") == 0) {
+			process_options.batch_io = true;
+		} else if (strcmp(option->name, "help") == 0) {
+			param_error = true;
+		}
+	}
+
+	if (param_error || work == NULL) {
+		printf("Strong Extract Benchmark -- Usage:\n");
+		printf("strongbench <workfolder> [<options>]\n\n");
+
+		generate_print_params();
+		printf(" -help                  Produce this help information.\n");
+		printf(" -readahead <n>         Prefetch <n> files ahead of each comparison.\n");
+		printf(" -runs <n>              Time each scenario <n> times, and report the median.\n");
+		printf(" -threads <n>           Use <n> threads to compare and update files.\n");
+		printf(" -uring                 Batch file access through io_uring.\n");
+
+		return EXIT_FAILURE;
+	}
+
+	/* Generate the manuals in the work folder. */
+
+	if (mkdir(work, 0777) != 0 && access(work, W_OK) != 0) {
+		fprintf(stderr, "Failed to create work folder '%s'.\n", work);
+		return EXIT_FAILURE;
+	}
+
+	snprintf(manuals[BENCH_MANUAL_BASE], BENCH_MAX_PATH, "%s/base,3d6", work);
+	snprintf(manuals[BENCH_MANUAL_CHANGED], BENCH_MAX_PATH, "%s/changed,3d6", work);
+	snprintf(manuals[BENCH_MANUAL_RENAMED], BENCH_MAX_PATH, "%s/renamed,3d6", work);
+	snprintf(folder, BENCH_MAX_PATH, "%s/output", work);
+	snprintf(log, BENCH_MAX_PATH, "%s/bench.log", work);
+
+	variant = params;
+	variant.changed = 0;
+	variant.renamed = 0;
+	success = generate_manual(&variant, manuals[BENCH_MANUAL_BASE], &summary);
+
+	variant.changed = params.changed;
+	success = success && generate_manual(&variant, manuals[BENCH_MANUAL_CHANGED], NULL);
+
+	variant.changed = 0;
+	variant.renamed = params.renamed;
+	success = success && generate_manual(&variant, manuals[BENCH_MANUAL_RENAMED], NULL);
+
+	if (!success)
+		return EXIT_FAILURE;
+
+	printf("Manual: %zu bytes, %u directories, %u files, %zu bytes of data\n",
+			summary.length, summary.directories, summary.files, summary.data);
+	printf("Variants: %u%% of files changed, %u%% of files renamed\n", params.changed, params.renamed);
+	printf("Threads: %d%s, readahead %d, median of %d runs, times in ms\n\n", process_options.threads,
+			(process_options.batch_io) ? " with io_uring" : "", process_options.readahead, runs);
+
+	/* Send the messages from Strong Extract to a log file, as they
+	 * would be to a terminal, so that they don't mix with the results.
+	 */
+
+	fflush(stderr);
+
+	log_file = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (log_file < 0 || dup2(log_file, STDERR_FILENO) < 0) {
+		fprintf(stderr, "Failed to open log file '%s'.\n", log);
+		return EXIT_FAILURE;
+	}
+
+	close(log_file);
+
+	/* Run the scenarios, putting the output folder into the required
+	 * state before each run.
+	 */
+
+	for (scenario = 0; success && scenario < BENCH_SCENARIO_COUNT; scenario++) {
+		for (run = 0; success && run < runs; run++) {
+			if (bench_scenarios[scenario].empty)
+				success = bench_clear_folder(folder);
+			else
+				success = bench_run(manuals[BENCH_MANUAL_BASE], folder, &process_options, NULL);
+
+			success = success && bench_run(manuals[bench_scenarios[scenario].manual], folder, &process_options, times[scenario][0] + run);
+		}
+	}
+
+	if (!success) {
+		printf("The benchmark failed; see %s for details.\n", log);
+		return EXIT_FAILURE;
+	}
+
+	/* Report the median time of each phase. */
+
+	printf("%-20s", "Scenario");
+	for (phase = 0; phase < BENCH_PHASE_COUNT; phase++)
+		printf("%10s", bench_phase_names[phase]);
+	printf("%10s\n", "Total");
+
+	for (scenario = 0; scenario < BENCH_SCENARIO_COUNT; scenario++) {
+		printf("%-20s", bench_scenarios[scenario].name);
+
+		for (phase = 0; phase <= BENCH_PHASE_COUNT; phase++) {
+			qsort(times[scenario][phase], runs, sizeof(double), bench_compare_times);
+			printf("%10.1f", times[scenario][phase][runs / 2] * 1000.0);
+		}
+
+		printf("\n");
+	}
+
+	bench_clear_folder(folder);
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * Process a manual against an output folder, updating the folder to
+ * match, and record the time taken by each phase.
+ *
+ * \param *manual_file		Pointer to the name of the manual to process.
+ * \param *output_folder	Pointer to the name of the folder to update.
+ * \param *options		Pointer to the options to apply.
+ * \param *times		Pointer to the first of the run's entries in
+ *				the times array, or NULL to skip timing.
+ * \return			True on success; False on failure.
+ */
+
+static bool bench_run(char *manual_file, char *output_folder, struct bench_options *options, double *times)
+{
+	double start, end, phase_times[BENCH_PHASE_COUNT];
+	struct files_mapping manual;
+	struct arena *arena;
+	struct objectdb *db = NULL;
+	bool success;
+	int phase;
+
+	start = bench_get_time();
+
+	/* Load the file into memory. */
+
+	if (!files_map_file(manual_file, &manual))
+		return false;
+
+	arena = arena_create();
+	if (arena != NULL)
+		db = objectdb_create(arena);
+
+	if (db == NULL) {
+		arena_destroy(arena);
+		files_unmap_file(&manual);
+		return false;
+	}
+
+	objectdb_set_batch_io(db, options->batch_io);
+	objectdb_set_readahead(db, options->readahead);
+
+	phase_times[BENCH_PHASE_LOAD] = bench_get_time();
+
+	/* Run the phases in turn. */
+
+	success = stronghelp_initialise_file(db, manual.data, manual.length);
+	phase_times[BENCH_PHASE_PARSE] = bench_get_time();
+
+	success = success && disc_initialise_folder(db, output_folder, options->threads);
+	phase_times[BENCH_PHASE_SCAN] = bench_get_time();
+
+	success = success && objectdb_check_status(db, options->threads);
+	phase_times[BENCH_PHASE_COMPARE] = bench_get_time();
+
+	success = success && objectdb_output_report(db, false, NULL) && (!msg_get_verbose() || objectdb_output_hashes(db));
+	phase_times[BENCH_PHASE_REPORT] = bench_get_time();
+
+	success = success && objectdb_update(db, options->threads, FILES_SYNC_NONE);
+	phase_times[BENCH_PHASE_UPDATE] = bench_get_time();
+
+	/* Release the memory, which is counted as part of the update. */
+
+	objectdb_destroy(db);
+	arena_destroy(arena);
+	files_unmap_file(&manual);
+
+	end = bench_get_time();
+
+	if (!success)
+		return false;
+
+	/* The times array holds each phase's runs in turn, followed by
+	 * the runs' totals.
+	 */
+
+	if (times != NULL) {
+		phase_times[BENCH_PHASE_UPDATE] = end;
+		times[BENCH_PHASE_COUNT * BENCH_MAX_RUNS] = end - start;
+
+		for (phase = 0; phase < BENCH_PHASE_COUNT; phase++) {
+			times[phase * BENCH_MAX_RUNS] = phase_times[phase] - start;
+			start = phase_times[phase];
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Read the time from a monotonic clock.
+ *
+ * \return		The time, in seconds.
+ */
+
+static double bench_get_time(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double) now.tv_sec + (double) now.tv_nsec / 1000000000.0;
+}
+
+/**
+ * Remove a folder and everything within it, if it exists.
+ *
+ * \param *path		Pointer to the path of the folder to remove.
+ * \return		True if successful; False on failure.
+ */
+
+static bool bench_clear_folder(char *path)
+{
+	if (access(path, F_OK) != 0)
+		return true;
+
+	if (nftw(path, bench_remove_object, 64, FTW_DEPTH | FTW_PHYS) != 0) {
+		fprintf(stderr, "Failed to remove folder '%s'.\n", path);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Remove an object from disc, as a callback from nftw().
+ *
+ * \param *path		Pointer to the path of the object.
+ * \param *info		Pointer to the object's stat details.
+ * \param flag		The nftw() type flag for the object.
+ * \param *ftw		Pointer to the nftw() position details.
+ * \return		Zero to continue, or non-zero on failure.
+ */
+
+static int bench_remove_object(const char *path, const struct stat *info, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+/**
+ * Compare two times, for sorting with qsort().
+ *
+ * \param *a		Pointer to the first time.
+ * \param *b		Pointer to the second time.
+ * \return		The result of comparing the two times.
+ */
+
+static int bench_compare_times(const void *a, const void *b)
+{
+	double first = *((double *) a), second = *((double *) b);
+
+	return (first > second) - (first < second);
+}
@@ -0,0 +1,840 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file archive.c
+ *
+ * Archive Writer, implementation.
+ *
+ * Tar archives use the POSIX ustar format, with the GNU long name extension
+ * for any paths which won't fit into the header. Zip archives have their
+ * files stored, each followed by a data descriptor so that the CRC can be
+ * calculated as the data goes past; this limits them to 4GB and 65535
+ * entries, as Zip64 isn't supported.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Local source headers. */
+
+#include "archive.h"
+
+#include "arena.h"
+#include "files.h"
+#include "hash.h"
+#include "msg.h"
+#include "stack.h"
+#include "stats.h"
+#include "string.h"
+
+/**
+ * The size of the buffer used to collect writes to the archive.
+ */
+
+#define ARCHIVE_BUFFER_SIZE (1024 * 1024)
+
+/**
+ * The size of a tar block.
+ */
+
+#define ARCHIVE_TAR_BLOCK 512
+
+/**
+ * The RISC OS filetypes of tar and Zip archives.
+ */
+
+#define ARCHIVE_TAR_FILETYPE (0xc46)
+#define ARCHIVE_ZIP_FILETYPE (0xddc)
+
+/**
+ * The extension identifying a Zip archive.
+ */
+
+#ifdef RISCOS
+#define ARCHIVE_ZIP_EXTENSION "/zip"
+#else
+#define ARCHIVE_ZIP_EXTENSION ".zip"
+#endif
+
+/**
+ * Zip record signatures.
+ */
+
+#define ARCHIVE_ZIP_LOCAL_HEADER (0x04034b50u)
+#define ARCHIVE_ZIP_DATA_DESCRIPTOR (0x08074b50u)
+#define ARCHIVE_ZIP_CENTRAL_HEADER (0x02014b50u)
+#define ARCHIVE_ZIP_END_OF_DIRECTORY (0x06054b50u)
+
+/**
+ * The Zip general purpose flag indicating that a data descriptor follows
+ * the file's contents.
+ */
+
+#define ARCHIVE_ZIP_FLAG_DESCRIPTOR (0x0008)
+
+/**
+ * The Zip version needed to extract the archive's contents (2.0), along
+ * with the host system (Unix) used in the version made by.
+ */
+
+#define ARCHIVE_ZIP_VERSION (20)
+#define ARCHIVE_ZIP_HOST_UNIX (3)
+
+/**
+ * The largest number of entries, and largest size or offset, which can be
+ * recorded in a Zip archive without using Zip64.
+ */
+
+#define ARCHIVE_ZIP_MAX_ENTRIES (0xffffu)
+#define ARCHIVE_ZIP_MAX_SIZE (0xffffffffu)
+
+/**
+ * The Unix permissions given to files and directories.
+ */
+
+#define ARCHIVE_FILE_MODE (0100644)
+#define ARCHIVE_DIR_MODE (040755)
+
+/**
+ * An entry in an archive, remembered for a Zip central directory.
+ */
+
+struct archive_entry {
+	char			*name;		/**< The name of the entry.				*/
+	uint32_t		crc;		/**< The CRC32 of the entry's contents.			*/
+	uint32_t		size;		/**< The size of the entry's contents.			*/
+	uint32_t		offset;		/**< The offset of the entry's local header.		*/
+	uint16_t		flags;		/**< The general purpose flags of the entry.		*/
+	bool			directory;	/**< True if the entry is a directory.			*/
+};
+
+/**
+ * An archive writer instance.
+ */
+
+struct archive {
+	char			*filename;	/**< The filename of the archive.			*/
+	char			*temp;		/**< The filename of the temporary file.		*/
+	FILE			*file;		/**< The temporary file being written.			*/
+	enum archive_format	format;		/**< The format of the archive.				*/
+	bool			failed;		/**< True if the archive has failed.			*/
+
+	char			*buffer;	/**< The buffer collecting writes to the file.		*/
+	size_t			used;		/**< The number of bytes in the buffer.			*/
+	uint64_t		offset;		/**< The number of bytes written to the archive.	*/
+
+	struct arena		*arena;		/**< The arena holding the entry names.			*/
+	struct stack		entries;	/**< The entries written to a Zip archive.		*/
+	struct archive_entry	current;	/**< The file currently being written.			*/
+	size_t			remaining;	/**< The bytes of the current file still to come.	*/
+
+	uint32_t		mtime;		/**< The Unix time given to the entries.		*/
+	uint16_t		dos_time;	/**< The MS-DOS time given to the entries.		*/
+	uint16_t		dos_date;	/**< The MS-DOS date given to the entries.		*/
+};
+
+/* Static Function Prototypes. */
+
+static bool archive_write_tar_header(struct archive *archive, char *path, size_t length, char type);
+static bool archive_write_tar_block(struct archive *archive, char *name, size_t name_length, char *prefix, size_t prefix_length, size_t length, char type);
+static void archive_set_octal(char *field, size_t size, uint64_t value);
+static bool archive_write_tar_padding(struct archive *archive);
+static bool archive_write_tar_end(struct archive *archive);
+static bool archive_write_zip_header(struct archive *archive, char *path, bool directory);
+static bool archive_write_zip_directory(struct archive *archive);
+static void archive_set_16(uint8_t *field, uint16_t value);
+static void archive_set_32(uint8_t *field, uint32_t value);
+static bool archive_output(struct archive *archive, void *data, size_t length);
+static bool archive_flush(struct archive *archive);
+
+/**
+ * Choose the format for an archive from its filename: anything with a Zip
+ * extension is written as a Zip archive, and everything else as tar.
+ *
+ * \param *filename	Pointer to the filename of the archive.
+ * \return		The format to use.
+ */
+
+enum archive_format archive_choose_format(char *filename)
+{
+	size_t length, extension;
+
+	if (filename == NULL)
+		return ARCHIVE_FORMAT_TAR;
+
+	length = strlen(filename);
+	extension = strlen(ARCHIVE_ZIP_EXTENSION);
+
+	if (length > extension && string_nocase_strcmp(filename + length - extension, ARCHIVE_ZIP_EXTENSION) == 0)
+		return ARCHIVE_FORMAT_ZIP;
+
+	return ARCHIVE_FORMAT_TAR;
+}
+
+/**
+ * Open a new archive for writing. The archive is written to a temporary
+ * file, which replaces any existing archive when it is closed.
+ *
+ * \param *filename	Pointer to the filename of the archive, which must
+ *			remain valid until the archive is closed.
+ * \param format	The format of the archive.
+ * \return		Pointer to the archive, or NULL on failure.
+ */
+
+struct archive *archive_open(char *filename, enum archive_format format)
+{
+	struct archive *archive;
+	struct tm *local;
+	time_t now;
+	size_t length;
+
+	if (filename == NULL)
+		return NULL;
+
+	length = strlen(filename) + strlen(FILES_TEMP_SUFFIX) + 1;
+
+	archive = malloc(sizeof(struct archive) + length);
+	if (archive == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return NULL;
+	}
+
+	archive->filename = filename;
+	archive->temp = (char *) (archive + 1);
+	archive->file = NULL;
+	archive->format = format;
+	archive->failed = false;
+	archive->used = 0;
+	archive->offset = 0;
+	archive->remaining = 0;
+
+	*(archive->temp) = '\0';
+	string_append(archive->temp, filename, length);
+	string_append(archive->temp, FILES_TEMP_SUFFIX, length);
+
+	stack_initialise(&(archive->entries), sizeof(struct archive_entry));
+
+	/* The manual doesn't record any dates, so everything is given the
+	 * time at which the archive was written.
+	 */
+
+	now = time(NULL);
+	archive->mtime = (uint32_t) now;
+
+	local = localtime(&now);
+	if (local != NULL && local->tm_year >= 80) {
+		archive->dos_time = (local->tm_hour << 11) | (local->tm_min << 5) | (local->tm_sec / 2);
+		archive->dos_date = ((local->tm_year - 80) << 9) | ((local->tm_mon + 1) << 5) | local->tm_mday;
+	} else {
+		archive->dos_time = 0;
+		archive->dos_date = (1 << 5) | 1;
+	}
+
+	archive->arena = arena_create();
+	archive->buffer = malloc(ARCHIVE_BUFFER_SIZE);
+
+	if (archive->arena == NULL || archive->buffer == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		archive_close(archive, false);
+		return NULL;
+	}
+
+	archive->file = fopen(archive->temp, "wb");
+	stats_count(STATS_SYSCALLS, 1);
+
+	if (archive->file == NULL) {
+		msg_report(MSG_ARCHIVE_WRITE_FAILED, filename);
+		archive_close(archive, false);
+		return NULL;
+	}
+
+	return archive;
+}
+
+/**
+ * Add a directory to an archive.
+ *
+ * \param *archive	Pointer to the archive to add to.
+ * \param *path		Pointer to the path of the directory in the archive.
+ * \return		True if successful; False on failure.
+ */
+
+bool archive_add_directory(struct archive *archive, char *path)
+{
+	if (archive == NULL || path == NULL || archive->failed)
+		return false;
+
+	if (archive->format == ARCHIVE_FORMAT_ZIP)
+		return archive_write_zip_header(archive, path, true);
+
+	return archive_write_tar_header(archive, path, 0, '5');
+}
+
+/**
+ * Start adding a file to an archive. The contents must then be supplied
+ * by calls to archive_write(), before archive_end_file() is called.
+ *
+ * \param *archive	Pointer to the archive to add to.
+ * \param *path		Pointer to the path of the file in the archive.
+ * \param length	The length of the file, in bytes.
+ * \return		True if successful; False on failure.
+ */
+
+bool archive_start_file(struct archive *archive, char *path, size_t length)
+{
+	if (archive == NULL || path == NULL || archive->failed)
+		return false;
+
+	archive->remaining = length;
+
+	if (archive->format == ARCHIVE_FORMAT_ZIP) {
+		if (length > ARCHIVE_ZIP_MAX_SIZE) {
+			msg_report(MSG_ARCHIVE_TOO_LARGE, archive->filename);
+			archive->failed = true;
+			return false;
+		}
+
+		return archive_write_zip_header(archive, path, false);
+	}
+
+	return archive_write_tar_header(archive, path, length, '0');
+}
+
+/**
+ * Write some of the contents of the file being added to an archive.
+ *
+ * \param *archive	Pointer to the archive to write to.
+ * \param *data		Pointer to the data to write.
+ * \param length	The length of the data, in bytes.
+ * \return		True if successful; False on failure.
+ */
+
+bool archive_write(struct archive *archive, void *data, size_t length)
+{
+	if (archive == NULL || data == NULL || archive->failed)
+		return false;
+
+	if (length > archive->remaining) {
+		archive->failed = true;
+		return false;
+	}
+
+	archive->remaining -= length;
+
+	if (archive->format == ARCHIVE_FORMAT_ZIP) {
+		archive->current.crc = hash_crc32(archive->current.crc, data, length);
+		archive->current.size += length;
+	}
+
+	return archive_output(archive, data, length);
+}
+
+/**
+ * Finish adding a file to an archive, once all of its contents have
+ * been written.
+ *
+ * \param *archive	Pointer to the archive to write to.
+ * \return		True if successful; False on failure.
+ */
+
+bool archive_end_file(struct archive *archive)
+{
+	uint8_t descriptor[16];
+
+	if (archive == NULL || archive->failed)
+		return false;
+
+	if (archive->remaining != 0) {
+		archive->failed = true;
+		return false;
+	}
+
+	if (archive->format == ARCHIVE_FORMAT_TAR)
+		return archive_write_tar_padding(archive);
+
+	/* Follow the contents with the descriptor, and remember the entry. */
+
+	archive_set_32(descriptor, ARCHIVE_ZIP_DATA_DESCRIPTOR);
+	archive_set_32(descriptor + 4, archive->current.crc);
+	archive_set_32(descriptor + 8, archive->current.size);
+	archive_set_32(descriptor + 12, archive->current.size);
+
+	if (!archive_output(archive, descriptor, sizeof(descriptor)))
+		return false;
+
+	if (!stack_push(&(archive->entries), &(archive->current))) {
+		msg_report(MSG_NO_MEMORY);
+		archive->failed = true;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Close an archive, completing it and putting it in place if required,
+ * or discarding it if not.
+ *
+ * \param *archive	Pointer to the archive to close.
+ * \param commit	True to complete the archive; False to discard it.
+ * \return		True if the archive was written successfully;
+ *			False on failure, or if it was discarded.
+ */
+
+bool archive_close(struct archive *archive, bool commit)
+{
+	bool success = false;
+
+	if (archive == NULL)
+		return false;
+
+	if (archive->file != NULL) {
+		if (commit && !archive->failed) {
+			if (archive->format == ARCHIVE_FORMAT_ZIP)
+				archive_write_zip_directory(archive);
+			else
+				archive_write_tar_end(archive);
+
+			archive_flush(archive);
+		}
+
+		if (fclose(archive->file) != 0)
+			archive->failed = true;
+
+		stats_count(STATS_SYSCALLS, 1);
+
+		success = commit && !archive->failed;
+
+		if (success) {
+			if (!files_rename_file(archive->temp, archive->filename) ||
+					!files_set_filetype(archive->filename, (archive->format == ARCHIVE_FORMAT_ZIP) ?
+					ARCHIVE_ZIP_FILETYPE : ARCHIVE_TAR_FILETYPE))
+				success = false;
+		}
+
+		if (success) {
+			stats_count(STATS_FILES_WRITTEN, 1);
+		} else {
+			if (commit || archive->failed)
+				msg_report(MSG_ARCHIVE_WRITE_FAILED, archive->filename);
+
+			remove(archive->temp);
+		}
+	}
+
+	stack_free(&(archive->entries));
+	arena_destroy(archive->arena);
+	free(archive->buffer);
+	free(archive);
+
+	return success;
+}
+
+/**
+ * Write the header for an entry in a tar archive. Paths which are too long
+ * for the header are split between its name and prefix fields where that's
+ * possible, and otherwise written out in full in a GNU long name entry.
+ *
+ * \param *archive	Pointer to the archive to write to.
+ * \param *path		Pointer to the path of the entry.
+ * \param length	The length of the entry's contents.
+ * \param type		The tar type flag for the entry.
+ * \return		True if successful; False on failure.
+ */
+
+static bool archive_write_tar_header(struct archive *archive, char *path, size_t length, char type)
+{
+	size_t path_length, name_length, split;
+
+	/* Directory names are given a trailing separator. */
+
+	path_length = strlen(path);
+	name_length = path_length + ((type == '5') ? 1 : 0);
+
+	if (name_length <= 100)
+		return archive_write_tar_block(archive, path, path_length, NULL, 0, length, type);
+
+	for (split = 0; split < path_length && split <= 155; split++) {
+		if (path[split] == '/' && name_length - split - 1 <= 100)
+			return archive_write_tar_block(archive, path + split + 1, path_length - split - 1, path, split, length, type);
+	}
+
+	if (!archive_write_tar_block(archive, "././@LongLink", 13, NULL, 0, name_length + 1, 'L'))
+		return false;
+
+	if (!archive_output(archive, path, path_length) ||
+			(type == '5' && !archive_output(archive, "/", 1)) ||
+			!archive_output(archive, "", 1) ||
+			!archive_write_tar_padding(archive))
+		return false;
+
+	return archive_write_tar_block(archive, path, 100 - ((type == '5') ? 1 : 0), NULL, 0, length, type);
+}
+
+/**
+ * Write a single tar header block.
+ *
+ * \param *archive	Pointer to the archive to write to.
+ * \param *name		Pointer to the name for the entry.
+ * \param name_length	The length of the name to use.
+ * \param *prefix	Pointer to the prefix for the entry, or NULL.
+ * \param prefix_length	The length of the prefix to use.
+ * \param length	The length of the entry's contents.
+ * \param type		The tar type flag for the entry.
+ * \return		True if successful; False on failure.
+ */
+
+static bool archive_write_tar_block(struct archive *archive, char *name, size_t name_length, char *prefix, size_t prefix_length, size_t length, char type)
+{
+	char header[ARCHIVE_TAR_BLOCK];
+	unsigned checksum = 0;
+	int i;
+
+	memset(header, 0, ARCHIVE_TAR_BLOCK);
+
+	memcpy(header, name, name_length);
+	if (type == '5')
+		header[name_length] = '/';
+
+	if (prefix != NULL)
+		memcpy(header + 345, prefix, prefix_length);
+
+	archive_set_octal(header + 100, 8, (type == '5') ? ARCHIVE_DIR_MODE & 07777 : ARCHIVE_FILE_MODE & 07777);
+	archive_set_octal(header + 108, 8, 0);
+	archive_set_octal(header + 116, 8, 0);
+	archive_set_octal(header + 124, 12, length);
+	archive_set_octal(header + 136, 12, archive->mtime);
+
+	header[156] = type;
+
+	memcpy(header + 257, "ustar", 6);
+	memcpy(header + 263, "00", 2);
+
+	/* The checksum is calculated with its own field filled with spaces. */
+
+	memset(header + 148, ' ', 8);
+
+	for (i = 0; i < ARCHIVE_TAR_BLOCK; i++)
+		checksum += (unsigned char) header[i];
+
+	archive_set_octal(header + 148, 7, checksum);
+
+	return archive_output(archive, header, ARCHIVE_TAR_BLOCK);
+}
+
+/**
+ * Fill in a numeric field in a tar header, as zero-padded octal followed
+ * by a terminator.
+ *
+ * \param *field	Pointer to the field to fill in.
+ * \param size		The size of the field, including the terminator.
+ * \param value		The value to write.
+ */
+
+static void archive_set_octal(char *field, size_t size, uint64_t value)
+{
+	field[--size] = '\0';
+
+	while (size-- > 0) {
+		field[size] = '0' + (value & 7);
+		value >>= 3;
+	}
+}
+
+/**
+ * Pad a tar archive with zeros, up to the next block boundary.
+ *
+ * \param *archive	Pointer to the archive to write to.
+ * \return		True if successful; False on failure.
+ */
+
+static bool archive_write_tar_padding(struct archive *archive)
+{
+	static char zeros[ARCHIVE_TAR_BLOCK];
+	size_t padding;
+
+	padding = (ARCHIVE_TAR_BLOCK - (archive->offset % ARCHIVE_TAR_BLOCK)) % ARCHIVE_TAR_BLOCK;
+
+	return (padding == 0) ? true : archive_output(archive, zeros, padding);
+}
+
+/**
+ * Write the end of archive marker to a tar archive, which consists of
+ * two blocks of zeros.
+ *
+ * \param *archive	Pointer to the archive to write to.
+ * \return		True if successful; False on failure.
+ */
+
+static bool archive_write_tar_end(struct archive *archive)
+{
+	static char zeros[2 * ARCHIVE_TAR_BLOCK];
+
+	return archive_output(archive, zeros, sizeof(zeros));
+}
+
+/**
+ * Write the local header for an entry in a Zip archive. The sizes and
+ * CRC of files aren't known until their contents have passed, so they
+ * are left as zero to be filled in by the data descriptor.
+ *
+ * \param *archive	Pointer to the archive to write to.
+ * \param *path		Pointer to the path of the entry.
+ * \param directory	True if the entry is a directory.
+ * \return		True if successful; False on failure.
+ */
+
+static bool archive_write_zip_header(struct archive *archive, char *path, bool directory)
+{
+	struct archive_entry *entry = &(archive->current);
+	uint8_t header[30];
+	size_t length;
+
+	if (stack_count(&(archive->entries)) >= ARCHIVE_ZIP_MAX_ENTRIES || archive->offset > ARCHIVE_ZIP_MAX_SIZE) {
+		msg_report(MSG_ARCHIVE_TOO_LARGE, archive->filename);
+		archive->failed = true;
+		return false;
+	}
+
+	/* Directory names are given a trailing separator. */
+
+	length = strlen(path) + ((directory) ? 1 : 0);
+
+	entry->name = arena_alloc(archive->arena, length + 1);
+	if (entry->name == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		archive->failed = true;
+		return false;
+	}
+
+	snprintf(entry->name, length + 1, "%s%s", path, (directory) ? "/" : "");
+
+	entry->crc = HASH_CRC32_INITIAL;
+	entry->size = 0;
+	entry->offset = (uint32_t) archive->offset;
+	entry->flags = (directory) ? 0 : ARCHIVE_ZIP_FLAG_DESCRIPTOR;
+	entry->directory = directory;
+
+	archive_set_32(header, ARCHIVE_ZIP_LOCAL_HEADER);
+	archive_set_16(header + 4, ARCHIVE_ZIP_VERSION);
+	archive_set_16(header + 6, entry->flags);
+	archive_set_16(header + 8, 0);
+	archive_set_16(header + 10, archive->dos_time);
+	archive_set_16(header + 12, archive->dos_date);
+	archive_set_32(header + 14, 0);
+	archive_set_32(header + 18, 0);
+	archive_set_32(header + 22, 0);
+	archive_set_16(header + 26, (uint16_t) length);
+	archive_set_16(header + 28, 0);
+
+	if (!archive_output(archive, header, sizeof(header)) || !archive_output(archive, entry->name, length))
+		return false;
+
+	/* Directories have no contents or descriptor, so are complete. */
+
+	if (directory && !stack_push(&(archive->entries), entry)) {
+		msg_report(MSG_NO_MEMORY);
+		archive->failed = true;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Write the central directory and end of central directory record to
+ * a Zip archive, from the entries remembered as they were written.
+ *
+ * \param *archive	Pointer to the archive to write to.
+ * \return		True if successful; False on failure.
+ */
+
+static bool archive_write_zip_directory(struct archive *archive)
+{
+	struct archive_entry entry;
+	uint8_t header[46];
+	uint64_t start;
+	size_t count, length;
+
+	start = archive->offset;
+	count = stack_count(&(archive->entries));
+
+	/* The entries come off the stack in reverse, so flip them first. */
+
+	stack_reverse(&(archive->entries), 0);
+
+	while (stack_pop(&(archive->entries), &entry)) {
+		length = strlen(entry.name);
+
+		archive_set_32(header, ARCHIVE_ZIP_CENTRAL_HEADER);
+		archive_set_16(header + 4, (ARCHIVE_ZIP_HOST_UNIX << 8) | ARCHIVE_ZIP_VERSION);
+		archive_set_16(header + 6, ARCHIVE_ZIP_VERSION);
+		archive_set_16(header + 8, entry.flags);
+		archive_set_16(header + 10, 0);
+		archive_set_16(header + 12, archive->dos_time);
+		archive_set_16(header + 14, archive->dos_date);
+		archive_set_32(header + 16, entry.crc);
+		archive_set_32(header + 20, entry.size);
+		archive_set_32(header + 24, entry.size);
+		archive_set_16(header + 28, (uint16_t) length);
+		archive_set_16(header + 30, 0);
+		archive_set_16(header + 32, 0);
+		archive_set_16(header + 34, 0);
+		archive_set_16(header + 36, 0);
+		archive_set_32(header + 38, ((uint32_t) ((entry.directory) ? ARCHIVE_DIR_MODE : ARCHIVE_FILE_MODE) << 16) |
+				((entry.directory) ? 0x10 : 0));
+		archive_set_32(header + 42, entry.offset);
+
+		if (!archive_output(archive, header, sizeof(header)) || !archive_output(archive, entry.name, length))
+			return false;
+	}
+
+	if (archive->offset > ARCHIVE_ZIP_MAX_SIZE) {
+		msg_report(MSG_ARCHIVE_TOO_LARGE, archive->filename);
+		archive->failed = true;
+		return false;
+	}
+
+	archive_set_32(header, ARCHIVE_ZIP_END_OF_DIRECTORY);
+	archive_set_16(header + 4, 0);
+	archive_set_16(header + 6, 0);
+	archive_set_16(header + 8, (uint16_t) count);
+	archive_set_16(header + 10, (uint16_t) count);
+	archive_set_32(header + 12, (uint32_t) (archive->offset - start));
+	archive_set_32(header + 16, (uint32_t) start);
+	archive_set_16(header + 20, 0);
+
+	return archive_output(archive, header, 22);
+}
+
+/**
+ * Write a 16-bit little-endian value into a Zip record.
+ *
+ * \param *field	Pointer to the field to fill in.
+ * \param value		The value to write.
+ */
+
+static void archive_set_16(uint8_t *field, uint16_t value)
+{
+	field[0] = value & 0xff;
+	field[1] = (value >> 8) & 0xff;
+}
+
+/**
+ * Write a 32-bit little-endian value into a Zip record.
+ *
+ * \param *field	Pointer to the field to fill in.
+ * \param value		The value to write.
+ */
+
+static void archive_set_32(uint8_t *field, uint32_t value)
+{
+	field[0] = value & 0xff;
+	field[1] = (value >> 8) & 0xff;
+	field[2] = (value >> 16) & 0xff;
+	field[3] = (value >> 24) & 0xff;
+}
+
+/**
+ * Write data to an archive, collecting it in the buffer so that the
+ * file sees large sequential writes. Anything bigger than the buffer
+ * goes straight to the file once the buffer has been flushed.
+ *
+ * \param *archive	Pointer to the archive to write to.
+ * \param *data		Pointer to the data to write.
+ * \param length	The length of the data, in bytes.
+ * \return		True if successful; False on failure.
+ */
+
+static bool archive_output(struct archive *archive, void *data, size_t length)
+{
+	size_t space;
+
+	if (archive->failed)
+		return false;
+
+	archive->offset += length;
+
+	while (length > 0) {
+		if (archive->used == 0 && length >= ARCHIVE_BUFFER_SIZE) {
+			stats_count(STATS_SYSCALLS, 1);
+
+			if (fwrite(data, 1, length, archive->file) != length) {
+				archive->failed = true;
+				return false;
+			}
+
+			stats_count(STATS_BYTES_WRITTEN, length);
+			return true;
+		}
+
+		space = ARCHIVE_BUFFER_SIZE - archive->used;
+		if (space > length)
+			space = length;
+
+		memcpy(archive->buffer + archive->used, data, space);
+		archive->used += space;
+		data = (char *) data + space;
+		length -= space;
+
+		if (archive->used == ARCHIVE_BUFFER_SIZE && !archive_flush(archive))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Flush the contents of an archive's buffer out to the file.
+ *
+ * \param *archive	Pointer to the archive to flush.
+ * \return		True if successful; False on failure.
+ */
+
+static bool archive_flush(struct archive *archive)
+{
+	if (archive->failed)
+		return false;
+
+	if (archive->used == 0)
+		return true;
+
+	stats_count(STATS_SYSCALLS, 1);
+
+	if (fwrite(archive->buffer, 1, archive->used, archive->file) != archive->used) {
+		archive->failed = true;
+		return false;
+	}
+
+	stats_count(STATS_BYTES_WRITTEN, archive->used);
+	archive->used = 0;
+
+	return true;
+}
+
@@ -0,0 +1,135 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file archive.h
+ *
+ * Archive Writer Interface.
+ *
+ * Write the contents of a manual out as a tar or Zip archive, streaming
+ * the files through a single large buffer so that nothing needs to be
+ * created on disc apart from the archive itself. Files are stored without
+ * compression.
+ */
+
+#ifndef STRONGEX_ARCHIVE_H
+#define STRONGEX_ARCHIVE_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+/**
+ * The supported archive formats.
+ */
+
+enum archive_format {
+	ARCHIVE_FORMAT_TAR,		/**< A POSIX ustar archive.			*/
+	ARCHIVE_FORMAT_ZIP		/**< A Zip archive, without compression.	*/
+};
+
+/**
+ * An archive writer instance reference.
+ */
+
+struct archive;
+
+/**
+ * Choose the format for an archive from its filename: anything with a Zip
+ * extension is written as a Zip archive, and everything else as tar.
+ *
+ * \param *filename	Pointer to the filename of the archive.
+ * \return		The format to use.
+ */
+
+enum archive_format archive_choose_format(char *filename);
+
+/**
+ * Open a new archive for writing. The archive is written to a temporary
+ * file, which replaces any existing archive when it is closed.
+ *
+ * \param *filename	Pointer to the filename of the archive, which must
+ *			remain valid until the archive is closed.
+ * \param format	The format of the archive.
+ * \return		Pointer to the archive, or NULL on failure.
+ */
+
+struct archive *archive_open(char *filename, enum archive_format format);
+
+/**
+ * Add a directory to an archive.
+ *
+ * \param *archive	Pointer to the archive to add to.
+ * \param *path		Pointer to the path of the directory in the archive.
+ * \return		True if successful; False on failure.
+ */
+
+bool archive_add_directory(struct archive *archive, char *path);
+
+/**
+ * Start adding a file to an archive. The contents must then be supplied
+ * by calls to archive_write(), before archive_end_file() is called.
+ *
+ * \param *archive	Pointer to the archive to add to.
+ * \param *path		Pointer to the path of the file in the archive.
+ * \param length	The length of the file, in bytes.
+ * \return		True if successful; False on failure.
+ */
+
+bool archive_start_file(struct archive *archive, char *path, size_t length);
+
+/**
+ * Write some of the contents of the file being added to an archive.
+ *
+ * \param *archive	Pointer to the archive to write to.
+ * \param *data		Pointer to the data to write.
+ * \param length	The length of the data, in bytes.
+ * \return		True if successful; False on failure.
+ */
+
+bool archive_write(struct archive *archive, void *data, size_t length);
+
+/**
+ * Finish adding a file to an archive, once all of its contents have
+ * been written.
+ *
+ * \param *archive	Pointer to the archive to write to.
+ * \return		True if successful; False on failure.
+ */
+
+bool archive_end_file(struct archive *archive);
+
+/**
+ * Close an archive, completing it and putting it in place if required,
+ * or discarding it if not.
+ *
+ * \param *archive	Pointer to the archive to close.
+ * \param commit	True to complete the archive; False to discard it.
+ * \return		True if the archive was written successfully;
+ *			False on failure, or if it was discarded.
+ */
+
+bool archive_close(struct archive *archive, bool commit);
+
+#endif
+
@@ -0,0 +1,223 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file arena.c
+ *
+ * Memory Arena, implementation.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LINUX
+#include <pthread.h>
+#endif
+
+/* Local source headers. */
+
+#include "arena.h"
+
+#include "msg.h"
+
+/**
+ * The size of the blocks claimed from the system for an arena.
+ */
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+/**
+ * The alignment applied to allocations from an arena.
+ */
+
+#define ARENA_ALIGNMENT 8
+
+/**
+ * A block of memory claimed for an arena.
+ */
+
+struct arena_block {
+	struct arena_block	*next;		/**< Pointer to the previously claimed block.		*/
+	size_t			size;		/**< The usable size of the block, in bytes.		*/
+	size_t			used;		/**< The number of bytes allocated from the block.	*/
+};
+
+/**
+ * An arena instance.
+ */
+
+struct arena {
+	struct arena_block	*blocks;	/**< Pointer to the block currently being allocated.	*/
+#ifdef LINUX
+	pthread_mutex_t		lock;		/**< Lock protecting allocations from the arena.	*/
+#endif
+};
+
+/**
+ * The offset from the start of a block to the first allocation.
+ */
+
+#define ARENA_HEADER_SIZE ((sizeof(struct arena_block) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+/**
+ * Create a new memory arena, from which blocks of memory can be
+ * allocated until the whole arena is released in one go.
+ *
+ * \return		Pointer to the new arena, or NULL on failure.
+ */
+
+struct arena *arena_create(void)
+{
+	struct arena *arena;
+
+	arena = malloc(sizeof(struct arena));
+	if (arena == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return NULL;
+	}
+
+	arena->blocks = NULL;
+
+#ifdef LINUX
+	pthread_mutex_init(&(arena->lock), NULL);
+#endif
+
+	return arena;
+}
+
+/**
+ * Allocate a block of memory from an arena. The memory is suitably
+ * aligned for any structure, and remains valid until the arena is
+ * destroyed.
+ *
+ * \param *arena	Pointer to the arena to allocate from.
+ * \param size		The number of bytes required.
+ * \return		Pointer to the memory, or NULL on failure.
+ */
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	struct arena_block *block;
+	void *memory = NULL;
+	size_t claim;
+
+	if (arena == NULL)
+		return NULL;
+
+	size = (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+
+#ifdef LINUX
+	pthread_mutex_lock(&(arena->lock));
+#endif
+
+	block = arena->blocks;
+
+	if (block != NULL && block->size - block->used >= size) {
+		memory = (char *) block + ARENA_HEADER_SIZE + block->used;
+		block->used += size;
+	} else {
+		/* Large allocations get a block of their own, which is linked
+		 * in behind the current one so that its free space isn't lost.
+		 */
+
+		claim = (size > ARENA_BLOCK_SIZE / 4) ? size : ARENA_BLOCK_SIZE;
+
+		block = malloc(ARENA_HEADER_SIZE + claim);
+
+		if (block != NULL) {
+			block->size = claim;
+			block->used = size;
+
+			if (claim == size && arena->blocks != NULL) {
+				block->next = arena->blocks->next;
+				arena->blocks->next = block;
+			} else {
+				block->next = arena->blocks;
+				arena->blocks = block;
+			}
+
+			memory = (char *) block + ARENA_HEADER_SIZE;
+		}
+	}
+
+#ifdef LINUX
+	pthread_mutex_unlock(&(arena->lock));
+#endif
+
+	if (memory == NULL)
+		msg_report(MSG_NO_MEMORY);
+
+	return memory;
+}
+
+/**
+ * Take a copy of a string, using memory allocated from an arena.
+ *
+ * \param *arena	Pointer to the arena to allocate from.
+ * \param *string	Pointer to the string to be copied.
+ * \return		Pointer to the copy, or NULL on failure.
+ */
+
+char *arena_strdup(struct arena *arena, char *string)
+{
+	char *copy;
+	size_t length;
+
+	if (string == NULL)
+		return NULL;
+
+	length = strlen(string) + 1;
+
+	copy = arena_alloc(arena, length);
+	if (copy != NULL)
+		memcpy(copy, string, length);
+
+	return copy;
+}
+
+/**
+ * Destroy an arena, releasing all of the memory allocated from it.
+ *
+ * \param *arena	Pointer to the arena to destroy.
+ */
+
+void arena_destroy(struct arena *arena)
+{
+	struct arena_block *block;
+
+	if (arena == NULL)
+		return;
+
+	while (arena->blocks != NULL) {
+		block = arena->blocks;
+		arena->blocks = block->next;
+		free(block);
+	}
+
+#ifdef LINUX
+	pthread_mutex_destroy(&(arena->lock));
+#endif
+
+	free(arena);
+}
@@ -0,0 +1,80 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file arena.h
+ *
+ * Memory Arena Interface.
+ */
+
+#ifndef STRONGEX_ARENA_H
+#define STRONGEX_ARENA_H
+
+#include <stdlib.h>
+
+/**
+ * An arena instance reference.
+ */
+
+struct arena;
+
+/**
+ * Create a new memory arena, from which blocks of memory can be
+ * allocated until the whole arena is released in one go.
+ *
+ * \return		Pointer to the new arena, or NULL on failure.
+ */
+
+struct arena *arena_create(void);
+
+/**
+ * Allocate a block of memory from an arena. The memory is suitably
+ * aligned for any structure, and remains valid until the arena is
+ * destroyed.
+ *
+ * \param *arena	Pointer to the arena to allocate from.
+ * \param size		The number of bytes required.
+ * \return		Pointer to the memory, or NULL on failure.
+ */
+
+void *arena_alloc(struct arena *arena, size_t size);
+
+/**
+ * Take a copy of a string, using memory allocated from an arena.
+ *
+ * \param *arena	Pointer to the arena to allocate from.
+ * \param *string	Pointer to the string to be copied.
+ * \return		Pointer to the copy, or NULL on failure.
+ */
+
+char *arena_strdup(struct arena *arena, char *string);
+
+/**
+ * Destroy an arena, releasing all of the memory allocated from it.
+ *
+ * \param *arena	Pointer to the arena to destroy.
+ */
+
+void arena_destroy(struct arena *arena);
+
+#endif
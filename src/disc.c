@@ -30,112 +30,337 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* Local source headers. */
 
 #include "disc.h"
 
+#include "arena.h"
 #include "files.h"
 #include "msg.h"
 #include "objectdb.h"
+#include "pool.h"
+
+/**
+ * The number of directory handles, besides the root, which a scan will
+ * hold open while they wait to be read.
+ */
+
+#define DISC_MAX_HANDLES 64
+
+/* Data Structures */
+
+/**
+ * The details of a disc scan which are shared between its tasks.
+ */
+
+struct disc_scan {
+	struct objectdb			*db;		/**< The database to add the objects to.		*/
+	struct files_directory		root;		/**< The handle of the root directory.			*/
+	int				handles;	/**< The number of directory handles waiting to be read.	*/
+};
+
+/**
+ * A directory to be scanned. Each directory is opened relative to its
+ * parent's handle while the parent is being read, and the handle passed
+ * on to the directory's own task, so that the path never has to be
+ * resolved from the root. Once DISC_MAX_HANDLES are waiting to be read,
+ * any more directories are left closed, and opened by their path from
+ * the root when their turn comes.
+ */
+
+struct disc_directory {
+	struct disc_scan		*scan;		/**< The scan to which the directory belongs.		*/
+	struct objectdb_object		*object;	/**< The Object DB entry for the directory.		*/
+	char				*path;		/**< The path relative to the root, or NULL for the root.	*/
+	struct files_directory		handle;		/**< The handle of the directory, if it is open.		*/
+	bool				open;		/**< True if the handle was opened by the parent.		*/
+};
 
 /* Static Function Prototypes. */
 
-static bool disc_process_object(struct files_object_info *entry, struct objectdb_object *parent);
-static bool disc_process_directory_entries(struct objectdb_object *object);
+static struct disc_directory *disc_create_directory(struct disc_scan *scan, struct objectdb_object *object, struct disc_directory *parent, char *name);
+static void disc_open_directory(struct disc_directory *dir, struct files_directory *parent, char *name);
+static void disc_close_directory(struct disc_directory *dir);
+static bool disc_scan_task(struct pool *pool, void *data);
+static void disc_report_read_failure(struct objectdb_object *object);
 
 /* Initialise a folder on disc, and roughly validate its
  * contents.
  *
+ * The folder is scanned by a worker pool, with each task reading one
+ * directory and queueing tasks for the directories within it. Each task
+ * only adds objects to its own directory, and the database is sorted
+ * once complete, so the final order is the same however the tasks run.
+ * If any directory can't be read, the whole scan fails, so that nothing
+ * is ever compared against or updated from a partial listing.
+ *
+ * \param *db		Pointer to the object database to add the contents to.
  * \param *file		Pointer to the folder path.
+ * \param threads	The number of threads to use for the scan.
  * \return		True if successful, false on failure.
  */
 
-bool disc_initialise_folder(char *path)
+bool disc_initialise_folder(struct objectdb *db, char *path, int threads)
 {
 	struct files_object_info *root;
+	struct objectdb_object *object;
+	struct disc_directory *dir;
+	struct disc_scan scan;
+	struct pool *pool;
+	bool success;
 
 	/* Validate the directory entries. */
 
-	root = files_read_directory_info(path, false);
+	root = files_read_directory_info(path, false, objectdb_get_arena(db));
 	if (root == NULL)
 		return false;
 
-	return disc_process_object(root, NULL);
+	object = objectdb_add_disc_directory(db, NULL, root->name, root->real_name);
+	if (object == NULL)
+		return false;
+
+	/* A folder which doesn't exist yet has nothing in it to scan. */
+
+	if (root->filetype == OBJECTDB_TYPE_UNKNOWN)
+		return true;
+
+	/* Open the root, which is held open until the scan is complete. */
+
+	scan.db = db;
+	scan.handles = 0;
+
+	if (!files_open_directory(NULL, root->real_name, &(scan.root))) {
+		disc_report_read_failure(object);
+		return false;
+	}
+
+	/* Scan the folder contents. */
+
+	dir = disc_create_directory(&scan, object, NULL, NULL);
+
+	pool = (dir != NULL) ? pool_create(threads) : NULL;
+	if (pool == NULL) {
+		files_close_directory(&(scan.root));
+		return false;
+	}
+
+	success = pool_submit(pool, disc_scan_task, dir);
+
+	if (!pool_wait(pool))
+		success = false;
+
+	pool_destroy(pool);
+
+	files_close_directory(&(scan.root));
+
+	return success;
 }
 
 /**
- * Process an object.
+ * Create a new directory to be scanned.
  *
- * \param *entry	Pointer to the directory entry for the object.
- * \param *parent	Pointer to the Object DB entry for the parent, or NULL.
- * \return		True if successful, false on failure.
-*/
+ * \param *scan		Pointer to the scan that the directory belongs to.
+ * \param *object	Pointer to the Object DB entry for the directory.
+ * \param *parent	Pointer to the parent directory, or NULL for the root.
+ * \param *name		Pointer to the name of the directory within the
+ *			parent, or NULL for the root.
+ * \return		Pointer to the new directory, or NULL on failure.
+ */
 
-static bool disc_process_object(struct files_object_info *entry, struct objectdb_object *parent)
+static struct disc_directory *disc_create_directory(struct disc_scan *scan, struct objectdb_object *object, struct disc_directory *parent, char *name)
 {
-	struct objectdb_object *object = NULL;
+	struct arena *arena = objectdb_get_arena(scan->db);
+	struct disc_directory *dir;
+	size_t length;
 
-	if (entry == NULL)
-		return false;
+	dir = arena_alloc(arena, sizeof(struct disc_directory));
+	if (dir == NULL)
+		return NULL;
 
-	/* Create an Object DB entry for the directory. */
-
-	if (entry->filetype == OBJECTDB_TYPE_DIRECTORY) {
-		object = objectdb_add_disc_directory(parent, entry->name, entry->real_name);
-		if (object == NULL)
-			return false;
-
-		if (!disc_process_directory_entries(object))
-			return false;
-	} else if (entry->filetype != OBJECTDB_TYPE_UNKNOWN) {
-		object = objectdb_add_disc_file(parent, entry->name, entry->real_name, entry->size, entry->filetype);
-		if (object == NULL)
-			return false;
-	} else {
-		msg_report(MSG_BAD_FILETYPE, entry->filetype);
-		return false;
+	dir->scan = scan;
+	dir->object = object;
+	dir->path = NULL;
+	dir->open = false;
+
+	/* Directories in the root are opened by name, and the rest by path. */
+
+	if (parent != NULL && parent->path == NULL) {
+		dir->path = name;
+	} else if (parent != NULL) {
+		length = strlen(parent->path) + strlen(FILES_PATH_SEPARATOR) + strlen(name) + 1;
+
+		dir->path = arena_alloc(arena, length);
+		if (dir->path == NULL)
+			return NULL;
+
+		snprintf(dir->path, length, "%s%s%s", parent->path, FILES_PATH_SEPARATOR, name);
 	}
 
-	return true;
+	return dir;
 }
 
 /**
- * Process a block of directory entries, recursing down into any
- * subdirectories.
+ * Open a directory relative to its parent, so that the handle can be
+ * passed to the directory's own task, if there are handles to spare. If
+ * not, or if the open fails, the directory is left closed, to be opened
+ * by its path from the root.
  *
- * \param *object	Pointer to the Object DB entry for the directory.
- * \return		True if successful, false on failure.
+ * \param *dir		Pointer to the directory to open.
+ * \param *parent	Pointer to the open parent directory.
+ * \param *name		Pointer to the name of the directory on disc.
  */
 
-static bool disc_process_directory_entries(struct objectdb_object *object)
+static void disc_open_directory(struct disc_directory *dir, struct files_directory *parent, char *name)
 {
-	struct files_object_info *entries;
-	char *path;
+	struct disc_scan *scan = dir->scan;
 
-	/* Validate the offset and length. */
+#ifdef LINUX
+	if (__atomic_add_fetch(&(scan->handles), 1, __ATOMIC_RELAXED) > DISC_MAX_HANDLES) {
+		__atomic_sub_fetch(&(scan->handles), 1, __ATOMIC_RELAXED);
+		return;
+	}
+#else
+	if (scan->handles >= DISC_MAX_HANDLES)
+		return;
 
-	if (object == NULL)
-		return false;
+	scan->handles++;
+#endif
+
+	dir->open = files_open_directory(parent, name, &(dir->handle));
+
+	if (!dir->open)
+		disc_close_directory(dir);
+}
+
+/**
+ * Close a directory which was opened by its parent, freeing up its handle
+ * for another directory.
+ *
+ * \param *dir		Pointer to the directory to close.
+ */
+
+static void disc_close_directory(struct disc_directory *dir)
+{
+	if (dir->open)
+		files_close_directory(&(dir->handle));
 
-	/* Read the directory on disc. */
+	dir->open = false;
 
-	path = objectdb_get_path(object, OBJECTDB_PATH_TYPE_DISC, FILES_PATH_SEPARATOR);
-	if (path == NULL)
+#ifdef LINUX
+	__atomic_sub_fetch(&(dir->scan->handles), 1, __ATOMIC_RELAXED);
+#else
+	dir->scan->handles--;
+#endif
+}
+
+/**
+ * A worker pool task to scan a directory, adding its files to the
+ * database and queueing tasks to scan any subdirectories.
+ *
+ * \param *pool		Pointer to the pool running the task.
+ * \param *data		Pointer to the directory to scan.
+ * \return		True if successful, false on failure.
+ */
+
+static bool disc_scan_task(struct pool *pool, void *data)
+{
+	struct disc_directory *dir = data, *child;
+	struct files_object_info *entries = NULL;
+	struct files_directory fallback, *handle;
+	struct objectdb_object *object;
+	struct objectdb_merge merge;
+	struct objectdb *db;
+	bool success;
+
+	if (dir == NULL)
 		return false;
 
-	entries = files_read_directory_contents(path);
+	db = dir->scan->db;
 
-	free(path);
+	/* Find the directory's handle; the root's is already open, as are
+	 * those opened by their parents, and anything else is opened by its
+	 * path from the root. A directory which can't be read fails the
+	 * scan, rather than appearing to be empty.
+	 */
+
+	if (dir->path == NULL)
+		handle = &(dir->scan->root);
+	else if (dir->open)
+		handle = &(dir->handle);
+	else if (files_open_directory(&(dir->scan->root), dir->path, &fallback))
+		handle = &fallback;
+	else
+		handle = NULL;
 
-	/* Process the entries. */
+	success = (handle != NULL) ? files_read_directory_contents(handle, objectdb_get_arena(db), &entries) : false;
 
-	while (entries != NULL) {
-		if (!disc_process_object(entries, object))
-			return false;
+	if (!success)
+		disc_report_read_failure(dir->object);
+
+	/* Process the entries, which are in alphabetical order and so can be
+	 * merged straight into the directory's sorted lists. Anything left out
+	 * by the filters is skipped, so excluded directories are never opened.
+	 */
+
+	if (success)
+		objectdb_start_disc_merge(dir->object, &merge);
+
+	while (entries != NULL && success) {
+		if (!objectdb_filter_object(db, dir->object, entries->name, (entries->filetype == OBJECTDB_TYPE_DIRECTORY) ? true : false)) {
+			entries = entries->next;
+			continue;
+		}
+
+		if (entries->filetype == OBJECTDB_TYPE_DIRECTORY) {
+			object = objectdb_merge_disc_directory(db, &merge, entries->name, entries->real_name);
+			child = (object != NULL) ? disc_create_directory(dir->scan, object, dir, entries->real_name) : NULL;
+
+			if (child != NULL)
+				disc_open_directory(child, handle, entries->real_name);
+
+			if (child == NULL || !pool_submit(pool, disc_scan_task, child))
+				success = false;
+
+			if (child != NULL && !success && child->open)
+				disc_close_directory(child);
+		} else if (entries->filetype != OBJECTDB_TYPE_UNKNOWN) {
+			if (objectdb_merge_disc_file(db, &merge, entries->name, entries->real_name, entries->size, entries->filetype) == NULL)
+				success = false;
+		} else {
+			msg_report(MSG_BAD_FILETYPE, entries->filetype);
+			success = false;
+		}
 
 		entries = entries->next;
 	}
 
-	return true;
+	/* The directory's handle is finished with once its children have
+	 * been opened from it.
+	 */
+
+	if (handle == &fallback)
+		files_close_directory(&fallback);
+	else if (dir->open)
+		disc_close_directory(dir);
+
+	return success;
+}
+
+/**
+ * Report a failure to read a directory on disc, giving its full path.
+ *
+ * \param *object	Pointer to the Object DB entry for the directory.
+ */
+
+static void disc_report_read_failure(struct objectdb_object *object)
+{
+	char *path;
+
+	path = objectdb_get_path(object, OBJECTDB_PATH_TYPE_DISC);
+
+	msg_report(MSG_DIR_READ_FAIL, (path != NULL) ? path : "");
+
+	free(path);
 }
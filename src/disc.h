@@ -32,14 +32,18 @@
 
 #include <stdbool.h>
 
+#include "objectdb.h"
+
 /* Initialise a folder on disc, and roughly validate its
  * contents.
  *
+ * \param *db		Pointer to the object database to add the contents to.
  * \param *file		Pointer to the folder path.
+ * \param threads	The number of threads to use for the scan.
  * \return		True if successful, false on failure.
  */
 
-bool disc_initialise_folder(char *path);
+bool disc_initialise_folder(struct objectdb *db, char *path, int threads);
 
 #endif
 
@@ -27,6 +27,12 @@
  * Platform-Agnostic File and Directory Access, implementation.
  */
 
+/* statx() is a GNU extension. */
+
+#ifdef LINUX
+#define _GNU_SOURCE
+#endif
+
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -35,12 +41,18 @@
 
 #ifdef LINUX
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #endif
 #ifdef RISCOS
 #include "oslib/os.h"
+#include "oslib/osargs.h"
 #include "oslib/osfile.h"
+#include "oslib/osfind.h"
+#include "oslib/osfscontrol.h"
 #include "oslib/osgbpb.h"
 #endif
 
@@ -48,9 +60,14 @@
 
 #include "files.h"
 
+#include "hash.h"
 #include "msg.h"
 #include "objectdb.h"
+#include "stats.h"
 #include "string.h"
+#ifndef READER_ONLY
+#include "uring.h"
+#endif
 
 /**
  * The size of block allocated to RISC OS OS_GBPB calls.
@@ -58,50 +75,223 @@
 
 #define FILES_OSGBPB_SIZE 256
 
+/**
+ * The size of the blocks read from disc when comparing files.
+ */
+
+#define FILES_COMPARE_BLOCK_SIZE (64 * 1024)
+
+/**
+ * The size of the chunks used to locate a difference within a block.
+ */
+
+#define FILES_COMPARE_CHUNK_SIZE 64
+
+/**
+ * The number of files processed at once by the batched operations.
+ */
+
+#define FILES_BATCH_SIZE 256
+
+/**
+ * The maximum size of a single write within a batch.
+ */
+
+#define FILES_BATCH_WRITE_SIZE (1024 * 1024 * 1024)
+
+/* Data Structures */
+
+#if defined(LINUX) && !defined(READER_ONLY)
+/**
+ * The progress of a single file within a batch.
+ */
+
+struct files_batch_state {
+	int				fd;		/**< The file's descriptor, or -1 if not open.	*/
+	size_t				offset;		/**< The offset reached within the file.	*/
+	bool				active;		/**< True if the file has operations pending.	*/
+	bool				fallback;	/**< True if the file needs the standard calls.	*/
+};
+#endif
+
 /* Static Function Prototypes. */
 
-static void files_link_object(struct files_object_info **list, struct files_object_info *object);
+static bool files_sort_objects(struct files_object_info **list, size_t count);
+static int files_compare_objects(const void *a, const void *b);
 #ifdef LINUX
+static bool files_stat_entry(int fd, char *name, bool *is_dir, size_t *size);
 static uint32_t files_get_filetype(char *name);
 #endif
 static char *files_convert_name_to_riscos(char *name);
+static bool files_open_source_file(char *path, struct files_source *source, bool update);
+static bool files_write_contents(char *path, char *data, struct files_source *source, size_t offset, size_t length, uint32_t filetype, bool sync);
+#ifdef LINUX
+static bool files_write_block(int fd, char *data, size_t length);
+#endif
+static bool files_replace_contents(char *path, char *old_path, char *data, struct files_source *source, size_t offset, size_t length, uint32_t filetype, bool sync);
+static bool files_compare_contents(char *path, struct files_handle *handle, char *data, struct files_source *source, size_t offset, size_t length, size_t *difference);
+static size_t files_find_difference(char *a, char *b, size_t length);
+#if defined(LINUX) && !defined(READER_ONLY)
+static void files_batch_open(struct uring *ring, struct files_batch_item *items, struct files_batch_state *state, size_t count, int flags, unsigned mode);
+static void files_batch_close(struct uring *ring, struct files_batch_item *items, struct files_batch_state *state, size_t count);
+static bool files_batch_active(struct files_batch_state *state, size_t count);
+#endif
+
+/**
+ * Open a directory on disc, so that its contents can be read. On Linux,
+ * a directory within an open parent is opened relative to the parent's
+ * descriptor with openat(), so that the full path doesn't need to be
+ * resolved again for every level.
+ *
+ * \param *parent	Pointer to the parent directory, or NULL if the
+ *			name is a full path.
+ * \param *name		Pointer to the name of the directory to open.
+ * \param *dir		Pointer to a block to take the directory details.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_open_directory(struct files_directory *parent, char *name, struct files_directory *dir)
+{
+#ifdef RISCOS
+	size_t length;
+	fileswitch_object_type type;
+#endif
+
+	if (name == NULL || dir == NULL)
+		return false;
+
+#ifdef LINUX
+	dir->fd = openat((parent != NULL) ? parent->fd : AT_FDCWD, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	stats_count(STATS_SYSCALLS, 1);
+	if (dir->fd == -1)
+		return false;
+#endif
+#ifdef RISCOS
+	length = strlen(name) + 1;
+	if (parent != NULL)
+		length += strlen(parent->path) + strlen(FILES_PATH_SEPARATOR);
+
+	dir->path = malloc(length);
+	if (dir->path == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	if (parent != NULL)
+		snprintf(dir->path, length, "%s%s%s", parent->path, FILES_PATH_SEPARATOR, name);
+	else
+		snprintf(dir->path, length, "%s", name);
+
+	stats_count(STATS_SYSCALLS, 1);
+
+	if (xosfile_read_no_path(dir->path, &type, NULL, NULL, NULL, NULL) != NULL || type != fileswitch_IS_DIR) {
+		free(dir->path);
+		dir->path = NULL;
+		return false;
+	}
+#endif
+
+	return true;
+}
 
 /**
- * Read the contents of a directory, returning a linked list of objects.
+ * Close a directory previously opened with files_open_directory().
  *
- * \param *path		Pointer to the path to the required directory.
- * \return		Pointer to the head of a linked list of objects, or NULL.
+ * \param *dir		Pointer to the directory to close.
  */
 
-struct files_object_info *files_read_directory_contents(char *path)
+void files_close_directory(struct files_directory *dir)
 {
-	struct files_object_info *list = NULL, *next = NULL;
+	if (dir == NULL)
+		return;
+
+#ifdef LINUX
+	if (dir->fd != -1) {
+		close(dir->fd);
+		stats_count(STATS_SYSCALLS, 1);
+	}
+
+	dir->fd = -1;
+#endif
+#ifdef RISCOS
+	free(dir->path);
+	dir->path = NULL;
+#endif
+}
+
+/**
+ * Read the contents of a directory, returning a linked list of objects
+ * sorted into alphabetical order. If an error occurs while reading, any
+ * objects read so far are still returned.
+ *
+ * \param *dir		Pointer to the directory to read.
+ * \param *arena	Pointer to the arena to allocate the objects from.
+ * \param **list	Pointer to a variable to take the head of the linked
+ *			list of objects, or NULL if there are none.
+ * \return		True if successful; False on failure.
+ */
 
+bool files_read_directory_contents(struct files_directory *dir, struct arena *arena, struct files_object_info **list)
+{
+	struct files_object_info *next = NULL;
+	size_t count = 0;
+	bool success = true;
 #ifdef LINUX
 	DIR *directory = NULL;
 	struct dirent *entry = NULL;
-	struct stat stat_buffer;
-	int directory_fd;
-	size_t length;
+	bool is_dir;
+	size_t length, size;
+	int fd;
+#endif
+#ifdef RISCOS
+	os_error *error;
+	int8_t buffer[FILES_OSGBPB_SIZE];
+	int context = 0, read = 0;
+	osgbpb_info_list *osgbpb_list = (osgbpb_info_list *) buffer;
+	size_t length = 0;
+#endif
+
+	if (dir == NULL || list == NULL)
+		return false;
+
+	*list = NULL;
+
+	stats_count(STATS_DIRS_SCANNED, 1);
+
+#ifdef LINUX
+	/* Open a directory stream on a copy of the descriptor, so that the
+	 * original remains available for opening the entries.
+	 */
 
-	/* Open a directory stream. */
+	fd = dup(dir->fd);
+	if (fd == -1)
+		return false;
 
-	directory = opendir(path);
+	directory = fdopendir(fd);
 	if (directory == NULL) {
-		msg_report(MSG_DIR_READ_FAIL);
-		return NULL;
+		close(fd);
+		return false;
 	}
 
-	directory_fd = dirfd(directory);
+	rewinddir(directory);
+
+	/* The dup(), the seek, the reads of the entries (counted as one, which
+	 * is usual for small directories) and the close.
+	 */
+
+	stats_count(STATS_SYSCALLS, 4);
 
 	while ((entry = readdir(directory)) != NULL) {
 		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
 			continue;
 
-		/* Stat the file for more details. */
+		/* Directories don't need their sizes, so can often avoid a stat. */
+
+		is_dir = (entry->d_type == DT_DIR);
+		size = 0;
 
-		if (fstatat(directory_fd, entry->d_name, &stat_buffer, 0) != 0) {
-			msg_report(MSG_DIR_READ_FAIL);
+		if (!is_dir && !files_stat_entry(dir->fd, entry->d_name, &is_dir, &size)) {
+			success = false;
 			break;
 		}
 
@@ -109,9 +299,9 @@ struct files_object_info *files_read_directory_contents(char *path)
 
 		length = sizeof(struct files_object_info) + (2 * (strlen(entry->d_name) + 1));
 
-		next = malloc(length);
+		next = arena_alloc(arena, length);
 		if (next == NULL) {
-			msg_report(MSG_NO_MEMORY);
+			success = false;
 			break;
 		}
 
@@ -125,7 +315,7 @@ struct files_object_info *files_read_directory_contents(char *path)
 
 		/* Work out the filetype details. */
 
-		next->filetype = (S_ISDIR(stat_buffer.st_mode)) ? OBJECTDB_TYPE_DIRECTORY : files_get_filetype(next->name);
+		next->filetype = (is_dir) ? OBJECTDB_TYPE_DIRECTORY : files_get_filetype(next->name);
 
 		/* Fix the filename conventions. */
 
@@ -133,24 +323,21 @@ struct files_object_info *files_read_directory_contents(char *path)
 
 		/* Store the file details. */
 
-		next->size = stat_buffer.st_size;
+		next->size = (is_dir) ? 0 : size;
 
-		files_link_object(&list, next);
+		next->next = *list;
+		*list = next;
+		count++;
 	}
 
 	closedir(directory);
 #endif
 #ifdef RISCOS
-	os_error *error;
-	int8_t buffer[FILES_OSGBPB_SIZE];
-	int context = 0, read = 0;
-	osgbpb_info_list *osgbpb_list = (osgbpb_info_list *) buffer;
-	size_t length = 0;
-
 	do {
-		error = xosgbpb_dir_entries_info(path, osgbpb_list, 1, context, FILES_OSGBPB_SIZE, "*", &read, &context);
+		error = xosgbpb_dir_entries_info(dir->path, osgbpb_list, 1, context, FILES_OSGBPB_SIZE, "*", &read, &context);
+		stats_count(STATS_SYSCALLS, 1);
 		if (error != NULL) {
-			msg_report(MSG_DIR_READ_FAIL);
+			success = false;
 			break;
 		}
 
@@ -161,9 +348,9 @@ struct files_object_info *files_read_directory_contents(char *path)
 
 		length = (sizeof(struct files_object_info) + strlen(osgbpb_list->info[0].name) + 1);
 
-		next = malloc(length);
+		next = arena_alloc(arena, length);
 		if (next == NULL) {
-			msg_report(MSG_NO_MEMORY);
+			success = false;
 			break;
 		}
 
@@ -177,30 +364,128 @@ struct files_object_info *files_read_directory_contents(char *path)
 		next->filetype = (osgbpb_list->info[0].obj_type == osfile_IS_DIR) ? OBJECTDB_TYPE_DIRECTORY : ((osgbpb_list->info[0].load_addr >> 8) & 0xfffu);
 		next->size = osgbpb_list->info[0].size;
 
-		files_link_object(&list, next);
+		next->next = *list;
+		*list = next;
+		count++;
 	} while (context != -1);
 #endif
 
-	return list;
+	/* Sort the objects once they have all been read. An unsorted list
+	 * would confuse the callers, so it is discarded if that fails.
+	 */
+
+	if (!files_sort_objects(list, count)) {
+		*list = NULL;
+		success = false;
+	}
+
+	return success;
+}
+
+#ifdef LINUX
+/**
+ * Read the type and size of an entry in an open directory, following any
+ * symbolic links. Where statx() is available, only the fields that are
+ * required are requested, which can save work on network filing systems.
+ *
+ * \param fd		The descriptor of the directory holding the entry.
+ * \param *name		Pointer to the name of the entry.
+ * \param *is_dir	Pointer to a variable to show if the entry is a directory.
+ * \param *size		Pointer to a variable to take the size of the entry.
+ * \return		True if successful; False on failure.
+ */
+
+static bool files_stat_entry(int fd, char *name, bool *is_dir, size_t *size)
+{
+#ifdef STATX_SIZE
+	struct statx stat_buffer;
+
+	stats_count(STATS_SYSCALLS, 1);
+
+	if (statx(fd, name, 0, STATX_TYPE | STATX_SIZE, &stat_buffer) != 0)
+		return false;
+
+	*is_dir = S_ISDIR(stat_buffer.stx_mode);
+	*size = stat_buffer.stx_size;
+#else
+	struct stat stat_buffer;
+
+	stats_count(STATS_SYSCALLS, 1);
+
+	if (fstatat(fd, name, &stat_buffer, 0) != 0)
+		return false;
+
+	*is_dir = S_ISDIR(stat_buffer.st_mode);
+	*size = stat_buffer.st_size;
+#endif
+
+	return true;
 }
+#endif
 
 /**
- * Link a new object into the object list, in the correct position alphabetically.
+ * Sort a list of objects into alphabetical order, by copying them into an
+ * array so that they can be sorted in a single pass. Objects with the same
+ * name are ordered by their real names, so that the result is repeatable.
  *
  * \param **list	Pointer to the list head pointer location.
- * \param *object	Pointer to the new object to link.
+ * \param count		The number of objects in the list.
+ * \return		True if successful; False on failure.
  */
 
-static void files_link_object(struct files_object_info **list, struct files_object_info *object)
+static bool files_sort_objects(struct files_object_info **list, size_t count)
 {
-	if (list == NULL || object == NULL)
-		return;
+	struct files_object_info **array, *object;
+	size_t i;
+
+	if (list == NULL)
+		return false;
+
+	if (count < 2)
+		return true;
+
+	array = malloc(count * sizeof(struct files_object_info *));
+	if (array == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	for (i = 0, object = *list; i < count && object != NULL; object = object->next)
+		array[i++] = object;
+
+	qsort(array, i, sizeof(struct files_object_info *), files_compare_objects);
 
-	while (*list != NULL && strcmp((*list)->name, object->name) < 0)
-		list = &((*list)->next);
+	*list = NULL;
 
-	object->next = *list;
-	*list = object;
+	while (i-- > 0) {
+		array[i]->next = *list;
+		*list = array[i];
+	}
+
+	free(array);
+
+	return true;
+}
+
+/**
+ * Compare two objects by name, for sorting.
+ *
+ * \param *a		Pointer to the first object pointer to compare.
+ * \param *b		Pointer to the second object pointer to compare.
+ * \return		The result of the comparison.
+ */
+
+static int files_compare_objects(const void *a, const void *b)
+{
+	const struct files_object_info *first = *((struct files_object_info * const *) a);
+	const struct files_object_info *second = *((struct files_object_info * const *) b);
+	int result;
+
+	result = strcmp(first->name, second->name);
+	if (result != 0)
+		return result;
+
+	return strcmp(first->real_name, second->real_name);
 }
 
 /**
@@ -265,15 +550,15 @@ static char *files_convert_name_to_riscos(char *name)
 
 /**
  * Make a filename up using its name and filetype, and create a new
- * buffer for it using malloc(). It is up to the caller to release
- * this using free() once no longer required.
+ * buffer for it in the supplied arena.
  *
  * \param *name		Pointer to the filename.
  * \param filetype	The RISC OS filetype.
+ * \param *arena	Pointer to the arena to allocate the name from.
  * \return		Pointer to the resulting name buffer.
  */
 
-char *files_make_filename(char *name, uint32_t filetype)
+char *files_make_filename(char *name, uint32_t filetype, struct arena *arena)
 {
 	size_t length = 0;
 	char *buffer = NULL;
@@ -284,7 +569,7 @@ char *files_make_filename(char *name, uint32_t filetype)
 
 	length = strlen(name) + ((filetype == FILES_TYPE_OMIT) ? 1 : 5);
 
-	buffer = malloc(length);
+	buffer = arena_alloc(arena, length);
 	if (buffer == NULL)
 		return NULL;
 
@@ -320,6 +605,8 @@ char *files_make_filename(char *name, uint32_t filetype)
 bool files_set_filetype(char *path, uint32_t filetype)
 {
 #ifdef RISCOS
+	stats_count(STATS_SYSCALLS, 1);
+
 	if (xosfile_set_type(path, filetype) != NULL)
 		return false;
 #endif
@@ -333,14 +620,16 @@ bool files_set_filetype(char *path, uint32_t filetype)
  * If strict is applied, the directory must exist on disc for an
  * object to be returned. Othertwise, so long as there is not a
  * non-directory object in the location, a phantom object will
- * be returned.
+ * be returned; this has a filetype of OBJECTDB_TYPE_UNKNOWN, so
+ * that callers know that there is nothing on disc to be read.
  *
  * \param *path		Pointer to the directory path.
  * \param strict	Should the directory exist.
+ * \param *arena	Pointer to the arena to allocate the object from.
  * \return		Pointer to the information, or NULL.
  */
 
-struct files_object_info *files_read_directory_info(char *path, bool strict)
+struct files_object_info *files_read_directory_info(char *path, bool strict, struct arena *arena)
 {
 	struct files_object_info *info;
 	size_t length;
@@ -350,6 +639,7 @@ struct files_object_info *files_read_directory_info(char *path, bool strict)
 	struct stat stat_buffer;
 
 	result = stat(path, &stat_buffer);
+	stats_count(STATS_SYSCALLS, 1);
 
 	if (((result != 0) && strict) || ((result == 0) && !strict && !S_ISDIR(stat_buffer.st_mode))) {
 		if ((result == 0) && !S_ISDIR(stat_buffer.st_mode))
@@ -360,6 +650,8 @@ struct files_object_info *files_read_directory_info(char *path, bool strict)
 #ifdef RISCOS
 	fileswitch_object_type type;
 
+	stats_count(STATS_SYSCALLS, 1);
+
 	if (xosfile_read_no_path(path, &type, NULL, NULL, NULL, NULL) != NULL) {
 		msg_report(MSG_DIR_READ_FAIL);
 		return NULL;
@@ -374,11 +666,9 @@ struct files_object_info *files_read_directory_info(char *path, bool strict)
 
 	length = sizeof(struct files_object_info) + strlen(path) + 1;
 
-	info = malloc(length);
-	if (info == NULL) {
-		msg_report(MSG_NO_MEMORY);
+	info = arena_alloc(arena, length);
+	if (info == NULL)
 		return NULL;
-	}
 
 	/* Store the filenames. */
 
@@ -390,6 +680,15 @@ struct files_object_info *files_read_directory_info(char *path, bool strict)
 	info->filetype = OBJECTDB_TYPE_DIRECTORY;
 	info->next = NULL;
 
+#ifdef LINUX
+	if (result != 0)
+		info->filetype = OBJECTDB_TYPE_UNKNOWN;
+#endif
+#ifdef RISCOS
+	if (type == fileswitch_NOT_FOUND)
+		info->filetype = OBJECTDB_TYPE_UNKNOWN;
+#endif
+
 	files_convert_name_to_riscos(info->name);
 
 	return info;
@@ -404,6 +703,8 @@ struct files_object_info *files_read_directory_info(char *path, bool strict)
 
 bool files_make_directory(char *path)
 {
+	stats_count(STATS_SYSCALLS, 1);
+
 #ifdef LINUX
 	if (mkdir(path, 0775) != 0)
 		return false;
@@ -413,6 +714,8 @@ bool files_make_directory(char *path)
 		return false;
 #endif
 
+	stats_count(STATS_DIRS_CREATED, 1);
+
 	return true;
 }
 
@@ -425,6 +728,8 @@ bool files_make_directory(char *path)
 
 bool files_delete_directory(char *path)
 {
+	stats_count(STATS_SYSCALLS, 1);
+
 #ifdef LINUX
 	if (rmdir(path) != 0)
 		return false;
@@ -434,58 +739,1900 @@ bool files_delete_directory(char *path)
 		return false;
 #endif
 
+	stats_count(STATS_DIRS_DELETED, 1);
+
 	return true;
 }
 
 /**
- * Write a file to disc.
+ * Write a file to disc, directly from the supplied buffer. On Linux, the
+ * space for the file is allocated up front, and short writes are resumed
+ * until all of the data has been written; on RISC OS, the file is saved
+ * in a single operation.
  *
  * \param *path		Pointer to the required file path.
  * \param *data		Pointer to the data to be written.
  * \param length	The length of the data to be written.
+ * \param filetype	The RISC OS filetype to give the file.
+ * \param sync		True to flush the file to disc before returning.
  * \return		True if successful; False on failure.
  */
 
-bool files_write_file(char *path, char *data, size_t length)
+bool files_write_file(char *path, char *data, size_t length, uint32_t filetype, bool sync)
 {
-	FILE *file;
-	size_t to_write = length;
-	size_t written;
-
-	file = fopen(path, "w");
-	if (file == NULL)
-		return false;
-
-	while (to_write > 0) {
-		written = fwrite(data, sizeof(char), length, file);
-		if (written == 0)
-			break;
+	return files_write_contents(path, data, NULL, 0, length, filetype, sync);
+}
 
-		to_write -= written;
-	}
+/**
+ * Write a file to disc, copying the data from a block within a source
+ * file in chunks, so that only a small buffer is needed.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *source	Pointer to the source file holding the data.
+ * \param offset	The offset of the data within the source file.
+ * \param length	The length of the data to be written.
+ * \param filetype	The RISC OS filetype to give the file.
+ * \param sync		True to flush the file to disc before returning.
+ * \return		True if successful; False on failure.
+ */
 
-	fclose(file);
+bool files_write_file_from_source(char *path, struct files_source *source, size_t offset, size_t length, uint32_t filetype, bool sync)
+{
+	if (source == NULL)
+		return false;
 
-	return (to_write > 0) ? false : true;
+	return files_write_contents(path, NULL, source, offset, length, filetype, sync);
 }
 
 /**
- * Delete a file
+ * Write a file to disc, either directly from a buffer in memory or by
+ * copying it through a small buffer from a block within a source file.
  *
  * \param *path		Pointer to the required file path.
+ * \param *data		Pointer to the data to be written, or NULL to
+ *			copy it from the source file.
+ * \param *source	Pointer to the source file holding the data, if
+ *			it is not in memory.
+ * \param offset	The offset of the data within the source file.
+ * \param length	The length of the data to be written.
+ * \param filetype	The RISC OS filetype to give the file.
+ * \param sync		True to flush the file to disc before returning.
  * \return		True if successful; False on failure.
  */
 
-bool files_delete_file(char *path)
+static bool files_write_contents(char *path, char *data, struct files_source *source, size_t offset, size_t length, uint32_t filetype, bool sync)
 {
+	char *buffer = NULL;
+	size_t written = 0, block;
+	bool success = true;
 #ifdef LINUX
-	if (unlink(path) != 0)
-		return false;
+	int fd;
 #endif
 #ifdef RISCOS
-	if (xosfile_delete(path, NULL, NULL, NULL, NULL, NULL) != NULL)
+	os_fw handle;
+	int unwritten;
+#endif
+
+	if (path == NULL || (data == NULL && source == NULL && length > 0))
+		return false;
+
+	/* Data from a source file is copied through a buffer, a block at a time. */
+
+	if (data == NULL && length > 0) {
+		buffer = malloc(FILES_COMPARE_BLOCK_SIZE);
+		if (buffer == NULL) {
+			msg_report(MSG_NO_MEMORY);
+			return false;
+		}
+	}
+
+#ifdef LINUX
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	stats_count(STATS_SYSCALLS, 1);
+	if (fd == -1) {
+		free(buffer);
 		return false;
+	}
+
+	/* Not all filing systems can preallocate space, so failures are ignored. */
+
+	if (length > 0) {
+		fallocate(fd, 0, 0, length);
+		stats_count(STATS_SYSCALLS, 1);
+	}
+
+	if (data != NULL) {
+		success = files_write_block(fd, data, length);
+	} else {
+		while (success && written < length) {
+			block = length - written;
+			if (block > FILES_COMPARE_BLOCK_SIZE)
+				block = FILES_COMPARE_BLOCK_SIZE;
+
+			if (!files_read_source(source, offset + written, buffer, block) ||
+					!files_write_block(fd, buffer, block))
+				success = false;
+
+			written += block;
+		}
+	}
+
+	if (success && sync) {
+		stats_count(STATS_SYSCALLS, 1);
+		if (fsync(fd) != 0)
+			success = false;
+	}
+
+	stats_count(STATS_SYSCALLS, 1);
+
+	if (close(fd) != 0)
+		success = false;
+#endif
+#ifdef RISCOS
+	if (buffer == NULL) {
+		stats_count(STATS_SYSCALLS, 1);
+
+		if (xosfile_save_stamped(path, filetype, (byte *) data, (byte *) data + length) != NULL)
+			success = false;
+		else
+			stats_count(STATS_BYTES_WRITTEN, length);
+	} else {
+		stats_count(STATS_SYSCALLS, 1);
+
+		if (xosfind_openoutw(osfind_NO_PATH | osfind_ERROR_IF_DIR, path, NULL, &handle) != NULL || handle == 0) {
+			free(buffer);
+			return false;
+		}
+
+		while (success && written < length) {
+			block = length - written;
+			if (block > FILES_COMPARE_BLOCK_SIZE)
+				block = FILES_COMPARE_BLOCK_SIZE;
+
+			stats_count(STATS_SYSCALLS, 1);
+
+			if (!files_read_source(source, offset + written, buffer, block) ||
+					xosgbpb_writew(handle, (byte *) buffer, block, &unwritten) != NULL || unwritten != 0)
+				success = false;
+			else
+				stats_count(STATS_BYTES_WRITTEN, block);
+
+			written += block;
+		}
+
+		stats_count(STATS_SYSCALLS, 2);
+
+		if (xosfind_closew(handle) != NULL)
+			success = false;
+
+		if (success && xosfile_set_type(path, filetype) != NULL)
+			success = false;
+	}
 #endif
 
+	free(buffer);
+
+	if (success)
+		stats_count(STATS_FILES_WRITTEN, 1);
+
+	return success;
+}
+
+#ifdef LINUX
+/**
+ * Write a block of data to an open file, resuming any short writes until
+ * all of the data has been written.
+ *
+ * \param fd		The descriptor of the file to write to.
+ * \param *data		Pointer to the data to be written.
+ * \param length	The length of the data to be written.
+ * \return		True if successful; False on failure.
+ */
+
+static bool files_write_block(int fd, char *data, size_t length)
+{
+	size_t to_write = length;
+	ssize_t written;
+
+	while (to_write > 0) {
+		written = write(fd, data + (length - to_write), to_write);
+		stats_count(STATS_SYSCALLS, 1);
+
+		if (written < 0 && errno == EINTR)
+			continue;
+
+		if (written <= 0)
+			return false;
+
+		to_write -= written;
+		stats_count(STATS_BYTES_WRITTEN, written);
+	}
+
+	return true;
+}
+#endif
+
+/**
+ * Flush all of the files written to the filing system holding a folder
+ * out to disc.
+ *
+ * \param *path		Pointer to the path of the folder.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_sync_folder(char *path)
+{
+#ifdef LINUX
+	int fd;
+	bool success = true;
+
+	if (path == NULL)
+		return false;
+
+	fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+
+	if (syncfs(fd) != 0)
+		success = false;
+
+	close(fd);
+
+	stats_count(STATS_SYSCALLS, 3);
+
+	return success;
+#endif
+#ifdef RISCOS
+	/* Files are written out in full by OS_File, so there is nothing to do. */
+
+	return (path != NULL) ? true : false;
+#endif
+}
+
+/**
+ * Replace a file on disc, by writing the new contents to a temporary
+ * file alongside it and then renaming that over the original, so that
+ * the file is never left partially written. If the old file had a
+ * different name, it is deleted once the new file is in place.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *old_path	Pointer to the path of the file being replaced,
+ *			or NULL if it is the same as the required path.
+ * \param *data		Pointer to the data to be written.
+ * \param length	The length of the data to be written.
+ * \param filetype	The RISC OS filetype to give the new file.
+ * \param sync		True to flush the new file to disc before it
+ *			replaces the old one.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_replace_file(char *path, char *old_path, char *data, size_t length, uint32_t filetype, bool sync)
+{
+	return files_replace_contents(path, old_path, data, NULL, 0, length, filetype, sync);
+}
+
+/**
+ * Replace a file on disc in the same way as files_replace_file(), copying
+ * the new contents from a block within a source file.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *old_path	Pointer to the path of the file being replaced,
+ *			or NULL if it is the same as the required path.
+ * \param *source	Pointer to the source file holding the data.
+ * \param offset	The offset of the data within the source file.
+ * \param length	The length of the data to be written.
+ * \param filetype	The RISC OS filetype to give the new file.
+ * \param sync		True to flush the new file to disc before it
+ *			replaces the old one.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_replace_file_from_source(char *path, char *old_path, struct files_source *source, size_t offset, size_t length, uint32_t filetype, bool sync)
+{
+	if (source == NULL)
+		return false;
+
+	return files_replace_contents(path, old_path, NULL, source, offset, length, filetype, sync);
+}
+
+/**
+ * Replace a file on disc, by writing the new contents from memory or from
+ * a source file to a temporary file alongside it and then renaming that
+ * over the original.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *old_path	Pointer to the path of the file being replaced,
+ *			or NULL if it is the same as the required path.
+ * \param *data		Pointer to the data to be written, or NULL to
+ *			copy it from the source file.
+ * \param *source	Pointer to the source file holding the data, if
+ *			it is not in memory.
+ * \param offset	The offset of the data within the source file.
+ * \param length	The length of the data to be written.
+ * \param filetype	The RISC OS filetype to give the new file.
+ * \param sync		True to flush the new file to disc before it
+ *			replaces the old one.
+ * \return		True if successful; False on failure.
+ */
+
+static bool files_replace_contents(char *path, char *old_path, char *data, struct files_source *source, size_t offset, size_t length, uint32_t filetype, bool sync)
+{
+	char *temp_path;
+	size_t temp_length;
+	bool success = true;
+
+	if (path == NULL)
+		return false;
+
+	temp_length = strlen(path) + strlen(FILES_TEMP_SUFFIX) + 1;
+
+	temp_path = malloc(temp_length);
+	if (temp_path == NULL)
+		return false;
+
+	snprintf(temp_path, temp_length, "%s%s", path, FILES_TEMP_SUFFIX);
+
+	if (!files_write_contents(temp_path, data, source, offset, length, filetype, sync) ||
+			!files_rename_file(temp_path, path)) {
+		files_delete_file(temp_path);
+		success = false;
+	}
+
+	free(temp_path);
+
+	if (success && old_path != NULL && strcmp(old_path, path) != 0 && !files_delete_file(old_path))
+		success = false;
+
+	return success;
+}
+
+/**
+ * Rename a file on disc, replacing any existing file of the new name.
+ *
+ * On Linux, the replacement is atomic. On RISC OS, any existing file is
+ * renamed out of the way first, and only deleted once the new file is in
+ * place; if the rename fails, the existing file is put back.
+ *
+ * \param *old_path	Pointer to the current file path.
+ * \param *new_path	Pointer to the required file path.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_rename_file(char *old_path, char *new_path)
+{
+#ifdef RISCOS
+	fileswitch_object_type type;
+	char *aside_path;
+	size_t aside_length;
+	bool success = true;
+#endif
+
+	if (old_path == NULL || new_path == NULL)
+		return false;
+
+#ifdef LINUX
+	stats_count(STATS_SYSCALLS, 1);
+
+	if (rename(old_path, new_path) != 0)
+		return false;
+#endif
+#ifdef RISCOS
+	stats_count(STATS_SYSCALLS, 1);
+
+	if (xosfile_read_no_path(new_path, &type, NULL, NULL, NULL, NULL) != NULL)
+		return false;
+
+	if (type == fileswitch_NOT_FOUND) {
+		stats_count(STATS_SYSCALLS, 1);
+
+		return (xosfscontrol_rename(old_path, new_path) == NULL) ? true : false;
+	}
+
+	/* The filing system won't rename over an existing file, so it is
+	 * moved aside until the new file is in place.
+	 */
+
+	aside_length = strlen(new_path) + strlen(FILES_OLD_SUFFIX) + 1;
+
+	aside_path = malloc(aside_length);
+	if (aside_path == NULL)
+		return false;
+
+	snprintf(aside_path, aside_length, "%s%s", new_path, FILES_OLD_SUFFIX);
+
+	/* Clear away anything left behind by an earlier failure. */
+
+	xosfile_delete(aside_path, NULL, NULL, NULL, NULL, NULL);
+
+	stats_count(STATS_SYSCALLS, 3);
+
+	if (xosfscontrol_rename(new_path, aside_path) != NULL) {
+		success = false;
+	} else if (xosfscontrol_rename(old_path, new_path) != NULL) {
+		xosfscontrol_rename(aside_path, new_path);
+		stats_count(STATS_SYSCALLS, 1);
+		success = false;
+	} else {
+		xosfile_delete(aside_path, NULL, NULL, NULL, NULL, NULL);
+	}
+
+	free(aside_path);
+
+	if (!success)
+		return false;
+#endif
+
+	return true;
+}
+
+/**
+ * Read the catalogue information for a file on disc. On RISC OS, the
+ * modified time is the five-byte datestamp from the load and execution
+ * addresses, and there is no inode.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *stat		Pointer to a block to take the information.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_read_stat(char *path, struct files_stat *stat)
+{
+#ifdef LINUX
+	struct stat stat_buffer;
+
+	if (path == NULL || stat == NULL)
+		return false;
+
+	stats_count(STATS_SYSCALLS, 1);
+
+	if (lstat(path, &stat_buffer) != 0 || !S_ISREG(stat_buffer.st_mode))
+		return false;
+
+	stat->size = stat_buffer.st_size;
+	stat->modified = stat_buffer.st_mtim.tv_sec;
+	stat->modified_ns = stat_buffer.st_mtim.tv_nsec;
+	stat->inode = stat_buffer.st_ino;
+#endif
+#ifdef RISCOS
+	fileswitch_object_type type;
+	bits load, exec;
+	int size;
+
+	if (path == NULL || stat == NULL)
+		return false;
+
+	stats_count(STATS_SYSCALLS, 1);
+
+	if (xosfile_read_no_path(path, &type, &load, &exec, &size, NULL) != NULL || type != fileswitch_IS_FILE)
+		return false;
+
+	stat->size = size;
+	stat->modified = ((int64_t) (load & 0xff) << 32) | exec;
+	stat->modified_ns = 0;
+	stat->inode = 0;
+#endif
+
+	return true;
+}
+
+/**
+ * Open a file which is about to be compared, and let the filing system know
+ * that it will be read, so that it can start fetching the contents in the
+ * background. The handle is passed on to the comparison, or closed with
+ * files_close_handle() if it isn't needed. Failures aren't reported, as
+ * the file can still be opened by the comparison itself.
+ *
+ * On RISC OS there is no way to ask for readahead, so the file is only
+ * opened.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param length	The number of bytes which will be read.
+ * \param *handle	Pointer to a block to take the open file.
+ * \return		True if the file was opened; False on failure.
+ */
+
+bool files_prefetch_file(char *path, size_t length, struct files_handle *handle)
+{
+	if (path == NULL || handle == NULL)
+		return false;
+
+#ifdef LINUX
+	handle->fd = open(path, O_RDONLY);
+	stats_count(STATS_SYSCALLS, 1);
+	if (handle->fd == -1)
+		return false;
+
+	if (length > 0) {
+		posix_fadvise(handle->fd, 0, length, POSIX_FADV_WILLNEED);
+		stats_count(STATS_SYSCALLS, 1);
+	}
+#endif
+#ifdef RISCOS
+	handle->file = fopen(path, "rb");
+	stats_count(STATS_SYSCALLS, 1);
+	if (handle->file == NULL)
+		return false;
+#endif
+
+	return true;
+}
+
+/**
+ * Close a file opened by files_prefetch_file() which isn't going to be
+ * compared.
+ *
+ * \param *handle	Pointer to the file to close.
+ */
+
+void files_close_handle(struct files_handle *handle)
+{
+	if (handle == NULL)
+		return;
+
+#ifdef LINUX
+	close(handle->fd);
+#endif
+#ifdef RISCOS
+	fclose(handle->file);
+#endif
+
+	stats_count(STATS_SYSCALLS, 1);
+}
+
+/**
+ * Compare the contents of a file on disc with a block of data in memory.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *handle	Pointer to the file opened by files_prefetch_file(),
+ *			which will be closed, or NULL to open the path.
+ * \param *data		Pointer to the data to compare against.
+ * \param length	The length of the data to compare.
+ * \param *difference	Pointer to a variable to take the offset of the
+ *			first differing byte, or NULL if not required.
+ * \return		True if the contents are identical; False if they
+ *			differ or the file could not be read.
+ */
+
+bool files_compare_file(char *path, struct files_handle *handle, char *data, size_t length, size_t *difference)
+{
+	if (data == NULL) {
+		if (difference != NULL)
+			*difference = 0;
+
+		files_close_handle(handle);
+
+		return false;
+	}
+
+	return files_compare_contents(path, handle, data, NULL, 0, length, difference);
+}
+
+/**
+ * Compare the contents of a file on disc with a block within a source
+ * file, reading both in chunks.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *handle	Pointer to the file opened by files_prefetch_file(),
+ *			which will be closed, or NULL to open the path.
+ * \param *source	Pointer to the source file holding the data.
+ * \param offset	The offset of the data within the source file.
+ * \param length	The length of the data to compare.
+ * \param *difference	Pointer to a variable to take the offset of the
+ *			first differing byte, or NULL if not required.
+ * \return		True if the contents are identical; False if they
+ *			differ or either file could not be read.
+ */
+
+bool files_compare_file_with_source(char *path, struct files_handle *handle, struct files_source *source, size_t offset, size_t length, size_t *difference)
+{
+	if (source == NULL) {
+		if (difference != NULL)
+			*difference = 0;
+
+		files_close_handle(handle);
+
+		return false;
+	}
+
+	return files_compare_contents(path, handle, NULL, source, offset, length, difference);
+}
+
+/**
+ * Compare the contents of a file on disc with a block of data, which is
+ * either in memory or within a source file.
+ *
+ * The file is read in large blocks, each of which is checked in turn
+ * using memcmp(); the comparison stops at the first block which differs.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *handle	Pointer to the file opened by files_prefetch_file(),
+ *			which will be closed, or NULL to open the path.
+ * \param *data		Pointer to the data to compare against, or NULL
+ *			to read it from the source file.
+ * \param *source	Pointer to the source file holding the data, if
+ *			it is not in memory.
+ * \param base		The offset of the data within the source file.
+ * \param length	The length of the data to compare.
+ * \param *difference	Pointer to a variable to take the offset of the
+ *			first differing byte, or NULL if not required.
+ * \return		True if the contents are identical; False if they
+ *			differ or could not be read.
+ */
+
+static bool files_compare_contents(char *path, struct files_handle *handle, char *data, struct files_source *source, size_t base, size_t length, size_t *difference)
+{
+	char *buffer, *expected;
+	size_t offset = 0, block, read;
+	bool identical = true;
+#ifdef LINUX
+	int fd;
+	ssize_t result;
+#else
+	FILE *file;
+#endif
+
+	if (difference != NULL)
+		*difference = 0;
+
+	if (path == NULL || (data == NULL && source == NULL)) {
+		files_close_handle(handle);
+		return false;
+	}
+
+	/* Data from a source file needs a second buffer to be read into. */
+
+	buffer = malloc((data == NULL) ? 2 * FILES_COMPARE_BLOCK_SIZE : FILES_COMPARE_BLOCK_SIZE);
+	if (buffer == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		files_close_handle(handle);
+		return false;
+	}
+
+	stats_count(STATS_FILES_READ, 1);
+
+	/* A file which has already been opened is taken over. */
+
+#ifdef LINUX
+	if (handle != NULL) {
+		fd = handle->fd;
+	} else {
+		fd = open(path, O_RDONLY);
+		stats_count(STATS_SYSCALLS, 1);
+		if (fd == -1) {
+			msg_report(MSG_OPEN_FAILED, path);
+			free(buffer);
+			return false;
+		}
+	}
+
+	posix_fadvise(fd, 0, length, POSIX_FADV_SEQUENTIAL);
+	stats_count(STATS_SYSCALLS, 1);
+#else
+	if (handle != NULL) {
+		file = handle->file;
+	} else {
+		file = fopen(path, "rb");
+		stats_count(STATS_SYSCALLS, 1);
+		if (file == NULL) {
+			msg_report(MSG_OPEN_FAILED, path);
+			free(buffer);
+			return false;
+		}
+	}
+#endif
+
+	while (identical && offset < length) {
+		block = length - offset;
+		if (block > FILES_COMPARE_BLOCK_SIZE)
+			block = FILES_COMPARE_BLOCK_SIZE;
+
+		/* Fill the buffer, allowing for short reads. */
+
+		read = 0;
+
+		while (read < block) {
+#ifdef LINUX
+			result = pread(fd, buffer + read, block - read, offset + read);
+			stats_count(STATS_SYSCALLS, 1);
+			if (result <= 0)
+				break;
+
+			read += result;
+#else
+			size_t result = fread(buffer + read, sizeof(char), block - read, file);
+			stats_count(STATS_SYSCALLS, 1);
+			if (result == 0)
+				break;
+
+			read += result;
+#endif
+		}
+
+		stats_count(STATS_BYTES_READ, read);
+
+		if (data != NULL) {
+			expected = data + offset;
+		} else {
+			expected = buffer + FILES_COMPARE_BLOCK_SIZE;
+
+			if (!files_read_source(source, base + offset, expected, read)) {
+				identical = false;
+				break;
+			}
+		}
+
+		/* Check the block; if the file was short, it can't match. */
+
+		if (memcmp(buffer, expected, read) != 0) {
+			offset += files_find_difference(buffer, expected, read);
+			identical = false;
+		} else if (read < block) {
+			offset += read;
+			identical = false;
+		} else {
+			offset += block;
+		}
+	}
+
+#ifdef LINUX
+	close(fd);
+#else
+	fclose(file);
+#endif
+
+	stats_count(STATS_SYSCALLS, 1);
+
+	free(buffer);
+
+	if (difference != NULL)
+		*difference = offset;
+
+	return identical;
+}
+
+/**
+ * Locate the first differing byte between two blocks of memory which
+ * are known to differ.
+ *
+ * \param *a		Pointer to the first block.
+ * \param *b		Pointer to the second block.
+ * \param length	The length of the two blocks.
+ * \return		The offset of the first differing byte.
+ */
+
+static size_t files_find_difference(char *a, char *b, size_t length)
+{
+	size_t offset = 0, chunk;
+
+	/* Skip over the matching chunks, then locate the byte. */
+
+	while (offset < length) {
+		chunk = length - offset;
+		if (chunk > FILES_COMPARE_CHUNK_SIZE)
+			chunk = FILES_COMPARE_CHUNK_SIZE;
+
+		if (memcmp(a + offset, b + offset, chunk) != 0)
+			break;
+
+		offset += chunk;
+	}
+
+	while (offset < length && a[offset] == b[offset])
+		offset++;
+
+	return offset;
+}
+
+#ifndef READER_ONLY
+/**
+ * Compare the contents of a batch of files on disc with blocks of data in
+ * memory. Where io_uring is available, the files are opened, read and
+ * closed with many operations in flight at once; otherwise, they are
+ * compared one at a time with files_compare_file(). Files whose data is
+ * held in a source file are always compared individually.
+ *
+ * \param *items	Pointer to the array of files to compare; the success
+ *			flag of each is set if its contents are identical.
+ * \param count		The number of files in the array.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_compare_batch(struct files_batch_item *items, size_t count)
+{
+	size_t i;
+#ifdef LINUX
+	struct files_batch_state *state = NULL;
+	struct uring *ring;
+	char *buffers = NULL, *buffer;
+	size_t start, n, block;
+	uint64_t index;
+	int result;
+
+	ring = (count > 1) ? uring_create(FILES_BATCH_SIZE) : NULL;
+
+	if (ring != NULL) {
+		state = malloc(FILES_BATCH_SIZE * sizeof(struct files_batch_state));
+		buffers = malloc(FILES_BATCH_SIZE * FILES_COMPARE_BLOCK_SIZE);
+	}
+
+	if (ring != NULL && state != NULL && buffers != NULL) {
+		for (start = 0; start < count; start += n) {
+			n = count - start;
+			if (n > FILES_BATCH_SIZE)
+				n = FILES_BATCH_SIZE;
+
+			files_batch_open(ring, items + start, state, n, O_RDONLY | O_CLOEXEC, 0);
+
+			/* Empty files match as soon as they are open. */
+
+			for (i = 0; i < n; i++) {
+				if (state[i].active)
+					stats_count(STATS_FILES_READ, 1);
+
+				if (state[i].active && items[start + i].length == 0) {
+					items[start + i].success = true;
+					state[i].active = false;
+				}
+			}
+
+			/* Read each file in blocks, until all have been resolved. */
+
+			while (files_batch_active(state, n)) {
+				for (i = 0; i < n; i++) {
+					if (!state[i].active)
+						continue;
+
+					block = items[start + i].length - state[i].offset;
+					if (block > FILES_COMPARE_BLOCK_SIZE)
+						block = FILES_COMPARE_BLOCK_SIZE;
+
+					uring_queue_read(ring, state[i].fd, buffers + (i * FILES_COMPARE_BLOCK_SIZE), block, state[i].offset, i);
+				}
+
+				if (!uring_submit_and_wait(ring)) {
+					for (i = 0; i < n; i++)
+						state[i].active = false;
+					break;
+				}
+
+				while (uring_next_completion(ring, &index, &result)) {
+					buffer = buffers + (index * FILES_COMPARE_BLOCK_SIZE);
+					i = start + index;
+
+					if (result > 0)
+						stats_count(STATS_BYTES_READ, result);
+
+					/* A short file can't match. */
+
+					if (result <= 0) {
+						items[i].difference = state[index].offset;
+						state[index].active = false;
+					} else if (memcmp(buffer, items[i].data + state[index].offset, result) != 0) {
+						items[i].difference = state[index].offset + files_find_difference(buffer, items[i].data + state[index].offset, result);
+						state[index].active = false;
+					} else {
+						state[index].offset += result;
+
+						if (state[index].offset >= items[i].length) {
+							items[i].difference = state[index].offset;
+							items[i].success = true;
+							state[index].active = false;
+						}
+					}
+				}
+			}
+
+			files_batch_close(ring, items + start, state, n);
+
+			for (i = 0; i < n; i++) {
+				if (state[i].fallback)
+					items[start + i].success = files_compare_contents(items[start + i].path, NULL, items[start + i].data,
+							items[start + i].source, items[start + i].offset, items[start + i].length,
+							&(items[start + i].difference));
+			}
+		}
+
+		free(buffers);
+		free(state);
+		uring_destroy(ring);
+
+		return true;
+	}
+
+	free(buffers);
+	free(state);
+	uring_destroy(ring);
+#endif
+
+	for (i = 0; i < count; i++)
+		items[i].success = files_compare_contents(items[i].path, NULL, items[i].data, items[i].source, items[i].offset,
+				items[i].length, &(items[i].difference));
+
+	return true;
+}
+
+/**
+ * Write a batch of files to disc. Where io_uring is available, the files
+ * are opened, written and closed with many operations in flight at once;
+ * otherwise, they are written one at a time with files_write_file(). Files
+ * whose data is held in a source file are always written individually.
+ *
+ * \param *items	Pointer to the array of files to write; the success
+ *			flag of each is set if it was written.
+ * \param count		The number of files in the array.
+ * \param sync		True to flush each file to disc before closing it.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_write_batch(struct files_batch_item *items, size_t count, bool sync)
+{
+	size_t i;
+#ifdef LINUX
+	struct files_batch_state *state = NULL;
+	struct uring *ring;
+	size_t start, n, block;
+	uint64_t index;
+	int result;
+
+	ring = (count > 1) ? uring_create(FILES_BATCH_SIZE) : NULL;
+
+	if (ring != NULL)
+		state = malloc(FILES_BATCH_SIZE * sizeof(struct files_batch_state));
+
+	if (ring != NULL && state != NULL) {
+		for (start = 0; start < count; start += n) {
+			n = count - start;
+			if (n > FILES_BATCH_SIZE)
+				n = FILES_BATCH_SIZE;
+
+			files_batch_open(ring, items + start, state, n, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+			for (i = 0; i < n; i++) {
+				if (state[i].active && items[start + i].length == 0) {
+					items[start + i].success = true;
+					state[i].active = false;
+				}
+			}
+
+			/* Write the files out, resuming any short writes. */
+
+			while (files_batch_active(state, n)) {
+				for (i = 0; i < n; i++) {
+					if (!state[i].active)
+						continue;
+
+					block = items[start + i].length - state[i].offset;
+					if (block > FILES_BATCH_WRITE_SIZE)
+						block = FILES_BATCH_WRITE_SIZE;
+
+					uring_queue_write(ring, state[i].fd, items[start + i].data + state[i].offset, block, state[i].offset, i);
+				}
+
+				if (!uring_submit_and_wait(ring)) {
+					for (i = 0; i < n; i++)
+						state[i].active = false;
+					break;
+				}
+
+				while (uring_next_completion(ring, &index, &result)) {
+					i = start + index;
+
+					if (result <= 0) {
+						state[index].active = false;
+					} else {
+						state[index].offset += result;
+						stats_count(STATS_BYTES_WRITTEN, result);
+
+						if (state[index].offset >= items[i].length) {
+							items[i].success = true;
+							state[index].active = false;
+						}
+					}
+				}
+			}
+
+			/* Flush the files which were written, if required. */
+
+			if (sync) {
+				for (i = 0; i < n; i++) {
+					if (items[start + i].success)
+						uring_queue_fsync(ring, state[i].fd, i);
+				}
+
+				if (uring_submit_and_wait(ring)) {
+					while (uring_next_completion(ring, &index, &result)) {
+						if (result < 0)
+							items[start + index].success = false;
+					}
+				} else {
+					for (i = 0; i < n; i++)
+						items[start + i].success = false;
+				}
+			}
+
+			files_batch_close(ring, items + start, state, n);
+
+			for (i = 0; i < n; i++) {
+				if (state[i].fallback)
+					items[start + i].success = files_write_contents(items[start + i].path, items[start + i].data,
+							items[start + i].source, items[start + i].offset, items[start + i].length,
+							items[start + i].filetype, sync);
+				else if (items[start + i].success)
+					stats_count(STATS_FILES_WRITTEN, 1);
+			}
+		}
+
+		free(state);
+		uring_destroy(ring);
+
+		return true;
+	}
+
+	free(state);
+	uring_destroy(ring);
+#endif
+
+	for (i = 0; i < count; i++)
+		items[i].success = files_write_contents(items[i].path, items[i].data, items[i].source, items[i].offset,
+				items[i].length, items[i].filetype, sync);
+
+	return true;
+}
+
+/**
+ * Delete a batch of files from disc. Where io_uring is available, the
+ * deletions are carried out with many operations in flight at once;
+ * otherwise they are done one at a time with files_delete_file().
+ *
+ * \param *items	Pointer to the array of files to delete; the success
+ *			flag of each is set if it was deleted.
+ * \param count		The number of files in the array.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_delete_batch(struct files_batch_item *items, size_t count)
+{
+	size_t i;
+#ifdef LINUX
+	struct uring *ring;
+	size_t start, n;
+	uint64_t index;
+	int result;
+
+	ring = (count > 1) ? uring_create(FILES_BATCH_SIZE) : NULL;
+
+	if (ring != NULL) {
+		for (start = 0; start < count; start += n) {
+			n = count - start;
+			if (n > FILES_BATCH_SIZE)
+				n = FILES_BATCH_SIZE;
+
+			for (i = 0; i < n; i++) {
+				items[start + i].success = false;
+				uring_queue_unlink(ring, items[start + i].path, start + i);
+			}
+
+			if (!uring_submit_and_wait(ring))
+				break;
+
+			/* Older kernels can't unlink through io_uring, so fall back. */
+
+			while (uring_next_completion(ring, &index, &result)) {
+				if (result == -EINVAL || result == -EOPNOTSUPP)
+					items[index].success = files_delete_file(items[index].path);
+				else if (result == 0)
+					items[index].success = true;
+
+				if (items[index].success)
+					stats_count(STATS_FILES_DELETED, 1);
+			}
+		}
+
+		uring_destroy(ring);
+
+		if (start >= count)
+			return true;
+
+		count -= start;
+		items += start;
+	}
+#endif
+
+	for (i = 0; i < count; i++)
+		items[i].success = files_delete_file(items[i].path);
+
+	return true;
+}
+
+#ifdef LINUX
+/**
+ * Open a batch of files through io_uring, recording the descriptors in
+ * the batch state. Any files which the kernel can't open through io_uring
+ * are marked to fall back to the standard calls.
+ *
+ * \param *ring		Pointer to the io_uring instance to use.
+ * \param *items	Pointer to the array of files to open.
+ * \param *state	Pointer to the array of states to update.
+ * \param count		The number of files in the arrays.
+ * \param flags		The flags to open the files with.
+ * \param mode		The mode to create any new files with.
+ */
+
+static void files_batch_open(struct uring *ring, struct files_batch_item *items, struct files_batch_state *state, size_t count, int flags, unsigned mode)
+{
+	uint64_t index;
+	int result;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		items[i].success = false;
+		items[i].difference = 0;
+
+		state[i].fd = -1;
+		state[i].offset = 0;
+		state[i].active = false;
+		state[i].fallback = false;
+
+		if (items[i].path == NULL || (items[i].data == NULL && items[i].length > 0)) {
+			/* Data held in a source file is copied by the standard calls. */
+
+			if (items[i].path != NULL && items[i].source != NULL)
+				state[i].fallback = true;
+
+			continue;
+		}
+
+		uring_queue_open(ring, items[i].path, flags, mode, i);
+	}
+
+	if (!uring_submit_and_wait(ring)) {
+		for (i = 0; i < count; i++)
+			state[i].fallback = true;
+		return;
+	}
+
+	while (uring_next_completion(ring, &index, &result)) {
+		if (result >= 0) {
+			state[index].fd = result;
+			state[index].active = true;
+		} else if (result == -EINVAL || result == -EOPNOTSUPP) {
+			state[index].fallback = true;
+		} else {
+			msg_report(MSG_OPEN_FAILED, items[index].path);
+		}
+	}
+}
+
+/**
+ * Close a batch of files which were opened through io_uring. Any files
+ * which fail to close are marked as having failed.
+ *
+ * \param *ring		Pointer to the io_uring instance to use.
+ * \param *items	Pointer to the array of files to close.
+ * \param *state	Pointer to the array of states holding the descriptors.
+ * \param count		The number of files in the arrays.
+ */
+
+static void files_batch_close(struct uring *ring, struct files_batch_item *items, struct files_batch_state *state, size_t count)
+{
+	uint64_t index;
+	int result;
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (state[i].fd != -1)
+			uring_queue_close(ring, state[i].fd, i);
+	}
+
+	if (!uring_submit_and_wait(ring)) {
+		for (i = 0; i < count; i++) {
+			if (state[i].fd != -1)
+				close(state[i].fd);
+		}
+		return;
+	}
+
+	while (uring_next_completion(ring, &index, &result)) {
+		if (result < 0)
+			items[index].success = false;
+
+		state[index].fd = -1;
+	}
+}
+
+/**
+ * Test whether any of the files in a batch still have operations to
+ * be carried out.
+ *
+ * \param *state	Pointer to the array of states to test.
+ * \param count		The number of files in the array.
+ * \return		True if any files are still active; otherwise False.
+ */
+
+static bool files_batch_active(struct files_batch_state *state, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (state[i].active)
+			return true;
+	}
+
+	return false;
+}
+#endif
+
+#endif
+
+/**
+ * Calculate the CRC32C hash of the contents of a file on disc, reading
+ * it in large blocks.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *hash		Pointer to a variable to take the hash.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_hash_file(char *path, uint32_t *hash)
+{
+	char *buffer;
+	uint32_t crc = HASH_CRC32C_INITIAL;
+	bool success = true;
+#ifdef LINUX
+	int fd;
+	ssize_t result;
+#else
+	FILE *file;
+	size_t result;
+#endif
+
+	if (path == NULL || hash == NULL)
+		return false;
+
+	buffer = malloc(FILES_COMPARE_BLOCK_SIZE);
+	if (buffer == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	stats_count(STATS_FILES_READ, 1);
+
+#ifdef LINUX
+	fd = open(path, O_RDONLY);
+	stats_count(STATS_SYSCALLS, 1);
+	if (fd == -1) {
+		msg_report(MSG_OPEN_FAILED, path);
+		free(buffer);
+		return false;
+	}
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	/* The advice, the final read which finds the end, and the close. */
+
+	stats_count(STATS_SYSCALLS, 3);
+
+	while ((result = read(fd, buffer, FILES_COMPARE_BLOCK_SIZE)) > 0) {
+		crc = hash_crc32c(crc, buffer, result);
+		stats_count(STATS_BYTES_READ, result);
+		stats_count(STATS_SYSCALLS, 1);
+	}
+
+	if (result < 0)
+		success = false;
+
+	close(fd);
+#else
+	file = fopen(path, "rb");
+	stats_count(STATS_SYSCALLS, 1);
+	if (file == NULL) {
+		msg_report(MSG_OPEN_FAILED, path);
+		free(buffer);
+		return false;
+	}
+
+	stats_count(STATS_SYSCALLS, 2);
+
+	while ((result = fread(buffer, sizeof(char), FILES_COMPARE_BLOCK_SIZE, file)) > 0) {
+		crc = hash_crc32c(crc, buffer, result);
+		stats_count(STATS_BYTES_READ, result);
+		stats_count(STATS_SYSCALLS, 1);
+	}
+
+	if (ferror(file))
+		success = false;
+
+	fclose(file);
+#endif
+
+	free(buffer);
+
+	if (success)
+		*hash = crc;
+
+	return success;
+}
+
+/**
+ * Open a file on disc for positioned reads with files_read_source().
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *source	Pointer to a block to take the file details.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_open_source(char *path, struct files_source *source)
+{
+	return files_open_source_file(path, source, false);
+}
+
+/**
+ * Open a file on disc for positioned reads with files_read_source() and
+ * writes with files_write_source(), so that it can be updated in place.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *source	Pointer to a block to take the file details.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_open_source_for_update(char *path, struct files_source *source)
+{
+	return files_open_source_file(path, source, true);
+}
+
+/**
+ * Open a file on disc as a source, for reading or for update.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *source	Pointer to a block to take the file details.
+ * \param update	True to open the file for update; False to open
+ *			it for reading only.
+ * \return		True if successful; False on failure.
+ */
+
+static bool files_open_source_file(char *path, struct files_source *source, bool update)
+{
+#ifdef LINUX
+	struct stat stat_buffer;
+#endif
+#ifdef RISCOS
+	int extent;
+#endif
+
+	if (path == NULL || source == NULL)
+		return false;
+
+	source->length = 0;
+
+#ifdef LINUX
+	/* The open and the stat. */
+
+	stats_count(STATS_SYSCALLS, 2);
+
+	source->fd = open(path, ((update) ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+	if (source->fd == -1) {
+		msg_report(MSG_OPEN_FAILED, path);
+		return false;
+	}
+
+	if (fstat(source->fd, &stat_buffer) != 0 || !S_ISREG(stat_buffer.st_mode)) {
+		files_close_source(source);
+		msg_report(MSG_LOAD_FAILED, path);
+		return false;
+	}
+
+	source->length = stat_buffer.st_size;
+#endif
+#ifdef RISCOS
+	stats_count(STATS_SYSCALLS, 2);
+
+	if (((update) ? xosfind_openupw(osfind_NO_PATH | osfind_ERROR_IF_ABSENT | osfind_ERROR_IF_DIR, path, NULL, &(source->handle)) :
+			xosfind_openinw(osfind_NO_PATH | osfind_ERROR_IF_ABSENT | osfind_ERROR_IF_DIR, path, NULL, &(source->handle))) != NULL ||
+			source->handle == 0) {
+		source->handle = 0;
+		msg_report(MSG_OPEN_FAILED, path);
+		return false;
+	}
+
+	if (xosargs_read_extw(source->handle, &extent) != NULL) {
+		files_close_source(source);
+		msg_report(MSG_LOAD_FAILED, path);
+		return false;
+	}
+
+	source->length = extent;
+#endif
+
+	return true;
+}
+
+/**
+ * Close a file previously opened with files_open_source().
+ *
+ * \param *source	Pointer to the file details to be released.
+ */
+
+void files_close_source(struct files_source *source)
+{
+	if (source == NULL)
+		return;
+
+#ifdef LINUX
+	if (source->fd != -1) {
+		close(source->fd);
+		stats_count(STATS_SYSCALLS, 1);
+	}
+
+	source->fd = -1;
+#endif
+#ifdef RISCOS
+	if (source->handle != 0) {
+		xosfind_closew(source->handle);
+		stats_count(STATS_SYSCALLS, 1);
+	}
+
+	source->handle = 0;
+#endif
+
+	source->length = 0;
+}
+
+/**
+ * Read a block of data from a source file. The read may be carried out
+ * by several threads at once on Linux.
+ *
+ * \param *source	Pointer to the source file to read from.
+ * \param offset	The offset of the block within the file.
+ * \param *buffer	Pointer to a buffer to take the data.
+ * \param length	The length of the block to read.
+ * \return		True if the whole block was read; False on failure.
+ */
+
+bool files_read_source(struct files_source *source, size_t offset, void *buffer, size_t length)
+{
+	size_t read = 0;
+#ifdef LINUX
+	ssize_t result;
+#endif
+#ifdef RISCOS
+	int unread;
+#endif
+
+	if (source == NULL || buffer == NULL)
+		return false;
+
+	if (offset > source->length || length > source->length - offset) {
+		msg_report(MSG_SOURCE_READ_FAILED, (int) length, (int) offset);
+		return false;
+	}
+
+#ifdef LINUX
+	while (read < length) {
+		result = pread(source->fd, (char *) buffer + read, length - read, offset + read);
+		stats_count(STATS_SYSCALLS, 1);
+
+		if (result < 0 && errno == EINTR)
+			continue;
+
+		if (result <= 0)
+			break;
+
+		read += result;
+	}
+#endif
+#ifdef RISCOS
+	stats_count(STATS_SYSCALLS, 1);
+
+	if (length > 0 && xosgbpb_read_atw(source->handle, (byte *) buffer, length, offset, &unread) == NULL)
+		read = length - unread;
+#endif
+
+	stats_count(STATS_BYTES_LOADED, read);
+
+	if (read < length) {
+		msg_report(MSG_SOURCE_READ_FAILED, (int) length, (int) offset);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Write a block of data to a source file which has been opened for update,
+ * extending the file if the block runs past its end.
+ *
+ * \param *source	Pointer to the source file to write to.
+ * \param offset	The offset of the block within the file.
+ * \param *buffer	Pointer to the data to be written.
+ * \param length	The length of the block to write.
+ * \return		True if the whole block was written; False on failure.
+ */
+
+bool files_write_source(struct files_source *source, size_t offset, void *buffer, size_t length)
+{
+	size_t written = 0;
+#ifdef LINUX
+	ssize_t result;
+#endif
+#ifdef RISCOS
+	int unwritten;
+#endif
+
+	if (source == NULL || buffer == NULL)
+		return false;
+
+#ifdef LINUX
+	while (written < length) {
+		result = pwrite(source->fd, (char *) buffer + written, length - written, offset + written);
+		stats_count(STATS_SYSCALLS, 1);
+
+		if (result < 0 && errno == EINTR)
+			continue;
+
+		if (result <= 0)
+			break;
+
+		written += result;
+	}
+#endif
+#ifdef RISCOS
+	stats_count(STATS_SYSCALLS, 1);
+
+	if (length > 0 && xosgbpb_write_atw(source->handle, (byte *) buffer, length, offset, &unwritten) == NULL)
+		written = length - unwritten;
+#endif
+
+	stats_count(STATS_BYTES_WRITTEN, written);
+
+	if (written < length) {
+		msg_report(MSG_SOURCE_WRITE_FAILED, (int) length, (int) offset);
+		return false;
+	}
+
+	if (offset + length > source->length)
+		source->length = offset + length;
+
+	return true;
+}
+
+/**
+ * Set the length of a source file which has been opened for update,
+ * discarding anything beyond the new end.
+ *
+ * \param *source	Pointer to the source file to update.
+ * \param length	The new length of the file.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_truncate_source(struct files_source *source, size_t length)
+{
+	bool success;
+
+	if (source == NULL)
+		return false;
+
+	stats_count(STATS_SYSCALLS, 1);
+
+#ifdef LINUX
+	success = (ftruncate(source->fd, length) == 0) ? true : false;
+#endif
+#ifdef RISCOS
+	success = (xosargs_set_extw(source->handle, length) == NULL) ? true : false;
+#endif
+
+	if (!success) {
+		msg_report(MSG_SOURCE_WRITE_FAILED, 0, (int) length);
+		return false;
+	}
+
+	source->length = length;
+
+	return true;
+}
+
+/**
+ * Flush the contents of a source file which has been opened for update
+ * out to disc.
+ *
+ * \param *source	Pointer to the source file to flush.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_sync_source(struct files_source *source)
+{
+	if (source == NULL)
+		return false;
+
+	stats_count(STATS_SYSCALLS, 1);
+
+#ifdef LINUX
+	if (fsync(source->fd) != 0)
+		return false;
+#endif
+#ifdef RISCOS
+	if (xosargs_ensurew(source->handle) != NULL)
+		return false;
+#endif
+
+	return true;
+}
+
+/**
+ * Calculate the CRC32C hash of a block within a source file, reading it
+ * in chunks.
+ *
+ * \param *source	Pointer to the source file to read from.
+ * \param offset	The offset of the block within the file.
+ * \param length	The length of the block.
+ * \param *hash		Pointer to a variable to take the hash.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_hash_source(struct files_source *source, size_t offset, size_t length, uint32_t *hash)
+{
+	char *buffer;
+	uint32_t crc = HASH_CRC32C_INITIAL;
+	size_t done = 0, block;
+	bool success = true;
+
+	if (source == NULL || hash == NULL)
+		return false;
+
+	buffer = malloc(FILES_COMPARE_BLOCK_SIZE);
+	if (buffer == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	while (success && done < length) {
+		block = length - done;
+		if (block > FILES_COMPARE_BLOCK_SIZE)
+			block = FILES_COMPARE_BLOCK_SIZE;
+
+		if (files_read_source(source, offset + done, buffer, block))
+			crc = hash_crc32c(crc, buffer, block);
+		else
+			success = false;
+
+		done += block;
+	}
+
+	free(buffer);
+
+	if (success)
+		*hash = crc;
+
+	return success;
+}
+
+/**
+ * Compare the contents of two blocks within a source file, reading them
+ * in chunks.
+ *
+ * \param *source	Pointer to the source file to read from.
+ * \param first		The offset of the first block within the file.
+ * \param second	The offset of the second block within the file.
+ * \param length	The length of the two blocks.
+ * \return		True if the blocks are identical; False if they
+ *			differ or could not be read.
+ */
+
+bool files_compare_source_blocks(struct files_source *source, size_t first, size_t second, size_t length)
+{
+	char *buffer;
+	size_t done = 0, block;
+	bool identical = true;
+
+	if (source == NULL)
+		return false;
+
+	if (first == second)
+		return true;
+
+	buffer = malloc(2 * FILES_COMPARE_BLOCK_SIZE);
+	if (buffer == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	while (identical && done < length) {
+		block = length - done;
+		if (block > FILES_COMPARE_BLOCK_SIZE)
+			block = FILES_COMPARE_BLOCK_SIZE;
+
+		if (!files_read_source(source, first + done, buffer, block) ||
+				!files_read_source(source, second + done, buffer + FILES_COMPARE_BLOCK_SIZE, block) ||
+				memcmp(buffer, buffer + FILES_COMPARE_BLOCK_SIZE, block) != 0)
+			identical = false;
+
+		done += block;
+	}
+
+	free(buffer);
+
+	return identical;
+}
+
+/**
+ * Load the contents of a file into memory for read-only access. Where
+ * the platform allows, the file is memory mapped so that only those
+ * parts of it which are accessed need to be read from disc; otherwise
+ * it is read into a buffer in a single operation.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *mapping	Pointer to a block to take the file details.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_map_file(char *path, struct files_mapping *mapping)
+{
+#ifdef LINUX
+	int fd;
+	struct stat stat_buffer;
+	void *data;
+#endif
+
+	if (path == NULL || mapping == NULL)
+		return false;
+
+	mapping->data = NULL;
+	mapping->length = 0;
+	mapping->mapped = false;
+
+#ifdef LINUX
+	/* The open, the stat and the close. */
+
+	stats_count(STATS_SYSCALLS, 3);
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		msg_report(MSG_OPEN_FAILED, path);
+		return false;
+	}
+
+	if (fstat(fd, &stat_buffer) != 0 || !S_ISREG(stat_buffer.st_mode)) {
+		close(fd);
+		msg_report(MSG_LOAD_FAILED, path);
+		return false;
+	}
+
+	/* A zero-length file can't be mapped; let the buffered load handle it. */
+
+	if (stat_buffer.st_size > 0) {
+		data = mmap(NULL, stat_buffer.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		stats_count(STATS_SYSCALLS, 1);
+
+		if (data != MAP_FAILED) {
+			close(fd);
+
+			stats_count(STATS_BYTES_MAPPED, stat_buffer.st_size);
+
+			mapping->data = data;
+			mapping->length = stat_buffer.st_size;
+			mapping->mapped = true;
+
+			msg_report(MSG_FILE_MAPPED);
+
+			return true;
+		}
+	}
+
+	close(fd);
+#endif
+
+	return files_load_file(path, mapping);
+}
+
+/**
+ * Load the contents of a file into a buffer allocated with malloc(), so
+ * that they are held privately and can't change or disappear if the file
+ * is rewritten while they are in use.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *mapping	Pointer to a block to take the file details.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_load_file(char *path, struct files_mapping *mapping)
+{
+	FILE *in;
+	long length;
+
+	if (path == NULL || mapping == NULL)
+		return false;
+
+	mapping->data = NULL;
+	mapping->length = 0;
+	mapping->mapped = false;
+
+	in = fopen(path, "rb");
+	if (in == NULL) {
+		msg_report(MSG_OPEN_FAILED, path);
+		return false;
+	}
+
+	/* Get the size of the file. */
+
+	fseek(in, 0, SEEK_END);
+	length = ftell(in);
+	fseek(in, 0, SEEK_SET);
+
+	/* Load the file into a memory buffer. */
+
+	if (length >= 0)
+		mapping->data = malloc((length > 0) ? length : 1);
+
+	if ((mapping->data != NULL) && (fread(mapping->data, sizeof(char), length, in) != length)) {
+		free(mapping->data);
+		mapping->data = NULL;
+	}
+
+	fclose(in);
+
+	if (mapping->data == NULL) {
+		msg_report(MSG_LOAD_FAILED, path);
+		return false;
+	}
+
+	mapping->length = length;
+	mapping->mapped = false;
+
+	/* The open, the seeks, the read and the close. */
+
+	stats_count(STATS_SYSCALLS, 6);
+	stats_count(STATS_BYTES_LOADED, length);
+
+	return true;
+}
+
+/**
+ * Release a file previously loaded into memory by files_map_file() or
+ * files_load_file().
+ *
+ * \param *mapping	Pointer to the file details to be released.
+ */
+
+void files_unmap_file(struct files_mapping *mapping)
+{
+	if (mapping == NULL || mapping->data == NULL)
+		return;
+
+#ifdef LINUX
+	if (mapping->mapped) {
+		munmap(mapping->data, mapping->length);
+		stats_count(STATS_SYSCALLS, 1);
+	} else
+		free(mapping->data);
+#else
+	free(mapping->data);
+#endif
+
+	mapping->data = NULL;
+	mapping->length = 0;
+	mapping->mapped = false;
+}
+
+/**
+ * Delete a file
+ *
+ * \param *path		Pointer to the required file path.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_delete_file(char *path)
+{
+	stats_count(STATS_SYSCALLS, 1);
+
+#ifdef LINUX
+	if (unlink(path) != 0)
+		return false;
+#endif
+#ifdef RISCOS
+	if (xosfile_delete(path, NULL, NULL, NULL, NULL, NULL) != NULL)
+		return false;
+#endif
+
+	stats_count(STATS_FILES_DELETED, 1);
+
 	return true;
 }
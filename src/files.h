@@ -32,8 +32,15 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+#ifdef RISCOS
+#include "oslib/os.h"
+#endif
+
+#include "arena.h"
+
 /**
  * The default file type applied when not otherwise specified.
  */
@@ -46,6 +53,30 @@
 
 #define FILES_TYPE_OMIT (0xffffffffu)
 
+/**
+ * The suffix added to a filename when writing replacement contents
+ * which are to be swapped into place once complete.
+ */
+
+#define FILES_TEMP_SUFFIX "~new"
+
+/**
+ * The suffix added to a filename when moving an existing file out of the
+ * way of its replacement, on systems which can't rename over it.
+ */
+
+#define FILES_OLD_SUFFIX "~old"
+
+/**
+ * The policies for making sure that the files written reach the disc.
+ */
+
+enum files_sync {
+	FILES_SYNC_NONE,		/**< Leave the data to be written back by the system.	*/
+	FILES_SYNC_FILE,		/**< Flush each file to disc as it is written.		*/
+	FILES_SYNC_END			/**< Flush the whole filing system once complete.	*/
+};
+
 #ifdef LINUX
 #define FILES_PATH_SEPARATOR "/"
 #endif
@@ -67,35 +98,142 @@ struct files_object_info {
 };
 
 /**
- * Read the contents of a directory, returning a linked list of objects.
+ * A directory on disc which is open for reading.
+ */
+
+struct files_directory {
+#ifdef LINUX
+	int				fd;		/**< The descriptor of the open directory.	*/
+#endif
+#ifdef RISCOS
+	char				*path;		/**< The full path to the directory.		*/
+#endif
+};
+
+/**
+ * The catalogue information used to spot changes to a file on disc.
+ */
+
+struct files_stat {
+	size_t				size;		/**< The size of the file in bytes.		*/
+	int64_t				modified;	/**< The time that the file was last modified.	*/
+	int32_t				modified_ns;	/**< The nanoseconds part of the modified time.	*/
+	uint64_t			inode;		/**< The inode of the file, or zero.		*/
+};
+
+/**
+ * A file on disc which is open for positioned reads, so that its contents
+ * can be read as required instead of being loaded into memory.
+ */
+
+struct files_source {
+#ifdef LINUX
+	int				fd;		/**< The descriptor of the open file.		*/
+#endif
+#ifdef RISCOS
+	os_fw				handle;		/**< The handle of the open file.		*/
+#endif
+	size_t				length;		/**< The length of the file.			*/
+};
+
+/**
+ * A file on disc which has been opened ahead of its contents being
+ * compared, so that the open doesn't hold up the comparison.
+ */
+
+struct files_handle {
+#ifdef LINUX
+	int				fd;		/**< The descriptor of the open file.		*/
+#endif
+#ifdef RISCOS
+	FILE				*file;		/**< The handle of the open file.		*/
+#endif
+};
+
+/**
+ * A single file within a batch of operations.
+ */
+
+struct files_batch_item {
+	char				*path;		/**< Pointer to the path of the file.		*/
+	char				*data;		/**< Pointer to the data to compare or write.	*/
+	struct files_source		*source;	/**< The file holding the data, if not in memory.	*/
+	size_t				offset;		/**< The offset of the data within the source.	*/
+	size_t				length;		/**< The length of the data.			*/
+	uint32_t			filetype;	/**< The RISC OS filetype for a written file.	*/
+	size_t				difference;	/**< The offset of the first difference found.	*/
+	bool				success;	/**< True if the operation succeeded.		*/
+};
+
+/**
+ * Details of a file loaded into memory for reading.
+ */
+
+struct files_mapping {
+	int8_t				*data;		/**< Pointer to the file contents in memory.	*/
+	size_t				length;		/**< The length of the file contents.		*/
+	bool				mapped;		/**< True if the contents are memory mapped.	*/
+};
+
+/**
+ * Open a directory on disc, so that its contents can be read. On Linux,
+ * a directory within an open parent is opened relative to the parent's
+ * descriptor with openat(), so that the full path doesn't need to be
+ * resolved again for every level.
  *
- * \param *path		Pointer to the path to the required directory.
- * \return		Pointer to the head of a linked list of objects, or NULL.
+ * \param *parent	Pointer to the parent directory, or NULL if the
+ *			name is a full path.
+ * \param *name		Pointer to the name of the directory to open.
+ * \param *dir		Pointer to a block to take the directory details.
+ * \return		True if successful; False on failure.
  */
 
-struct files_object_info *files_read_directory_contents(char *path);
+bool files_open_directory(struct files_directory *parent, char *name, struct files_directory *dir);
+
+/**
+ * Close a directory previously opened with files_open_directory().
+ *
+ * \param *dir		Pointer to the directory to close.
+ */
+
+void files_close_directory(struct files_directory *dir);
+
+/**
+ * Read the contents of a directory, returning a linked list of objects
+ * sorted into alphabetical order. If an error occurs while reading, any
+ * objects read so far are still returned.
+ *
+ * \param *dir		Pointer to the directory to read.
+ * \param *arena	Pointer to the arena to allocate the objects from.
+ * \param **list	Pointer to a variable to take the head of the linked
+ *			list of objects, or NULL if there are none.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_read_directory_contents(struct files_directory *dir, struct arena *arena, struct files_object_info **list);
 
 /**
  * Return object info details for a single directory on disc.
  *
  * \param *path		Pointer to the directory path.
  * \param strict	Should the directory exist.
+ * \param *arena	Pointer to the arena to allocate the object from.
  * \return		Pointer to the information, or NULL.
  */
 
-struct files_object_info *files_read_directory_info(char *path, bool strict);
+struct files_object_info *files_read_directory_info(char *path, bool strict, struct arena *arena);
 
 /**
  * Make a filename up using its name and filetype, and create a new
- * buffer for it using malloc(). It is up to the caller to release
- * this using free() once no longer required.
+ * buffer for it in the supplied arena.
  *
  * \param *name		Pointer to the filename.
  * \param filetype	The RISC OS filetype.
+ * \param *arena	Pointer to the arena to allocate the name from.
  * \return		Pointer to the resulting name buffer.
  */
 
-char *files_make_filename(char *name, uint32_t filetype);
+char *files_make_filename(char *name, uint32_t filetype, struct arena *arena);
 
 /**
  * Set the RISC OS filetype of a file.
@@ -125,15 +263,360 @@ bool files_make_directory(char *path);
 bool files_delete_directory(char *path);
 
 /**
- * Write a file to disc.
+ * Write a file to disc, directly from the supplied buffer. On Linux, the
+ * space for the file is allocated up front, and short writes are resumed
+ * until all of the data has been written; on RISC OS, the file is saved
+ * in a single operation.
  *
  * \param *path		Pointer to the required file path.
  * \param *data		Pointer to the data to be written.
  * \param length	The length of the data to be written.
+ * \param filetype	The RISC OS filetype to give the file.
+ * \param sync		True to flush the file to disc before returning.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_write_file(char *path, char *data, size_t length, uint32_t filetype, bool sync);
+
+/**
+ * Write a file to disc, copying the data from a block within a source
+ * file in chunks, so that only a small buffer is needed.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *source	Pointer to the source file holding the data.
+ * \param offset	The offset of the data within the source file.
+ * \param length	The length of the data to be written.
+ * \param filetype	The RISC OS filetype to give the file.
+ * \param sync		True to flush the file to disc before returning.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_write_file_from_source(char *path, struct files_source *source, size_t offset, size_t length, uint32_t filetype, bool sync);
+
+/**
+ * Flush all of the files written to the filing system holding a folder
+ * out to disc.
+ *
+ * \param *path		Pointer to the path of the folder.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_sync_folder(char *path);
+
+/**
+ * Replace a file on disc, by writing the new contents to a temporary
+ * file alongside it and then renaming that over the original, so that
+ * the file is never left partially written. If the old file had a
+ * different name, it is deleted once the new file is in place.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *old_path	Pointer to the path of the file being replaced,
+ *			or NULL if it is the same as the required path.
+ * \param *data		Pointer to the data to be written.
+ * \param length	The length of the data to be written.
+ * \param filetype	The RISC OS filetype to give the new file.
+ * \param sync		True to flush the new file to disc before it
+ *			replaces the old one.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_replace_file(char *path, char *old_path, char *data, size_t length, uint32_t filetype, bool sync);
+
+/**
+ * Replace a file on disc in the same way as files_replace_file(), copying
+ * the new contents from a block within a source file.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *old_path	Pointer to the path of the file being replaced,
+ *			or NULL if it is the same as the required path.
+ * \param *source	Pointer to the source file holding the data.
+ * \param offset	The offset of the data within the source file.
+ * \param length	The length of the data to be written.
+ * \param filetype	The RISC OS filetype to give the new file.
+ * \param sync		True to flush the new file to disc before it
+ *			replaces the old one.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_replace_file_from_source(char *path, char *old_path, struct files_source *source, size_t offset, size_t length, uint32_t filetype, bool sync);
+
+/**
+ * Rename a file on disc, replacing any existing file of the new name.
+ *
+ * On Linux, the replacement is atomic. On RISC OS, any existing file is
+ * renamed out of the way first, and only deleted once the new file is in
+ * place; if the rename fails, the existing file is put back.
+ *
+ * \param *old_path	Pointer to the current file path.
+ * \param *new_path	Pointer to the required file path.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_rename_file(char *old_path, char *new_path);
+
+/**
+ * Compare the contents of a file on disc with a block of data in memory.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *handle	Pointer to the file opened by files_prefetch_file(),
+ *			which will be closed, or NULL to open the path.
+ * \param *data		Pointer to the data to compare against.
+ * \param length	The length of the data to compare.
+ * \param *difference	Pointer to a variable to take the offset of the
+ *			first differing byte, or NULL if not required.
+ * \return		True if the contents are identical; False if they
+ *			differ or the file could not be read.
+ */
+
+bool files_compare_file(char *path, struct files_handle *handle, char *data, size_t length, size_t *difference);
+
+/**
+ * Compare the contents of a file on disc with a block within a source
+ * file, reading both in chunks.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *handle	Pointer to the file opened by files_prefetch_file(),
+ *			which will be closed, or NULL to open the path.
+ * \param *source	Pointer to the source file holding the data.
+ * \param offset	The offset of the data within the source file.
+ * \param length	The length of the data to compare.
+ * \param *difference	Pointer to a variable to take the offset of the
+ *			first differing byte, or NULL if not required.
+ * \return		True if the contents are identical; False if they
+ *			differ or either file could not be read.
+ */
+
+bool files_compare_file_with_source(char *path, struct files_handle *handle, struct files_source *source, size_t offset, size_t length, size_t *difference);
+
+#ifndef READER_ONLY
+/**
+ * Compare the contents of a batch of files on disc with blocks of data in
+ * memory. Where io_uring is available, the files are opened, read and
+ * closed with many operations in flight at once; otherwise, they are
+ * compared one at a time with files_compare_file(). Files whose data is
+ * held in a source file are always compared individually.
+ *
+ * \param *items	Pointer to the array of files to compare; the success
+ *			flag of each is set if its contents are identical.
+ * \param count		The number of files in the array.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_compare_batch(struct files_batch_item *items, size_t count);
+
+/**
+ * Write a batch of files to disc. Where io_uring is available, the files
+ * are opened, written and closed with many operations in flight at once;
+ * otherwise, they are written one at a time with files_write_file(). Files
+ * whose data is held in a source file are always written individually.
+ *
+ * \param *items	Pointer to the array of files to write; the success
+ *			flag of each is set if it was written.
+ * \param count		The number of files in the array.
+ * \param sync		True to flush each file to disc before closing it.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_write_batch(struct files_batch_item *items, size_t count, bool sync);
+
+/**
+ * Delete a batch of files from disc. Where io_uring is available, the
+ * deletions are carried out with many operations in flight at once;
+ * otherwise they are done one at a time with files_delete_file().
+ *
+ * \param *items	Pointer to the array of files to delete; the success
+ *			flag of each is set if it was deleted.
+ * \param count		The number of files in the array.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_delete_batch(struct files_batch_item *items, size_t count);
+
+#endif
+
+/**
+ * Calculate the CRC32C hash of the contents of a file on disc.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *hash		Pointer to a variable to take the hash.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_hash_file(char *path, uint32_t *hash);
+
+/**
+ * Open a file on disc for positioned reads with files_read_source().
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *source	Pointer to a block to take the file details.
  * \return		True if successful; False on failure.
  */
 
-bool files_write_file(char *path, char *data, size_t length);
+bool files_open_source(char *path, struct files_source *source);
+
+/**
+ * Open a file on disc for positioned reads with files_read_source() and
+ * writes with files_write_source(), so that it can be updated in place.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *source	Pointer to a block to take the file details.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_open_source_for_update(char *path, struct files_source *source);
+
+/**
+ * Close a file previously opened with files_open_source().
+ *
+ * \param *source	Pointer to the file details to be released.
+ */
+
+void files_close_source(struct files_source *source);
+
+/**
+ * Read a block of data from a source file. The read may be carried out
+ * by several threads at once on Linux.
+ *
+ * \param *source	Pointer to the source file to read from.
+ * \param offset	The offset of the block within the file.
+ * \param *buffer	Pointer to a buffer to take the data.
+ * \param length	The length of the block to read.
+ * \return		True if the whole block was read; False on failure.
+ */
+
+bool files_read_source(struct files_source *source, size_t offset, void *buffer, size_t length);
+
+/**
+ * Write a block of data to a source file which has been opened for update,
+ * extending the file if the block runs past its end.
+ *
+ * \param *source	Pointer to the source file to write to.
+ * \param offset	The offset of the block within the file.
+ * \param *buffer	Pointer to the data to be written.
+ * \param length	The length of the block to write.
+ * \return		True if the whole block was written; False on failure.
+ */
+
+bool files_write_source(struct files_source *source, size_t offset, void *buffer, size_t length);
+
+/**
+ * Set the length of a source file which has been opened for update,
+ * discarding anything beyond the new end.
+ *
+ * \param *source	Pointer to the source file to update.
+ * \param length	The new length of the file.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_truncate_source(struct files_source *source, size_t length);
+
+/**
+ * Flush the contents of a source file which has been opened for update
+ * out to disc.
+ *
+ * \param *source	Pointer to the source file to flush.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_sync_source(struct files_source *source);
+
+/**
+ * Calculate the CRC32C hash of a block within a source file, reading it
+ * in chunks.
+ *
+ * \param *source	Pointer to the source file to read from.
+ * \param offset	The offset of the block within the file.
+ * \param length	The length of the block.
+ * \param *hash		Pointer to a variable to take the hash.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_hash_source(struct files_source *source, size_t offset, size_t length, uint32_t *hash);
+
+/**
+ * Compare the contents of two blocks within a source file, reading them
+ * in chunks.
+ *
+ * \param *source	Pointer to the source file to read from.
+ * \param first		The offset of the first block within the file.
+ * \param second	The offset of the second block within the file.
+ * \param length	The length of the two blocks.
+ * \return		True if the blocks are identical; False if they
+ *			differ or could not be read.
+ */
+
+bool files_compare_source_blocks(struct files_source *source, size_t first, size_t second, size_t length);
+
+/**
+ * Load the contents of a file into memory for read-only access. Where
+ * the platform allows, the file is memory mapped so that only those
+ * parts of it which are accessed need to be read from disc; otherwise
+ * it is read into a buffer in a single operation.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *mapping	Pointer to a block to take the file details.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_map_file(char *path, struct files_mapping *mapping);
+
+/**
+ * Load the contents of a file into a buffer allocated with malloc(), so
+ * that they are held privately and can't change or disappear if the file
+ * is rewritten while they are in use.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *mapping	Pointer to a block to take the file details.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_load_file(char *path, struct files_mapping *mapping);
+
+/**
+ * Release a file previously loaded into memory by files_map_file() or
+ * files_load_file().
+ *
+ * \param *mapping	Pointer to the file details to be released.
+ */
+
+void files_unmap_file(struct files_mapping *mapping);
+
+/**
+ * Read the catalogue information for a file on disc.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param *stat		Pointer to a block to take the information.
+ * \return		True if successful; False on failure.
+ */
+
+bool files_read_stat(char *path, struct files_stat *stat);
+
+/**
+ * Open a file which is about to be compared, and let the filing system know
+ * that it will be read, so that it can start fetching the contents in the
+ * background. The handle is passed on to the comparison, or closed with
+ * files_close_handle() if it isn't needed. Failures aren't reported, as
+ * the file can still be opened by the comparison itself.
+ *
+ * On RISC OS there is no way to ask for readahead, so the file is only
+ * opened.
+ *
+ * \param *path		Pointer to the required file path.
+ * \param length	The number of bytes which will be read.
+ * \param *handle	Pointer to a block to take the open file.
+ * \return		True if the file was opened; False on failure.
+ */
+
+bool files_prefetch_file(char *path, size_t length, struct files_handle *handle);
+
+/**
+ * Close a file opened by files_prefetch_file() which isn't going to be
+ * compared.
+ *
+ * \param *handle	Pointer to the file to close.
+ */
+
+void files_close_handle(struct files_handle *handle);
 
 /**
  * Delete a file
@@ -0,0 +1,374 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file hash.c
+ *
+ * Hash Functions, implementation.
+ */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LINUX
+#include <pthread.h>
+#endif
+
+/* Where the compiler can target SSE4.2 on a function-by-function basis,
+ * use the CRC32 instruction if the processor turns out to support it.
+ */
+
+#if defined(LINUX) && defined(__GNUC__) && defined(__x86_64__)
+#define HASH_CRC32C_SSE42
+#include <nmmintrin.h>
+#endif
+
+/* Local source headers. */
+
+#include "hash.h"
+
+/**
+ * The reflected CRC32C (Castagnoli) polynomial.
+ */
+
+#define HASH_CRC32C_POLYNOMIAL (0x82f63b78u)
+
+/**
+ * The reflected CRC32 (IEEE 802.3) polynomial, as used by Zip files.
+ */
+
+#define HASH_CRC32_POLYNOMIAL (0xedb88320u)
+
+/**
+ * The number of lookup tables used by the slice-by-8 CRC calculations.
+ */
+
+#define HASH_CRC_SLICES 8
+
+/**
+ * The lookup tables for the CRC32C calculation.
+ */
+
+static uint32_t hash_crc32c_table[HASH_CRC_SLICES][256];
+
+/**
+ * The lookup tables for the CRC32 calculation.
+ */
+
+static uint32_t hash_crc32_table[HASH_CRC_SLICES][256];
+
+/**
+ * A CRC32C kernel, which updates a checksum without any pre- or
+ * post-conditioning.
+ */
+
+typedef uint32_t (*hash_crc32c_kernel)(uint32_t crc, uint8_t *bytes, size_t length);
+
+/**
+ * The kernel being used to calculate CRC32C checksums.
+ */
+
+static hash_crc32c_kernel hash_crc32c_process = NULL;
+
+#ifdef LINUX
+/**
+ * Control to ensure that the CRC32C kernel is only set up once.
+ */
+
+static pthread_once_t hash_crc32c_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Control to ensure that the CRC32 tables are only built once.
+ */
+
+static pthread_once_t hash_crc32_once = PTHREAD_ONCE_INIT;
+#else
+/**
+ * Set to true once the CRC32 tables have been built.
+ */
+
+static bool hash_crc32_ready = false;
+#endif
+
+/* Static Function Prototypes. */
+
+static void hash_crc32c_initialise(void);
+static void hash_crc32_initialise(void);
+static void hash_build_tables(uint32_t table[HASH_CRC_SLICES][256], uint32_t polynomial);
+static uint32_t hash_crc32c_software(uint32_t crc, uint8_t *bytes, size_t length);
+static uint32_t hash_slice_by_8(uint32_t table[HASH_CRC_SLICES][256], uint32_t crc, uint8_t *bytes, size_t length);
+#ifdef HASH_CRC32C_SSE42
+static uint32_t hash_crc32c_sse42(uint32_t crc, uint8_t *bytes, size_t length);
+#endif
+
+/**
+ * Calculate a hash of a zero-terminated string, suitable for use in
+ * indexing hash tables. The FNV-1a algorithm is used.
+ *
+ * \param *string	Pointer to the string to hash.
+ * \return		The hash value.
+ */
+
+uint32_t hash_string(char *string)
+{
+	uint32_t hash = 2166136261u;
+
+	while (string != NULL && *string != '\0') {
+		hash ^= (uint8_t) *string++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/**
+ * Calculate a hash of a zero-terminated string, ignoring the case of any
+ * letters, suitable for use in indexing hash tables. The FNV-1a algorithm
+ * is used, on the lower case form of each character.
+ *
+ * \param *string	Pointer to the string to hash.
+ * \return		The hash value.
+ */
+
+uint32_t hash_string_nocase(char *string)
+{
+	uint32_t hash = 2166136261u;
+
+	while (string != NULL && *string != '\0') {
+		hash ^= (uint8_t) tolower((unsigned char) *string++);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/**
+ * Calculate the CRC32C (Castagnoli) checksum of a block of data. Longer
+ * blocks can be processed in sections, by passing the result from one
+ * section in as the crc for the next.
+ *
+ * \param crc		The checksum so far, or HASH_CRC32C_INITIAL.
+ * \param *data		Pointer to the data to process.
+ * \param length	The length of the data, in bytes.
+ * \return		The updated checksum.
+ */
+
+uint32_t hash_crc32c(uint32_t crc, void *data, size_t length)
+{
+#ifdef LINUX
+	pthread_once(&hash_crc32c_once, hash_crc32c_initialise);
+#else
+	if (hash_crc32c_process == NULL)
+		hash_crc32c_initialise();
+#endif
+
+	if (data == NULL)
+		return crc;
+
+	return ~hash_crc32c_process(~crc, data, length);
+}
+
+/**
+ * Calculate the CRC32 (IEEE 802.3) checksum of a block of data, as used
+ * in Zip files. Longer blocks can be processed in sections, by passing the
+ * result from one section in as the crc for the next.
+ *
+ * \param crc		The checksum so far, or HASH_CRC32_INITIAL.
+ * \param *data		Pointer to the data to process.
+ * \param length	The length of the data, in bytes.
+ * \return		The updated checksum.
+ */
+
+uint32_t hash_crc32(uint32_t crc, void *data, size_t length)
+{
+#ifdef LINUX
+	pthread_once(&hash_crc32_once, hash_crc32_initialise);
+#else
+	if (!hash_crc32_ready)
+		hash_crc32_initialise();
+#endif
+
+	if (data == NULL)
+		return crc;
+
+	return ~hash_slice_by_8(hash_crc32_table, ~crc, data, length);
+}
+
+/**
+ * Select the fastest CRC32C kernel available on the processor, building
+ * the lookup tables for the software version if it is required.
+ */
+
+static void hash_crc32c_initialise(void)
+{
+#ifdef HASH_CRC32C_SSE42
+	if (__builtin_cpu_supports("sse4.2")) {
+		hash_crc32c_process = hash_crc32c_sse42;
+		return;
+	}
+#endif
+
+	hash_build_tables(hash_crc32c_table, HASH_CRC32C_POLYNOMIAL);
+
+	hash_crc32c_process = hash_crc32c_software;
+}
+
+/**
+ * Build the lookup tables for the CRC32 calculation.
+ */
+
+static void hash_crc32_initialise(void)
+{
+	hash_build_tables(hash_crc32_table, HASH_CRC32_POLYNOMIAL);
+
+#ifndef LINUX
+	hash_crc32_ready = true;
+#endif
+}
+
+/**
+ * Build a set of slice-by-8 lookup tables for a reflected CRC polynomial.
+ *
+ * \param table		The tables to be filled in.
+ * \param polynomial	The reflected polynomial.
+ */
+
+static void hash_build_tables(uint32_t table[HASH_CRC_SLICES][256], uint32_t polynomial)
+{
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+
+		for (j = 0; j < 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ polynomial : (crc >> 1);
+
+		table[0][i] = crc;
+	}
+
+	for (i = 0; i < 256; i++) {
+		crc = table[0][i];
+
+		for (j = 1; j < HASH_CRC_SLICES; j++) {
+			crc = table[0][crc & 0xff] ^ (crc >> 8);
+			table[j][i] = crc;
+		}
+	}
+}
+
+/**
+ * Update a CRC32C checksum in software, using the slice-by-8 tables.
+ *
+ * \param crc		The checksum so far.
+ * \param *bytes	Pointer to the data to process.
+ * \param length	The length of the data, in bytes.
+ * \return		The updated checksum.
+ */
+
+static uint32_t hash_crc32c_software(uint32_t crc, uint8_t *bytes, size_t length)
+{
+	return hash_slice_by_8(hash_crc32c_table, crc, bytes, length);
+}
+
+/**
+ * Update a CRC checksum using a set of slice-by-8 tables.
+ *
+ * \param table		The tables for the CRC polynomial.
+ * \param crc		The checksum so far.
+ * \param *bytes	Pointer to the data to process.
+ * \param length	The length of the data, in bytes.
+ * \return		The updated checksum.
+ */
+
+static uint32_t hash_slice_by_8(uint32_t table[HASH_CRC_SLICES][256], uint32_t crc, uint8_t *bytes, size_t length)
+{
+	uint32_t low, high;
+
+	/* Process eight bytes at a time. The words are assembled byte by
+	 * byte, so that the alignment and endianness of the data don't matter.
+	 */
+
+	while (length >= 8) {
+		low = crc ^ ((uint32_t) bytes[0] | ((uint32_t) bytes[1] << 8) |
+				((uint32_t) bytes[2] << 16) | ((uint32_t) bytes[3] << 24));
+		high = (uint32_t) bytes[4] | ((uint32_t) bytes[5] << 8) |
+				((uint32_t) bytes[6] << 16) | ((uint32_t) bytes[7] << 24);
+
+		crc = table[7][low & 0xff] ^
+				table[6][(low >> 8) & 0xff] ^
+				table[5][(low >> 16) & 0xff] ^
+				table[4][low >> 24] ^
+				table[3][high & 0xff] ^
+				table[2][(high >> 8) & 0xff] ^
+				table[1][(high >> 16) & 0xff] ^
+				table[0][high >> 24];
+
+		bytes += 8;
+		length -= 8;
+	}
+
+	/* Mop up any remaining bytes one at a time. */
+
+	while (length-- > 0)
+		crc = table[0][(crc ^ *bytes++) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+#ifdef HASH_CRC32C_SSE42
+
+/**
+ * Update a CRC32C checksum using the SSE4.2 CRC32 instruction.
+ *
+ * \param crc		The checksum so far.
+ * \param *bytes	Pointer to the data to process.
+ * \param length	The length of the data, in bytes.
+ * \return		The updated checksum.
+ */
+
+__attribute__((target("sse4.2")))
+static uint32_t hash_crc32c_sse42(uint32_t crc, uint8_t *bytes, size_t length)
+{
+	uint64_t word, crc64 = crc;
+
+	while (length >= 8) {
+		memcpy(&word, bytes, sizeof(uint64_t));
+		crc64 = _mm_crc32_u64(crc64, word);
+
+		bytes += 8;
+		length -= 8;
+	}
+
+	crc = (uint32_t) crc64;
+
+	while (length-- > 0)
+		crc = _mm_crc32_u8(crc, *bytes++);
+
+	return crc;
+}
+
+#endif
@@ -0,0 +1,94 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file hash.h
+ *
+ * Hash Functions Interface.
+ */
+
+#ifndef STRONGEX_HASH_H
+#define STRONGEX_HASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * The initial value to pass to hash_crc32c() at the start of a block.
+ */
+
+#define HASH_CRC32C_INITIAL (0u)
+
+/**
+ * The initial value to pass to hash_crc32() at the start of a block.
+ */
+
+#define HASH_CRC32_INITIAL (0u)
+
+/**
+ * Calculate a hash of a zero-terminated string, suitable for use in
+ * indexing hash tables.
+ *
+ * \param *string	Pointer to the string to hash.
+ * \return		The hash value.
+ */
+
+uint32_t hash_string(char *string);
+
+/**
+ * Calculate a hash of a zero-terminated string, ignoring the case of any
+ * letters, suitable for use in indexing hash tables.
+ *
+ * \param *string	Pointer to the string to hash.
+ * \return		The hash value.
+ */
+
+uint32_t hash_string_nocase(char *string);
+
+/**
+ * Calculate the CRC32C (Castagnoli) checksum of a block of data. Longer
+ * blocks can be processed in sections, by passing the result from one
+ * section in as the crc for the next.
+ *
+ * \param crc		The checksum so far, or HASH_CRC32C_INITIAL.
+ * \param *data		Pointer to the data to process.
+ * \param length	The length of the data, in bytes.
+ * \return		The updated checksum.
+ */
+
+uint32_t hash_crc32c(uint32_t crc, void *data, size_t length);
+
+/**
+ * Calculate the CRC32 (IEEE 802.3) checksum of a block of data, as used
+ * in Zip files. Longer blocks can be processed in sections, by passing the
+ * result from one section in as the crc for the next.
+ *
+ * \param crc		The checksum so far, or HASH_CRC32_INITIAL.
+ * \param *data		Pointer to the data to process.
+ * \param length	The length of the data, in bytes.
+ * \return		The updated checksum.
+ */
+
+uint32_t hash_crc32(uint32_t crc, void *data, size_t length);
+
+#endif
@@ -0,0 +1,512 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file libstrongex.c
+ *
+ * Embeddable Manual Reader, implementation.
+ *
+ * The manual is parsed into an object database in the usual way, which
+ * is then walked once to build an index entry for every object. The
+ * entries hold everything needed to answer a query, and are linked in to
+ * a hash table on their full paths and to their parent directories, so
+ * the database itself can be discarded once the index is complete.
+ *
+ * Anything reported while a manual is being opened is passed to a handler
+ * set for the calling thread, which keeps the first error with the handle
+ * instead of it being written to stderr.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Local source headers. */
+
+#include "libstrongex.h"
+
+#include "arena.h"
+#include "files.h"
+#include "hash.h"
+#include "msg.h"
+#include "objectdb.h"
+#include "stack.h"
+#include "string.h"
+#include "stronghelp.h"
+
+/**
+ * The smallest number of buckets in the index hash table.
+ */
+
+#define LIBSTRONGEX_INDEX_MIN_SIZE 16
+
+/**
+ * The maximum length of an error message held by a manual handle.
+ */
+
+#define LIBSTRONGEX_MAX_ERROR 256
+
+/**
+ * An entry in the index of a manual.
+ */
+
+struct libstrongex_entry {
+	struct libstrongex_object	object;		/**< The details of the object.				*/
+	uint32_t			hash;		/**< The hash of the object's full path.		*/
+
+	struct libstrongex_entry	*chain;		/**< The next entry in the same hash bucket.		*/
+	struct libstrongex_entry	*contents;	/**< The first entry in a directory, or NULL.		*/
+	struct libstrongex_entry	*next;		/**< The next entry in the same directory, or NULL.	*/
+};
+
+/**
+ * A directory waiting to be indexed, along with its database object.
+ */
+
+struct libstrongex_walk {
+	struct libstrongex_entry	*entry;		/**< The entry for the directory.			*/
+	struct objectdb_object		*object;	/**< The directory in the object database.		*/
+};
+
+/**
+ * An open manual.
+ */
+
+struct libstrongex {
+	struct files_mapping		manual;		/**< The manual file in memory.				*/
+	struct arena			*arena;		/**< The arena holding the index.			*/
+
+	struct libstrongex_entry	*root;		/**< The entry for the root directory.			*/
+	struct libstrongex_entry	**buckets;	/**< The hash table of entries by path.			*/
+	size_t				size;		/**< The number of buckets in the hash table.		*/
+	size_t				count;		/**< The number of entries, not counting the root.	*/
+
+	char				error[LIBSTRONGEX_MAX_ERROR];	/**< The first error, or an empty string.	*/
+};
+
+/* Static Function Prototypes. */
+
+static bool libstrongex_build_index(struct libstrongex *manual, struct objectdb *db);
+static struct libstrongex_entry *libstrongex_add_entry(struct libstrongex *manual, struct libstrongex_entry *parent,
+		struct objectdb_object *object, bool directory, struct libstrongex_entry **all);
+static void libstrongex_report(bool error, char *message, void *context);
+
+/**
+ * Open a StrongHelp manual, mapping it into memory and indexing all of the
+ * objects that it contains. If the manual can't be opened, a handle is still
+ * returned, holding an error which can be read with libstrongex_get_error()
+ * and containing no objects; it must be closed in the usual way.
+ *
+ * \param *filename	Pointer to the filename of the manual to open.
+ * \return		Pointer to the manual handle, or NULL if there was
+ *			not enough memory to create one.
+ */
+
+struct libstrongex *libstrongex_open(char *filename)
+{
+	struct libstrongex *manual;
+	struct objectdb *db = NULL;
+	bool success = false;
+
+	manual = malloc(sizeof(struct libstrongex));
+	if (manual == NULL)
+		return NULL;
+
+	manual->manual.data = NULL;
+	manual->manual.length = 0;
+	manual->manual.mapped = false;
+	manual->arena = NULL;
+	manual->root = NULL;
+	manual->buckets = NULL;
+	manual->size = 0;
+	manual->count = 0;
+	manual->error[0] = '\0';
+
+	/* Keep anything reported along the way with the handle. */
+
+	msg_set_handler(libstrongex_report, manual);
+
+	/* Parse the manual, and index its contents. */
+
+	if (filename == NULL) {
+		msg_report(MSG_NO_FILE);
+	} else if (files_map_file(filename, &(manual->manual))) {
+		manual->arena = arena_create();
+		if (manual->arena != NULL)
+			db = objectdb_create(manual->arena);
+		else
+			msg_report(MSG_NO_MEMORY);
+
+		if (db != NULL && stronghelp_initialise_file(db, manual->manual.data, manual->manual.length))
+			success = libstrongex_build_index(manual, db);
+
+		/* The index holds everything that's needed, so the database can go. */
+
+		objectdb_destroy(db);
+	}
+
+	msg_set_handler(NULL, NULL);
+
+	/* On failure, release everything apart from the handle and its error. */
+
+	if (!success) {
+		if (manual->error[0] == '\0')
+			libstrongex_report(true, "Unknown error", manual);
+
+		arena_destroy(manual->arena);
+		files_unmap_file(&(manual->manual));
+
+		manual->arena = NULL;
+		manual->root = NULL;
+		manual->buckets = NULL;
+		manual->size = 0;
+		manual->count = 0;
+	}
+
+	return manual;
+}
+
+/**
+ * Return the error which stopped a manual from being opened.
+ *
+ * \param *manual	Pointer to the manual of interest.
+ * \return		Pointer to the error message, or NULL if the manual
+ *			was opened successfully.
+ */
+
+char *libstrongex_get_error(struct libstrongex *manual)
+{
+	if (manual == NULL)
+		return "Out of memory";
+
+	return (manual->error[0] != '\0') ? manual->error : NULL;
+}
+
+/**
+ * Close a StrongHelp manual, releasing everything associated with it.
+ *
+ * \param *manual	Pointer to the manual to close.
+ */
+
+void libstrongex_close(struct libstrongex *manual)
+{
+	if (manual == NULL)
+		return;
+
+	arena_destroy(manual->arena);
+	files_unmap_file(&(manual->manual));
+	free(manual);
+}
+
+/**
+ * Return the number of objects in a manual, not counting the root directory.
+ *
+ * \param *manual	Pointer to the manual of interest.
+ * \return		The number of objects.
+ */
+
+size_t libstrongex_count(struct libstrongex *manual)
+{
+	return (manual != NULL) ? manual->count : 0;
+}
+
+/**
+ * Look up an object in a manual by its full path. Paths use . to separate
+ * their elements and are relative to the root, which can optionally be
+ * given as $; an empty path, or $ on its own, refers to the root directory
+ * itself. Names are matched ignoring case, as on RISC OS.
+ *
+ * \param *manual	Pointer to the manual to look in.
+ * \param *path		Pointer to the path of the object to find.
+ * \param *object	Pointer to a block to take the object's details.
+ * \return		True if the object was found; False if not.
+ */
+
+bool libstrongex_lookup(struct libstrongex *manual, char *path, struct libstrongex_object *object)
+{
+	struct libstrongex_entry *entry;
+	uint32_t hash;
+
+	if (manual == NULL || manual->root == NULL || path == NULL || object == NULL)
+		return false;
+
+	/* Strip off any reference to the root directory. */
+
+	if (path[0] == '$' && path[1] == '.')
+		path += 2;
+	else if (path[0] == '$' && path[1] == '\0')
+		path += 1;
+
+	if (*path == '\0') {
+		*object = manual->root->object;
+		return true;
+	}
+
+	hash = hash_string_nocase(path);
+
+	entry = manual->buckets[hash & (manual->size - 1)];
+
+	while (entry != NULL && (entry->hash != hash || string_nocase_strcmp(entry->object.path, path) != 0))
+		entry = entry->chain;
+
+	if (entry == NULL)
+		return false;
+
+	*object = entry->object;
+
+	return true;
+}
+
+/**
+ * Return the first object within a directory. The files in a directory
+ * are returned before its subdirectories.
+ *
+ * \param *dir		Pointer to the details of the directory.
+ * \param *object	Pointer to a block to take the first object's details.
+ * \return		True if an object was found; False if the directory
+ *			is empty, or isn't a directory.
+ */
+
+bool libstrongex_first_object(struct libstrongex_object *dir, struct libstrongex_object *object)
+{
+	if (dir == NULL || object == NULL || dir->entry == NULL || dir->entry->contents == NULL)
+		return false;
+
+	*object = dir->entry->contents->object;
+
+	return true;
+}
+
+/**
+ * Step on to the next object within the same directory.
+ *
+ * \param *object	Pointer to the details of the current object, which
+ *			are replaced by those of the next one.
+ * \return		True if there was another object; False if not.
+ */
+
+bool libstrongex_next_object(struct libstrongex_object *object)
+{
+	if (object == NULL || object->entry == NULL || object->entry->next == NULL)
+		return false;
+
+	*object = object->entry->next->object;
+
+	return true;
+}
+
+/**
+ * Build the index for a manual from its object database, walking the
+ * directory tree and then hashing the entries into a table sized to
+ * hold them all.
+ *
+ * \param *manual	Pointer to the manual to build the index for.
+ * \param *db		Pointer to the object database holding the manual.
+ * \return		True if successful; False on failure.
+ */
+
+static bool libstrongex_build_index(struct libstrongex *manual, struct objectdb *db)
+{
+	struct libstrongex_entry *entry, *all = NULL, *next;
+	struct libstrongex_walk pending, child;
+	struct objectdb_object *object;
+	struct stack stack;
+	bool success = true;
+	uint32_t bucket;
+	size_t i;
+
+	pending.object = objectdb_get_root(db);
+	pending.entry = libstrongex_add_entry(manual, NULL, pending.object, true, &all);
+	if (pending.entry == NULL)
+		return false;
+
+	manual->root = pending.entry;
+
+	/* Walk the tree without recursion, collecting every entry on a list
+	 * threaded through the hash chains until the table can be sized.
+	 */
+
+	stack_initialise(&stack, sizeof(struct libstrongex_walk));
+
+	if (!stack_push(&stack, &pending))
+		success = false;
+
+	while (success && stack_pop(&stack, &pending)) {
+		for (object = objectdb_get_first_directory(pending.object); object != NULL && success; object = objectdb_get_next_object(object)) {
+			child.object = object;
+			child.entry = libstrongex_add_entry(manual, pending.entry, object, true, &all);
+
+			if (child.entry == NULL || !stack_push(&stack, &child))
+				success = false;
+		}
+
+		for (object = objectdb_get_first_file(pending.object); object != NULL && success; object = objectdb_get_next_object(object)) {
+			if (libstrongex_add_entry(manual, pending.entry, object, false, &all) == NULL)
+				success = false;
+		}
+	}
+
+	stack_free(&stack);
+
+	if (!success)
+		return false;
+
+	/* Hash the entries into a table with at least twice as many buckets. */
+
+	for (manual->size = LIBSTRONGEX_INDEX_MIN_SIZE; manual->size < 2 * manual->count; manual->size *= 2)
+		;
+
+	manual->buckets = arena_alloc(manual->arena, manual->size * sizeof(struct libstrongex_entry *));
+	if (manual->buckets == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	for (i = 0; i < manual->size; i++)
+		manual->buckets[i] = NULL;
+
+	for (entry = all; entry != NULL; entry = next) {
+		next = entry->chain;
+		entry->chain = NULL;
+
+		/* The root is found without using the table. */
+
+		if (entry == manual->root)
+			continue;
+
+		bucket = entry->hash & (manual->size - 1);
+		entry->chain = manual->buckets[bucket];
+		manual->buckets[bucket] = entry;
+	}
+
+	return true;
+}
+
+/**
+ * Create an index entry for an object, adding it to the front of its
+ * parent directory's list and to the list of all entries. The objects in
+ * the database are held in the reverse of their order in the manual, so
+ * adding them to the front of the lists puts them back in order.
+ *
+ * \param *manual	Pointer to the manual to add the entry to.
+ * \param *parent	Pointer to the parent directory's entry, or NULL
+ *			for the root.
+ * \param *object	Pointer to the object to add an entry for.
+ * \param directory	True if the object is a directory.
+ * \param **all		Pointer to the head of the list of all entries.
+ * \return		Pointer to the new entry, or NULL on failure.
+ */
+
+static struct libstrongex_entry *libstrongex_add_entry(struct libstrongex *manual, struct libstrongex_entry *parent,
+		struct objectdb_object *object, bool directory, struct libstrongex_entry **all)
+{
+	struct libstrongex_entry *entry;
+	char *name, *path;
+	size_t length, offset;
+
+	if (object == NULL)
+		return NULL;
+
+	entry = arena_alloc(manual->arena, sizeof(struct libstrongex_entry));
+	if (entry == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return NULL;
+	}
+
+	name = objectdb_get_name(object);
+	if (name == NULL)
+		name = "";
+
+	/* The root's path is empty, and the objects within it have no prefix. */
+
+	if (parent == NULL) {
+		path = "";
+	} else if (*(parent->object.path) == '\0') {
+		path = name;
+	} else {
+		length = strlen(parent->object.path) + strlen(name) + 2;
+
+		path = arena_alloc(manual->arena, length);
+		if (path == NULL) {
+			msg_report(MSG_NO_MEMORY);
+			return NULL;
+		}
+
+		snprintf(path, length, "%s.%s", parent->object.path, name);
+	}
+
+	entry->object.type = (directory) ? LIBSTRONGEX_TYPE_DIRECTORY : LIBSTRONGEX_TYPE_FILE;
+	entry->object.name = name;
+	entry->object.path = path;
+	entry->object.filetype = 0;
+	entry->object.size = 0;
+	entry->object.data = NULL;
+	entry->object.entry = entry;
+
+	/* Files point straight in to their contents within the manual. */
+
+	if (!directory) {
+		if (!objectdb_get_stronghelp_details(object, &(entry->object.size), &(entry->object.filetype), &offset))
+			return NULL;
+
+		entry->object.data = manual->manual.data + offset;
+	}
+
+	entry->hash = hash_string_nocase(path);
+	entry->contents = NULL;
+
+	if (parent != NULL) {
+		entry->next = parent->contents;
+		parent->contents = entry;
+		manual->count++;
+	} else {
+		entry->next = NULL;
+	}
+
+	entry->chain = *all;
+	*all = entry;
+
+	return entry;
+}
+
+/**
+ * Take a message reported while a manual is being opened, keeping the
+ * first error with the manual's handle.
+ *
+ * \param error		True if the message is an error.
+ * \param *message	Pointer to the text of the message.
+ * \param *context	Pointer to the manual being opened.
+ */
+
+static void libstrongex_report(bool error, char *message, void *context)
+{
+	struct libstrongex *manual = context;
+
+	if (!error || manual == NULL || manual->error[0] != '\0')
+		return;
+
+	snprintf(manual->error, LIBSTRONGEX_MAX_ERROR, "%s", message);
+}
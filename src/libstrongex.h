@@ -0,0 +1,165 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file libstrongex.h
+ *
+ * Embeddable Manual Reader Interface.
+ *
+ * Open a StrongHelp manual for other software to read from directly,
+ * without anything being extracted to disc. The manual is mapped into
+ * memory and parsed once when it is opened, and an index of the full
+ * paths of all of its objects is built, so that looking up a page costs
+ * a single hash probe and returns a pointer straight into the manual.
+ *
+ * Each handle holds all of its own state, so any number of manuals can be
+ * open at once. Once a handle has been opened nothing within it changes,
+ * so it can be read from any number of threads until it is closed.
+ *
+ * Nothing is written to stderr: if a manual can't be opened, the reason is
+ * held with its handle for the caller to collect.
+ */
+
+#ifndef STRONGEX_LIBSTRONGEX_H
+#define STRONGEX_LIBSTRONGEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * The types of object which can be found in a manual.
+ */
+
+enum libstrongex_type {
+	LIBSTRONGEX_TYPE_FILE,			/**< The object is a file.			*/
+	LIBSTRONGEX_TYPE_DIRECTORY		/**< The object is a directory.			*/
+};
+
+/**
+ * An open manual handle.
+ */
+
+struct libstrongex;
+
+/**
+ * An entry in the index of an open manual.
+ */
+
+struct libstrongex_entry;
+
+/**
+ * The details of an object within an open manual. All of the pointers
+ * remain valid until the manual is closed.
+ */
+
+struct libstrongex_object {
+	enum libstrongex_type		type;		/**< The type of the object.				*/
+	char				*name;		/**< The name of the object.				*/
+	char				*path;		/**< The full path of the object, relative to the root.	*/
+	uint32_t			filetype;	/**< The RISC OS filetype of a file.			*/
+	size_t				size;		/**< The size of a file, in bytes.			*/
+	void				*data;		/**< Pointer to a file's contents within the manual.	*/
+
+	struct libstrongex_entry	*entry;		/**< The object's index entry, for iterating.		*/
+};
+
+/**
+ * Open a StrongHelp manual, mapping it into memory and indexing all of the
+ * objects that it contains. If the manual can't be opened, a handle is still
+ * returned, holding an error which can be read with libstrongex_get_error()
+ * and containing no objects; it must be closed in the usual way.
+ *
+ * \param *filename	Pointer to the filename of the manual to open.
+ * \return		Pointer to the manual handle, or NULL if there was
+ *			not enough memory to create one.
+ */
+
+struct libstrongex *libstrongex_open(char *filename);
+
+/**
+ * Return the error which stopped a manual from being opened.
+ *
+ * \param *manual	Pointer to the manual of interest.
+ * \return		Pointer to the error message, or NULL if the manual
+ *			was opened successfully.
+ */
+
+char *libstrongex_get_error(struct libstrongex *manual);
+
+/**
+ * Close a StrongHelp manual, releasing everything associated with it.
+ *
+ * \param *manual	Pointer to the manual to close.
+ */
+
+void libstrongex_close(struct libstrongex *manual);
+
+/**
+ * Return the number of objects in a manual, not counting the root directory.
+ *
+ * \param *manual	Pointer to the manual of interest.
+ * \return		The number of objects.
+ */
+
+size_t libstrongex_count(struct libstrongex *manual);
+
+/**
+ * Look up an object in a manual by its full path. Paths use . to separate
+ * their elements and are relative to the root, which can optionally be
+ * given as $; an empty path, or $ on its own, refers to the root directory
+ * itself. Names are matched ignoring case, as on RISC OS.
+ *
+ * \param *manual	Pointer to the manual to look in.
+ * \param *path		Pointer to the path of the object to find.
+ * \param *object	Pointer to a block to take the object's details.
+ * \return		True if the object was found; False if not.
+ */
+
+bool libstrongex_lookup(struct libstrongex *manual, char *path, struct libstrongex_object *object);
+
+/**
+ * Return the first object within a directory. The files in a directory
+ * are returned before its subdirectories.
+ *
+ * \param *dir		Pointer to the details of the directory.
+ * \param *object	Pointer to a block to take the first object's details.
+ * \return		True if an object was found; False if the directory
+ *			is empty, or isn't a directory.
+ */
+
+bool libstrongex_first_object(struct libstrongex_object *dir, struct libstrongex_object *object);
+
+/**
+ * Step on to the next object within the same directory.
+ *
+ * \param *object	Pointer to the details of the current object, which
+ *			are replaced by those of the next one.
+ * \return		True if there was another object; False if not.
+ */
+
+bool libstrongex_next_object(struct libstrongex_object *object);
+
+#endif
+
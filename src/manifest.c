@@ -0,0 +1,571 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file manifest.c
+ *
+ * Disc State Manifest, implementation.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Local source headers. */
+
+#include "manifest.h"
+
+#include "arena.h"
+#include "files.h"
+#include "hash.h"
+#include "msg.h"
+#include "string.h"
+
+/**
+ * The suffix added to the output folder name to give the manifest filename.
+ */
+
+#ifdef LINUX
+#define MANIFEST_SUFFIX ".manifest"
+#endif
+#ifdef RISCOS
+#define MANIFEST_SUFFIX "/manifest"
+#endif
+
+/**
+ * The suffix added to the manifest filename while a new copy is written.
+ */
+
+#define MANIFEST_TEMP_SUFFIX "-new"
+
+/**
+ * The header line at the start of a manifest file.
+ */
+
+#define MANIFEST_HEADER "# Strong Extract Manifest 1\n"
+
+/**
+ * The longest line which can be read from a manifest file.
+ */
+
+#define MANIFEST_MAX_LINE 4096
+
+/**
+ * The minimum number of hash buckets in a manifest's index.
+ */
+
+#define MANIFEST_MIN_BUCKETS 16
+
+/**
+ * An entry in a manifest.
+ */
+
+struct manifest_entry {
+	char			*path;		/**< The manifest path of the file.		*/
+	struct files_stat	stat;		/**< The recorded catalogue information.	*/
+	uint32_t		hash;		/**< The recorded hash of the contents.		*/
+
+	struct manifest_entry	*next;		/**< The next entry in the hash chain.		*/
+};
+
+/**
+ * A manifest instance.
+ */
+
+struct manifest {
+	struct arena		*arena;		/**< The arena holding the manifest.		*/
+	struct manifest_entry	**buckets;	/**< The hash buckets for the entries.		*/
+	size_t			size;		/**< The number of hash buckets.		*/
+	int			count;		/**< The number of entries in the manifest.	*/
+};
+
+/**
+ * A manifest being written.
+ */
+
+struct manifest_writer {
+	FILE			*file;		/**< The handle of the temporary file.		*/
+	char			*filename;	/**< The name of the manifest file.		*/
+	char			*temp;		/**< The name of the temporary file.		*/
+	int			count;		/**< The number of entries written.		*/
+	bool			failed;		/**< True if a write has failed.		*/
+};
+
+/* Static Function Prototypes. */
+
+static struct manifest_entry *manifest_parse_line(char *line, struct arena *arena);
+static bool manifest_build_index(struct manifest *manifest, struct manifest_entry *list, size_t size);
+
+/**
+ * Construct the name of the manifest file for an output folder, which
+ * sits alongside the folder itself.
+ *
+ * \param *folder	Pointer to the path of the output folder.
+ * \param *arena	Pointer to the arena to allocate the name from.
+ * \return		Pointer to the manifest filename, or NULL.
+ */
+
+char *manifest_make_filename(char *folder, struct arena *arena)
+{
+	char *filename;
+	size_t length;
+
+	if (folder == NULL)
+		return NULL;
+
+	length = strlen(folder) + strlen(MANIFEST_SUFFIX) + 1;
+
+	filename = arena_alloc(arena, length);
+	if (filename == NULL)
+		return NULL;
+
+	*filename = '\0';
+
+	string_append(filename, folder, length);
+	string_append(filename, MANIFEST_SUFFIX, length);
+
+	return filename;
+}
+
+/**
+ * Load a manifest from disc. If the file does not exist, an empty
+ * manifest is returned.
+ *
+ * \param *filename	Pointer to the name of the manifest file.
+ * \param *arena	Pointer to the arena to allocate memory from.
+ * \return		Pointer to the manifest, or NULL on failure.
+ */
+
+struct manifest *manifest_load(char *filename, struct arena *arena)
+{
+	struct manifest *manifest;
+	struct manifest_entry *list = NULL, *entry;
+	char line[MANIFEST_MAX_LINE];
+	FILE *file;
+	int line_number = 1;
+	size_t size;
+
+	manifest = manifest_create(arena);
+	if (manifest == NULL)
+		return NULL;
+
+	if (filename == NULL)
+		return manifest;
+
+	file = fopen(filename, "r");
+	if (file == NULL)
+		return manifest;
+
+	/* Check that the file is in a format that we understand. */
+
+	if (fgets(line, MANIFEST_MAX_LINE, file) == NULL || strcmp(line, MANIFEST_HEADER) != 0) {
+		msg_report(MSG_MANIFEST_FORMAT, filename);
+		fclose(file);
+		return manifest;
+	}
+
+	/* Read the entries into a list. */
+
+	while (fgets(line, MANIFEST_MAX_LINE, file) != NULL) {
+		line_number++;
+
+		entry = manifest_parse_line(line, arena);
+		if (entry == NULL) {
+			msg_report(MSG_MANIFEST_BAD_LINE, line_number, filename);
+
+			/* Skip the remainder of any over-long line. */
+
+			while (strchr(line, '\n') == NULL && fgets(line, MANIFEST_MAX_LINE, file) != NULL);
+
+			continue;
+		}
+
+		entry->next = list;
+		list = entry;
+		manifest->count++;
+	}
+
+	fclose(file);
+
+	/* Build the index, with around two buckets for each entry. */
+
+	size = MANIFEST_MIN_BUCKETS;
+	while (size < 2 * (size_t) manifest->count)
+		size *= 2;
+
+	if (!manifest_build_index(manifest, list, size))
+		return NULL;
+
+	msg_report(MSG_MANIFEST_READ, manifest->count, filename);
+
+	return manifest;
+}
+
+/**
+ * Create a new, empty, manifest in memory.
+ *
+ * \param *arena	Pointer to the arena to allocate memory from.
+ * \return		Pointer to the manifest, or NULL on failure.
+ */
+
+struct manifest *manifest_create(struct arena *arena)
+{
+	struct manifest *manifest;
+
+	manifest = arena_alloc(arena, sizeof(struct manifest));
+	if (manifest == NULL)
+		return NULL;
+
+	manifest->arena = arena;
+	manifest->buckets = NULL;
+	manifest->size = 0;
+	manifest->count = 0;
+
+	return manifest;
+}
+
+/**
+ * Add an entry to a manifest in memory, replacing any existing entry
+ * for the same path. The index is doubled in size whenever there are
+ * more entries than buckets.
+ *
+ * \param *manifest	Pointer to the manifest to add to.
+ * \param *path		Pointer to the manifest path of the file.
+ * \param *stat		Pointer to the catalogue information for the file.
+ * \param hash		The hash of the file's contents.
+ * \return		True if successful; False on failure.
+ */
+
+bool manifest_remember(struct manifest *manifest, char *path, struct files_stat *stat, uint32_t hash)
+{
+	struct manifest_entry *entry, *list = NULL;
+	size_t bucket;
+
+	if (manifest == NULL || path == NULL || stat == NULL)
+		return false;
+
+	if (manifest->buckets != NULL) {
+		entry = manifest->buckets[hash_string(path) & (manifest->size - 1)];
+
+		while (entry != NULL && strcmp(entry->path, path) != 0)
+			entry = entry->next;
+
+		if (entry != NULL) {
+			entry->stat = *stat;
+			entry->hash = hash;
+			return true;
+		}
+	}
+
+	/* The old index is left in the arena when it is replaced. */
+
+	if ((size_t) manifest->count >= manifest->size) {
+		for (bucket = 0; bucket < manifest->size; bucket++) {
+			while (manifest->buckets[bucket] != NULL) {
+				entry = manifest->buckets[bucket];
+				manifest->buckets[bucket] = entry->next;
+				entry->next = list;
+				list = entry;
+			}
+		}
+
+		if (!manifest_build_index(manifest, list, (manifest->size > 0) ? manifest->size * 2 : MANIFEST_MIN_BUCKETS))
+			return false;
+	}
+
+	entry = arena_alloc(manifest->arena, sizeof(struct manifest_entry));
+	if (entry == NULL)
+		return false;
+
+	entry->path = arena_strdup(manifest->arena, path);
+	if (entry->path == NULL)
+		return false;
+
+	entry->stat = *stat;
+	entry->hash = hash;
+
+	bucket = hash_string(path) & (manifest->size - 1);
+
+	entry->next = manifest->buckets[bucket];
+	manifest->buckets[bucket] = entry;
+	manifest->count++;
+
+	return true;
+}
+
+/**
+ * Build the index for a manifest from a list of entries, replacing any
+ * index that it already has.
+ *
+ * \param *manifest	Pointer to the manifest to index.
+ * \param *list		Pointer to the first entry in the list.
+ * \param size		The number of buckets, which must be a power of 2.
+ * \return		True if successful; False on failure.
+ */
+
+static bool manifest_build_index(struct manifest *manifest, struct manifest_entry *list, size_t size)
+{
+	struct manifest_entry *entry, **buckets;
+	size_t bucket;
+
+	buckets = arena_alloc(manifest->arena, size * sizeof(struct manifest_entry *));
+	if (buckets == NULL)
+		return false;
+
+	for (bucket = 0; bucket < size; bucket++)
+		buckets[bucket] = NULL;
+
+	while (list != NULL) {
+		entry = list;
+		list = entry->next;
+
+		bucket = hash_string(entry->path) & (size - 1);
+
+		entry->next = buckets[bucket];
+		buckets[bucket] = entry;
+	}
+
+	manifest->buckets = buckets;
+	manifest->size = size;
+
+	return true;
+}
+
+/**
+ * Parse a line from a manifest file into a new entry.
+ *
+ * \param *line		Pointer to the line to parse.
+ * \param *arena	Pointer to the arena to allocate the entry from.
+ * \return		Pointer to the new entry, or NULL on failure.
+ */
+
+static struct manifest_entry *manifest_parse_line(char *line, struct arena *arena)
+{
+	struct manifest_entry *entry;
+	char *end;
+	uint32_t hash;
+	struct files_stat stat;
+
+	end = strchr(line, '\n');
+	if (end == NULL)
+		return NULL;
+
+	*end = '\0';
+
+	hash = strtoul(line, &end, 16);
+	if (end == line || *end != ' ')
+		return NULL;
+
+	line = end;
+	stat.size = strtoull(line, &end, 10);
+	if (end == line || *end != ' ')
+		return NULL;
+
+	line = end;
+	stat.modified = strtoll(line, &end, 10);
+	if (end == line || *end != ' ')
+		return NULL;
+
+	line = end;
+	stat.modified_ns = strtol(line, &end, 10);
+	if (end == line || *end != ' ')
+		return NULL;
+
+	line = end;
+	stat.inode = strtoull(line, &end, 10);
+	if (end == line || *end != ' ' || *(end + 1) == '\0')
+		return NULL;
+
+	entry = arena_alloc(arena, sizeof(struct manifest_entry));
+	if (entry == NULL)
+		return NULL;
+
+	entry->path = arena_strdup(arena, end + 1);
+	if (entry->path == NULL)
+		return NULL;
+
+	entry->stat = stat;
+	entry->hash = hash;
+	entry->next = NULL;
+
+	return entry;
+}
+
+/**
+ * Test a file against the entry for it in a manifest. This is safe to
+ * call from several threads at once.
+ *
+ * \param *manifest	Pointer to the manifest to search.
+ * \param *path		Pointer to the manifest path of the file.
+ * \param *stat		Pointer to the current catalogue information for
+ *			the file.
+ * \param *hash		Pointer to a variable to take the recorded hash.
+ * \return		True if the file has an entry whose catalogue
+ *			information matches; otherwise False.
+ */
+
+bool manifest_check(struct manifest *manifest, char *path, struct files_stat *stat, uint32_t *hash)
+{
+	struct manifest_entry *entry;
+
+	if (manifest == NULL || manifest->buckets == NULL || path == NULL || stat == NULL)
+		return false;
+
+	entry = manifest->buckets[hash_string(path) & (manifest->size - 1)];
+
+	while (entry != NULL && strcmp(entry->path, path) != 0)
+		entry = entry->next;
+
+	if (entry == NULL || entry->stat.size != stat->size || entry->stat.modified != stat->modified ||
+			entry->stat.modified_ns != stat->modified_ns || entry->stat.inode != stat->inode)
+		return false;
+
+	if (hash != NULL)
+		*hash = entry->hash;
+
+	return true;
+}
+
+/**
+ * Open a new manifest for writing. The entries are written to a temporary
+ * file, which only replaces the existing manifest when it is committed.
+ *
+ * \param *filename	Pointer to the name of the manifest file.
+ * \return		Pointer to the writer, or NULL on failure.
+ */
+
+struct manifest_writer *manifest_open(char *filename)
+{
+	struct manifest_writer *writer;
+	size_t length;
+
+	if (filename == NULL)
+		return NULL;
+
+	length = strlen(filename) + strlen(MANIFEST_TEMP_SUFFIX) + 1;
+
+	writer = malloc(sizeof(struct manifest_writer) + length);
+	if (writer == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return NULL;
+	}
+
+	writer->filename = filename;
+	writer->temp = (char *) (writer + 1);
+	writer->count = 0;
+	writer->failed = false;
+
+	*(writer->temp) = '\0';
+	string_append(writer->temp, filename, length);
+	string_append(writer->temp, MANIFEST_TEMP_SUFFIX, length);
+
+	writer->file = fopen(writer->temp, "w");
+	if (writer->file == NULL) {
+		msg_report(MSG_MANIFEST_WRITE_FAILED, filename);
+		free(writer);
+		return NULL;
+	}
+
+	if (fputs(MANIFEST_HEADER, writer->file) == EOF)
+		writer->failed = true;
+
+	return writer;
+}
+
+/**
+ * Add an entry to a manifest which is being written.
+ *
+ * \param *writer	Pointer to the writer to add to.
+ * \param *path		Pointer to the manifest path of the file.
+ * \param *stat		Pointer to the catalogue information for the file.
+ * \param hash		The hash of the file's contents.
+ * \return		True if successful; False on failure.
+ */
+
+bool manifest_add(struct manifest_writer *writer, char *path, struct files_stat *stat, uint32_t hash)
+{
+	if (writer == NULL || path == NULL || stat == NULL || writer->failed)
+		return false;
+
+	/* Paths containing line breaks can't be stored, so are left out. */
+
+	if (strchr(path, '\n') != NULL)
+		return true;
+
+	if (fprintf(writer->file, "%08" PRIx32 " %zu %" PRId64 " %" PRId32 " %" PRIu64 " %s\n",
+			hash, stat->size, stat->modified, stat->modified_ns, stat->inode, path) < 0) {
+		writer->failed = true;
+		return false;
+	}
+
+	writer->count++;
+
+	return true;
+}
+
+/**
+ * Close a manifest which is being written. If all of the writes were
+ * successful, the new manifest replaces any previous version; otherwise
+ * the previous version is left untouched.
+ *
+ * \param *writer	Pointer to the writer to close.
+ * \param commit	True to commit the new manifest; False to discard it.
+ * \return		True if the manifest was committed; False if not.
+ */
+
+bool manifest_close(struct manifest_writer *writer, bool commit)
+{
+	bool success;
+
+	if (writer == NULL)
+		return false;
+
+	if (fclose(writer->file) != 0)
+		writer->failed = true;
+
+	success = commit && !writer->failed;
+
+	if (success) {
+#ifdef RISCOS
+		remove(writer->filename);
+#endif
+		if (rename(writer->temp, writer->filename) != 0)
+			success = false;
+	}
+
+	if (success) {
+		msg_report(MSG_MANIFEST_WRITTEN, writer->count, writer->filename);
+	} else {
+		if (commit)
+			msg_report(MSG_MANIFEST_WRITE_FAILED, writer->filename);
+
+		remove(writer->temp);
+	}
+
+	free(writer);
+
+	return success;
+}
@@ -0,0 +1,150 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file manifest.h
+ *
+ * Disc State Manifest Interface.
+ *
+ * A manifest records the catalogue information and content hash of each
+ * file in an output folder, as it was when the folder was last updated.
+ * If a file's catalogue information hasn't changed since then, its
+ * contents can be assumed to match the recorded hash without reading it.
+ */
+
+#ifndef STRONGEX_MANIFEST_H
+#define STRONGEX_MANIFEST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "files.h"
+
+/**
+ * A manifest instance reference.
+ */
+
+struct manifest;
+
+/**
+ * A manifest being written, instance reference.
+ */
+
+struct manifest_writer;
+
+/**
+ * Construct the name of the manifest file for an output folder, which
+ * sits alongside the folder itself.
+ *
+ * \param *folder	Pointer to the path of the output folder.
+ * \param *arena	Pointer to the arena to allocate the name from.
+ * \return		Pointer to the manifest filename, or NULL.
+ */
+
+char *manifest_make_filename(char *folder, struct arena *arena);
+
+/**
+ * Load a manifest from disc. If the file does not exist, an empty
+ * manifest is returned.
+ *
+ * \param *filename	Pointer to the name of the manifest file.
+ * \param *arena	Pointer to the arena to allocate memory from.
+ * \return		Pointer to the manifest, or NULL on failure.
+ */
+
+struct manifest *manifest_load(char *filename, struct arena *arena);
+
+/**
+ * Create a new, empty, manifest in memory, to which entries can be added
+ * using manifest_remember().
+ *
+ * \param *arena	Pointer to the arena to allocate memory from.
+ * \return		Pointer to the manifest, or NULL on failure.
+ */
+
+struct manifest *manifest_create(struct arena *arena);
+
+/**
+ * Add an entry to a manifest in memory, replacing any existing entry
+ * for the same path. This must not be called while the manifest is
+ * being checked from other threads.
+ *
+ * \param *manifest	Pointer to the manifest to add to.
+ * \param *path		Pointer to the manifest path of the file.
+ * \param *stat		Pointer to the catalogue information for the file.
+ * \param hash		The hash of the file's contents.
+ * \return		True if successful; False on failure.
+ */
+
+bool manifest_remember(struct manifest *manifest, char *path, struct files_stat *stat, uint32_t hash);
+
+/**
+ * Test a file against the entry for it in a manifest. This is safe to
+ * call from several threads at once.
+ *
+ * \param *manifest	Pointer to the manifest to search.
+ * \param *path		Pointer to the manifest path of the file.
+ * \param *stat		Pointer to the current catalogue information for
+ *			the file.
+ * \param *hash		Pointer to a variable to take the recorded hash.
+ * \return		True if the file has an entry whose catalogue
+ *			information matches; otherwise False.
+ */
+
+bool manifest_check(struct manifest *manifest, char *path, struct files_stat *stat, uint32_t *hash);
+
+/**
+ * Open a new manifest for writing.
+ *
+ * \param *filename	Pointer to the name of the manifest file.
+ * \return		Pointer to the writer, or NULL on failure.
+ */
+
+struct manifest_writer *manifest_open(char *filename);
+
+/**
+ * Add an entry to a manifest which is being written.
+ *
+ * \param *writer	Pointer to the writer to add to.
+ * \param *path		Pointer to the manifest path of the file.
+ * \param *stat		Pointer to the catalogue information for the file.
+ * \param hash		The hash of the file's contents.
+ * \return		True if successful; False on failure.
+ */
+
+bool manifest_add(struct manifest_writer *writer, char *path, struct files_stat *stat, uint32_t hash);
+
+/**
+ * Close a manifest which is being written. If all of the writes were
+ * successful, the new manifest replaces any previous version; otherwise
+ * the previous version is left untouched.
+ *
+ * \param *writer	Pointer to the writer to close.
+ * \param commit	True to commit the new manifest; False to discard it.
+ * \return		True if the manifest was committed; False if not.
+ */
+
+bool manifest_close(struct manifest_writer *writer, bool commit);
+
+#endif
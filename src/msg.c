@@ -34,6 +34,10 @@
 #include <stdio.h>
 #include <stdarg.h>
 
+#ifdef LINUX
+#include <pthread.h>
+#endif
+
 /* Local source headers. */
 
 #include "msg.h"
@@ -65,6 +69,8 @@ static struct msg_data msg_messages[] = {
 	{MSG_ERROR,	"Out of memory"},
 	{MSG_ERROR,	"Failed to open file '%s'"},
 	{MSG_ERROR,	"Failed to read file '%s' into memory"},
+	{MSG_ERROR,	"Failed to read %d bytes at offset %d of the StrongHelp file"},
+	{MSG_ERROR,	"Failed to write %d bytes at offset %d of the StrongHelp file"},
 	{MSG_ERROR,	"No file currently loaded"},
 	{MSG_ERROR,	"Attempt to use invalid offset of %d"},
 	{MSG_ERROR,	"Attempt to use invalid size of %d"},
@@ -73,21 +79,54 @@ static struct msg_data msg_messages[] = {
 	{MSG_ERROR,	"Unexpected file magic word 0x%x"},
 	{MSG_ERROR,	"Unexpected free magic word 0x%x"},
 	{MSG_ERROR,	"Unexpected object magic word 0x%x"},
+	{MSG_ERROR,	"Free space list loops back to offset %d"},
+	{MSG_ERROR,	"Directory '%s' at offset %d is shared with another directory, or contains itself"},
 	{MSG_ERROR,	"Unable to find root directory entry"},
 	{MSG_ERROR,	"Attempt to create multiple root directories"},
-	{MSG_ERROR,	"No root directory defined"},
 	{MSG_ERROR,	"No parent directory specified"},
 	{MSG_ERROR,	"Unable to read from directory '%s'"},
 	{MSG_ERROR,	"Object '%s' is not a directory"},
 	{MSG_ERROR,	"Unexpected filetype of 0x%x"},
 	{MSG_ERROR,	"Unexpected status for '%s'"},
+	{MSG_ERROR,	"Line %d of batch file '%s' is too long"},
+	{MSG_ERROR,	"Expected a source and output at line %d of batch file '%s'"},
+	{MSG_ERROR,	"Failed to write manifest '%s'"},
+	{MSG_ERROR,	"The folder is too large to pack into a StrongHelp file"},
+	{MSG_ERROR,	"File '%s' changed while being copied into the manual"},
+	{MSG_ERROR,	"Invalid %s block at offset %d"},
+	{MSG_ERROR,	"Invalid directory entry at offset %d"},
+	{MSG_ERROR,	"%s block at offset %d overlaps another block"},
+	{MSG_ERROR,	"%d bytes at offset %d are not used by any block"},
+	{MSG_ERROR,	"Unable to watch '%s' for changes"},
+	{MSG_ERROR,	"Failed to write archive '%s'"},
+	{MSG_ERROR,	"Archive '%s' has too many entries or is too large for the Zip format"},
+	{MSG_WARNING,	"Only %d of %d worker threads could be started"},
+	{MSG_WARNING,	"Ignoring manifest '%s', which is not in a recognised format"},
+	{MSG_WARNING,	"Ignoring malformed entry at line %d of manifest '%s'"},
+	{MSG_WARNING,	"Changes within directory '%s' will not be seen"},
 	{MSG_INFO,	"Extracting StrongHelp file '%s' to '%s'"},
+	{MSG_INFO,	"Packing folder '%s' into StrongHelp file '%s'"},
+	{MSG_INFO,	"Validating StrongHelp file '%s'"},
+	{MSG_INFO,	"Watching '%s' and '%s' for changes..."},
+	{MSG_INFO,	"Archiving StrongHelp file '%s' to '%s'"},
 	{MSG_VERBOSE,	"The file is %d bytes long"},
+	{MSG_VERBOSE,	"The file has been mapped into memory"},
+	{MSG_VERBOSE,	"The file will be read from disc as required"},
 	{MSG_INFO,	"Processing the contents of the StrongHelp manual..."},
 	{MSG_INFO,	"Processing the contents of the disc folder..."},
 	{MSG_INFO,	"Comparing the two versions..."},
 	{MSG_INFO,	"Updating the disc folder contents..."},
+	{MSG_INFO,	"Writing the StrongHelp manual..."},
+	{MSG_INFO,	"Updating the StrongHelp manual contents..."},
+	{MSG_INFO,	"Writing the archive contents..."},
 	{MSG_INFO,	"All done!"},
+	{MSG_INFO,	"Changes seen; bringing the folder up to date again"},
+	{MSG_VERBOSE,	"Read %d entries from manifest '%s'"},
+	{MSG_VERBOSE,	"Written %d entries to manifest '%s'"},
+	{MSG_INFO,	"Batch complete: %d of %d manuals processed successfully"},
+	{MSG_VERBOSE,	"Packed %d directories and %d files into %d bytes"},
+	{MSG_VERBOSE,	"Wrote %d bytes to the manual, which is now %d bytes long"},
+	{MSG_INFO,	"Found %d directories, %d files and %d free blocks, with %d problems"},
 	{MSG_VERBOSE,	"Magic Word: 0x%x"},
 	{MSG_VERBOSE,	"StrongHelp Version: %d"},
 	{MSG_VERBOSE,	"Header Size: %d bytes"},
@@ -111,13 +150,29 @@ static struct msg_data msg_messages[] = {
 	{MSG_INFO,	"File Unchanged: %s"},
 	{MSG_INFO,	"File Type Changed from 0x%3x to 0x%3x: %s"},
 	{MSG_INFO,	"File Contents Changed from %d to %d bytes: %s"},
+	{MSG_INFO,	"File Moved from %s: %s"},
+	{MSG_VERBOSE,	"First difference found at offset %d"},
+	{MSG_VERBOSE,	"Contents matched using the manifest: %s"},
+	{MSG_VERBOSE,	"File Hash 0x%08x, %d bytes: %s"},
 	{MSG_VERBOSE,	"Creating directory %s"},
 	{MSG_VERBOSE,	"Deleting directory %s"},
 	{MSG_VERBOSE,	"Writing file %s"},
+	{MSG_VERBOSE,	"Changing type of file %s to 0x%3x"},
+	{MSG_VERBOSE,	"Moving file %s to %s"},
 	{MSG_VERBOSE,	"Deleting file %s"},
+	{MSG_VERBOSE,	"Flushing the contents of %s to disc"},
 	{MSG_INFO,	"The manuals are identical"},
 	{MSG_INFO,	"Directories: %d added, %d removed"},
-	{MSG_INFO,	"Files: %d added, %d changed, %d removed"}
+	{MSG_INFO,	"Files: %d added, %d changed, %d removed"},
+	{MSG_INFO,	"Files: %d moved"},
+	{MSG_INFO,	"Time to %-7s %10.1f ms elapsed, %10.1f ms CPU"},
+	{MSG_INFO,	"Total time      %10.1f ms elapsed, %10.1f ms CPU"},
+	{MSG_INFO,	"Manual: %llu bytes mapped, %llu bytes loaded"},
+	{MSG_INFO,	"Disc: %llu bytes read from %llu files, %llu bytes written to %llu files"},
+	{MSG_INFO,	"Objects: %llu files deleted, %llu files renamed; %llu directories scanned, %llu created, %llu deleted"},
+	{MSG_INFO,	"File system calls: %llu"},
+	{MSG_ERROR,	"Failed to write statistics to '%s'"},
+	{MSG_ERROR,	"Failed to write the report to stdout"}
 };
 
 /**
@@ -132,6 +187,27 @@ static bool msg_error_reported = false;
 
 static bool msg_verbose = false;
 
+/**
+ * The handler taking the current thread's messages, or NULL for stderr,
+ * and its context pointer.
+ */
+
+#ifdef LINUX
+static __thread msg_handler msg_thread_handler = NULL;
+static __thread void *msg_thread_context = NULL;
+#else
+static msg_handler msg_thread_handler = NULL;
+static void *msg_thread_context = NULL;
+#endif
+
+#ifdef LINUX
+/**
+ * Lock to serialise reports from multiple threads.
+ */
+
+static pthread_mutex_t msg_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 /**
  * Set the verbosity of reporting.
  *
@@ -143,6 +219,32 @@ void msg_set_verbose(bool verbose)
 	msg_verbose = verbose;
 }
 
+/**
+ * Indicate whether verbose reporting is enabled.
+ *
+ * \return		True if verbose reporting is enabled; else false.
+ */
+
+bool msg_get_verbose(void)
+{
+	return msg_verbose;
+}
+
+/**
+ * Set a handler to take the messages reported by the current thread, in
+ * place of them being written to stderr. Errors passed to a handler are
+ * not recorded for msg_errors().
+ *
+ * \param handler	The handler to use, or NULL to write to stderr again.
+ * \param *context	A context pointer to pass to the handler.
+ */
+
+void msg_set_handler(msg_handler handler, void *context)
+{
+	msg_thread_handler = handler;
+	msg_thread_context = context;
+}
+
 /**
  * Generate a message to the user, based on a range of standard message tokens
  *
@@ -167,6 +269,15 @@ void msg_report(enum msg_type type, ...)
 
 	message[MSG_MAX_MESSAGE - 1] = '\0';
 
+	if (msg_thread_handler != NULL) {
+		msg_thread_handler(msg_messages[type].level == MSG_ERROR, message, msg_thread_context);
+		return;
+	}
+
+#ifdef LINUX
+	pthread_mutex_lock(&msg_lock);
+#endif
+
 	switch (msg_messages[type].level) {
 	case MSG_VERBOSE:
 	case MSG_INFO:
@@ -185,6 +296,10 @@ void msg_report(enum msg_type type, ...)
 	}
 
 	fprintf(stderr, "%s: %s\n", level, message);
+
+#ifdef LINUX
+	pthread_mutex_unlock(&msg_lock);
+#endif
 }
 
 
@@ -45,6 +45,8 @@ enum msg_type {
 	MSG_NO_MEMORY,
 	MSG_OPEN_FAILED,
 	MSG_LOAD_FAILED,
+	MSG_SOURCE_READ_FAILED,
+	MSG_SOURCE_WRITE_FAILED,
 	MSG_NO_FILE,
 	MSG_BAD_OFFSET,
 	MSG_BAD_SIZE,
@@ -53,21 +55,54 @@ enum msg_type {
 	MSG_BAD_FILE_MAGIC,
 	MSG_BAD_FREE_MAGIC,
 	MSG_BAD_OBJECT_MAGIC,
+	MSG_FREE_SPACE_LOOP,
+	MSG_DIRECTORY_SHARED,
 	MSG_MISSING_ROOT,
 	MSG_TOO_MANY_ROOTS,
-	MSG_NO_ROOT,
 	MSG_NO_PARENT,
 	MSG_DIR_READ_FAIL,
 	MSG_NOT_DIR,
 	MSG_BAD_FILETYPE,
 	MSG_BAD_STATUS,
+	MSG_BATCH_LINE_LENGTH,
+	MSG_BATCH_SYNTAX,
+	MSG_MANIFEST_WRITE_FAILED,
+	MSG_PACK_TOO_LARGE,
+	MSG_PACK_FILE_CHANGED,
+	MSG_VALIDATE_BAD_BLOCK,
+	MSG_VALIDATE_BAD_ENTRY,
+	MSG_VALIDATE_OVERLAP,
+	MSG_VALIDATE_UNREACHABLE,
+	MSG_WATCH_FAILED,
+	MSG_ARCHIVE_WRITE_FAILED,
+	MSG_ARCHIVE_TOO_LARGE,
+	MSG_THREADS_FAILED,
+	MSG_MANIFEST_FORMAT,
+	MSG_MANIFEST_BAD_LINE,
+	MSG_WATCH_DIR_FAILED,
 	MSG_EXTRACTING,
+	MSG_PACKING,
+	MSG_VALIDATING,
+	MSG_WATCHING,
+	MSG_ARCHIVING,
 	MSG_FILE_SIZE,
+	MSG_FILE_MAPPED,
+	MSG_FILE_STREAMED,
 	MSG_READ_STRONGHELP,
 	MSG_READ_DISC,
 	MSG_COMPARING_DATA,
 	MSG_UPDATING_DISC,
+	MSG_WRITE_STRONGHELP,
+	MSG_UPDATING_MANUAL,
+	MSG_WRITING_ARCHIVE,
 	MSG_COMPLETE,
+	MSG_WATCH_CHANGED,
+	MSG_MANIFEST_READ,
+	MSG_MANIFEST_WRITTEN,
+	MSG_BATCH_SUMMARY,
+	MSG_PACK_SUMMARY,
+	MSG_PATCH_SUMMARY,
+	MSG_VALIDATE_SUMMARY,
 	MSG_STRONG_HEADER_MAGIC_WORD,
 	MSG_STRONG_VERSION,
 	MSG_STRONG_HEADER_SIZE,
@@ -91,17 +126,46 @@ enum msg_type {
 	MSG_REPORT_FILE_UNCHANGED,
 	MSG_REPORT_FILE_TYPE,
 	MSG_REPORT_FILE_CONTENTS,
+	MSG_REPORT_FILE_MOVED,
+	MSG_REPORT_FILE_DIFFERENCE,
+	MSG_REPORT_FILE_MANIFEST,
+	MSG_REPORT_FILE_HASH,
 	MSG_CREATE_DIR,
 	MSG_DELETE_DIR,
 	MSG_WRITE_FILE,
+	MSG_RETYPE_FILE,
+	MSG_MOVE_FILE,
 	MSG_DELETE_FILE,
+	MSG_SYNC_FOLDER,
 	MSG_SUMMARY_IDENTICAL,
 	MSG_SUMMARY_DIRS,
 	MSG_SUMMARY_FILES,
+	MSG_SUMMARY_MOVED,
+	MSG_STATS_PHASE,
+	MSG_STATS_TOTAL,
+	MSG_STATS_MANUAL,
+	MSG_STATS_DISC,
+	MSG_STATS_OBJECTS,
+	MSG_STATS_SYSCALLS,
+	MSG_STATS_WRITE_FAILED,
+	MSG_REPORT_WRITE_FAILED,
 	MSG_MAX_MESSAGES
 };
 
 
+/**
+ * A handler to take the messages reported by the current thread, in place
+ * of them being written to stderr.
+ *
+ * \param error		True if the message is an error; False if it
+ *			is a warning or for information.
+ * \param *message	Pointer to the text of the message.
+ * \param *context	The context pointer passed to msg_set_handler().
+ */
+
+typedef void (*msg_handler)(bool error, char *message, void *context);
+
+
 /**
  * Set the verbosity of reporting.
  *
@@ -110,6 +174,25 @@ enum msg_type {
 
 void msg_set_verbose(bool verbose);
 
+/**
+ * Indicate whether verbose reporting is enabled.
+ *
+ * \return		True if verbose reporting is enabled; else false.
+ */
+
+bool msg_get_verbose(void);
+
+/**
+ * Set a handler to take the messages reported by the current thread, in
+ * place of them being written to stderr. Errors passed to a handler are
+ * not recorded for msg_errors().
+ *
+ * \param handler	The handler to use, or NULL to write to stderr again.
+ * \param *context	A context pointer to pass to the handler.
+ */
+
+void msg_set_handler(msg_handler handler, void *context);
+
 /**
  * Generate a message to the user, based on a range of standard message tokens
  *
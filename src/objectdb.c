@@ -31,14 +31,27 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifdef LINUX
+#include <pthread.h>
+#endif
+
 /* Local source headers. */
 
 #include "objectdb.h"
 
+#include "archive.h"
+#include "arena.h"
 #include "files.h"
+#include "hash.h"
+#include "manifest.h"
 #include "msg.h"
+#include "pool.h"
+#include "report.h"
+#include "stack.h"
+#include "stats.h"
 #include "string.h"
 
 /**
@@ -51,17 +64,52 @@ enum objectdb_status {
 	OBJECTDB_STATUS_ADDED,
 	OBJECTDB_STATUS_DELETED,
 	OBJECTDB_STATUS_TYPE_CHANGED,
+	OBJECTDB_STATUS_RETYPED,
 	OBJECTDB_STATUS_SIZE_CHANGED,
 	OBJECTDB_STATUS_CONTENT_CHANGED,
+	OBJECTDB_STATUS_MOVED,
 };
 
+/**
+ * The number of buckets initially allocated to a directory index.
+ */
+
+#define OBJECTDB_INDEX_INITIAL_SIZE 16
+
+/**
+ * The number of different path types which can be cached.
+ */
+
+#define OBJECTDB_PATH_TYPES 4
+
+/**
+ * The size of the chunks in which files are copied from the source file
+ * into an archive.
+ */
+
+#define OBJECTDB_ARCHIVE_CHUNK (256 * 1024)
+
 /* Data Structures */
 
+/**
+ * A hash index of the objects in a directory list, chained through
+ * the objects themselves.
+ */
+
+struct objectdb_index {
+	struct objectdb_object		**buckets;
+	size_t				size;
+	size_t				count;
+};
+
 struct objectdb_details {
 	char 		*name;
 	size_t		size;
 	uint32_t	filetype;
 	char		*data;
+	size_t		offset;
+	uint32_t	hash;
+	bool		hashed;
 };
 
 /**
@@ -71,15 +119,86 @@ struct objectdb_details {
 struct objectdb_object {
 	char				*name;
 	enum objectdb_status		status;
+	size_t				sequence;
 
 	struct objectdb_details		stronghelp;
 	struct objectdb_details		disc;
 
+	size_t				difference;
+	struct objectdb_object		*moved;
+
 	struct objectdb_object		*directories;
 	struct objectdb_object		*files;
 
+	struct objectdb_index		directory_index;
+	struct objectdb_index		file_index;
+
+	char				*paths[OBJECTDB_PATH_TYPES];
+	size_t				path_lengths[OBJECTDB_PATH_TYPES];
+
+	bool				included;
+	bool				filtered;
+
+	struct objectdb			*db;
 	struct objectdb_object		*parent;
 	struct objectdb_object		*next;
+	struct objectdb_object		*chain;
+};
+
+/**
+ * A reusable buffer for building the paths of files in a directory,
+ * based on the cached path of the directory itself.
+ */
+
+struct objectdb_path {
+	enum objectdb_path_type		type;
+	char				*buffer;
+	size_t				size;
+
+	struct objectdb_object		*dir;
+	size_t				base;
+};
+
+/**
+ * A wildcard pattern used to select the objects to be processed.
+ */
+
+struct objectdb_filter {
+	char				*pattern;	/**< The pattern to match the paths against.		*/
+	struct objectdb_filter		*next;		/**< The next pattern in the list, or NULL.		*/
+};
+
+/**
+ * A list of objects collected for batched file access.
+ */
+
+struct objectdb_batch {
+	struct objectdb_object		**objects;	/**< The array of objects in the batch.			*/
+	size_t				count;		/**< The number of objects in the batch.		*/
+	size_t				size;		/**< The number of objects that the array can hold.	*/
+#ifdef LINUX
+	pthread_mutex_t			lock;		/**< Lock protecting additions to the batch.		*/
+#endif
+};
+
+/**
+ * The progress of a file in the prefetch batch.
+ */
+
+enum objectdb_prefetch_state {
+	OBJECTDB_PREFETCH_NONE,		/**< The file hasn't been opened ahead.			*/
+	OBJECTDB_PREFETCH_OPEN,		/**< The file is open, waiting to be compared.		*/
+	OBJECTDB_PREFETCH_TAKEN		/**< The file's comparison has started without it.	*/
+};
+
+/**
+ * A file in the prefetch batch, which may have been opened ahead of
+ * being compared.
+ */
+
+struct objectdb_prefetch {
+	struct files_handle		handle;		/**< The open file, if it has been opened.		*/
+	enum objectdb_prefetch_state	state;		/**< The progress of the file.				*/
 };
 
 /**
@@ -91,73 +210,361 @@ struct objectdb_report_summary {
 	int	directories_deleted;
 	int	files_added;
 	int	files_changed;
+	int	files_moved;
 	int	files_deleted;
 };
 
-/* Global Variables. */
+/**
+ * A walk over the directories in a database, which visits each directory
+ * before those within it, and the directories within it in order. The
+ * directories still to be visited are held on a heap-allocated stack.
+ */
+
+struct objectdb_walk {
+	struct stack			stack;		/**< The directories still to be visited.		*/
+	bool				failed;		/**< True if the walk could not be completed.		*/
+};
 
 /**
- * The root directory in the structure.
+ * An object database instance.
  */
 
-struct objectdb_object *objectdb_root = NULL;
+struct objectdb {
+	struct objectdb_object		*root;		/**< The root directory in the structure.		*/
+	struct arena			*arena;		/**< The arena from which memory is allocated.		*/
+	struct manifest			*manifest;	/**< The manifest to quick-check files against, or NULL.	*/
+	struct objectdb_object		**added;	/**< The added files, sorted for matching with moved ones.	*/
+	size_t				added_count;	/**< The number of files in the added files array.		*/
+	size_t				created;	/**< The number of objects created, to order them by.		*/
+	enum files_sync			sync;		/**< The policy for flushing written files to disc.		*/
+	bool				batch_io;	/**< True if file access should be batched where possible.	*/
+	size_t				readahead;	/**< The number of files to prefetch ahead of comparisons.	*/
+	struct objectdb_batch		*prefetch;	/**< The files being compared in order, or NULL.		*/
+	size_t				prefetched;	/**< The number of those files prefetched so far.		*/
+	struct objectdb_prefetch	*prefetches;	/**< The files opened ahead, one for each in the batch.	*/
+	struct objectdb_batch		*writes;	/**< The files to be written in a batch, or NULL.		*/
+	struct objectdb_batch		*deletes;	/**< The files to be deleted in a batch, or NULL.		*/
+	struct files_source		*source;	/**< The file to read StrongHelp data from, or NULL.		*/
+	struct objectdb_filter		*includes;	/**< The patterns for the objects to include, or NULL for all.	*/
+	struct objectdb_filter		*excludes;	/**< The patterns for the objects to leave out, or NULL.	*/
+#ifdef LINUX
+	pthread_mutex_t			path_lock;	/**< Lock protecting the directory path caches.		*/
+#endif
+};
 
 /* Static Function Prototypes. */
 
-static void objectdb_link_object(struct objectdb_object **list, struct objectdb_object *object);
-static struct objectdb_object *objectdb_find_object(struct objectdb_object *list, char *name);
-static bool objectdb_check_directory_status(struct objectdb_object *dir);
-static bool objectdb_compare_files(struct objectdb_object *object);
-static bool objectdb_output_directory_report(struct objectdb_object *dir, struct objectdb_report_summary *summary, bool include_all);
-static bool objectdb_update_directory(struct objectdb_object *dir);
-static char *objectdb_get_dir_path(struct objectdb_object *dir, size_t *length, enum objectdb_path_type type, char *separator);
+static struct objectdb_object *objectdb_create_object(struct objectdb *db, struct objectdb_object *parent, char *name);
+static bool objectdb_link_object(struct objectdb_object **list, struct objectdb_index *index, struct objectdb_object *object);
+static bool objectdb_index_object(struct objectdb_index *index, struct objectdb_object *object);
+static struct objectdb_object *objectdb_merge_object(struct objectdb *db, struct objectdb_object *parent, struct objectdb_object ***cursor, struct objectdb_index *index, char *name);
+static struct objectdb_object *objectdb_find_object(struct objectdb_index *index, char *name);
+static struct objectdb_object *objectdb_reset_disc_list(struct objectdb_object *list, struct objectdb_index *index);
+static void objectdb_reset_disc_object(struct objectdb_object *object);
+static void objectdb_set_included(struct objectdb_object *dir);
+static enum string_match objectdb_match_filters(struct objectdb_filter *filters, struct objectdb_object *parent, char *name);
+static struct objectdb_object *objectdb_sort_list(struct objectdb_object *list);
+#ifndef READER_ONLY
+static void objectdb_sort_directory(struct objectdb_object *dir);
+static bool objectdb_check_directory_status(struct objectdb_object *dir, struct pool *pool, struct objectdb_batch *batch);
+static bool objectdb_compare_task(struct pool *pool, void *data);
+static bool objectdb_queue_readahead(struct objectdb *db, struct objectdb_batch *batch, struct pool *pool);
+static bool objectdb_readahead_task(struct pool *pool, void *data);
+static void objectdb_prefetch_files(struct objectdb *db, size_t target);
+static bool objectdb_take_prefetch(struct objectdb *db, size_t index, struct files_handle *handle);
+static void objectdb_end_readahead(struct objectdb *db);
+static void objectdb_set_compare_status(struct objectdb_object *object, bool identical);
+static bool objectdb_compare_batch(struct objectdb *db, struct objectdb_batch *batch);
+static bool objectdb_compare_files(struct objectdb_object *object, struct files_handle *handle);
+static bool objectdb_has_contents(struct objectdb_object *object);
+static bool objectdb_compare_contents(struct objectdb_object *object, struct files_handle *handle, char *filename, size_t *difference);
+static bool objectdb_match_contents(struct objectdb_object *first, struct objectdb_object *second);
+static bool objectdb_write_contents(struct objectdb_object *object, char *filename, char *old_filename);
+static bool objectdb_hash_contents(struct objectdb_object *object);
+static bool objectdb_check_manifest(struct objectdb_object *object);
+static bool objectdb_check_moves(struct objectdb *db, struct pool *pool);
+static size_t objectdb_find_added_files(struct objectdb_object *dir, struct objectdb_object **files, size_t count);
+static int objectdb_compare_added_files(const void *a, const void *b);
+static size_t objectdb_find_added_file(struct objectdb *db, size_t size, uint32_t filetype, uint32_t hash, bool match_hash);
+static bool objectdb_queue_move_tasks(struct objectdb_object *dir, struct pool *pool);
+static bool objectdb_queue_hash_tasks(struct objectdb *db, struct pool *pool);
+static bool objectdb_hash_task(struct pool *pool, void *data);
+static bool objectdb_move_task(struct pool *pool, void *data);
+static void objectdb_pair_moves(struct objectdb_object *dir);
+static bool objectdb_output_directory_report(struct objectdb_object *dir, struct objectdb_report_summary *summary, bool include_all, struct report *report);
+static bool objectdb_write_report_record(struct report *report, struct objectdb_object *object, char *name, char *source, bool include_all);
+static char *objectdb_get_status_name(enum objectdb_status status);
+static bool objectdb_output_directory_hashes(struct objectdb_object *dir);
+static bool objectdb_update_directory_task(struct pool *pool, void *data);
+static bool objectdb_update_file_task(struct pool *pool, void *data);
+static bool objectdb_remove_directories(struct objectdb_object *dir);
+static bool objectdb_update_batch(struct objectdb *db);
+static struct files_batch_item *objectdb_make_batch_items(struct objectdb_batch *batch, bool write);
+static void objectdb_initialise_batch(struct objectdb_batch *batch);
+static bool objectdb_add_to_batch(struct objectdb_batch *batch, struct objectdb_object *object);
+static void objectdb_free_batch(struct objectdb_batch *batch);
+static bool objectdb_collect_manifest(struct objectdb *db, struct manifest_writer *writer, struct manifest *manifest);
+static bool objectdb_write_directory_manifest(struct objectdb_object *dir, struct manifest_writer *writer, struct manifest *manifest);
+static bool objectdb_write_directory_archive(struct objectdb_object *dir, struct archive *archive, char *buffer);
+#endif
+static char *objectdb_get_dir_path(struct objectdb_object *dir, enum objectdb_path_type type, size_t *length);
+static char *objectdb_get_path_part(struct objectdb_object *object, enum objectdb_path_type type);
+static char *objectdb_get_path_separator(enum objectdb_path_type type);
+#ifndef READER_ONLY
+static void objectdb_initialise_path(struct objectdb_path *path, enum objectdb_path_type type);
+static char *objectdb_get_file_path(struct objectdb_path *path, struct objectdb_object *file);
+static void objectdb_free_path(struct objectdb_path *path);
+#endif
+static char *objectdb_get_cached_path(struct objectdb_object *dir, enum objectdb_path_type type, size_t *length);
+static char *objectdb_build_dir_path(struct objectdb_object *dir, enum objectdb_path_type type, char *parent, size_t parent_length, size_t *length);
+static void objectdb_start_walk(struct objectdb_walk *walk, struct objectdb_object *dir);
+static struct objectdb_object *objectdb_walk_next(struct objectdb_walk *walk);
+static bool objectdb_end_walk(struct objectdb_walk *walk);
+
+/**
+ * Create a new, empty, object database.
+ *
+ * \param *arena	Pointer to the arena to allocate memory from.
+ * \return		Pointer to the new database, or NULL on failure.
+ */
+
+struct objectdb *objectdb_create(struct arena *arena)
+{
+	struct objectdb *db;
+
+	if (arena == NULL)
+		return NULL;
+
+	db = arena_alloc(arena, sizeof(struct objectdb));
+	if (db == NULL)
+		return NULL;
+
+	db->root = NULL;
+	db->arena = arena;
+	db->manifest = NULL;
+	db->added = NULL;
+	db->added_count = 0;
+	db->created = 0;
+	db->sync = FILES_SYNC_NONE;
+	db->batch_io = false;
+	db->readahead = 0;
+	db->prefetch = NULL;
+	db->prefetched = 0;
+	db->prefetches = NULL;
+	db->writes = NULL;
+	db->deletes = NULL;
+	db->source = NULL;
+	db->includes = NULL;
+	db->excludes = NULL;
+
+#ifdef LINUX
+	pthread_mutex_init(&(db->path_lock), NULL);
+#endif
+
+	return db;
+}
+
+/**
+ * Destroy an object database. The memory will be released when the
+ * arena passed to objectdb_create() is destroyed.
+ *
+ * \param *db		Pointer to the database to destroy.
+ */
+
+void objectdb_destroy(struct objectdb *db)
+{
+	if (db == NULL)
+		return;
+
+#ifdef LINUX
+	pthread_mutex_destroy(&(db->path_lock));
+#endif
+
+	db->root = NULL;
+}
+
+/**
+ * Return the arena from which an object database allocates its memory.
+ *
+ * \param *db		Pointer to the database of interest.
+ * \return		Pointer to the arena, or NULL.
+ */
+
+struct arena *objectdb_get_arena(struct objectdb *db)
+{
+	return (db != NULL) ? db->arena : NULL;
+}
+
+/**
+ * Set a manifest which can be used to avoid reading the contents of files
+ * whose catalogue information hasn't changed since the manifest was written.
+ *
+ * \param *db		Pointer to the database to update.
+ * \param *manifest	Pointer to the manifest to use, or NULL for none.
+ */
+
+void objectdb_set_manifest(struct objectdb *db, struct manifest *manifest)
+{
+	if (db != NULL)
+		db->manifest = manifest;
+}
+
+/**
+ * Set whether file access should be batched up where possible, so that
+ * many operations can be in flight at once.
+ *
+ * \param *db		Pointer to the database to update.
+ * \param batch_io	True to batch file access; False to access files
+ *			individually.
+ */
+
+void objectdb_set_batch_io(struct objectdb *db, bool batch_io)
+{
+	if (db != NULL)
+		db->batch_io = batch_io;
+}
+
+/**
+ * Set the number of files whose contents should be prefetched ahead of
+ * the one being compared, so that the filing system can fetch them in the
+ * background. This has no effect if file access is being batched.
+ *
+ * \param *db		Pointer to the database to update.
+ * \param readahead	The number of files to prefetch, or 0 for none.
+ */
+
+void objectdb_set_readahead(struct objectdb *db, size_t readahead)
+{
+	if (db != NULL)
+		db->readahead = readahead;
+}
+
+/**
+ * Set the source file from which the contents of StrongHelp files are to
+ * be read as required, for files which were added without their data
+ * being held in memory.
+ *
+ * \param *db		Pointer to the database to update.
+ * \param *source	Pointer to the source file, or NULL for none.
+ */
+
+void objectdb_set_source(struct objectdb *db, struct files_source *source)
+{
+	if (db != NULL)
+		db->source = source;
+}
+
+/**
+ * Add a wildcard pattern to select the objects to be processed, which is
+ * matched against their paths within the manual. If there are any patterns
+ * to include objects, only directories and files which match one of them,
+ * or which are within a directory that does, are included. Anything which
+ * matches a pattern to exclude it is left out. Filters must be added before
+ * any objects.
+ *
+ * \param *db		Pointer to the database to update.
+ * \param *pattern	Pointer to the pattern to add.
+ * \param exclude	True to exclude the matching objects; False to
+ *			include them.
+ * \return		True if successful; False on failure.
+ */
+
+bool objectdb_add_filter(struct objectdb *db, char *pattern, bool exclude)
+{
+	struct objectdb_filter *filter;
+
+	if (db == NULL || pattern == NULL)
+		return false;
+
+	filter = arena_alloc(db->arena, sizeof(struct objectdb_filter));
+	if (filter == NULL)
+		return false;
+
+	filter->pattern = pattern;
+
+	if (exclude) {
+		filter->next = db->excludes;
+		db->excludes = filter;
+	} else {
+		filter->next = db->includes;
+		db->includes = filter;
+	}
+
+	return true;
+}
+
+/**
+ * Test whether an object found in a directory should be added to the
+ * database, given the filters that have been set on it. Directories are
+ * included if anything within them could be. If anything is left out, the
+ * directory is marked so that it won't be deleted by an update.
+ *
+ * \param *db		Pointer to the database to test against.
+ * \param *parent	Pointer to the directory holding the object.
+ * \param *name		Pointer to the name of the object.
+ * \param directory	True if the object is a directory; else false.
+ * \return		True if the object should be added; else false.
+ */
+
+bool objectdb_filter_object(struct objectdb *db, struct objectdb_object *parent, char *name, bool directory)
+{
+	enum string_match match;
+	bool include = true;
+
+	if (db == NULL || parent == NULL || name == NULL)
+		return true;
+
+	if (db->excludes != NULL && objectdb_match_filters(db->excludes, parent, name) == STRING_MATCH_FULL)
+		include = false;
+	else if (!parent->included) {
+		match = objectdb_match_filters(db->includes, parent, name);
+		include = (match == STRING_MATCH_FULL || (directory && match == STRING_MATCH_PARTIAL)) ? true : false;
+	}
+
+	/* Each directory is only filled in by a single thread at a time. */
+
+	if (!include)
+		parent->filtered = true;
+
+	return include;
+}
 
 /**
  * Add a directory reference from the StrongHelp manual.
  *
+ * \param *db		Pointer to the database to add to.
  * \param *parent	Pointer to the parent directory, or NULL for the root.
  * \param *name		Pointer to the name of the directory.
  * \return		Pointer to the new directory instance, or NULL.
  */
 
-struct objectdb_object *objectdb_add_stronghelp_directory(struct objectdb_object *parent, char *name)
+struct objectdb_object *objectdb_add_stronghelp_directory(struct objectdb *db, struct objectdb_object *parent, char *name)
 {
 	struct objectdb_object *dir;
 
-	if (parent == NULL && objectdb_root != NULL) {
-		msg_report(MSG_TOO_MANY_ROOTS);
+	if (db == NULL)
 		return NULL;
-	}
 
-	dir = malloc(sizeof(struct objectdb_object));
-	if (dir == NULL) {
-		msg_report(MSG_NO_MEMORY);
+	if (parent == NULL && db->root != NULL) {
+		msg_report(MSG_TOO_MANY_ROOTS);
 		return NULL;
 	}
 
-	dir->name = name;
-	dir->status = OBJECTDB_STATUS_UNKNOWN;
+	dir = objectdb_create_object(db, parent, name);
+	if (dir == NULL)
+		return NULL;
 
 	dir->stronghelp.name = name;
 	dir->stronghelp.size = 0;
 	dir->stronghelp.filetype = OBJECTDB_TYPE_DIRECTORY;
 	dir->stronghelp.data = NULL;
 
-	dir->disc.name = NULL;
-	dir->disc.size = 0;
-	dir->disc.filetype = OBJECTDB_TYPE_UNKNOWN;
-	dir->disc.data = NULL;
-
-	dir->directories = NULL;
-	dir->files = NULL;
-	dir->parent = parent;
+	objectdb_set_included(dir);
 
-	if (parent != NULL) {
-		objectdb_link_object(&(parent->directories), dir);
-	} else {
-		dir->next = NULL;
-		objectdb_root = dir;
-	}
+	if (parent == NULL)
+		db->root = dir;
+	else if (!objectdb_link_object(&(parent->directories), &(parent->directory_index), dir))
+		return NULL;
 
 	return dir;
 }
@@ -165,47 +572,45 @@ struct objectdb_object *objectdb_add_stronghelp_directory(struct objectdb_object
 /**
  * Add a file reference from the StrongHelp manual.
  *
+ * \param *db		Pointer to the database to add to.
  * \param *parent	Pointer to the parent directory.
  * \param *name		Pointer to the name of the file.
  * \param size		The size of the file.
  * \param filetype	The filetype of the file.
- * \param *data		Pointer to the file data.
+ * \param *data		Pointer to the file data, or NULL if it is to be
+ *			read from the database's source file.
+ * \param offset	The offset of the file data within the source file.
+ * \param *hash		Pointer to the CRC32C hash of the file data, or NULL
+ *			if it is to be calculated when it is first needed.
  * \return		Pointer to the new file instance, or NULL.
  */
 
-struct objectdb_object *objectdb_add_stronghelp_file(struct objectdb_object *parent, char *name, size_t size, uint32_t filetype, char *data)
+struct objectdb_object *objectdb_add_stronghelp_file(struct objectdb *db, struct objectdb_object *parent, char *name, size_t size, uint32_t filetype, char *data, size_t offset, uint32_t *hash)
 {
 	struct objectdb_object *file;
 
+	if (db == NULL)
+		return NULL;
+
 	if (parent == NULL) {
 		msg_report(MSG_NO_PARENT);
 		return NULL;
 	}
 
-	file = malloc(sizeof(struct objectdb_object));
-	if (file == NULL) {
-		msg_report(MSG_NO_MEMORY);
+	file = objectdb_create_object(db, parent, name);
+	if (file == NULL)
 		return NULL;
-	}
-
-	file->name = name;
-	file->status = OBJECTDB_STATUS_UNKNOWN;
 
 	file->stronghelp.name = name;
 	file->stronghelp.size = size;
 	file->stronghelp.filetype = filetype;
 	file->stronghelp.data = data;
+	file->stronghelp.offset = offset;
+	file->stronghelp.hash = (hash != NULL) ? *hash : 0;
+	file->stronghelp.hashed = (hash != NULL) ? true : false;
 
-	file->disc.name = NULL;
-	file->disc.size = 0;
-	file->disc.filetype = OBJECTDB_TYPE_UNKNOWN;
-	file->disc.data = NULL;
-
-	file->directories = NULL;
-	file->files = NULL;
-	file->parent = parent;
-
-	objectdb_link_object(&(parent->files), file);
+	if (!objectdb_link_object(&(parent->files), &(parent->file_index), file))
+		return NULL;
 
 	return file;
 }
@@ -213,44 +618,37 @@ struct objectdb_object *objectdb_add_stronghelp_file(struct objectdb_object *par
 /**
  * Add a directory reference from the disc manual.
  *
+ * \param *db		Pointer to the database to add to.
  * \param *parent	Pointer to the parent directory, or NULL for the root.
  * \param *name		Pointer to the name of the directory.
  * \param *real_name	Pointer to the real name of the directory.
  * \return		Pointer to the resulting directory instance, or NULL.
  */
 
-struct objectdb_object *objectdb_add_disc_directory(struct objectdb_object *parent, char *name, char *real_name)
+struct objectdb_object *objectdb_add_disc_directory(struct objectdb *db, struct objectdb_object *parent, char *name, char *real_name)
 {
 	struct objectdb_object *dir;
 
-	if (parent == NULL && objectdb_root == NULL) {
-		msg_report(MSG_NO_ROOT);
+	if (db == NULL)
 		return NULL;
-	}
 
-	dir = (parent == NULL) ? objectdb_root : objectdb_find_object(parent->directories, name);
+	/* If there's no StrongHelp manual to compare the folder against, as
+	 * when a folder is being packed, the disc's root becomes the root.
+	 */
+
+	dir = (parent == NULL) ? db->root : objectdb_find_object(&(parent->directory_index), name);
 
 	if (dir == NULL) {
-		dir = malloc(sizeof(struct objectdb_object));
-		if (dir == NULL) {
-			msg_report(MSG_NO_MEMORY);
+		dir = objectdb_create_object(db, parent, name);
+		if (dir == NULL)
 			return NULL;
-		}
 
-		dir->name = name;
-		dir->status = OBJECTDB_STATUS_UNKNOWN;
-
-		dir->stronghelp.name = NULL;
-		dir->stronghelp.size = 0;
-		dir->stronghelp.filetype = OBJECTDB_TYPE_UNKNOWN;
-		dir->stronghelp.data = NULL;
-
-		dir->directories = NULL;
-		dir->files = NULL;
-		dir->parent = parent;
+		if (parent == NULL)
+			db->root = dir;
+		else if (!objectdb_link_object(&(parent->directories), &(parent->directory_index), dir))
+			return NULL;
 
-		if (parent != NULL)
-			objectdb_link_object(&(parent->directories), dir);
+		objectdb_set_included(dir);
 	}
 
 	dir->disc.name = real_name;
@@ -264,6 +662,7 @@ struct objectdb_object *objectdb_add_disc_directory(struct objectdb_object *pare
 /**
  * Add a file reference from the StrongHelp manual.
  *
+ * \param *db		Pointer to the database to add to.
  * \param *parent	Pointer to the parent directory.
  * \param *name		Pointer to the name of the file.
  * \param *real_name	Pointer to the real name of the file.
@@ -272,37 +671,27 @@ struct objectdb_object *objectdb_add_disc_directory(struct objectdb_object *pare
  * \return		Pointer to the new file instance, or NULL.
  */
 
-struct objectdb_object *objectdb_add_disc_file(struct objectdb_object *parent, char *name, char *real_name, size_t size, uint32_t filetype)
+struct objectdb_object *objectdb_add_disc_file(struct objectdb *db, struct objectdb_object *parent, char *name, char *real_name, size_t size, uint32_t filetype)
 {
 	struct objectdb_object *file;
 
+	if (db == NULL)
+		return NULL;
+
 	if (parent == NULL) {
 		msg_report(MSG_NO_PARENT);
 		return NULL;
 	}
 
-	file = objectdb_find_object(parent->files, name);
+	file = objectdb_find_object(&(parent->file_index), name);
 
 	if (file == NULL) {
-		file = malloc(sizeof(struct objectdb_object));
-		if (file == NULL) {
-			msg_report(MSG_NO_MEMORY);
+		file = objectdb_create_object(db, parent, name);
+		if (file == NULL)
 			return NULL;
-		}
-
-		file->name = name;
-		file->status = OBJECTDB_STATUS_UNKNOWN;
 
-		file->stronghelp.name = NULL;
-		file->stronghelp.size = 0;
-		file->stronghelp.filetype = OBJECTDB_TYPE_UNKNOWN;
-		file->stronghelp.data = NULL;
-
-		file->directories = NULL;
-		file->files = NULL;
-		file->parent = parent;
-
-		objectdb_link_object(&(parent->files), file);
+		if (!objectdb_link_object(&(parent->files), &(parent->file_index), file))
+			return NULL;
 	}
 
 	file->disc.name = real_name;
@@ -314,505 +703,3275 @@ struct objectdb_object *objectdb_add_disc_file(struct objectdb_object *parent, c
 }
 
 /**
- * Find an object by matching the common filename.
+ * Start merging the contents of a directory on disc into the database.
+ * The directory's lists are sorted, so that the disc objects can then be
+ * matched up with them in a single pass.
  *
- * \param *list		Pointer to the first object in the list to search.
- * \param *name		Pointer to the name to be matched.
- * \return		Pointer to the matched object, or NULL.
+ * \param *parent	Pointer to the directory to merge into.
+ * \param *merge	Pointer to the merge block to initialise.
  */
 
-static struct objectdb_object *objectdb_find_object(struct objectdb_object *list, char *name)
+void objectdb_start_disc_merge(struct objectdb_object *parent, struct objectdb_merge *merge)
 {
-	int result = -1;
+	if (merge == NULL)
+		return;
+
+	merge->parent = parent;
+	merge->files = NULL;
+	merge->directories = NULL;
 
-	while (list != NULL && ((list->name == NULL) || ((result = strcmp(list->name, name)) < 0)))
-		list = list->next;
+	if (parent == NULL)
+		return;
+
+	parent->files = objectdb_sort_list(parent->files);
+	parent->directories = objectdb_sort_list(parent->directories);
 
-	return (result == 0) ? list : NULL;
+	merge->files = &(parent->files);
+	merge->directories = &(parent->directories);
 }
 
 /**
- * Link a new object into an object list, in the correct position alphabetically.
+ * Merge a directory reference from the disc into the database. References
+ * must be supplied in alphabetical order.
  *
- * \param **list	Pointer to the list head pointer location.
- * \param *object	Pointer to the new object to link.
+ * \param *db		Pointer to the database to add to.
+ * \param *merge	Pointer to the merge block for the parent directory.
+ * \param *name		Pointer to the name of the directory.
+ * \param *real_name	Pointer to the real name of the directory.
+ * \return		Pointer to the resulting directory instance, or NULL.
  */
 
-static void objectdb_link_object(struct objectdb_object **list, struct objectdb_object *object)
+struct objectdb_object *objectdb_merge_disc_directory(struct objectdb *db, struct objectdb_merge *merge, char *name, char *real_name)
 {
-	if (list == NULL || object == NULL)
-		return;
+	struct objectdb_object *dir;
 
-	while (*list != NULL && strcmp((*list)->name, object->name) < 0)
-		list = &((*list)->next);
+	if (db == NULL || merge == NULL || merge->parent == NULL) {
+		msg_report(MSG_NO_PARENT);
+		return NULL;
+	}
 
-	object->next = *list;
-	*list = object;
+	dir = objectdb_merge_object(db, merge->parent, &(merge->directories), &(merge->parent->directory_index), name);
+	if (dir == NULL)
+		return NULL;
+
+	if (dir->disc.name == NULL && dir->stronghelp.name == NULL)
+		objectdb_set_included(dir);
+
+	dir->disc.name = real_name;
+	dir->disc.size = 0;
+	dir->disc.filetype = OBJECTDB_TYPE_DIRECTORY;
+	dir->disc.data = NULL;
+
+	return dir;
 }
 
 /**
- * Check the status of the objects held in the database.
- * 
- * \return		True if successful, false on failure.
-*/
+ * Merge a file reference from the disc into the database. References
+ * must be supplied in alphabetical order.
+ *
+ * \param *db		Pointer to the database to add to.
+ * \param *merge	Pointer to the merge block for the parent directory.
+ * \param *name		Pointer to the name of the file.
+ * \param *real_name	Pointer to the real name of the file.
+ * \param size		The size of the file.
+ * \param filetype	The filetype of the file.
+ * \return		Pointer to the resulting file instance, or NULL.
+ */
 
-bool objectdb_check_status(void)
+struct objectdb_object *objectdb_merge_disc_file(struct objectdb *db, struct objectdb_merge *merge, char *name, char *real_name, size_t size, uint32_t filetype)
 {
-	return objectdb_check_directory_status(objectdb_root);
+	struct objectdb_object *file;
+
+	if (db == NULL || merge == NULL || merge->parent == NULL) {
+		msg_report(MSG_NO_PARENT);
+		return NULL;
+	}
+
+	file = objectdb_merge_object(db, merge->parent, &(merge->files), &(merge->parent->file_index), name);
+	if (file == NULL)
+		return NULL;
+
+	file->disc.name = real_name;
+	file->disc.size = size;
+	file->disc.filetype = filetype;
+	file->disc.data = NULL;
+
+	return file;
 }
 
 /**
- * Check the statis of the objects held in a directory, and in all of the
- * directories and files contained within it.
+ * Forget everything that was found in the disc folder, so that the folder
+ * can be scanned again and compared with the manual already held in the
+ * database. Objects which were only on disc are dropped, and the rest are
+ * left as they were after the manual had been read.
  *
- * \param *dir		Pointer to the directory to be checked.
+ * \param *db		Pointer to the database to reset.
  * \return		True if successful, false on failure.
  */
 
-static bool objectdb_check_directory_status(struct objectdb_object *dir)
+bool objectdb_reset_disc(struct objectdb *db)
 {
-	struct objectdb_object *object;
+	struct objectdb_object *dir;
+	struct objectdb_walk walk;
 
-	if (dir == NULL)
+	if (db == NULL || db->root == NULL)
 		return false;
 
-	if (dir->stronghelp.name == NULL && dir->disc.name != NULL)
-		dir->status = OBJECTDB_STATUS_DELETED;
-	else if (dir->stronghelp.name != NULL && dir->disc.name == NULL)
-		dir->status = OBJECTDB_STATUS_ADDED;
-	else
-		dir->status = OBJECTDB_STATUS_IDENTICAL;
+	db->added = NULL;
+	db->added_count = 0;
 
-	object = dir->files;
-	while (object != NULL) {
-		if (object->stronghelp.name == NULL && object->disc.name != NULL)
-			object->status = OBJECTDB_STATUS_DELETED;
-		else if (object->stronghelp.name != NULL && object->disc.name == NULL)
-			object->status = OBJECTDB_STATUS_ADDED;
-		else if (object->stronghelp.filetype != object->disc.filetype)
-			object->status = OBJECTDB_STATUS_TYPE_CHANGED;
-		else if (object->stronghelp.size != object->disc.size)
-			object->status = OBJECTDB_STATUS_SIZE_CHANGED;
-		else if (!objectdb_compare_files(object))
-			object->status = OBJECTDB_STATUS_CONTENT_CHANGED;
-		else
-			object->status = OBJECTDB_STATUS_IDENTICAL;
+	/* Any directories which were only on disc are still visited, as they
+	 * have already been queued by the walk, but are no longer linked in.
+	 */
 
-		object = object->next;
-	}
+	objectdb_start_walk(&walk, db->root);
 
-	object = dir->directories;
-	while (object != NULL) {
-		if (!objectdb_check_directory_status(object))
-			return false;
-		object = object->next;
+	while ((dir = objectdb_walk_next(&walk)) != NULL) {
+		objectdb_reset_disc_object(dir);
+
+		dir->files = objectdb_reset_disc_list(dir->files, &(dir->file_index));
+		dir->directories = objectdb_reset_disc_list(dir->directories, &(dir->directory_index));
 	}
 
-	return true;
+	return objectdb_end_walk(&walk);
 }
 
 /**
- * Perform a byte-wise content comparison between the StrongHelp and disc-based
- * versions of a file.
+ * Drop the objects which were only on disc from a directory list, and
+ * reset the disc details of those which remain. The list stays in the
+ * same order, and its index is rebuilt in place.
  *
- * \param *object	Pointer to the file object to be tested.
- * \return		True if the files are identical, False if different.
+ * \param *list		Pointer to the first object in the list.
+ * \param *index	Pointer to the index for the list.
+ * \return		Pointer to the first object in the new list.
  */
 
-static bool objectdb_compare_files(struct objectdb_object *object)
+static struct objectdb_object *objectdb_reset_disc_list(struct objectdb_object *list, struct objectdb_index *index)
 {
-	char *filename;
-	FILE *file = NULL;
-	bool identical = true;
-	int i = 0;
+	struct objectdb_object *head = NULL, **tail = &head;
+	size_t i;
 
-	if (object == NULL || object->stronghelp.data == NULL || object->disc.name == NULL)
-		return false;
+	for (i = 0; i < index->size; i++)
+		index->buckets[i] = NULL;
 
-	filename = objectdb_get_path(object, OBJECTDB_PATH_TYPE_DISC, FILES_PATH_SEPARATOR);
-	if (filename == NULL) {
-		msg_report(MSG_NO_MEMORY);
-		return false;
-	}
+	index->count = 0;
 
-	file = fopen(filename, "rw");
-	if (file == NULL) {
-		msg_report(MSG_OPEN_FAILED, filename);
-		free(filename);
-		return false;
-	}
+	/* The index never needs to grow, as it is only losing objects. */
 
-	free(filename);
+	for (; list != NULL; list = list->next) {
+		if (list->stronghelp.name == NULL)
+			continue;
 
-	while (i < object->stronghelp.size && !feof(file) && identical) {
-		if (object->stronghelp.data[i++] != (char) fgetc(file))
-			identical = false;
+		objectdb_reset_disc_object(list);
+
+		*tail = list;
+		tail = &(list->next);
+
+		objectdb_index_object(index, list);
 	}
 
-	fclose(file);
+	*tail = NULL;
 
-	return identical;
+	return head;
 }
 
 /**
- * Write a report of the object statuses in the database.
+ * Reset the disc details of an object, along with anything which was
+ * worked out from them.
  *
- * \param include_all	Should identical objects be included.
- * \return		True if successful, false on failure.
+ * \param *object	Pointer to the object to reset.
  */
 
-bool objectdb_output_report(bool include_all)
+static void objectdb_reset_disc_object(struct objectdb_object *object)
 {
-	struct objectdb_report_summary summary = { 0, 0, 0, 0, 0 };
+	object->status = OBJECTDB_STATUS_UNKNOWN;
+	object->difference = 0;
+	object->moved = NULL;
+
+	object->disc.name = NULL;
+	object->disc.size = 0;
+	object->disc.filetype = OBJECTDB_TYPE_UNKNOWN;
+	object->disc.data = NULL;
+	object->disc.offset = 0;
+	object->disc.hash = 0;
+	object->disc.hashed = false;
+
+	object->paths[OBJECTDB_PATH_TYPE_DISC] = NULL;
+	object->path_lengths[OBJECTDB_PATH_TYPE_DISC] = 0;
+	object->paths[OBJECTDB_PATH_TYPE_ARCHIVE] = NULL;
+	object->path_lengths[OBJECTDB_PATH_TYPE_ARCHIVE] = 0;
+
+	object->filtered = false;
+}
 
-	if (!objectdb_output_directory_report(objectdb_root, &summary, include_all))
-		return false;
+/**
+ * Find an object in a sorted list by advancing a cursor through it, or
+ * create a new one in the correct position if there isn't a match. The
+ * cursor is left on the object, so that a repeated name finds it again.
+ *
+ * \param *db		Pointer to the database to own any new object.
+ * \param *parent	Pointer to the directory holding the list.
+ * \param ***cursor	Pointer to the cursor into the list.
+ * \param *index	Pointer to the index for the list.
+ * \param *name		Pointer to the name of the object.
+ * \return		Pointer to the object, or NULL on failure.
+ */
 
-	if (summary.directories_added == 0 && summary.directories_deleted == 0 &&
-			summary.files_added == 0 && summary.files_changed == 0 && summary.files_deleted == 0) {
-		msg_report(MSG_SUMMARY_IDENTICAL);
-	} else {
-		if (summary.directories_added > 0 || summary.directories_deleted > 0)
-			msg_report(MSG_SUMMARY_DIRS, summary.directories_added, summary.directories_deleted);
+static struct objectdb_object *objectdb_merge_object(struct objectdb *db, struct objectdb_object *parent, struct objectdb_object ***cursor, struct objectdb_index *index, char *name)
+{
+	struct objectdb_object *object;
 
-		if (summary.files_added > 0 || summary.files_changed > 0 || summary.files_deleted > 0)
-			msg_report(MSG_SUMMARY_FILES, summary.files_added, summary.files_changed, summary.files_deleted);
-	}
+	while (**cursor != NULL && strcmp((**cursor)->name, name) < 0)
+		*cursor = &((**cursor)->next);
 
-	return true;
+	if (**cursor != NULL && strcmp((**cursor)->name, name) == 0)
+		return **cursor;
+
+	object = objectdb_create_object(db, parent, name);
+	if (object == NULL || !objectdb_index_object(index, object))
+		return NULL;
+
+	object->next = **cursor;
+	**cursor = object;
+
+	return object;
 }
 
 /**
- * Write a report of the object statuses in a directory, and all subdirectories
- * below that.
+ * Create a new object, with no StrongHelp or disc details attached.
  *
- * \param *dir		Pointer to the directory on which to report.
- * \param *summary	Pointer to the report summary data block.
- * \param include_all	Should identical objects be included.
- * \return		True if successful, false on failure.
+ * \param *db		Pointer to the database to own the object.
+ * \param *parent	Pointer to the parent directory, or NULL for the root.
+ * \param *name		Pointer to the name of the object.
+ * \return		Pointer to the new object, or NULL on failure.
  */
 
-static bool objectdb_output_directory_report(struct objectdb_object *dir, struct objectdb_report_summary *summary, bool include_all)
+static struct objectdb_object *objectdb_create_object(struct objectdb *db, struct objectdb_object *parent, char *name)
 {
 	struct objectdb_object *object;
-	char *name;
-
-	if (dir == NULL)
-		return false;
+	int i;
 
-	name = objectdb_get_path(dir, OBJECTDB_PATH_TYPE_AGNOSTIC, ".");
-	if (name != NULL) {
-		switch (dir->status) {
-		case OBJECTDB_STATUS_ADDED:
-			msg_report(MSG_REPORT_DIR_ADDED, name);
-			summary->directories_added++;
-			break;
-		case OBJECTDB_STATUS_DELETED:
-			msg_report(MSG_REPORT_DIR_DELETED, name);
-			summary->directories_deleted++;
-			break;
-		case OBJECTDB_STATUS_IDENTICAL:
-			if (include_all)
-				msg_report(MSG_REPORT_DIR_UNCHANGED, name);
-			break;
-		default:
-			msg_report(MSG_BAD_STATUS, name);
-			break;
-		}
+	object = arena_alloc(db->arena, sizeof(struct objectdb_object));
+	if (object == NULL)
+		return NULL;
 
-		free(name);
-	} else {
-		msg_report(MSG_NO_MEMORY);
-		return false;
+	object->name = name;
+	object->status = OBJECTDB_STATUS_UNKNOWN;
+#ifdef LINUX
+	object->sequence = __atomic_fetch_add(&(db->created), 1, __ATOMIC_RELAXED);
+#else
+	object->sequence = db->created++;
+#endif
+	object->difference = 0;
+	object->moved = NULL;
+
+	object->stronghelp.name = NULL;
+	object->stronghelp.size = 0;
+	object->stronghelp.filetype = OBJECTDB_TYPE_UNKNOWN;
+	object->stronghelp.data = NULL;
+	object->stronghelp.offset = 0;
+	object->stronghelp.hash = 0;
+	object->stronghelp.hashed = false;
+
+	object->disc.name = NULL;
+	object->disc.size = 0;
+	object->disc.filetype = OBJECTDB_TYPE_UNKNOWN;
+	object->disc.data = NULL;
+	object->disc.offset = 0;
+	object->disc.hash = 0;
+	object->disc.hashed = false;
+
+	object->directories = NULL;
+	object->files = NULL;
+
+	object->directory_index.buckets = NULL;
+	object->directory_index.size = 0;
+	object->directory_index.count = 0;
+
+	object->file_index.buckets = NULL;
+	object->file_index.size = 0;
+	object->file_index.count = 0;
+
+	for (i = 0; i < OBJECTDB_PATH_TYPES; i++) {
+		object->paths[i] = NULL;
+		object->path_lengths[i] = 0;
 	}
 
-	object = dir->files;
-	while (object != NULL) {
-		name = objectdb_get_path(object, OBJECTDB_PATH_TYPE_AGNOSTIC, ".");
-		if (name != NULL) {
-			switch (object->status) {
-			case OBJECTDB_STATUS_ADDED:
-				msg_report(MSG_REPORT_FILE_ADDED, name);
-				summary->files_added++;
-				break;
-			case OBJECTDB_STATUS_DELETED:
-				msg_report(MSG_REPORT_FILE_DELETED, name);
-				summary->files_deleted++;
-				break;
-			case OBJECTDB_STATUS_TYPE_CHANGED:
-				msg_report(MSG_REPORT_FILE_TYPE, object->disc.filetype, object->stronghelp.filetype, name);
-				summary->files_changed++;
-				break;
-			case OBJECTDB_STATUS_SIZE_CHANGED:
-			case OBJECTDB_STATUS_CONTENT_CHANGED:
-				msg_report(MSG_REPORT_FILE_CONTENTS, object->disc.size, object->stronghelp.size, name);
-				summary->files_changed++;
-				break;
-			case OBJECTDB_STATUS_IDENTICAL:
-				if (include_all)
-					msg_report(MSG_REPORT_FILE_UNCHANGED, name);
-				break;
-			default:
-				msg_report(MSG_BAD_STATUS, name);
-				break;
-			}
+	object->included = true;
+	object->filtered = false;
 
-			free(name);
-		} else {
-			msg_report(MSG_NO_MEMORY);
-			return false;
-		}
+	object->db = db;
+	object->parent = parent;
+	object->next = NULL;
+	object->chain = NULL;
 
-		object = object->next;
-	}
+	return object;
+}
 
-	object = dir->directories;
-	while (object != NULL) {
-		if (!objectdb_output_directory_report(object, summary, include_all))
-			return false;
-		object = object->next;
-	}
+/**
+ * Set whether everything within a new directory is included by the
+ * filters on the database, without needing to be tested individually.
+ *
+ * \param *dir		Pointer to the directory to update.
+ */
 
-	return true;
+static void objectdb_set_included(struct objectdb_object *dir)
+{
+	if (dir->db->includes == NULL)
+		dir->included = true;
+	else if (dir->parent == NULL)
+		dir->included = false;
+	else if (dir->parent->included)
+		dir->included = true;
+	else
+		dir->included = (objectdb_match_filters(dir->db->includes, dir->parent, dir->name) == STRING_MATCH_FULL) ? true : false;
 }
 
 /**
- * Update the objects in the database.
- * 
- * \return		True if successful, false on failure.
+ * Match the path of an object against a list of filters, returning the
+ * best match found. Paths are matched relative to the root directory.
+ *
+ * \param *filters	Pointer to the first filter in the list.
+ * \param *parent	Pointer to the directory holding the object.
+ * \param *name		Pointer to the name of the object.
+ * \return		The best match found.
  */
 
-bool objectdb_update(void)
+static enum string_match objectdb_match_filters(struct objectdb_filter *filters, struct objectdb_object *parent, char *name)
 {
-	char *path = NULL;
-	struct files_object_info *root;
+	enum string_match match, best = STRING_MATCH_NONE;
+	size_t parent_length, root_length, length;
+	char *parent_path, *root_path, *path;
 
-	/* Make sure that the root directory exists on disc first. */
+	root_path = objectdb_get_dir_path(parent->db->root, OBJECTDB_PATH_TYPE_AGNOSTIC, &root_length);
+	parent_path = objectdb_get_dir_path(parent, OBJECTDB_PATH_TYPE_AGNOSTIC, &parent_length);
+	if (root_path == NULL || parent_path == NULL)
+		return STRING_MATCH_NONE;
+
+	/* Strip the root directory's name from the start of the path. */
+
+	if (parent_length > root_length) {
+		parent_path += root_length + 1;
+		parent_length -= root_length + 1;
+	} else {
+		parent_length = 0;
+	}
 
-	path = objectdb_get_path(objectdb_root, OBJECTDB_PATH_TYPE_DISC, FILES_PATH_SEPARATOR);
+	length = parent_length + strlen(name) + 2;
+
+	path = malloc(length);
 	if (path == NULL) {
 		msg_report(MSG_NO_MEMORY);
-		return false;
+		return STRING_MATCH_NONE;
 	}
 
-	root = files_read_directory_info(path, true);
+	*path = '\0';
 
-	if (root == NULL) {
-		msg_report(MSG_CREATE_DIR, path);
-		if (!files_make_directory(path))
-			return false;
-	} else {
-		free(root);
+	if (parent_length > 0) {
+		string_copy(path, parent_path, parent_length + 1);
+		string_append(path, ".", length);
 	}
 
-	free(path);
+	string_append(path, name, length);
 
-	/* Update all of the files and folders. */
+	while (filters != NULL && best != STRING_MATCH_FULL) {
+		match = string_match_path(filters->pattern, path, '.');
+		if (match > best)
+			best = match;
+
+		filters = filters->next;
+	}
+
+	free(path);
 
-	return objectdb_update_directory(objectdb_root);
+	return best;
 }
 
 /**
- * Update a given output directory and all of the folders below it.
+ * Find an object by matching the common filename.
  *
- * \param *dir		Pointer to the directory directory to be output.
- * \return		True if successful, false on failure.
+ * \param *index	Pointer to the index of the list to search.
+ * \param *name		Pointer to the name to be matched.
+ * \return		Pointer to the matched object, or NULL.
  */
 
-static bool objectdb_update_directory(struct objectdb_object *dir)
+static struct objectdb_object *objectdb_find_object(struct objectdb_index *index, char *name)
 {
 	struct objectdb_object *object;
-	char *path = NULL;
 
-	if (dir == NULL)
+	if (index == NULL || index->buckets == NULL || name == NULL)
+		return NULL;
+
+	object = index->buckets[hash_string(name) & (index->size - 1)];
+
+	while (object != NULL && ((object->name == NULL) || (strcmp(object->name, name) != 0)))
+		object = object->chain;
+
+	return object;
+}
+
+/**
+ * Link a new object into an object list and its index. The list is not
+ * kept in order: objectdb_sort_directory() must be used to sort it once
+ * all of the objects have been added.
+ *
+ * \param **list	Pointer to the list head pointer location.
+ * \param *index	Pointer to the index for the list.
+ * \param *object	Pointer to the new object to link.
+ * \return		True if successful; false if the object couldn't be
+ *			indexed, in which case it is left unlinked.
+ */
+
+static bool objectdb_link_object(struct objectdb_object **list, struct objectdb_index *index, struct objectdb_object *object)
+{
+	if (list == NULL || index == NULL || object == NULL)
 		return false;
 
-	if (dir->status == OBJECTDB_STATUS_ADDED) {
-		dir->disc.name = files_make_filename(dir->stronghelp.name, dir->stronghelp.filetype);
+	if (!objectdb_index_object(index, object))
+		return false;
 
-		path = objectdb_get_path(dir, OBJECTDB_PATH_TYPE_DISC, FILES_PATH_SEPARATOR);
-		if (path == NULL) {
-			msg_report(MSG_NO_MEMORY);
-			return false;
-		}
+	object->next = *list;
+	*list = object;
 
-		msg_report(MSG_CREATE_DIR, path);
-		if (!files_make_directory(path))
-			return false;
+	return true;
+}
 
-		free(path);
-	}
+/**
+ * Add an object to the index of a directory list. If the index can't be
+ * grown, the object is added to the existing buckets, which still works
+ * but more slowly; it can only fail if there are no buckets at all.
+ *
+ * \param *index	Pointer to the index for the list.
+ * \param *object	Pointer to the object to add.
+ * \return		True if successful; false on failure.
+ */
 
-	object = dir->files;
-	while (object != NULL) {
-		switch (object->status) {
-		case OBJECTDB_STATUS_ADDED:
-			object->disc.name = files_make_filename(object->stronghelp.name, object->stronghelp.filetype);
+static bool objectdb_index_object(struct objectdb_index *index, struct objectdb_object *object)
+{
+	struct objectdb_object **buckets, *entry, *next;
+	size_t size, i;
+	uint32_t bucket;
 
-			path = objectdb_get_path(object, OBJECTDB_PATH_TYPE_DISC, FILES_PATH_SEPARATOR);
-			if (path == NULL) {
-				msg_report(MSG_NO_MEMORY);
-				return false;
-			}
+	if (index == NULL || object == NULL)
+		return false;
 
-			msg_report(MSG_WRITE_FILE, path);
+	/* Grow the index if it is getting full, rehashing the existing entries. */
 
-			if (!files_write_file(path, object->stronghelp.data, object->stronghelp.size))
-				return false;
-			if (!files_set_filetype(path, object->stronghelp.filetype))
-				return false;
+	if (index->count >= index->size) {
+		size = (index->size == 0) ? OBJECTDB_INDEX_INITIAL_SIZE : 2 * index->size;
 
-			free(path);
-			break;
-		case OBJECTDB_STATUS_DELETED:
-			path = objectdb_get_path(object, OBJECTDB_PATH_TYPE_DISC, FILES_PATH_SEPARATOR);
-			if (path == NULL) {
-				msg_report(MSG_NO_MEMORY);
-				return false;
+		buckets = arena_alloc(object->db->arena, size * sizeof(struct objectdb_object *));
+
+		if (buckets != NULL) {
+			for (i = 0; i < size; i++)
+				buckets[i] = NULL;
+
+			for (i = 0; i < index->size; i++) {
+				for (entry = index->buckets[i]; entry != NULL; entry = next) {
+					next = entry->chain;
+					bucket = hash_string(entry->name) & (size - 1);
+					entry->chain = buckets[bucket];
+					buckets[bucket] = entry;
+				}
 			}
 
-			msg_report(MSG_DELETE_FILE, path);
+			index->buckets = buckets;
+			index->size = size;
+		} else if (index->buckets == NULL) {
+			return false;
+		}
+	}
 
-			if (!files_delete_file(path))
-				return false;
+	bucket = hash_string(object->name) & (index->size - 1);
+	object->chain = index->buckets[bucket];
+	index->buckets[bucket] = object;
+	index->count++;
 
-			free(path);
-			break;
-		case OBJECTDB_STATUS_TYPE_CHANGED:
-		case OBJECTDB_STATUS_SIZE_CHANGED:
-		case OBJECTDB_STATUS_CONTENT_CHANGED:
-			path = objectdb_get_path(object, OBJECTDB_PATH_TYPE_DISC, FILES_PATH_SEPARATOR);
-			if (path == NULL) {
-				msg_report(MSG_NO_MEMORY);
-				return false;
-			}
+	return true;
+}
+
+#ifndef READER_ONLY
+/**
+ * Sort the object lists in a directory, and all of the directories below
+ * it, into alphabetical order.
+ *
+ * \param *dir		Pointer to the directory to sort.
+ */
 
-			msg_report(MSG_DELETE_FILE, path);
+static void objectdb_sort_directory(struct objectdb_object *dir)
+{
+	struct objectdb_walk walk;
 
-			if (!files_delete_file(path))
-				return false;
+	objectdb_start_walk(&walk, dir);
 
-			free(path);
+	while ((dir = objectdb_walk_next(&walk)) != NULL) {
+		dir->files = objectdb_sort_list(dir->files);
+		dir->directories = objectdb_sort_list(dir->directories);
+	}
 
-			object->disc.name = files_make_filename(object->stronghelp.name, object->stronghelp.filetype);
+	objectdb_end_walk(&walk);
+}
+#endif
 
-			path = objectdb_get_path(object, OBJECTDB_PATH_TYPE_DISC, FILES_PATH_SEPARATOR);
-			if (path == NULL) {
-				msg_report(MSG_NO_MEMORY);
-				return false;
-			}
+/**
+ * Sort a list of objects into alphabetical order, using a merge sort.
+ *
+ * \param *list		Pointer to the first object in the list.
+ * \return		Pointer to the first object in the sorted list.
+ */
 
-			msg_report(MSG_WRITE_FILE, path);
+static struct objectdb_object *objectdb_sort_list(struct objectdb_object *list)
+{
+	struct objectdb_object *slow, *fast, *second, *head = NULL, **tail = &head;
 
-			if (!files_write_file(path, object->stronghelp.data, object->stronghelp.size))
-				return false;
-			if (!files_set_filetype(path, object->stronghelp.filetype))
-				return false;
+	if (list == NULL || list->next == NULL)
+		return list;
 
-			free(path);
-			break;
-		default:
-			break;
-		}
+	/* Split the list in two, and sort each half. */
 
-		object = object->next;
-	}
+	slow = list;
+	fast = list->next;
 
-	object = dir->directories;
-	while (object != NULL) {
-		if (!objectdb_update_directory(object))
-			return false;
-		object = object->next;
+	while (fast != NULL && fast->next != NULL) {
+		slow = slow->next;
+		fast = fast->next->next;
 	}
 
-	if (dir->status == OBJECTDB_STATUS_DELETED) {
-		path = objectdb_get_path(dir, OBJECTDB_PATH_TYPE_DISC, FILES_PATH_SEPARATOR);
-		if (path == NULL) {
-			msg_report(MSG_NO_MEMORY);
-			return false;
-		}
+	second = slow->next;
+	slow->next = NULL;
 
-		msg_report(MSG_DELETE_DIR, path);
-		if (!files_delete_directory(path))
-			return false;
+	list = objectdb_sort_list(list);
+	second = objectdb_sort_list(second);
+
+	/* Merge the two halves back together, keeping equal names in order. */
 
-		free(path);
+	while (list != NULL && second != NULL) {
+		if (strcmp(second->name, list->name) < 0) {
+			*tail = second;
+			second = second->next;
+		} else {
+			*tail = list;
+			list = list->next;
+		}
+
+		tail = &((*tail)->next);
 	}
 
-	return true;
+	*tail = (list != NULL) ? list : second;
+
+	return head;
 }
 
+#ifndef READER_ONLY
 /**
- * Get a file path to an object.
+ * Check the status of the objects held in a database.
  *
- * The path is allocated using malloc(), and must be freed with free() after use.
+ * Files whose contents need to be compared are passed to a worker pool,
+ * so that the comparisons can proceed in parallel. Each comparison only
+ * writes the status of its own object, so the order of the tree is left
+ * untouched. Once the comparisons are complete, any deleted files which
+ * match added files are paired up as having been moved.
  *
- * \param *object 	Pointer to the object of interest.
- * \param type		The type of path to return.
- * \param *separator	The directory separator to use.
- * \return		A pointer to the path, or NULL.
- */
+ * \param *db		Pointer to the database to check.
+ * \param threads	The number of threads to use for comparisons.
+ * \return		True if successful, false on failure.
+*/
 
-char *objectdb_get_path(struct objectdb_object *object, enum objectdb_path_type type, char *separator)
+bool objectdb_check_status(struct objectdb *db, int threads)
 {
-	size_t length = 0;
+	struct objectdb_batch batch;
+	struct pool *pool;
+	bool success;
+
+	if (db == NULL)
+		return false;
+
+	pool = pool_create(threads);
+	if (pool == NULL)
+		return false;
+
+	objectdb_sort_directory(db->root);
+
+	objectdb_initialise_batch(&batch);
+
+	/* When reading ahead, the files are collected before being queued, so
+	 * that the order in which they'll be compared is known.
+	 */
+
+	success = objectdb_check_directory_status(db->root, pool, (db->batch_io || db->readahead > 0) ? &batch : NULL);
+
+	if (success && !db->batch_io && db->readahead > 0 && !objectdb_queue_readahead(db, &batch, pool))
+		success = false;
+
+	if (!pool_wait(pool))
+		success = false;
+
+	objectdb_end_readahead(db);
+
+	if (success && db->batch_io && !objectdb_compare_batch(db, &batch))
+		success = false;
+
+	objectdb_free_batch(&batch);
 
-	return objectdb_get_dir_path(object, &length, type, separator);
+	if (success && !objectdb_check_moves(db, pool))
+		success = false;
+
+	pool_destroy(pool);
+
+	return success;
 }
 
 /**
- * Build up a full path name from a directory object.
- * 
- * On entry, the length variable should be set to hold the number
- * of characters (including terminator) required after the trailing
- * separator of the final directory name; the allocated buffer will
- * then contain sufficient free space.
- * 
- * The returned buffer is allocated using malloc(), and should be
- * freed with free() after use.
+ * Check the status of the objects held in a directory, and in all of the
+ * directories and files contained within it. Any files which require their
+ * contents to be compared are queued in the supplied pool, or added to
+ * the supplied batch if there is one.
  *
- * \param *dir		Pointer to the object to work from.
- * \param *length	Pointer to a variable to hold the length of the name buffer.
- * \param type		The type of path to generate.
- * \param *separator	Pointer to a separator string.
- * \return		Pointer to a buffer holding the assembled name.
+ * \param *dir		Pointer to the directory to be checked.
+ * \param *pool		Pointer to the pool to take the comparisons.
+ * \param *batch	Pointer to the batch to take the comparisons, or NULL.
+ * \return		True if successful, false on failure.
  */
 
-static char *objectdb_get_dir_path(struct objectdb_object *dir, size_t *length, enum objectdb_path_type type, char *separator)
+static bool objectdb_check_directory_status(struct objectdb_object *dir, struct pool *pool, struct objectdb_batch *batch)
 {
-	char *name = NULL, *part = NULL;
+	struct objectdb_object *object;
+	struct objectdb_walk walk;
+	bool success = true;
 
-	switch (type) {
-	case OBJECTDB_PATH_TYPE_AGNOSTIC:
-		part = dir->name;
-		break;
-	case OBJECTDB_PATH_TYPE_STRONGHELP:
-		part = dir->stronghelp.name;
-		break;
-	case OBJECTDB_PATH_TYPE_DISC:
-		part = dir->disc.name;
-		break;
+	objectdb_start_walk(&walk, dir);
+
+	while (success && (dir = objectdb_walk_next(&walk)) != NULL) {
+		if (dir->stronghelp.name == NULL && dir->disc.name != NULL)
+			dir->status = OBJECTDB_STATUS_DELETED;
+		else if (dir->stronghelp.name != NULL && dir->disc.name == NULL)
+			dir->status = OBJECTDB_STATUS_ADDED;
+		else
+			dir->status = OBJECTDB_STATUS_IDENTICAL;
+
+		for (object = dir->files; object != NULL && success; object = object->next) {
+			if (object->stronghelp.name == NULL && object->disc.name != NULL)
+				object->status = OBJECTDB_STATUS_DELETED;
+			else if (object->stronghelp.name != NULL && object->disc.name == NULL)
+				object->status = OBJECTDB_STATUS_ADDED;
+			else if (object->stronghelp.size != object->disc.size && object->stronghelp.filetype != object->disc.filetype)
+				object->status = OBJECTDB_STATUS_TYPE_CHANGED;
+			else if (object->stronghelp.size != object->disc.size)
+				object->status = OBJECTDB_STATUS_SIZE_CHANGED;
+			else if (batch != NULL && !objectdb_add_to_batch(batch, object))
+				success = false;
+			else if (batch == NULL && !pool_submit(pool, objectdb_compare_task, object))
+				success = false;
+		}
 	}
 
-	*length += strlen(part) + strlen(separator);
+	if (!objectdb_end_walk(&walk))
+		success = false;
 
-	if (dir->parent != NULL) {
-		name = objectdb_get_dir_path(dir->parent, length, type, separator);
-		if (name == NULL)
-			return NULL;
+	return success;
+}
 
-		string_append(name, separator, *length);
-	} else {
-		name = malloc(*length);
-		if (name == NULL) {
-			msg_report(MSG_NO_MEMORY);
-			return NULL;
-		}
+/**
+ * A worker pool task to compare the contents of a file, and set its
+ * status accordingly. If the filetype has changed but the contents are
+ * the same, the file can be fixed up without being rewritten.
+ *
+ * \param *pool		Pointer to the pool running the task.
+ * \param *data		Pointer to the file object to be compared.
+ * \return		True if successful, false on failure.
+ */
 
-		*name = '\0';
-	}
+static bool objectdb_compare_task(struct pool *pool, void *data)
+{
+	struct objectdb_object *object = data;
+
+	if (object == NULL)
+		return false;
 
-	string_append(name, part, *length);
+	objectdb_set_compare_status(object, objectdb_check_manifest(object) || objectdb_compare_files(object, NULL));
 
-	return name;
+	return true;
+}
+
+/**
+ * Queue the comparison of a batch of files in the pool, in the order of
+ * the tree, so that each comparison can prefetch the files which will be
+ * compared after it. Any files which can be resolved using the manifest
+ * are dealt with first, so that they are never read.
+ *
+ * \param *db		Pointer to the database holding the files.
+ * \param *batch	Pointer to the batch of files to compare, which must
+ *			remain in place until the pool has finished.
+ * \param *pool		Pointer to the pool to take the comparisons.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_queue_readahead(struct objectdb *db, struct objectdb_batch *batch, struct pool *pool)
+{
+	size_t i, count = 0;
+
+	for (i = 0; i < batch->count; i++) {
+		if (objectdb_check_manifest(batch->objects[i]))
+			objectdb_set_compare_status(batch->objects[i], true);
+		else if (!objectdb_has_contents(batch->objects[i]) || batch->objects[i]->disc.name == NULL)
+			objectdb_set_compare_status(batch->objects[i], false);
+		else
+			batch->objects[count++] = batch->objects[i];
+	}
+
+	batch->count = count;
+
+	if (count == 0)
+		return true;
+
+	/* Each file's handle is passed from the task which opens it ahead to
+	 * the task which compares it.
+	 */
+
+	db->prefetches = malloc(count * sizeof(struct objectdb_prefetch));
+	if (db->prefetches == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	for (i = 0; i < count; i++)
+		db->prefetches[i].state = OBJECTDB_PREFETCH_NONE;
+
+	db->prefetch = batch;
+	db->prefetched = 0;
+
+	for (i = 0; i < count; i++) {
+		if (!pool_submit(pool, objectdb_readahead_task, batch->objects + i))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * A worker pool task to compare the contents of a file, and set its
+ * status accordingly, once the files due to be compared after it have
+ * been prefetched. If the file has itself been opened ahead, the open
+ * handle is used for the comparison.
+ *
+ * \param *pool		Pointer to the pool running the task.
+ * \param *data		Pointer to the file's entry in the prefetch batch.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_readahead_task(struct pool *pool, void *data)
+{
+	struct objectdb_object **entry = data, *object;
+	struct files_handle handle;
+	struct objectdb *db;
+	size_t index;
+	bool opened;
+
+	if (entry == NULL || *entry == NULL)
+		return false;
+
+	object = *entry;
+	db = object->db;
+	index = entry - db->prefetch->objects;
+
+	objectdb_prefetch_files(db, index + 1 + db->readahead);
+
+	opened = objectdb_take_prefetch(db, index, &handle);
+
+	objectdb_set_compare_status(object, objectdb_compare_files(object, opened ? &handle : NULL));
+
+	return true;
+}
+
+/**
+ * Prefetch the files in the prefetch batch, up to a given point, which
+ * haven't already been prefetched. Each file is only claimed by one task,
+ * so nothing is fetched twice; the handles are left open for the tasks
+ * which compare the files, unless they have already started.
+ *
+ * \param *db		Pointer to the database holding the files.
+ * \param target	The number of files which should have been prefetched.
+ */
+
+static void objectdb_prefetch_files(struct objectdb *db, size_t target)
+{
+	struct objectdb_batch *batch = db->prefetch;
+	struct files_handle handle;
+	struct objectdb_path path;
+	size_t first, i;
+	char *filename;
+	bool opened;
+
+	/* The batch is complete, so its lock now protects the prefetch count
+	 * and the states of the prefetched files.
+	 */
+
+#ifdef LINUX
+	pthread_mutex_lock(&(batch->lock));
+#endif
+
+	if (target > batch->count)
+		target = batch->count;
+
+	first = db->prefetched;
+
+	if (target > first)
+		db->prefetched = target;
+
+#ifdef LINUX
+	pthread_mutex_unlock(&(batch->lock));
+#endif
+
+	if (target <= first)
+		return;
+
+	objectdb_initialise_path(&path, OBJECTDB_PATH_TYPE_DISC);
+
+	for (i = first; i < target; i++) {
+		filename = objectdb_get_file_path(&path, batch->objects[i]);
+		if (filename == NULL || !files_prefetch_file(filename, batch->objects[i]->disc.size, &handle))
+			continue;
+
+		/* If the comparison has already started, it opened the file. */
+
+#ifdef LINUX
+		pthread_mutex_lock(&(batch->lock));
+#endif
+
+		opened = (db->prefetches[i].state == OBJECTDB_PREFETCH_NONE) ? true : false;
+
+		if (opened) {
+			db->prefetches[i].handle = handle;
+			db->prefetches[i].state = OBJECTDB_PREFETCH_OPEN;
+		}
+
+#ifdef LINUX
+		pthread_mutex_unlock(&(batch->lock));
+#endif
+
+		if (!opened)
+			files_close_handle(&handle);
+	}
+
+	objectdb_free_path(&path);
+}
+
+/**
+ * Claim the handle of a file in the prefetch batch for its comparison, if
+ * it has been opened ahead. Once claimed, any later attempt to open it
+ * ahead will be discarded.
+ *
+ * \param *db		Pointer to the database holding the files.
+ * \param index		The index of the file in the prefetch batch.
+ * \param *handle	Pointer to a block to take the open file.
+ * \return		True if the file was open; False if the comparison
+ *			must open it.
+ */
+
+static bool objectdb_take_prefetch(struct objectdb *db, size_t index, struct files_handle *handle)
+{
+	bool opened;
+
+#ifdef LINUX
+	pthread_mutex_lock(&(db->prefetch->lock));
+#endif
+
+	opened = (db->prefetches[index].state == OBJECTDB_PREFETCH_OPEN) ? true : false;
+
+	if (opened)
+		*handle = db->prefetches[index].handle;
+
+	db->prefetches[index].state = OBJECTDB_PREFETCH_TAKEN;
+
+#ifdef LINUX
+	pthread_mutex_unlock(&(db->prefetch->lock));
+#endif
+
+	return opened;
+}
+
+/**
+ * Tidy up once the prefetch batch has been compared, closing any files
+ * which were opened ahead but never compared because the pool failed.
+ *
+ * \param *db		Pointer to the database holding the files.
+ */
+
+static void objectdb_end_readahead(struct objectdb *db)
+{
+	size_t i;
+
+	if (db->prefetches != NULL) {
+		for (i = 0; i < db->prefetch->count; i++) {
+			if (db->prefetches[i].state == OBJECTDB_PREFETCH_OPEN)
+				files_close_handle(&(db->prefetches[i].handle));
+		}
+
+		free(db->prefetches);
+	}
+
+	db->prefetch = NULL;
+	db->prefetches = NULL;
+}
+
+/**
+ * Set the status of a file once its contents have been compared.
+ *
+ * \param *object	Pointer to the file object to update.
+ * \param identical	True if the contents are identical.
+ */
+
+static void objectdb_set_compare_status(struct objectdb_object *object, bool identical)
+{
+	if (identical)
+		object->status = (object->stronghelp.filetype == object->disc.filetype) ?
+				OBJECTDB_STATUS_IDENTICAL : OBJECTDB_STATUS_RETYPED;
+	else
+		object->status = (object->stronghelp.filetype == object->disc.filetype) ?
+				OBJECTDB_STATUS_CONTENT_CHANGED : OBJECTDB_STATUS_TYPE_CHANGED;
+}
+
+/**
+ * Compare the contents of a batch of files, setting their statuses
+ * accordingly. Any files which can be resolved using the manifest are
+ * dealt with first, and the rest are compared in a single batch.
+ *
+ * \param *db		Pointer to the database holding the files.
+ * \param *batch	Pointer to the batch of files to compare.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_compare_batch(struct objectdb *db, struct objectdb_batch *batch)
+{
+	struct files_batch_item *items;
+	size_t i, count = 0;
+	bool success;
+
+	for (i = 0; i < batch->count; i++) {
+		if (objectdb_check_manifest(batch->objects[i]))
+			objectdb_set_compare_status(batch->objects[i], true);
+		else if (!objectdb_has_contents(batch->objects[i]) || batch->objects[i]->disc.name == NULL)
+			objectdb_set_compare_status(batch->objects[i], false);
+		else
+			batch->objects[count++] = batch->objects[i];
+	}
+
+	batch->count = count;
+
+	if (count == 0)
+		return true;
+
+	items = objectdb_make_batch_items(batch, false);
+	if (items == NULL)
+		return false;
+
+	success = files_compare_batch(items, count);
+
+	for (i = 0; success && i < count; i++) {
+		batch->objects[i]->difference = items[i].difference;
+		objectdb_set_compare_status(batch->objects[i], items[i].success);
+	}
+
+	free(items);
+
+	return success;
+}
+
+/**
+ * Perform a block-wise content comparison between the StrongHelp and disc-based
+ * versions of a file, recording the offset of the first difference found.
+ *
+ * \param *object	Pointer to the file object to be tested.
+ * \param *handle	Pointer to the file if it has already been opened,
+ *			which will be closed, or NULL to open it.
+ * \return		True if the files are identical, False if different.
+ */
+
+static bool objectdb_compare_files(struct objectdb_object *object, struct files_handle *handle)
+{
+	struct objectdb_path path;
+	char *filename;
+	bool identical = false;
+
+	if (object == NULL || !objectdb_has_contents(object) || object->disc.name == NULL) {
+		files_close_handle(handle);
+		return false;
+	}
+
+	objectdb_initialise_path(&path, OBJECTDB_PATH_TYPE_DISC);
+
+	filename = objectdb_get_file_path(&path, object);
+	if (filename != NULL)
+		identical = objectdb_compare_contents(object, handle, filename, &(object->difference));
+	else
+		files_close_handle(handle);
+
+	objectdb_free_path(&path);
+
+	return identical;
+}
+
+/**
+ * Test whether the contents of a file in the StrongHelp manual are
+ * available, either in memory or from the database's source file.
+ *
+ * \param *object	Pointer to the file object to be tested.
+ * \return		True if the contents are available; else False.
+ */
+
+static bool objectdb_has_contents(struct objectdb_object *object)
+{
+	return (object->stronghelp.data != NULL || object->db->source != NULL) ? true : false;
+}
+
+/**
+ * Compare the contents of a file in the StrongHelp manual with a file on
+ * disc, reading the manual's copy from the source file if it isn't held
+ * in memory.
+ *
+ * \param *object	Pointer to the file object to be compared.
+ * \param *handle	Pointer to the file if it has already been opened,
+ *			which will be closed, or NULL to open it.
+ * \param *filename	Pointer to the path of the file on disc.
+ * \param *difference	Pointer to a variable to take the offset of the
+ *			first differing byte, or NULL if not required.
+ * \return		True if the files are identical, False if different.
+ */
+
+static bool objectdb_compare_contents(struct objectdb_object *object, struct files_handle *handle, char *filename, size_t *difference)
+{
+	if (object->stronghelp.data != NULL)
+		return files_compare_file(filename, handle, object->stronghelp.data, object->stronghelp.size, difference);
+
+	return files_compare_file_with_source(filename, handle, object->db->source, object->stronghelp.offset,
+			object->stronghelp.size, difference);
+}
+
+/**
+ * Compare the contents of two files of the same size in the StrongHelp
+ * manual.
+ *
+ * \param *first	Pointer to the first file object to be compared.
+ * \param *second	Pointer to the second file object to be compared.
+ * \return		True if the files are identical, False if different.
+ */
+
+static bool objectdb_match_contents(struct objectdb_object *first, struct objectdb_object *second)
+{
+	if (first->stronghelp.data != NULL && second->stronghelp.data != NULL)
+		return (memcmp(first->stronghelp.data, second->stronghelp.data, second->stronghelp.size) == 0) ? true : false;
+
+	return files_compare_source_blocks(first->db->source, first->stronghelp.offset, second->stronghelp.offset,
+			second->stronghelp.size);
+}
+
+/**
+ * Write the contents of a file in the StrongHelp manual out to disc,
+ * reading them from the source file if they aren't held in memory.
+ *
+ * \param *object	Pointer to the file object to be written.
+ * \param *filename	Pointer to the path of the file on disc.
+ * \param *old_filename	Pointer to the path of the file being replaced,
+ *			or NULL if a new file is being written.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_write_contents(struct objectdb_object *object, char *filename, char *old_filename)
+{
+	bool sync = (object->db->sync == FILES_SYNC_FILE) ? true : false;
+
+	if (object->stronghelp.data != NULL && old_filename != NULL)
+		return files_replace_file(filename, old_filename, object->stronghelp.data, object->stronghelp.size,
+				object->stronghelp.filetype, sync);
+	else if (object->stronghelp.data != NULL)
+		return files_write_file(filename, object->stronghelp.data, object->stronghelp.size,
+				object->stronghelp.filetype, sync);
+	else if (old_filename != NULL)
+		return files_replace_file_from_source(filename, old_filename, object->db->source, object->stronghelp.offset,
+				object->stronghelp.size, object->stronghelp.filetype, sync);
+
+	return files_write_file_from_source(filename, object->db->source, object->stronghelp.offset,
+			object->stronghelp.size, object->stronghelp.filetype, sync);
+}
+
+/**
+ * Make sure that the hash of the contents of a file in the StrongHelp
+ * manual is known. Files which are streamed from the source file aren't
+ * hashed as they are added, so are read in to be hashed when first needed.
+ *
+ * \param *object	Pointer to the file object to be hashed.
+ * \return		True if the hash is known; false on failure.
+ */
+
+static bool objectdb_hash_contents(struct objectdb_object *object)
+{
+	if (object->stronghelp.hashed)
+		return true;
+
+	if (object->stronghelp.data != NULL || object->stronghelp.size == 0)
+		object->stronghelp.hash = hash_crc32c(HASH_CRC32C_INITIAL, object->stronghelp.data, object->stronghelp.size);
+	else if (!files_hash_source(object->db->source, object->stronghelp.offset, object->stronghelp.size, &(object->stronghelp.hash)))
+		return false;
+
+	object->stronghelp.hashed = true;
+
+	return true;
+}
+
+/**
+ * Test whether a file on disc is known to be identical to the copy in the
+ * StrongHelp manual, based on the manifest. If the file's catalogue
+ * information matches the manifest entry, the recorded hash is taken as
+ * the hash of the disc file and checked against the manual's copy without
+ * reading the file.
+ *
+ * \param *object	Pointer to the object to be checked.
+ * \return		True if the file is known to be identical; False if its
+ *			contents will need to be compared.
+ */
+
+static bool objectdb_check_manifest(struct objectdb_object *object)
+{
+	struct objectdb_path disc_path, manifest_path;
+	char *filename, *name;
+	struct files_stat stat;
+	bool identical = false;
+
+	if (object == NULL || object->db->manifest == NULL)
+		return false;
+
+	objectdb_initialise_path(&disc_path, OBJECTDB_PATH_TYPE_DISC);
+	objectdb_initialise_path(&manifest_path, OBJECTDB_PATH_TYPE_AGNOSTIC);
+
+	filename = objectdb_get_file_path(&disc_path, object);
+	name = objectdb_get_file_path(&manifest_path, object);
+
+	if (filename != NULL && name != NULL && files_read_stat(filename, &stat) &&
+			manifest_check(object->db->manifest, name, &stat, &(object->disc.hash))) {
+		object->disc.hashed = true;
+
+		if (objectdb_hash_contents(object) && object->disc.hash == object->stronghelp.hash) {
+			msg_report(MSG_REPORT_FILE_MANIFEST, name);
+			identical = true;
+		}
+	}
+
+	objectdb_free_path(&disc_path);
+	objectdb_free_path(&manifest_path);
+
+	return identical;
+}
+
+/**
+ * Look for files which have been moved within the manual, by pairing up
+ * deleted files on disc with added files in the manual which have the same
+ * size, type and contents. Any matching files can be renamed into their
+ * new locations, instead of being deleted and written out again.
+ *
+ * Deleted files which have possible matches are hashed by the worker pool,
+ * and then paired up with the added files in the order of the tree, so
+ * that the outcome doesn't depend on the order of the tasks.
+ *
+ * \param *db		Pointer to the database to check.
+ * \param *pool		Pointer to the pool to take the hashing tasks.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_check_moves(struct objectdb *db, struct pool *pool)
+{
+	size_t count;
+
+	count = objectdb_find_added_files(db->root, NULL, 0);
+	if (count == 0)
+		return true;
+
+	db->added = arena_alloc(db->arena, count * sizeof(struct objectdb_object *));
+	if (db->added == NULL)
+		return false;
+
+	db->added_count = objectdb_find_added_files(db->root, db->added, 0);
+
+	qsort(db->added, db->added_count, sizeof(struct objectdb_object *), objectdb_compare_added_files);
+
+	/* Any added files which haven't been hashed yet, but which could match
+	 * a deleted file, are hashed before being sorted into their places.
+	 */
+
+	if (!objectdb_queue_hash_tasks(db, pool) || !pool_wait(pool))
+		return false;
+
+	qsort(db->added, db->added_count, sizeof(struct objectdb_object *), objectdb_compare_added_files);
+
+	if (!objectdb_queue_move_tasks(db->root, pool) || !pool_wait(pool))
+		return false;
+
+	objectdb_pair_moves(db->root);
+
+	return true;
+}
+
+/**
+ * Collect the files which have been added to the manual in a directory,
+ * and in all of the directories below it, which could have been moved.
+ *
+ * \param *dir		Pointer to the directory to search.
+ * \param **files	Pointer to an array to take the files, or NULL to
+ *			just count them.
+ * \param count		The number of files already in the array.
+ * \return		The number of files in the array once updated.
+ */
+
+static size_t objectdb_find_added_files(struct objectdb_object *dir, struct objectdb_object **files, size_t count)
+{
+	struct objectdb_object *object;
+	struct objectdb_walk walk;
+
+	objectdb_start_walk(&walk, dir);
+
+	while ((dir = objectdb_walk_next(&walk)) != NULL) {
+		for (object = dir->files; object != NULL; object = object->next) {
+			/* Empty files are as quick to write as to move. */
+
+			if (object->status != OBJECTDB_STATUS_ADDED ||
+					object->stronghelp.size == 0 || !objectdb_has_contents(object))
+				continue;
+
+			if (files != NULL)
+				files[count] = object;
+
+			count++;
+		}
+	}
+
+	/* If the walk failed, report that nothing was found; the moves
+	 * will simply not be spotted.
+	 */
+
+	if (!objectdb_end_walk(&walk))
+		return 0;
+
+	return count;
+}
+
+/**
+ * Compare two added files for sorting, by size, type and hash. Files
+ * which match on all three are left in their order of creation, so that
+ * the pairing of moved files is repeatable.
+ *
+ * \param *a		Pointer to the first file pointer to compare.
+ * \param *b		Pointer to the second file pointer to compare.
+ * \return		The result of the comparison.
+ */
+
+static int objectdb_compare_added_files(const void *a, const void *b)
+{
+	const struct objectdb_object *first = *((struct objectdb_object * const *) a);
+	const struct objectdb_object *second = *((struct objectdb_object * const *) b);
+
+	if (first->stronghelp.size != second->stronghelp.size)
+		return (first->stronghelp.size < second->stronghelp.size) ? -1 : 1;
+
+	if (first->stronghelp.filetype != second->stronghelp.filetype)
+		return (first->stronghelp.filetype < second->stronghelp.filetype) ? -1 : 1;
+
+	if (first->stronghelp.hash != second->stronghelp.hash)
+		return (first->stronghelp.hash < second->stronghelp.hash) ? -1 : 1;
+
+	if (first->sequence != second->sequence)
+		return (first->sequence < second->sequence) ? -1 : 1;
+
+	return 0;
+}
+
+/**
+ * Find the first of the added files with a given size and type, and
+ * optionally hash, in the sorted array of added files.
+ *
+ * \param *db		Pointer to the database to search.
+ * \param size		The size of file to find.
+ * \param filetype	The type of file to find.
+ * \param hash		The hash of the file to find.
+ * \param match_hash	True if the hash must match; False to ignore it.
+ * \return		The index of the first matching file, or the number
+ *			of added files if there isn't one.
+ */
+
+static size_t objectdb_find_added_file(struct objectdb *db, size_t size, uint32_t filetype, uint32_t hash, bool match_hash)
+{
+	struct objectdb_object *file;
+	size_t low = 0, high = db->added_count, middle;
+
+	/* Find the first entry which doesn't sort before the key. */
+
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		file = db->added[middle];
+
+		if (file->stronghelp.size < size || (file->stronghelp.size == size &&
+				(file->stronghelp.filetype < filetype || (file->stronghelp.filetype == filetype &&
+				match_hash && file->stronghelp.hash < hash))))
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	if (low >= db->added_count)
+		return db->added_count;
+
+	file = db->added[low];
+
+	if (file->stronghelp.size != size || file->stronghelp.filetype != filetype ||
+			(match_hash && file->stronghelp.hash != hash))
+		return db->added_count;
+
+	return low;
+}
+
+/**
+ * Queue hashing tasks for any deleted files in a directory, and in all of
+ * the directories below it, which might match an added file.
+ *
+ * \param *dir		Pointer to the directory to search.
+ * \param *pool		Pointer to the pool to take the tasks.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_queue_move_tasks(struct objectdb_object *dir, struct pool *pool)
+{
+	struct objectdb_object *object;
+	struct objectdb_walk walk;
+	struct objectdb *db;
+	bool success = true;
+
+	if (dir == NULL)
+		return false;
+
+	db = dir->db;
+
+	objectdb_start_walk(&walk, dir);
+
+	while (success && (dir = objectdb_walk_next(&walk)) != NULL) {
+		for (object = dir->files; object != NULL && success; object = object->next) {
+			if (object->status != OBJECTDB_STATUS_DELETED ||
+					objectdb_find_added_file(db, object->disc.size, object->disc.filetype, 0, false) == db->added_count)
+				continue;
+
+			if (!pool_submit(pool, objectdb_move_task, object))
+				success = false;
+		}
+	}
+
+	if (!objectdb_end_walk(&walk))
+		success = false;
+
+	return success;
+}
+
+/**
+ * Queue hashing tasks for any added files which haven't been hashed, and
+ * which have the same size and type as one of the deleted files. The added
+ * files must be sorted by size and type, although not necessarily by hash.
+ *
+ * \param *db		Pointer to the database holding the added files.
+ * \param *pool		Pointer to the pool to take the tasks.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_queue_hash_tasks(struct objectdb *db, struct pool *pool)
+{
+	struct objectdb_object *dir, *object, *file;
+	struct objectdb_walk walk;
+	bool *queued, success = true;
+	size_t i;
+
+	i = 0;
+
+	while (i < db->added_count && db->added[i]->stronghelp.hashed)
+		i++;
+
+	if (i >= db->added_count)
+		return true;
+
+	/* Note the files to be hashed, so that each is only queued once. */
+
+	queued = calloc(db->added_count, sizeof(bool));
+	if (queued == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	objectdb_start_walk(&walk, db->root);
+
+	while (success && (dir = objectdb_walk_next(&walk)) != NULL) {
+		for (object = dir->files; object != NULL && success; object = object->next) {
+			if (object->status != OBJECTDB_STATUS_DELETED)
+				continue;
+
+			i = objectdb_find_added_file(db, object->disc.size, object->disc.filetype, 0, false);
+
+			for (; i < db->added_count && !queued[i]; i++) {
+				file = db->added[i];
+
+				if (file->stronghelp.size != object->disc.size || file->stronghelp.filetype != object->disc.filetype)
+					break;
+
+				queued[i] = true;
+
+				if (!file->stronghelp.hashed && !pool_submit(pool, objectdb_hash_task, file))
+					success = false;
+			}
+		}
+	}
+
+	if (!objectdb_end_walk(&walk))
+		success = false;
+
+	free(queued);
+
+	return success;
+}
+
+/**
+ * A worker pool task to hash the contents of an added file.
+ *
+ * \param *pool		Pointer to the pool running the task.
+ * \param *data		Pointer to the added file to be hashed.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_hash_task(struct pool *pool, void *data)
+{
+	struct objectdb_object *object = data;
+
+	if (object == NULL)
+		return false;
+
+	return objectdb_hash_contents(object);
+}
+
+/**
+ * A worker pool task to hash a deleted file, and look for an added file
+ * with the same contents. The hash is taken from the manifest if it is
+ * known to be up to date; otherwise the file is read from disc, and the
+ * contents of any possible match are then compared in full.
+ *
+ * Any match found is recorded in the deleted file's moved pointer, as an
+ * example of the contents that it holds.
+ *
+ * \param *pool		Pointer to the pool running the task.
+ * \param *data		Pointer to the deleted file to be checked.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_move_task(struct pool *pool, void *data)
+{
+	struct objectdb_object *object = data, *file;
+	struct objectdb_path disc_path, manifest_path;
+	char *filename, *name;
+	struct files_stat stat;
+	struct objectdb *db;
+	bool trusted = false;
+	size_t i;
+
+	if (object == NULL)
+		return false;
+
+	db = object->db;
+
+	objectdb_initialise_path(&disc_path, OBJECTDB_PATH_TYPE_DISC);
+	objectdb_initialise_path(&manifest_path, OBJECTDB_PATH_TYPE_AGNOSTIC);
+
+	filename = objectdb_get_file_path(&disc_path, object);
+	name = objectdb_get_file_path(&manifest_path, object);
+
+	if (filename != NULL && name != NULL) {
+		if (db->manifest != NULL && files_read_stat(filename, &stat) &&
+				manifest_check(db->manifest, name, &stat, &(object->disc.hash)))
+			trusted = true;
+		else if (!files_hash_file(filename, &(object->disc.hash)))
+			filename = NULL;
+	}
+
+	if (filename != NULL) {
+		object->disc.hashed = true;
+
+		i = objectdb_find_added_file(db, object->disc.size, object->disc.filetype, object->disc.hash, true);
+
+		for (; i < db->added_count && object->moved == NULL; i++) {
+			file = db->added[i];
+
+			if (file->stronghelp.size != object->disc.size || file->stronghelp.filetype != object->disc.filetype ||
+					file->stronghelp.hash != object->disc.hash)
+				break;
+
+			if (trusted || objectdb_compare_contents(file, NULL, filename, NULL))
+				object->moved = file;
+		}
+	}
+
+	objectdb_free_path(&disc_path);
+	objectdb_free_path(&manifest_path);
+
+	return true;
+}
+
+/**
+ * Pair up the deleted files in a directory, and in all of the directories
+ * below it, with added files which have the same contents. Each deleted file
+ * can only be paired with a single added file, and vice versa; the added
+ * files with the same hash as a deleted file's match are checked against
+ * the match within the manual, so that the disc file doesn't need to be
+ * read again.
+ *
+ * \param *dir		Pointer to the directory to process.
+ */
+
+static void objectdb_pair_moves(struct objectdb_object *dir)
+{
+	struct objectdb_object *object, *match, *file;
+	struct objectdb_walk walk;
+	struct objectdb *db;
+	size_t i;
+
+	if (dir == NULL)
+		return;
+
+	db = dir->db;
+
+	objectdb_start_walk(&walk, dir);
+
+	while ((dir = objectdb_walk_next(&walk)) != NULL) {
+		for (object = dir->files; object != NULL; object = object->next) {
+			if (object->status != OBJECTDB_STATUS_DELETED || object->moved == NULL)
+				continue;
+
+			match = object->moved;
+			object->moved = NULL;
+
+			i = objectdb_find_added_file(db, match->stronghelp.size, match->stronghelp.filetype, match->stronghelp.hash, true);
+
+			for (; i < db->added_count; i++) {
+				file = db->added[i];
+
+				if (file->stronghelp.size != match->stronghelp.size || file->stronghelp.filetype != match->stronghelp.filetype ||
+						file->stronghelp.hash != match->stronghelp.hash)
+					break;
+
+				if (file->moved != NULL || (file != match && !objectdb_match_contents(file, match)))
+					continue;
+
+				file->moved = object;
+				file->status = OBJECTDB_STATUS_MOVED;
+				object->moved = file;
+				object->status = OBJECTDB_STATUS_MOVED;
+				break;
+			}
+		}
+	}
+
+	objectdb_end_walk(&walk);
+}
+
+/**
+ * Write a report of the object statuses in a database.
+ *
+ * \param *db		Pointer to the database to report on.
+ * \param include_all	Should identical objects be included.
+ * \param *report	Pointer to a structured report to write records to,
+ *			or NULL to report as text.
+ * \return		True if successful, false on failure.
+ */
+
+bool objectdb_output_report(struct objectdb *db, bool include_all, struct report *report)
+{
+	struct objectdb_report_summary summary = { 0, 0, 0, 0, 0, 0 };
+	struct objectdb_object *dir;
+	struct objectdb_walk walk;
+	bool success = true;
+
+	if (db == NULL)
+		return false;
+
+	objectdb_start_walk(&walk, db->root);
+
+	while (success && (dir = objectdb_walk_next(&walk)) != NULL)
+		success = objectdb_output_directory_report(dir, &summary, include_all, report);
+
+	if (!objectdb_end_walk(&walk) || !success)
+		return false;
+
+	if (report != NULL) {
+		report_start_record(report, "summary");
+		report_add_integer(report, "directories_added", summary.directories_added);
+		report_add_integer(report, "directories_deleted", summary.directories_deleted);
+		report_add_integer(report, "files_added", summary.files_added);
+		report_add_integer(report, "files_changed", summary.files_changed);
+		report_add_integer(report, "files_moved", summary.files_moved);
+		report_add_integer(report, "files_deleted", summary.files_deleted);
+
+		return report_end_record(report);
+	}
+
+	if (summary.directories_added == 0 && summary.directories_deleted == 0 && summary.files_added == 0 &&
+			summary.files_changed == 0 && summary.files_moved == 0 && summary.files_deleted == 0) {
+		msg_report(MSG_SUMMARY_IDENTICAL);
+	} else {
+		if (summary.directories_added > 0 || summary.directories_deleted > 0)
+			msg_report(MSG_SUMMARY_DIRS, summary.directories_added, summary.directories_deleted);
+
+		if (summary.files_added > 0 || summary.files_changed > 0 || summary.files_deleted > 0)
+			msg_report(MSG_SUMMARY_FILES, summary.files_added, summary.files_changed, summary.files_deleted);
+
+		if (summary.files_moved > 0)
+			msg_report(MSG_SUMMARY_MOVED, summary.files_moved);
+	}
+
+	return true;
+}
+
+/**
+ * Write a report of the statuses of a directory and the files within it;
+ * the directories below it are reported separately.
+ *
+ * \param *dir		Pointer to the directory on which to report.
+ * \param *summary	Pointer to the report summary data block.
+ * \param include_all	Should identical objects be included.
+ * \param *report	Pointer to a structured report to write records to,
+ *			or NULL to report as text.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_output_directory_report(struct objectdb_object *dir, struct objectdb_report_summary *summary, bool include_all, struct report *report)
+{
+	struct objectdb_object *object;
+	struct objectdb_path path, source_path;
+	char *name, *source;
+
+	if (dir == NULL)
+		return false;
+
+	name = objectdb_get_dir_path(dir, OBJECTDB_PATH_TYPE_AGNOSTIC, NULL);
+	if (name == NULL)
+		return false;
+
+	switch (dir->status) {
+	case OBJECTDB_STATUS_ADDED:
+		if (report == NULL)
+			msg_report(MSG_REPORT_DIR_ADDED, name);
+		summary->directories_added++;
+		break;
+	case OBJECTDB_STATUS_DELETED:
+		if (report == NULL)
+			msg_report(MSG_REPORT_DIR_DELETED, name);
+		summary->directories_deleted++;
+		break;
+	case OBJECTDB_STATUS_IDENTICAL:
+		if (include_all && report == NULL)
+			msg_report(MSG_REPORT_DIR_UNCHANGED, name);
+		break;
+	default:
+		msg_report(MSG_BAD_STATUS, name);
+		break;
+	}
+
+	if (report != NULL && !objectdb_write_report_record(report, dir, name, NULL, include_all))
+		return false;
+
+	objectdb_initialise_path(&path, OBJECTDB_PATH_TYPE_AGNOSTIC);
+	objectdb_initialise_path(&source_path, OBJECTDB_PATH_TYPE_AGNOSTIC);
+
+	object = dir->files;
+	while (object != NULL) {
+		name = objectdb_get_file_path(&path, object);
+		if (name == NULL) {
+			objectdb_free_path(&path);
+			objectdb_free_path(&source_path);
+			return false;
+		}
+
+		source = NULL;
+
+		switch (object->status) {
+		case OBJECTDB_STATUS_ADDED:
+			if (report == NULL)
+				msg_report(MSG_REPORT_FILE_ADDED, name);
+			summary->files_added++;
+			break;
+		case OBJECTDB_STATUS_DELETED:
+			if (report == NULL)
+				msg_report(MSG_REPORT_FILE_DELETED, name);
+			summary->files_deleted++;
+			break;
+		case OBJECTDB_STATUS_TYPE_CHANGED:
+		case OBJECTDB_STATUS_RETYPED:
+			if (report == NULL)
+				msg_report(MSG_REPORT_FILE_TYPE, object->disc.filetype, object->stronghelp.filetype, name);
+			summary->files_changed++;
+			break;
+		case OBJECTDB_STATUS_SIZE_CHANGED:
+			if (report == NULL)
+				msg_report(MSG_REPORT_FILE_CONTENTS, object->disc.size, object->stronghelp.size, name);
+			summary->files_changed++;
+			break;
+		case OBJECTDB_STATUS_CONTENT_CHANGED:
+			if (report == NULL) {
+				msg_report(MSG_REPORT_FILE_CONTENTS, object->disc.size, object->stronghelp.size, name);
+				msg_report(MSG_REPORT_FILE_DIFFERENCE, object->difference);
+			}
+			summary->files_changed++;
+			break;
+		case OBJECTDB_STATUS_MOVED:
+			/* Moves are reported against the file's new location. */
+
+			if (object->stronghelp.name == NULL)
+				break;
+
+			source = objectdb_get_file_path(&source_path, object->moved);
+			if (source == NULL) {
+				objectdb_free_path(&path);
+				objectdb_free_path(&source_path);
+				return false;
+			}
+
+			if (report == NULL)
+				msg_report(MSG_REPORT_FILE_MOVED, source, name);
+			summary->files_moved++;
+			break;
+		case OBJECTDB_STATUS_IDENTICAL:
+			if (include_all && report == NULL)
+				msg_report(MSG_REPORT_FILE_UNCHANGED, name);
+			break;
+		default:
+			msg_report(MSG_BAD_STATUS, name);
+			break;
+		}
+
+		if (report != NULL && !objectdb_write_report_record(report, object, name, source, include_all)) {
+			objectdb_free_path(&path);
+			objectdb_free_path(&source_path);
+			return false;
+		}
+
+		object = object->next;
+	}
+
+	objectdb_free_path(&path);
+	objectdb_free_path(&source_path);
+
+	return true;
+}
+
+/**
+ * Write a structured report record for an object, giving its status and
+ * the type and size of the copies on disc and in the manual. Identical
+ * objects are only included if requested, and moved files are reported
+ * against their new locations.
+ *
+ * \param *report	Pointer to the report to write to.
+ * \param *object	Pointer to the object to report on.
+ * \param *name		Pointer to the path of the object.
+ * \param *source	Pointer to the path that a moved file came from,
+ *			or NULL.
+ * \param include_all	Should identical objects be included.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_write_report_record(struct report *report, struct objectdb_object *object, char *name, char *source, bool include_all)
+{
+	struct objectdb_details *old;
+	char *status;
+	bool directory;
+
+	status = objectdb_get_status_name(object->status);
+
+	if (status == NULL || (object->status == OBJECTDB_STATUS_IDENTICAL && !include_all) ||
+			(object->status == OBJECTDB_STATUS_MOVED && object->stronghelp.name == NULL))
+		return true;
+
+	directory = (object->stronghelp.filetype == OBJECTDB_TYPE_DIRECTORY ||
+			object->disc.filetype == OBJECTDB_TYPE_DIRECTORY) ? true : false;
+
+	/* A moved file's old details are those of the file that it came from. */
+
+	old = (object->status == OBJECTDB_STATUS_MOVED) ? &(object->moved->disc) : &(object->disc);
+
+	report_start_record(report, (directory) ? "directory" : "file");
+	report_add_string(report, "path", name);
+	report_add_string(report, "status", status);
+
+	if (source != NULL)
+		report_add_string(report, "from", source);
+
+	if (!directory && old->filetype != OBJECTDB_TYPE_UNKNOWN) {
+		report_add_integer(report, "old_type", old->filetype);
+		report_add_integer(report, "old_size", old->size);
+	}
+
+	if (!directory && object->stronghelp.filetype != OBJECTDB_TYPE_UNKNOWN) {
+		report_add_integer(report, "new_type", object->stronghelp.filetype);
+		report_add_integer(report, "new_size", object->stronghelp.size);
+	}
+
+	if (object->status == OBJECTDB_STATUS_CONTENT_CHANGED)
+		report_add_integer(report, "difference", object->difference);
+
+	return report_end_record(report);
+}
+
+/**
+ * Return the name used for an object status in structured reports.
+ *
+ * \param status	The status to look up.
+ * \return		Pointer to the name, or NULL if the status is not
+ *			reported.
+ */
+
+static char *objectdb_get_status_name(enum objectdb_status status)
+{
+	switch (status) {
+	case OBJECTDB_STATUS_IDENTICAL:
+		return "unchanged";
+	case OBJECTDB_STATUS_ADDED:
+		return "added";
+	case OBJECTDB_STATUS_DELETED:
+		return "deleted";
+	case OBJECTDB_STATUS_TYPE_CHANGED:
+		return "type_changed";
+	case OBJECTDB_STATUS_RETYPED:
+		return "retyped";
+	case OBJECTDB_STATUS_SIZE_CHANGED:
+		return "size_changed";
+	case OBJECTDB_STATUS_CONTENT_CHANGED:
+		return "content_changed";
+	case OBJECTDB_STATUS_MOVED:
+		return "moved";
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * Write a listing of the hashes of the files in the StrongHelp manual,
+ * as verbose output.
+ *
+ * \param *db		Pointer to the database to list.
+ * \return		True if successful, false on failure.
+ */
+
+bool objectdb_output_hashes(struct objectdb *db)
+{
+	struct objectdb_object *dir;
+	struct objectdb_walk walk;
+	bool success = true;
+
+	if (db == NULL)
+		return false;
+
+	/* Directories which aren't in the manual can't hold any of its files. */
+
+	objectdb_start_walk(&walk, db->root);
+
+	while (success && (dir = objectdb_walk_next(&walk)) != NULL) {
+		if (dir == db->root || dir->stronghelp.name != NULL)
+			success = objectdb_output_directory_hashes(dir);
+	}
+
+	if (!objectdb_end_walk(&walk))
+		success = false;
+
+	return success;
+}
+
+/**
+ * Write a listing of the hashes of the files from the StrongHelp manual
+ * in a single directory.
+ *
+ * \param *dir		Pointer to the directory to list.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_output_directory_hashes(struct objectdb_object *dir)
+{
+	struct objectdb_path path;
+	struct objectdb_object *object;
+	char *name;
+
+	if (dir == NULL)
+		return false;
+
+	objectdb_initialise_path(&path, OBJECTDB_PATH_TYPE_AGNOSTIC);
+
+	for (object = dir->files; object != NULL; object = object->next) {
+		if (object->stronghelp.name == NULL)
+			continue;
+
+		name = objectdb_get_file_path(&path, object);
+		if (name == NULL || !objectdb_hash_contents(object)) {
+			objectdb_free_path(&path);
+			return false;
+		}
+
+		msg_report(MSG_REPORT_FILE_HASH, object->stronghelp.hash, object->stronghelp.size, name);
+	}
+
+	objectdb_free_path(&path);
+
+	return true;
+}
+
+/**
+ * Update the objects in the database.
+ *
+ * The work is split into tasks which are run by a worker pool, in an
+ * order which respects the dependencies between them: each directory
+ * is created before the tasks for the objects within it are queued,
+ * and each file's deletion happens before it is rewritten. Moved files
+ * are renamed from their old locations, which remain in place until the
+ * directories are cleared up at the end. If file access is being batched,
+ * new and deleted files are collected up by the tasks and then dealt with
+ * in two batches once the pool has finished. Deleted
+ * directories are removed once all of the file operations are complete,
+ * working up from the bottom of the tree.
+ *
+ * \param *db		Pointer to the database to update from.
+ * \param threads	The number of threads to use for updates.
+ * \param sync		The policy for flushing written files to disc.
+ * \return		True if successful, false on failure.
+ */
+
+bool objectdb_update(struct objectdb *db, int threads, enum files_sync sync)
+{
+	struct objectdb_batch writes, deletes;
+	char *path = NULL;
+	struct files_object_info *root;
+	struct pool *pool;
+	bool success;
+
+	if (db == NULL)
+		return false;
+
+	/* Make sure that the root directory exists on disc first. */
+
+	path = objectdb_get_dir_path(db->root, OBJECTDB_PATH_TYPE_DISC, NULL);
+	if (path == NULL)
+		return false;
+
+	root = files_read_directory_info(path, true, db->arena);
+
+	if (root == NULL) {
+		msg_report(MSG_CREATE_DIR, path);
+		if (!files_make_directory(path))
+			return false;
+	}
+
+	/* Update all of the files and folders. */
+
+	db->sync = sync;
+
+	pool = pool_create(threads);
+	if (pool == NULL)
+		return false;
+
+	objectdb_initialise_batch(&writes);
+	objectdb_initialise_batch(&deletes);
+
+	if (db->batch_io) {
+		db->writes = &writes;
+		db->deletes = &deletes;
+	}
+
+	success = pool_submit(pool, objectdb_update_directory_task, db->root);
+
+	if (!pool_wait(pool))
+		success = false;
+
+	pool_destroy(pool);
+
+	if (success && db->batch_io && !objectdb_update_batch(db))
+		success = false;
+
+	db->writes = NULL;
+	db->deletes = NULL;
+
+	objectdb_free_batch(&writes);
+	objectdb_free_batch(&deletes);
+
+	if (!success)
+		return false;
+
+	/* Remove any directories which are no longer required. */
+
+	if (!objectdb_remove_directories(db->root))
+		return false;
+
+	/* Flush everything out to disc, if required. */
+
+	if (sync == FILES_SYNC_END) {
+		msg_report(MSG_SYNC_FOLDER, path);
+		if (!files_sync_folder(path))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * A worker pool task to update a given output directory, creating it if
+ * required and then queueing tasks to update any files and directories
+ * that it contains.
+ *
+ * \param *pool		Pointer to the pool running the task.
+ * \param *data		Pointer to the directory to be updated.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_update_directory_task(struct pool *pool, void *data)
+{
+	struct objectdb_object *dir = data, *object;
+	char *path = NULL;
+
+	if (dir == NULL)
+		return false;
+
+	if (dir->status == OBJECTDB_STATUS_ADDED) {
+		dir->disc.name = files_make_filename(dir->stronghelp.name, dir->stronghelp.filetype, dir->db->arena);
+
+		path = objectdb_get_dir_path(dir, OBJECTDB_PATH_TYPE_DISC, NULL);
+		if (path == NULL)
+			return false;
+
+		msg_report(MSG_CREATE_DIR, path);
+		if (!files_make_directory(path))
+			return false;
+	}
+
+	/* The directory now exists, so its contents can be updated. */
+
+	object = dir->files;
+	while (object != NULL) {
+		if (object->status == OBJECTDB_STATUS_ADDED && dir->db->writes != NULL) {
+			object->disc.name = files_make_filename(object->stronghelp.name, object->stronghelp.filetype, dir->db->arena);
+			if (object->disc.name == NULL || !objectdb_add_to_batch(dir->db->writes, object))
+				return false;
+		} else if (object->status == OBJECTDB_STATUS_DELETED && dir->db->deletes != NULL) {
+			if (!objectdb_add_to_batch(dir->db->deletes, object))
+				return false;
+		} else if (object->status != OBJECTDB_STATUS_IDENTICAL && !pool_submit(pool, objectdb_update_file_task, object)) {
+			return false;
+		}
+
+		object = object->next;
+	}
+
+	object = dir->directories;
+	while (object != NULL) {
+		if (!pool_submit(pool, objectdb_update_directory_task, object))
+			return false;
+		object = object->next;
+	}
+
+	return true;
+}
+
+/**
+ * A worker pool task to update a given output file.
+ *
+ * \param *pool		Pointer to the pool running the task.
+ * \param *data		Pointer to the file to be updated.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_update_file_task(struct pool *pool, void *data)
+{
+	struct objectdb_object *object = data;
+	struct objectdb_path path, old_path;
+	char *filename = NULL, *old_filename = NULL;
+	bool success = true;
+
+	if (object == NULL)
+		return false;
+
+	objectdb_initialise_path(&path, OBJECTDB_PATH_TYPE_DISC);
+	objectdb_initialise_path(&old_path, OBJECTDB_PATH_TYPE_DISC);
+
+	switch (object->status) {
+	case OBJECTDB_STATUS_ADDED:
+		object->disc.name = files_make_filename(object->stronghelp.name, object->stronghelp.filetype, object->db->arena);
+
+		filename = objectdb_get_file_path(&path, object);
+		if (filename == NULL) {
+			success = false;
+			break;
+		}
+
+		msg_report(MSG_WRITE_FILE, filename);
+
+		if (!objectdb_write_contents(object, filename, NULL))
+			success = false;
+		break;
+	case OBJECTDB_STATUS_DELETED:
+		filename = objectdb_get_file_path(&path, object);
+		if (filename == NULL) {
+			success = false;
+			break;
+		}
+
+		msg_report(MSG_DELETE_FILE, filename);
+
+		if (!files_delete_file(filename))
+			success = false;
+		break;
+	case OBJECTDB_STATUS_RETYPED:
+		/* The contents are unchanged, so just rename the file or set its type. */
+
+		old_filename = objectdb_get_file_path(&old_path, object);
+
+		object->disc.name = files_make_filename(object->stronghelp.name, object->stronghelp.filetype, object->db->arena);
+
+		filename = objectdb_get_file_path(&path, object);
+		if (old_filename == NULL || filename == NULL) {
+			success = false;
+			break;
+		}
+
+		msg_report(MSG_RETYPE_FILE, filename, object->stronghelp.filetype);
+
+		if ((strcmp(old_filename, filename) != 0 && !files_rename_file(old_filename, filename)) ||
+				!files_set_filetype(filename, object->stronghelp.filetype))
+			success = false;
+		else
+			stats_count(STATS_FILES_RENAMED, 1);
+		break;
+	case OBJECTDB_STATUS_MOVED:
+		/* Only the new location has any work to do, renaming the old file. */
+
+		if (object->stronghelp.name == NULL)
+			break;
+
+		old_filename = objectdb_get_file_path(&old_path, object->moved);
+
+		object->disc.name = files_make_filename(object->stronghelp.name, object->stronghelp.filetype, object->db->arena);
+
+		filename = objectdb_get_file_path(&path, object);
+		if (old_filename == NULL || filename == NULL) {
+			success = false;
+			break;
+		}
+
+		msg_report(MSG_MOVE_FILE, old_filename, filename);
+
+		if (!files_rename_file(old_filename, filename))
+			success = false;
+		else
+			stats_count(STATS_FILES_RENAMED, 1);
+		break;
+	case OBJECTDB_STATUS_TYPE_CHANGED:
+	case OBJECTDB_STATUS_SIZE_CHANGED:
+	case OBJECTDB_STATUS_CONTENT_CHANGED:
+		/* Write the new contents alongside the old, then swap them over. */
+
+		old_filename = objectdb_get_file_path(&old_path, object);
+
+		object->disc.name = files_make_filename(object->stronghelp.name, object->stronghelp.filetype, object->db->arena);
+
+		filename = objectdb_get_file_path(&path, object);
+		if (old_filename == NULL || filename == NULL) {
+			success = false;
+			break;
+		}
+
+		msg_report(MSG_WRITE_FILE, filename);
+
+		if (!objectdb_write_contents(object, filename, old_filename))
+			success = false;
+		break;
+	default:
+		break;
+	}
+
+	objectdb_free_path(&path);
+	objectdb_free_path(&old_path);
+
+	return success;
+}
+
+/**
+ * Remove any deleted directories from a given output directory and all
+ * of the folders below it, working from the bottom up so that each is
+ * empty by the time that it is removed. The directories are collected
+ * as they are walked, and then removed in the reverse order, so that
+ * every directory comes after all of those within it.
+ *
+ * \param *dir		Pointer to the directory to be processed.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_remove_directories(struct objectdb_object *dir)
+{
+	struct objectdb_walk walk;
+	struct stack deleted;
+	char *path = NULL;
+	bool success = true;
+
+	stack_initialise(&deleted, sizeof(struct objectdb_object *));
+
+	objectdb_start_walk(&walk, dir);
+
+	while (success && (dir = objectdb_walk_next(&walk)) != NULL) {
+		if (dir->status == OBJECTDB_STATUS_DELETED && !stack_push(&deleted, &dir))
+			success = false;
+	}
+
+	if (!objectdb_end_walk(&walk))
+		success = false;
+
+	/* Directories come off the stack after those within them, so any
+	 * holding objects which were left out by a filter can be kept, along
+	 * with all of the directories that they are in.
+	 */
+
+	while (success && stack_pop(&deleted, &dir)) {
+		if (dir->filtered) {
+			if (dir->parent != NULL)
+				dir->parent->filtered = true;
+			continue;
+		}
+
+		path = objectdb_get_dir_path(dir, OBJECTDB_PATH_TYPE_DISC, NULL);
+		if (path == NULL) {
+			success = false;
+			break;
+		}
+
+		msg_report(MSG_DELETE_DIR, path);
+		if (!files_delete_directory(path))
+			success = false;
+	}
+
+	stack_free(&deleted);
+
+	return success;
+}
+
+/**
+ * Carry out the batched file updates collected by the update tasks,
+ * deleting the old files before writing the new ones.
+ *
+ * \param *db		Pointer to the database holding the batches.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_update_batch(struct objectdb *db)
+{
+	struct files_batch_item *items;
+	bool success;
+	size_t i;
+
+	/* Delete the files which are no longer required. */
+
+	if (db->deletes->count > 0) {
+		items = objectdb_make_batch_items(db->deletes, false);
+		if (items == NULL)
+			return false;
+
+		for (i = 0; i < db->deletes->count; i++)
+			msg_report(MSG_DELETE_FILE, items[i].path);
+
+		success = files_delete_batch(items, db->deletes->count);
+
+		for (i = 0; success && i < db->deletes->count; i++) {
+			if (!items[i].success)
+				success = false;
+		}
+
+		free(items);
+
+		if (!success)
+			return false;
+	}
+
+	/* Write the files which have been added. */
+
+	if (db->writes->count > 0) {
+		items = objectdb_make_batch_items(db->writes, true);
+		if (items == NULL)
+			return false;
+
+		for (i = 0; i < db->writes->count; i++)
+			msg_report(MSG_WRITE_FILE, items[i].path);
+
+		success = files_write_batch(items, db->writes->count, db->sync == FILES_SYNC_FILE);
+
+		for (i = 0; success && i < db->writes->count; i++) {
+			if (!items[i].success)
+				success = false;
+		}
+
+		free(items);
+
+		if (!success)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Build an array of file batch items for the objects in a batch, giving
+ * the path of each on disc and the data from the StrongHelp manual. The
+ * paths are allocated from the database's arena.
+ *
+ * The array is allocated using malloc(), and must be freed with free()
+ * after use.
+ *
+ * \param *batch	Pointer to the batch to build the items for.
+ * \param write		True if the items are to be written, in which case
+ *			the filetypes are taken from the StrongHelp manual.
+ * \return		Pointer to the array of items, or NULL on failure.
+ */
+
+static struct files_batch_item *objectdb_make_batch_items(struct objectdb_batch *batch, bool write)
+{
+	struct files_batch_item *items;
+	struct objectdb_object *object;
+	struct objectdb_path path;
+	char *filename;
+	size_t i;
+
+	items = malloc(batch->count * sizeof(struct files_batch_item));
+	if (items == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return NULL;
+	}
+
+	objectdb_initialise_path(&path, OBJECTDB_PATH_TYPE_DISC);
+
+	for (i = 0; i < batch->count; i++) {
+		object = batch->objects[i];
+
+		filename = objectdb_get_file_path(&path, object);
+
+		items[i].path = (filename != NULL) ? arena_strdup(object->db->arena, filename) : NULL;
+		items[i].data = object->stronghelp.data;
+		items[i].source = (object->stronghelp.data == NULL) ? object->db->source : NULL;
+		items[i].offset = object->stronghelp.offset;
+		items[i].length = object->stronghelp.size;
+		items[i].filetype = (write) ? object->stronghelp.filetype : object->disc.filetype;
+		items[i].difference = 0;
+		items[i].success = false;
+
+		if (items[i].path == NULL) {
+			objectdb_free_path(&path);
+			free(items);
+			return NULL;
+		}
+	}
+
+	objectdb_free_path(&path);
+
+	return items;
+}
+
+/**
+ * Initialise an empty batch of objects.
+ *
+ * \param *batch	Pointer to the batch to initialise.
+ */
+
+static void objectdb_initialise_batch(struct objectdb_batch *batch)
+{
+	batch->objects = NULL;
+	batch->count = 0;
+	batch->size = 0;
+#ifdef LINUX
+	pthread_mutex_init(&(batch->lock), NULL);
+#endif
+}
+
+/**
+ * Add an object to a batch, extending the batch's array if required. This
+ * can be called from any of the pool's tasks.
+ *
+ * \param *batch	Pointer to the batch to add the object to.
+ * \param *object	Pointer to the object to add.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_add_to_batch(struct objectdb_batch *batch, struct objectdb_object *object)
+{
+	struct objectdb_object **objects;
+	bool success = true;
+
+#ifdef LINUX
+	pthread_mutex_lock(&(batch->lock));
+#endif
+
+	if (batch->count >= batch->size) {
+		objects = realloc(batch->objects, ((batch->size > 0) ? batch->size * 2 : 64) * sizeof(struct objectdb_object *));
+
+		if (objects != NULL) {
+			batch->objects = objects;
+			batch->size = (batch->size > 0) ? batch->size * 2 : 64;
+		} else {
+			msg_report(MSG_NO_MEMORY);
+			success = false;
+		}
+	}
+
+	if (success)
+		batch->objects[batch->count++] = object;
+
+#ifdef LINUX
+	pthread_mutex_unlock(&(batch->lock));
+#endif
+
+	return success;
+}
+
+/**
+ * Free the memory used by a batch of objects.
+ *
+ * \param *batch	Pointer to the batch to free.
+ */
+
+static void objectdb_free_batch(struct objectdb_batch *batch)
+{
+	free(batch->objects);
+
+	batch->objects = NULL;
+	batch->count = 0;
+	batch->size = 0;
+#ifdef LINUX
+	pthread_mutex_destroy(&(batch->lock));
+#endif
+}
+
+/**
+ * Write a manifest recording the catalogue information and content hash of
+ * all of the files in the output folder, once it has been updated to match
+ * the StrongHelp manual.
+ *
+ * \param *db		Pointer to the database to write the manifest for.
+ * \param *filename	Pointer to the name of the manifest file.
+ * \return		True if successful, false on failure.
+ */
+
+bool objectdb_write_manifest(struct objectdb *db, char *filename)
+{
+	struct manifest_writer *writer;
+
+	if (db == NULL || filename == NULL)
+		return false;
+
+	writer = manifest_open(filename);
+	if (writer == NULL)
+		return false;
+
+	return manifest_close(writer, objectdb_collect_manifest(db, writer, NULL));
+}
+
+/**
+ * Record the catalogue information and content hash of all of the files
+ * in the output folder into a manifest in memory, once it has been updated
+ * to match the StrongHelp manual.
+ *
+ * \param *db		Pointer to the database to record the manifest for.
+ * \param *manifest	Pointer to the manifest to add the entries to.
+ * \return		True if successful, false on failure.
+ */
+
+bool objectdb_record_manifest(struct objectdb *db, struct manifest *manifest)
+{
+	if (db == NULL || manifest == NULL)
+		return false;
+
+	return objectdb_collect_manifest(db, NULL, manifest);
+}
+
+/**
+ * Collect the manifest entries for all of the files in the output folder,
+ * either writing them out to a file or adding them to a manifest in memory.
+ *
+ * \param *db		Pointer to the database to collect the entries for.
+ * \param *writer	Pointer to the manifest writer to use, or NULL.
+ * \param *manifest	Pointer to the manifest to add to, if there's no writer.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_collect_manifest(struct objectdb *db, struct manifest_writer *writer, struct manifest *manifest)
+{
+	struct objectdb_object *dir;
+	struct objectdb_walk walk;
+	bool success = true;
+
+	/* Directories which aren't in the manual can't hold any of its files. */
+
+	objectdb_start_walk(&walk, db->root);
+
+	while (success && (dir = objectdb_walk_next(&walk)) != NULL) {
+		if (dir == db->root || dir->stronghelp.name != NULL)
+			success = objectdb_write_directory_manifest(dir, writer, manifest);
+	}
+
+	if (!objectdb_end_walk(&walk))
+		success = false;
+
+	return success;
+}
+
+/**
+ * Collect the manifest entries for the files in a single output directory.
+ *
+ * \param *dir		Pointer to the directory to be processed.
+ * \param *writer	Pointer to the manifest writer to use, or NULL.
+ * \param *manifest	Pointer to the manifest to add to, if there's no writer.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_write_directory_manifest(struct objectdb_object *dir, struct manifest_writer *writer, struct manifest *manifest)
+{
+	struct objectdb_path disc_path, manifest_path;
+	struct objectdb_object *object;
+	char *filename, *name;
+	struct files_stat stat;
+	bool success = true;
+
+	if (dir == NULL)
+		return false;
+
+	objectdb_initialise_path(&disc_path, OBJECTDB_PATH_TYPE_DISC);
+	objectdb_initialise_path(&manifest_path, OBJECTDB_PATH_TYPE_AGNOSTIC);
+
+	for (object = dir->files; object != NULL && success; object = object->next) {
+		if (object->stronghelp.name == NULL || object->disc.name == NULL)
+			continue;
+
+		filename = objectdb_get_file_path(&disc_path, object);
+		name = objectdb_get_file_path(&manifest_path, object);
+		if (filename == NULL || name == NULL) {
+			success = false;
+			break;
+		}
+
+		/* Any files which can't be found are simply left out. */
+
+		if (!files_read_stat(filename, &stat) || stat.size != object->stronghelp.size)
+			continue;
+
+		if (!objectdb_hash_contents(object)) {
+			success = false;
+			break;
+		}
+
+		if (writer != NULL)
+			success = manifest_add(writer, name, &stat, object->stronghelp.hash);
+		else
+			success = manifest_remember(manifest, name, &stat, object->stronghelp.hash);
+	}
+
+	objectdb_free_path(&disc_path);
+	objectdb_free_path(&manifest_path);
+
+	return success;
+}
+
+/**
+ * Write the contents of the StrongHelp manual out to an archive, using the
+ * same names as would be given to the files in an output folder. Only the
+ * manual's side of the database is used, so no folder needs to have been
+ * scanned.
+ *
+ * \param *db		Pointer to the database to write the archive from.
+ * \param *archive	Pointer to the archive to write to.
+ * \return		True if successful, false on failure.
+ */
+
+bool objectdb_write_archive(struct objectdb *db, struct archive *archive)
+{
+	struct objectdb_object *dir;
+	struct objectdb_walk walk;
+	char *buffer = NULL, *path;
+	bool success = true;
+
+	if (db == NULL || archive == NULL)
+		return false;
+
+	/* Files which aren't held in memory are copied through a buffer. */
+
+	if (db->source != NULL) {
+		buffer = malloc(OBJECTDB_ARCHIVE_CHUNK);
+		if (buffer == NULL) {
+			msg_report(MSG_NO_MEMORY);
+			return false;
+		}
+	}
+
+	/* The objects are linked in as they were read from the manual, so need
+	 * to be sorted for the archive to be in alphabetical order.
+	 */
+
+	objectdb_sort_directory(db->root);
+
+	objectdb_start_walk(&walk, db->root);
+
+	while (success && (dir = objectdb_walk_next(&walk)) != NULL) {
+		if (dir->stronghelp.name == NULL && dir != db->root)
+			continue;
+
+		if (dir != db->root) {
+			dir->disc.name = files_make_filename(dir->stronghelp.name, dir->stronghelp.filetype, db->arena);
+
+			path = objectdb_get_dir_path(dir, OBJECTDB_PATH_TYPE_ARCHIVE, NULL);
+			if (path == NULL || !archive_add_directory(archive, path)) {
+				success = false;
+				break;
+			}
+		}
+
+		success = objectdb_write_directory_archive(dir, archive, buffer);
+	}
+
+	if (!objectdb_end_walk(&walk))
+		success = false;
+
+	free(buffer);
+
+	return success;
+}
+
+/**
+ * Write the files in a single directory of the StrongHelp manual out to
+ * an archive.
+ *
+ * \param *dir		Pointer to the directory to be processed.
+ * \param *archive	Pointer to the archive to write to.
+ * \param *buffer	Pointer to a buffer of OBJECTDB_ARCHIVE_CHUNK bytes,
+ *			used to copy files from the source, or NULL.
+ * \return		True if successful, false on failure.
+ */
+
+static bool objectdb_write_directory_archive(struct objectdb_object *dir, struct archive *archive, char *buffer)
+{
+	struct objectdb_object *object;
+	struct objectdb_path path;
+	size_t offset, length;
+	char *filename;
+	bool success = true;
+
+	if (dir == NULL)
+		return false;
+
+	objectdb_initialise_path(&path, OBJECTDB_PATH_TYPE_ARCHIVE);
+
+	for (object = dir->files; object != NULL && success; object = object->next) {
+		if (object->stronghelp.name == NULL)
+			continue;
+
+		object->disc.name = files_make_filename(object->stronghelp.name, object->stronghelp.filetype, dir->db->arena);
+
+		filename = objectdb_get_file_path(&path, object);
+		if (filename == NULL || !objectdb_has_contents(object)) {
+			success = false;
+			break;
+		}
+
+		msg_report(MSG_WRITE_FILE, filename);
+
+		if (!archive_start_file(archive, filename, object->stronghelp.size)) {
+			success = false;
+			break;
+		}
+
+		/* Files held in memory go straight in; the rest come from the source. */
+
+		if (object->stronghelp.data != NULL) {
+			success = archive_write(archive, object->stronghelp.data, object->stronghelp.size);
+		} else {
+			for (offset = 0; offset < object->stronghelp.size && success; offset += length) {
+				length = object->stronghelp.size - offset;
+				if (length > OBJECTDB_ARCHIVE_CHUNK)
+					length = OBJECTDB_ARCHIVE_CHUNK;
+
+				success = files_read_source(dir->db->source, object->stronghelp.offset + offset, buffer, length) &&
+						archive_write(archive, buffer, length);
+			}
+		}
+
+		if (success)
+			success = archive_end_file(archive);
+	}
+
+	objectdb_free_path(&path);
+
+	return success;
+}
+
+#endif
+
+/**
+ * Return the root directory of an object database.
+ *
+ * \param *db		Pointer to the database of interest.
+ * \return		Pointer to the root directory, or NULL if none.
+ */
+
+struct objectdb_object *objectdb_get_root(struct objectdb *db)
+{
+	return (db != NULL) ? db->root : NULL;
+}
+
+/**
+ * Return the first of the subdirectories within a directory. The
+ * subdirectories are in alphabetical order once the disc folder has
+ * been read.
+ *
+ * \param *dir		Pointer to the directory of interest.
+ * \return		Pointer to the first subdirectory, or NULL if none.
+ */
+
+struct objectdb_object *objectdb_get_first_directory(struct objectdb_object *dir)
+{
+	return (dir != NULL) ? dir->directories : NULL;
+}
+
+/**
+ * Return the first of the files within a directory. The files are in
+ * alphabetical order once the disc folder has been read.
+ *
+ * \param *dir		Pointer to the directory of interest.
+ * \return		Pointer to the first file, or NULL if none.
+ */
+
+struct objectdb_object *objectdb_get_first_file(struct objectdb_object *dir)
+{
+	return (dir != NULL) ? dir->files : NULL;
+}
+
+/**
+ * Return the object following another in its parent directory's list
+ * of files or subdirectories.
+ *
+ * \param *object	Pointer to the object of interest.
+ * \return		Pointer to the next object, or NULL if none.
+ */
+
+struct objectdb_object *objectdb_get_next_object(struct objectdb_object *object)
+{
+	return (object != NULL) ? object->next : NULL;
+}
+
+/**
+ * Find a file within a directory by name.
+ *
+ * \param *dir		Pointer to the directory to search.
+ * \param *name		Pointer to the name of the file.
+ * \return		Pointer to the file, or NULL if not found.
+ */
+
+struct objectdb_object *objectdb_find_file(struct objectdb_object *dir, char *name)
+{
+	return (dir != NULL && name != NULL) ? objectdb_find_object(&(dir->file_index), name) : NULL;
+}
+
+/**
+ * Find a subdirectory within a directory by name.
+ *
+ * \param *dir		Pointer to the directory to search.
+ * \param *name		Pointer to the name of the subdirectory.
+ * \return		Pointer to the subdirectory, or NULL if not found.
+ */
+
+struct objectdb_object *objectdb_find_directory(struct objectdb_object *dir, char *name)
+{
+	return (dir != NULL && name != NULL) ? objectdb_find_object(&(dir->directory_index), name) : NULL;
+}
+
+/**
+ * Return the name of an object, in its RISC OS form.
+ *
+ * \param *object	Pointer to the object of interest.
+ * \return		Pointer to the name, or NULL.
+ */
+
+char *objectdb_get_name(struct objectdb_object *object)
+{
+	return (object != NULL) ? object->name : NULL;
+}
+
+/**
+ * Return the details of an object as found in the disc folder.
+ *
+ * \param *object	Pointer to the object of interest.
+ * \param *size		Pointer to a variable to take the size, or NULL.
+ * \param *filetype	Pointer to a variable to take the filetype, or NULL.
+ * \return		True if the object is on disc; False if not.
+ */
+
+bool objectdb_get_disc_details(struct objectdb_object *object, size_t *size, uint32_t *filetype)
+{
+	if (object == NULL || object->disc.filetype == OBJECTDB_TYPE_UNKNOWN)
+		return false;
+
+	if (size != NULL)
+		*size = object->disc.size;
+
+	if (filetype != NULL)
+		*filetype = object->disc.filetype;
+
+	return true;
+}
+
+/**
+ * Return the details of an object as found in the StrongHelp manual.
+ *
+ * \param *object	Pointer to the object of interest.
+ * \param *size		Pointer to a variable to take the size, or NULL.
+ * \param *filetype	Pointer to a variable to take the filetype, or NULL.
+ * \param *offset	Pointer to a variable to take the offset of a file's
+ *			data within the manual, or NULL.
+ * \return		True if the object is in the manual; False if not.
+ */
+
+bool objectdb_get_stronghelp_details(struct objectdb_object *object, size_t *size, uint32_t *filetype, size_t *offset)
+{
+	if (object == NULL || object->stronghelp.filetype == OBJECTDB_TYPE_UNKNOWN)
+		return false;
+
+	if (size != NULL)
+		*size = object->stronghelp.size;
+
+	if (filetype != NULL)
+		*filetype = object->stronghelp.filetype;
+
+	if (offset != NULL)
+		*offset = object->stronghelp.offset;
+
+	return true;
+}
+
+/**
+ * Test whether the contents of a file were found to be the same in the
+ * StrongHelp manual and the disc folder by objectdb_check_status(), even
+ * if the file's type has changed.
+ *
+ * \param *object	Pointer to the object of interest.
+ * \return		True if the contents match; False if not.
+ */
+
+bool objectdb_get_contents_matched(struct objectdb_object *object)
+{
+	if (object == NULL)
+		return false;
+
+	return (object->status == OBJECTDB_STATUS_IDENTICAL || object->status == OBJECTDB_STATUS_RETYPED) ? true : false;
+}
+
+/**
+ * Return the other half of a file which objectdb_check_status() found to
+ * have been moved: the copy in the disc folder for a file that is only in
+ * the manual, or the copy in the manual for a file that is only on disc.
+ *
+ * \param *object	Pointer to the object of interest.
+ * \return		Pointer to the other copy, or NULL if not moved.
+ */
+
+struct objectdb_object *objectdb_get_moved(struct objectdb_object *object)
+{
+	return (object != NULL && object->status == OBJECTDB_STATUS_MOVED) ? object->moved : NULL;
+}
+
+/**
+ * Get a file path to a directory.
+ *
+ * The path is allocated using malloc(), and must be freed with free() after use.
+ *
+ * \param *dir	 	Pointer to the directory of interest.
+ * \param type		The type of path to return.
+ * \return		A pointer to the path, or NULL.
+ */
+
+char *objectdb_get_path(struct objectdb_object *dir, enum objectdb_path_type type)
+{
+	char *path, *name;
+	size_t length;
+
+	path = objectdb_get_dir_path(dir, type, &length);
+	if (path == NULL)
+		return NULL;
+
+	name = malloc(length + 1);
+	if (name == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return NULL;
+	}
+
+	string_copy(name, path, length + 1);
+
+	return name;
+}
+
+/**
+ * Get the full path of a directory, from the cache held on the directory
+ * object if possible, or by building it up from the parent's path if not.
+ * The returned path is owned by the database, and must not be modified.
+ *
+ * \param *dir		Pointer to the directory to work from.
+ * \param type		The type of path to generate.
+ * \param *length	Pointer to a variable to take the length of the path,
+ *			or NULL if not required.
+ * \return		Pointer to the path, or NULL on failure.
+ */
+
+static char *objectdb_get_dir_path(struct objectdb_object *dir, enum objectdb_path_type type, size_t *length)
+{
+	struct objectdb_object *object;
+	char *path, *parent = NULL;
+	size_t path_length, parent_length = 0;
+	struct stack stack;
+
+	if (dir == NULL)
+		return NULL;
+
+	path = objectdb_get_cached_path(dir, type, &path_length);
+
+	/* If the path isn't cached, work up the tree to the nearest directory
+	 * whose path is, and then build the paths back down from there.
+	 */
+
+	if (path == NULL) {
+		stack_initialise(&stack, sizeof(struct objectdb_object *));
+
+		object = dir;
+
+		while (object != NULL && parent == NULL) {
+			if (!stack_push(&stack, &object)) {
+				stack_free(&stack);
+				return NULL;
+			}
+
+			object = object->parent;
+
+			if (object != NULL)
+				parent = objectdb_get_cached_path(object, type, &parent_length);
+		}
+
+		while (stack_pop(&stack, &object)) {
+			path = objectdb_build_dir_path(object, type, parent, parent_length, &path_length);
+			if (path == NULL)
+				break;
+
+			parent = path;
+			parent_length = path_length;
+		}
+
+		stack_free(&stack);
+
+		if (path == NULL)
+			return NULL;
+	}
+
+	if (length != NULL)
+		*length = path_length;
+
+	return path;
+}
+
+/**
+ * Return the full path of a directory, if it is held in the cache on the
+ * directory object.
+ *
+ * \param *dir		Pointer to the directory of interest.
+ * \param type		The type of path to return.
+ * \param *length	Pointer to a variable to take the length of the path.
+ * \return		Pointer to the path, or NULL if it isn't cached.
+ */
+
+static char *objectdb_get_cached_path(struct objectdb_object *dir, enum objectdb_path_type type, size_t *length)
+{
+	char *path;
+
+#ifdef LINUX
+	pthread_mutex_lock(&(dir->db->path_lock));
+#endif
+
+	path = dir->paths[type];
+	*length = dir->path_lengths[type];
+
+#ifdef LINUX
+	pthread_mutex_unlock(&(dir->db->path_lock));
+#endif
+
+	return path;
+}
+
+/**
+ * Build the full path of a directory from that of its parent, and store
+ * it in the cache on the directory object.
+ *
+ * \param *dir		Pointer to the directory of interest.
+ * \param type		The type of path to build.
+ * \param *parent	Pointer to the parent's path, or NULL for the root.
+ * \param parent_length	The length of the parent's path.
+ * \param *length	Pointer to a variable to take the length of the path.
+ * \return		Pointer to the path, or NULL on failure.
+ */
+
+static char *objectdb_build_dir_path(struct objectdb_object *dir, enum objectdb_path_type type, char *parent, size_t parent_length, size_t *length)
+{
+	char *path, *part, *separator;
+	size_t path_length;
+
+	part = objectdb_get_path_part(dir, type);
+	if (part == NULL)
+		return NULL;
+
+	/* Archive paths are relative, so the root's children have no prefix. */
+
+	separator = objectdb_get_path_separator(type);
+
+	if (parent != NULL && parent_length == 0)
+		parent = NULL;
+
+	if (parent != NULL)
+		path_length = parent_length + strlen(separator) + strlen(part);
+	else
+		path_length = strlen(part);
+
+	path = arena_alloc(dir->db->arena, path_length + 1);
+	if (path == NULL)
+		return NULL;
+
+	*path = '\0';
+
+	if (parent != NULL) {
+		string_append(path, parent, path_length + 1);
+		string_append(path, separator, path_length + 1);
+	}
+
+	string_append(path, part, path_length + 1);
+
+#ifdef LINUX
+	pthread_mutex_lock(&(dir->db->path_lock));
+#endif
+
+	dir->paths[type] = path;
+	dir->path_lengths[type] = path_length;
+
+#ifdef LINUX
+	pthread_mutex_unlock(&(dir->db->path_lock));
+#endif
+
+	*length = path_length;
+
+	return path;
+}
+
+/**
+ * Return the part of an object's path contributed by its own name.
+ *
+ * \param *object	Pointer to the object of interest.
+ * \param type		The type of path being built.
+ * \return		Pointer to the name, or NULL if there isn't one.
+ */
+
+static char *objectdb_get_path_part(struct objectdb_object *object, enum objectdb_path_type type)
+{
+	switch (type) {
+	case OBJECTDB_PATH_TYPE_AGNOSTIC:
+		return object->name;
+	case OBJECTDB_PATH_TYPE_STRONGHELP:
+		return object->stronghelp.name;
+	case OBJECTDB_PATH_TYPE_DISC:
+		return object->disc.name;
+	case OBJECTDB_PATH_TYPE_ARCHIVE:
+		return (object->parent != NULL) ? object->disc.name : "";
+	}
+
+	return NULL;
+}
+
+/**
+ * Return the directory separator used by a given type of path.
+ *
+ * \param type		The type of path being built.
+ * \return		Pointer to the separator.
+ */
+
+static char *objectdb_get_path_separator(enum objectdb_path_type type)
+{
+	switch (type) {
+	case OBJECTDB_PATH_TYPE_DISC:
+		return FILES_PATH_SEPARATOR;
+	case OBJECTDB_PATH_TYPE_ARCHIVE:
+		return "/";
+	default:
+		return ".";
+	}
+}
+
+#ifndef READER_ONLY
+/**
+ * Initialise a path buffer, ready to build file paths.
+ *
+ * \param *path		Pointer to the path buffer to initialise.
+ * \param type		The type of path to be built.
+ */
+
+static void objectdb_initialise_path(struct objectdb_path *path, enum objectdb_path_type type)
+{
+	path->type = type;
+	path->buffer = NULL;
+	path->size = 0;
+	path->dir = NULL;
+	path->base = 0;
+}
+
+/**
+ * Build the path to a file in a path buffer. The parent directory's path
+ * is only copied in to the buffer when it differs from that of the previous
+ * file, so walking the files in a directory just replaces the leaf name.
+ *
+ * The returned path remains valid until the buffer is next used.
+ *
+ * \param *path		Pointer to the path buffer to use.
+ * \param *file		Pointer to the file of interest.
+ * \return		Pointer to the path, or NULL on failure.
+ */
+
+static char *objectdb_get_file_path(struct objectdb_path *path, struct objectdb_object *file)
+{
+	char *prefix, *part, *buffer, *separator;
+	size_t prefix_length = 0, length, size;
+
+	if (path == NULL || file == NULL || file->parent == NULL)
+		return NULL;
+
+	part = objectdb_get_path_part(file, path->type);
+	if (part == NULL)
+		return NULL;
+
+	separator = objectdb_get_path_separator(path->type);
+
+	/* If the file is in a different directory, start again with the new prefix. */
+
+	if (path->dir != file->parent || path->buffer == NULL) {
+		prefix = objectdb_get_dir_path(file->parent, path->type, &prefix_length);
+		if (prefix == NULL)
+			return NULL;
+
+		path->dir = NULL;
+		path->base = (prefix_length > 0) ? prefix_length + strlen(separator) : 0;
+	} else {
+		prefix = NULL;
+	}
+
+	/* Make sure that the buffer is big enough, growing it if not. */
+
+	length = path->base + strlen(part) + 1;
+
+	if (length > path->size) {
+		size = (path->size == 0) ? 256 : path->size;
+		while (size < length)
+			size *= 2;
+
+		buffer = realloc(path->buffer, size);
+		if (buffer == NULL) {
+			msg_report(MSG_NO_MEMORY);
+			return NULL;
+		}
+
+		path->buffer = buffer;
+		path->size = size;
+	}
+
+	if (prefix != NULL) {
+		*(path->buffer) = '\0';
+		if (prefix_length > 0) {
+			string_append(path->buffer, prefix, path->size);
+			string_append(path->buffer, separator, path->size);
+		}
+		path->dir = file->parent;
+	}
+
+	path->buffer[path->base] = '\0';
+	string_append(path->buffer + path->base, part, path->size - path->base);
+
+	return path->buffer;
+}
+
+/**
+ * Free the memory used by a path buffer.
+ *
+ * \param *path		Pointer to the path buffer to free.
+ */
+
+static void objectdb_free_path(struct objectdb_path *path)
+{
+	if (path == NULL)
+		return;
+
+	free(path->buffer);
+	objectdb_initialise_path(path, path->type);
+}
+
+#endif
+
+/**
+ * Start a walk over a directory, and all of the directories below it.
+ *
+ * \param *walk		Pointer to the walk to start.
+ * \param *dir		Pointer to the directory to start from.
+ */
+
+static void objectdb_start_walk(struct objectdb_walk *walk, struct objectdb_object *dir)
+{
+	stack_initialise(&(walk->stack), sizeof(struct objectdb_object *));
+
+	walk->failed = (dir == NULL || !stack_push(&(walk->stack), &dir)) ? true : false;
+}
+
+/**
+ * Return the next directory in a walk. The directories within it are
+ * pushed on to the stack in reverse order, so that the first of them
+ * will be visited next.
+ *
+ * \param *walk		Pointer to the walk to continue.
+ * \return		Pointer to the next directory, or NULL if the walk
+ *			is complete or has failed.
+ */
+
+static struct objectdb_object *objectdb_walk_next(struct objectdb_walk *walk)
+{
+	struct objectdb_object *dir, *object;
+	size_t depth;
+
+	if (walk->failed || !stack_pop(&(walk->stack), &dir))
+		return NULL;
+
+	depth = stack_count(&(walk->stack));
+
+	for (object = dir->directories; object != NULL; object = object->next) {
+		if (!stack_push(&(walk->stack), &object)) {
+			walk->failed = true;
+			return NULL;
+		}
+	}
+
+	stack_reverse(&(walk->stack), depth);
+
+	return dir;
+}
+
+/**
+ * End a walk, releasing the memory that it used.
+ *
+ * \param *walk		Pointer to the walk to end.
+ * \return		True if the walk was completed; false if it failed.
+ */
+
+static bool objectdb_end_walk(struct objectdb_walk *walk)
+{
+	stack_free(&(walk->stack));
+
+	return (walk->failed) ? false : true;
 }
@@ -31,6 +31,13 @@
 #define STRONGEX_OBJECTDB_H
 
 #include <stdbool.h>
+#include <stdint.h>
+
+#include "archive.h"
+#include "arena.h"
+#include "files.h"
+#include "manifest.h"
+#include "report.h"
 
 /**
  * The types of path to return from path queries.
@@ -39,7 +46,8 @@
 enum objectdb_path_type {
 	OBJECTDB_PATH_TYPE_AGNOSTIC,		/**< The generic path to the file.		*/
 	OBJECTDB_PATH_TYPE_STRONGHELP,		/**< The StrongHelp path to the file.		*/
-	OBJECTDB_PATH_TYPE_DISC			/**< The disc-based path to the file.		*/
+	OBJECTDB_PATH_TYPE_DISC,		/**< The disc-based path to the file.		*/
+	OBJECTDB_PATH_TYPE_ARCHIVE		/**< The path to the file within an archive.	*/
 };
 
 /**
@@ -54,50 +62,177 @@ enum objectdb_path_type {
 
 #define OBJECTDB_TYPE_UNKNOWN (0xffff)
 
+/**
+ * An object database instance reference.
+ */
+
+struct objectdb;
+
 /**
  * An object instance reference.
  */
 
 struct objectdb_object;
 
+/**
+ * The position reached in merging the contents of a directory on disc
+ * into the database.
+ */
+
+struct objectdb_merge {
+	struct objectdb_object		*parent;	/**< The directory being merged into.			*/
+	struct objectdb_object		**files;	/**< The position reached in the list of files.		*/
+	struct objectdb_object		**directories;	/**< The position reached in the list of directories.	*/
+};
+
+/**
+ * Create a new, empty, object database.
+ *
+ * \param *arena	Pointer to the arena to allocate memory from.
+ * \return		Pointer to the new database, or NULL on failure.
+ */
+
+struct objectdb *objectdb_create(struct arena *arena);
+
+/**
+ * Destroy an object database. The memory will be released when the
+ * arena passed to objectdb_create() is destroyed.
+ *
+ * \param *db		Pointer to the database to destroy.
+ */
+
+void objectdb_destroy(struct objectdb *db);
+
+/**
+ * Return the arena from which an object database allocates its memory.
+ *
+ * \param *db		Pointer to the database of interest.
+ * \return		Pointer to the arena, or NULL.
+ */
+
+struct arena *objectdb_get_arena(struct objectdb *db);
+
+/**
+ * Set a manifest which can be used to avoid reading the contents of files
+ * whose catalogue information hasn't changed since the manifest was written.
+ *
+ * \param *db		Pointer to the database to update.
+ * \param *manifest	Pointer to the manifest to use, or NULL for none.
+ */
+
+void objectdb_set_manifest(struct objectdb *db, struct manifest *manifest);
+
+/**
+ * Set whether file access should be batched up where possible, so that
+ * many operations can be in flight at once.
+ *
+ * \param *db		Pointer to the database to update.
+ * \param batch_io	True to batch file access; False to access files
+ *			individually.
+ */
+
+void objectdb_set_batch_io(struct objectdb *db, bool batch_io);
+
+/**
+ * Set the number of files whose contents should be prefetched ahead of
+ * the one being compared, so that the filing system can fetch them in the
+ * background. This has no effect if file access is being batched.
+ *
+ * \param *db		Pointer to the database to update.
+ * \param readahead	The number of files to prefetch, or 0 for none.
+ */
+
+void objectdb_set_readahead(struct objectdb *db, size_t readahead);
+
+/**
+ * Set the source file from which the contents of StrongHelp files are to
+ * be read as required, for files which were added without their data
+ * being held in memory.
+ *
+ * \param *db		Pointer to the database to update.
+ * \param *source	Pointer to the source file, or NULL for none.
+ */
+
+void objectdb_set_source(struct objectdb *db, struct files_source *source);
+
+/**
+ * Add a wildcard pattern to select the objects to be processed, which is
+ * matched against their paths within the manual. If there are any patterns
+ * to include objects, only directories and files which match one of them,
+ * or which are within a directory that does, are included. Anything which
+ * matches a pattern to exclude it is left out. Filters must be added before
+ * any objects.
+ *
+ * \param *db		Pointer to the database to update.
+ * \param *pattern	Pointer to the pattern to add, which must remain
+ *			valid for the life of the database.
+ * \param exclude	True to exclude the matching objects; False to
+ *			include them.
+ * \return		True if successful; False on failure.
+ */
+
+bool objectdb_add_filter(struct objectdb *db, char *pattern, bool exclude);
+
+/**
+ * Test whether an object found in a directory should be added to the
+ * database, given the filters that have been set on it. Directories are
+ * included if anything within them could be. If anything is left out, the
+ * directory is marked so that it won't be deleted by an update.
+ *
+ * \param *db		Pointer to the database to test against.
+ * \param *parent	Pointer to the directory holding the object.
+ * \param *name		Pointer to the name of the object.
+ * \param directory	True if the object is a directory; else false.
+ * \return		True if the object should be added; else false.
+ */
+
+bool objectdb_filter_object(struct objectdb *db, struct objectdb_object *parent, char *name, bool directory);
 
 /**
  * Add a directory reference from the StrongHelp manual.
  *
+ * \param *db		Pointer to the database to add to.
  * \param *parent	Pointer to the parent directory, or NULL for the root.
  * \param *name		Pointer to the name of the directory.
  * \return		Pointer to the new directory instance, or NULL.
  */
 
-struct objectdb_object *objectdb_add_stronghelp_directory(struct objectdb_object *parent, char *name);
+struct objectdb_object *objectdb_add_stronghelp_directory(struct objectdb *db, struct objectdb_object *parent, char *name);
 
 /**
  * Add a file reference from the StrongHelp manual.
  *
+ * \param *db		Pointer to the database to add to.
  * \param *parent	Pointer to the parent directory.
  * \param *name		Pointer to the name of the file.
  * \param size		The size of the file.
  * \param filetype	The filetype of the file.
- * \param *data		Pointer to the file data.
+ * \param *data		Pointer to the file data, or NULL if it is to be
+ *			read from the database's source file.
+ * \param offset	The offset of the file data within the source file.
+ * \param *hash		Pointer to the CRC32C hash of the file data, or NULL
+ *			if it is to be calculated when it is first needed.
  * \return		Pointer to the new file instance, or NULL.
  */
 
-struct objectdb_object *objectdb_add_stronghelp_file(struct objectdb_object *parent, char *name, size_t size, uint32_t filetype, char *data);
+struct objectdb_object *objectdb_add_stronghelp_file(struct objectdb *db, struct objectdb_object *parent, char *name, size_t size, uint32_t filetype, char *data, size_t offset, uint32_t *hash);
 
 /**
  * Add a directory reference from the disc manual.
  *
+ * \param *db		Pointer to the database to add to.
  * \param *parent	Pointer to the parent directory, or NULL for the root.
  * \param *name		Pointer to the name of the directory.
  * \param *real_name	Pointer to the real name of the directory.
  * \return		Pointer to the resulting directory instance, or NULL.
  */
 
-struct objectdb_object *objectdb_add_disc_directory(struct objectdb_object *parent, char *name, char *real_name);
+struct objectdb_object *objectdb_add_disc_directory(struct objectdb *db, struct objectdb_object *parent, char *name, char *real_name);
 
 /**
  * Add a file reference from the StrongHelp manual.
  *
+ * \param *db		Pointer to the database to add to.
  * \param *parent	Pointer to the parent directory.
  * \param *name		Pointer to the name of the file.
  * \param *real_name	Pointer to the real name of the file.
@@ -106,44 +241,267 @@ struct objectdb_object *objectdb_add_disc_directory(struct objectdb_object *pare
  * \return		Pointer to the new file instance, or NULL.
  */
 
-struct objectdb_object *objectdb_add_disc_file(struct objectdb_object *parent, char *name, char *real_name, size_t size, uint32_t filetype);
+struct objectdb_object *objectdb_add_disc_file(struct objectdb *db, struct objectdb_object *parent, char *name, char *real_name, size_t size, uint32_t filetype);
+
+/**
+ * Start merging the contents of a directory on disc into the database.
+ * The directory's lists are sorted, so that the disc objects can then be
+ * matched up with them in a single pass.
+ *
+ * \param *parent	Pointer to the directory to merge into.
+ * \param *merge	Pointer to the merge block to initialise.
+ */
+
+void objectdb_start_disc_merge(struct objectdb_object *parent, struct objectdb_merge *merge);
 
 /**
- * Check the status of the objects held in the database.
- * 
+ * Merge a directory reference from the disc into the database. References
+ * must be supplied in alphabetical order.
+ *
+ * \param *db		Pointer to the database to add to.
+ * \param *merge	Pointer to the merge block for the parent directory.
+ * \param *name		Pointer to the name of the directory.
+ * \param *real_name	Pointer to the real name of the directory.
+ * \return		Pointer to the resulting directory instance, or NULL.
+ */
+
+struct objectdb_object *objectdb_merge_disc_directory(struct objectdb *db, struct objectdb_merge *merge, char *name, char *real_name);
+
+/**
+ * Merge a file reference from the disc into the database. References
+ * must be supplied in alphabetical order.
+ *
+ * \param *db		Pointer to the database to add to.
+ * \param *merge	Pointer to the merge block for the parent directory.
+ * \param *name		Pointer to the name of the file.
+ * \param *real_name	Pointer to the real name of the file.
+ * \param size		The size of the file.
+ * \param filetype	The filetype of the file.
+ * \return		Pointer to the resulting file instance, or NULL.
+ */
+
+struct objectdb_object *objectdb_merge_disc_file(struct objectdb *db, struct objectdb_merge *merge, char *name, char *real_name, size_t size, uint32_t filetype);
+
+/**
+ * Forget everything that was found in the disc folder, so that the folder
+ * can be scanned again and compared with the manual already held in the
+ * database. Objects which were only on disc are dropped, and the rest are
+ * left as they were after the manual had been read.
+ *
+ * \param *db		Pointer to the database to reset.
+ * \return		True if successful, false on failure.
+ */
+
+bool objectdb_reset_disc(struct objectdb *db);
+
+#ifndef READER_ONLY
+/**
+ * Check the status of the objects held in a database.
+ *
+ * \param *db		Pointer to the database to check.
+ * \param threads	The number of threads to use for comparisons.
  * \return		True if successful, false on failure.
  */
 
-bool objectdb_check_status(void);
+bool objectdb_check_status(struct objectdb *db, int threads);
 
 /**
- * Write a report of the object statuses in the database.
+ * Write a report of the object statuses in a database.
  *
+ * \param *db		Pointer to the database to report on.
  * \param include_all	Should identical objects be included.
+ * \param *report	Pointer to a structured report to write records to,
+ *			or NULL to report as text.
  * \return		True if successful, false on failure.
  */
 
-bool objectdb_output_report(bool include_all);
+bool objectdb_output_report(struct objectdb *db, bool include_all, struct report *report);
 
 /**
- * Update the objects in the database.
- * 
+ * Write a listing of the hashes of the files in the StrongHelp manual,
+ * as verbose output.
+ *
+ * \param *db		Pointer to the database to list.
+ * \return		True if successful, false on failure.
+ */
+
+bool objectdb_output_hashes(struct objectdb *db);
+
+/**
+ * Update the objects in a database.
+ *
+ * \param *db		Pointer to the database to update from.
+ * \param threads	The number of threads to use for updates.
+ * \param sync		The policy for flushing written files to disc.
+ * \return		True if successful, false on failure.
+ */
+
+bool objectdb_update(struct objectdb *db, int threads, enum files_sync sync);
+
+/**
+ * Write a manifest recording the catalogue information and content hash of
+ * all of the files in the output folder, once it has been updated to match
+ * the StrongHelp manual.
+ *
+ * \param *db		Pointer to the database to write the manifest for.
+ * \param *filename	Pointer to the name of the manifest file.
+ * \return		True if successful, false on failure.
+ */
+
+bool objectdb_write_manifest(struct objectdb *db, char *filename);
+
+/**
+ * Record the catalogue information and content hash of all of the files
+ * in the output folder into a manifest in memory, once it has been updated
+ * to match the StrongHelp manual.
+ *
+ * \param *db		Pointer to the database to record the manifest for.
+ * \param *manifest	Pointer to the manifest to add the entries to.
+ * \return		True if successful, false on failure.
+ */
+
+bool objectdb_record_manifest(struct objectdb *db, struct manifest *manifest);
+
+/**
+ * Write the contents of the StrongHelp manual out to an archive, using the
+ * same names as would be given to the files in an output folder. Only the
+ * manual's side of the database is used, so no folder needs to have been
+ * scanned.
+ *
+ * \param *db		Pointer to the database to write the archive from.
+ * \param *archive	Pointer to the archive to write to.
  * \return		True if successful, false on failure.
  */
 
-bool objectdb_update(void);
+bool objectdb_write_archive(struct objectdb *db, struct archive *archive);
+
+#endif
+
+/**
+ * Return the root directory of an object database.
+ *
+ * \param *db		Pointer to the database of interest.
+ * \return		Pointer to the root directory, or NULL if none.
+ */
+
+struct objectdb_object *objectdb_get_root(struct objectdb *db);
+
+/**
+ * Return the first of the subdirectories within a directory. The
+ * subdirectories are in alphabetical order once the disc folder has
+ * been read.
+ *
+ * \param *dir		Pointer to the directory of interest.
+ * \return		Pointer to the first subdirectory, or NULL if none.
+ */
+
+struct objectdb_object *objectdb_get_first_directory(struct objectdb_object *dir);
+
+/**
+ * Return the first of the files within a directory. The files are in
+ * alphabetical order once the disc folder has been read.
+ *
+ * \param *dir		Pointer to the directory of interest.
+ * \return		Pointer to the first file, or NULL if none.
+ */
+
+struct objectdb_object *objectdb_get_first_file(struct objectdb_object *dir);
+
+/**
+ * Return the object following another in its parent directory's list
+ * of files or subdirectories.
+ *
+ * \param *object	Pointer to the object of interest.
+ * \return		Pointer to the next object, or NULL if none.
+ */
+
+struct objectdb_object *objectdb_get_next_object(struct objectdb_object *object);
+
+/**
+ * Find a file within a directory by name.
+ *
+ * \param *dir		Pointer to the directory to search.
+ * \param *name		Pointer to the name of the file.
+ * \return		Pointer to the file, or NULL if not found.
+ */
+
+struct objectdb_object *objectdb_find_file(struct objectdb_object *dir, char *name);
+
+/**
+ * Find a subdirectory within a directory by name.
+ *
+ * \param *dir		Pointer to the directory to search.
+ * \param *name		Pointer to the name of the subdirectory.
+ * \return		Pointer to the subdirectory, or NULL if not found.
+ */
+
+struct objectdb_object *objectdb_find_directory(struct objectdb_object *dir, char *name);
+
+/**
+ * Return the name of an object, in its RISC OS form.
+ *
+ * \param *object	Pointer to the object of interest.
+ * \return		Pointer to the name, or NULL.
+ */
+
+char *objectdb_get_name(struct objectdb_object *object);
+
+/**
+ * Return the details of an object as found in the disc folder.
+ *
+ * \param *object	Pointer to the object of interest.
+ * \param *size		Pointer to a variable to take the size, or NULL.
+ * \param *filetype	Pointer to a variable to take the filetype, or NULL.
+ * \return		True if the object is on disc; False if not.
+ */
+
+bool objectdb_get_disc_details(struct objectdb_object *object, size_t *size, uint32_t *filetype);
+
+/**
+ * Return the details of an object as found in the StrongHelp manual.
+ *
+ * \param *object	Pointer to the object of interest.
+ * \param *size		Pointer to a variable to take the size, or NULL.
+ * \param *filetype	Pointer to a variable to take the filetype, or NULL.
+ * \param *offset	Pointer to a variable to take the offset of a file's
+ *			data within the manual, or NULL.
+ * \return		True if the object is in the manual; False if not.
+ */
+
+bool objectdb_get_stronghelp_details(struct objectdb_object *object, size_t *size, uint32_t *filetype, size_t *offset);
+
+/**
+ * Test whether the contents of a file were found to be the same in the
+ * StrongHelp manual and the disc folder by objectdb_check_status(), even
+ * if the file's type has changed.
+ *
+ * \param *object	Pointer to the object of interest.
+ * \return		True if the contents match; False if not.
+ */
+
+bool objectdb_get_contents_matched(struct objectdb_object *object);
+
+/**
+ * Return the other half of a file which objectdb_check_status() found to
+ * have been moved: the copy in the disc folder for a file that is only in
+ * the manual, or the copy in the manual for a file that is only on disc.
+ *
+ * \param *object	Pointer to the object of interest.
+ * \return		Pointer to the other copy, or NULL if not moved.
+ */
+
+struct objectdb_object *objectdb_get_moved(struct objectdb_object *object);
 
 /**
- * Get a file path to an object.
+ * Get a file path to a directory.
  *
  * The path is allocated using malloc(), and must be freed with free() after use.
  *
- * \param *object 	Pointer to the object of interest.
+ * \param *dir	 	Pointer to the directory of interest.
  * \param type		The type of path to return.
- * \param *separator	The directory separator to use.
  * \return		A pointer to the path, or NULL.
  */
 
-char *objectdb_get_path(struct objectdb_object *object, enum objectdb_path_type type, char *separator);
+char *objectdb_get_path(struct objectdb_object *dir, enum objectdb_path_type type);
 
 #endif
@@ -0,0 +1,400 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file pool.c
+ *
+ * Worker Thread Pool, implementation.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef LINUX
+#include <pthread.h>
+#endif
+
+/* Local source headers. */
+
+#include "pool.h"
+
+#include "msg.h"
+#include "stats.h"
+
+/**
+ * The maximum number of worker threads that a pool can contain.
+ */
+
+#define POOL_MAX_THREADS 256
+
+/**
+ * A task waiting in a pool's queue.
+ */
+
+struct pool_item {
+	pool_task		task;		/**< The task to be run.				*/
+	void			*data;		/**< The data to be passed to the task.			*/
+
+	struct pool_item	*next;		/**< Pointer to the next item in the queue, or NULL.	*/
+};
+
+/**
+ * A worker pool instance.
+ */
+
+struct pool {
+	struct pool_item	*head;		/**< Pointer to the first task in the queue.		*/
+	struct pool_item	*tail;		/**< Pointer to the last task in the queue.		*/
+
+	int			outstanding;	/**< The number of tasks queued or running.		*/
+	bool			failed;		/**< True if a task has failed since the last wait.	*/
+
+	int			threads;	/**< The number of worker threads running.		*/
+#ifdef LINUX
+	pthread_t		*workers;	/**< The worker thread handles.				*/
+	pthread_mutex_t		lock;		/**< Lock protecting the queue and counters.		*/
+	struct stats		*stats;		/**< The statistics block for the workers to use.	*/
+	pthread_cond_t		work;		/**< Signalled when work is added to the queue.		*/
+	pthread_cond_t		done;		/**< Signalled when the outstanding count hits zero.	*/
+	bool			stopping;	/**< True if the workers should exit.			*/
+#endif
+};
+
+/* Static Function Prototypes. */
+
+static struct pool_item *pool_pop(struct pool *pool);
+static void pool_complete(struct pool *pool, bool success);
+#ifdef LINUX
+static void *pool_worker(void *data);
+#endif
+
+/**
+ * Create a new worker pool. If threads are not available on the
+ * platform, or one or fewer are requested, the tasks will be run
+ * in turn from within pool_wait() by the calling thread. Any operations
+ * counted by the workers are added to the calling thread's statistics.
+ *
+ * \param threads	The number of worker threads to use.
+ * \return		Pointer to the new pool, or NULL on failure.
+ */
+
+struct pool *pool_create(int threads)
+{
+	struct pool *pool;
+
+	pool = malloc(sizeof(struct pool));
+	if (pool == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return NULL;
+	}
+
+	pool->head = NULL;
+	pool->tail = NULL;
+	pool->outstanding = 0;
+	pool->failed = false;
+	pool->threads = 0;
+
+#ifdef LINUX
+	pool->workers = NULL;
+	pool->stopping = false;
+	pool->stats = stats_get_current();
+
+	pthread_mutex_init(&(pool->lock), NULL);
+	pthread_cond_init(&(pool->work), NULL);
+	pthread_cond_init(&(pool->done), NULL);
+
+	if (threads > POOL_MAX_THREADS)
+		threads = POOL_MAX_THREADS;
+
+	if (threads > 1) {
+		pool->workers = malloc(threads * sizeof(pthread_t));
+		if (pool->workers == NULL) {
+			msg_report(MSG_NO_MEMORY);
+			pool_destroy(pool);
+			return NULL;
+		}
+
+		/* If we can't start all of the threads, make do with what we get. */
+
+		while (pool->threads < threads) {
+			if (pthread_create(pool->workers + pool->threads, NULL, pool_worker, pool) != 0)
+				break;
+
+			pool->threads++;
+		}
+
+		if (pool->threads < threads)
+			msg_report(MSG_THREADS_FAILED, pool->threads, threads);
+	}
+#endif
+
+	return pool;
+}
+
+/**
+ * Add a task to the queue of a worker pool. Tasks may themselves
+ * add further tasks to the pool that is running them.
+ *
+ * \param *pool		Pointer to the pool to take the task.
+ * \param task		The task to be run.
+ * \param *data		Pointer to data to pass to the task.
+ * \return		True if successful; False on failure.
+ */
+
+bool pool_submit(struct pool *pool, pool_task task, void *data)
+{
+	struct pool_item *item;
+
+	if (pool == NULL || task == NULL)
+		return false;
+
+	item = malloc(sizeof(struct pool_item));
+	if (item == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	item->task = task;
+	item->data = data;
+	item->next = NULL;
+
+#ifdef LINUX
+	pthread_mutex_lock(&(pool->lock));
+#endif
+
+	if (pool->tail != NULL)
+		pool->tail->next = item;
+	else
+		pool->head = item;
+
+	pool->tail = item;
+	pool->outstanding++;
+
+#ifdef LINUX
+	pthread_cond_signal(&(pool->work));
+	pthread_mutex_unlock(&(pool->lock));
+#endif
+
+	return true;
+}
+
+/**
+ * Wait for all of the tasks in a worker pool's queue to complete,
+ * including any that are added while waiting.
+ *
+ * \param *pool		Pointer to the pool to wait for.
+ * \return		True if all of the tasks succeeded; False if
+ *			any of them failed.
+ */
+
+bool pool_wait(struct pool *pool)
+{
+	struct pool_item *item;
+	bool success;
+
+	if (pool == NULL)
+		return false;
+
+	/* With no workers, run the queue from here until it's empty. */
+
+	if (pool->threads == 0) {
+		while ((item = pool_pop(pool)) != NULL) {
+			success = item->task(pool, item->data);
+			free(item);
+			pool_complete(pool, success);
+		}
+	}
+
+#ifdef LINUX
+	pthread_mutex_lock(&(pool->lock));
+
+	while (pool->outstanding > 0)
+		pthread_cond_wait(&(pool->done), &(pool->lock));
+#endif
+
+	success = !pool->failed;
+	pool->failed = false;
+
+#ifdef LINUX
+	pthread_mutex_unlock(&(pool->lock));
+#endif
+
+	return success;
+}
+
+/**
+ * Destroy a worker pool, stopping its threads. Any tasks which are
+ * still queued will be discarded.
+ *
+ * \param *pool		Pointer to the pool to destroy.
+ */
+
+void pool_destroy(struct pool *pool)
+{
+	struct pool_item *item;
+
+	if (pool == NULL)
+		return;
+
+#ifdef LINUX
+	pthread_mutex_lock(&(pool->lock));
+	pool->stopping = true;
+	pthread_cond_broadcast(&(pool->work));
+	pthread_mutex_unlock(&(pool->lock));
+
+	while (pool->threads > 0)
+		pthread_join(pool->workers[--pool->threads], NULL);
+
+	free(pool->workers);
+
+	pthread_cond_destroy(&(pool->done));
+	pthread_cond_destroy(&(pool->work));
+	pthread_mutex_destroy(&(pool->lock));
+#endif
+
+	while (pool->head != NULL) {
+		item = pool->head;
+		pool->head = item->next;
+		free(item);
+	}
+
+	free(pool);
+}
+
+/**
+ * Remove the task at the head of a pool's queue.
+ *
+ * \param *pool		Pointer to the pool to take the task from.
+ * \return		Pointer to the task, or NULL if the queue is empty.
+ */
+
+static struct pool_item *pool_pop(struct pool *pool)
+{
+	struct pool_item *item;
+
+#ifdef LINUX
+	pthread_mutex_lock(&(pool->lock));
+#endif
+
+	item = pool->head;
+
+	if (item != NULL) {
+		pool->head = item->next;
+		if (pool->head == NULL)
+			pool->tail = NULL;
+	}
+
+#ifdef LINUX
+	pthread_mutex_unlock(&(pool->lock));
+#endif
+
+	return item;
+}
+
+/**
+ * Record the completion of a task from a pool's queue.
+ *
+ * \param *pool		Pointer to the pool which ran the task.
+ * \param success	True if the task succeeded; False if it failed.
+ */
+
+static void pool_complete(struct pool *pool, bool success)
+{
+#ifdef LINUX
+	pthread_mutex_lock(&(pool->lock));
+#endif
+
+	if (!success)
+		pool->failed = true;
+
+	pool->outstanding--;
+
+#ifdef LINUX
+	if (pool->outstanding == 0)
+		pthread_cond_broadcast(&(pool->done));
+
+	pthread_mutex_unlock(&(pool->lock));
+#endif
+}
+
+#ifdef LINUX
+
+/**
+ * The main loop of a worker thread, which takes tasks from the queue
+ * and runs them until the pool is destroyed.
+ *
+ * \param *data		Pointer to the pool owning the thread.
+ * \return		NULL.
+ */
+
+static void *pool_worker(void *data)
+{
+	struct pool *pool = data;
+	struct pool_item *item;
+	uint64_t start;
+	bool success;
+
+	/* Count the workers' operations, and the CPU time used by their tasks,
+	 * against their creator's statistics.
+	 */
+
+	stats_set_current(pool->stats);
+
+	pthread_mutex_lock(&(pool->lock));
+
+	while (!pool->stopping) {
+		item = pool->head;
+
+		if (item == NULL) {
+			pthread_cond_wait(&(pool->work), &(pool->lock));
+			continue;
+		}
+
+		pool->head = item->next;
+		if (pool->head == NULL)
+			pool->tail = NULL;
+
+		pthread_mutex_unlock(&(pool->lock));
+
+		start = stats_start_task();
+		success = item->task(pool, item->data);
+		stats_end_task(pool->stats, start);
+		free(item);
+
+		pthread_mutex_lock(&(pool->lock));
+
+		if (!success)
+			pool->failed = true;
+
+		pool->outstanding--;
+		if (pool->outstanding == 0)
+			pthread_cond_broadcast(&(pool->done));
+	}
+
+	pthread_mutex_unlock(&(pool->lock));
+
+	return NULL;
+}
+
+#endif
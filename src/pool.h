@@ -0,0 +1,95 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+/**
+ * \file pool.h
+ *
+ * Worker Thread Pool Interface.
+ */
+
+#ifndef STRONGEX_POOL_H
+#define STRONGEX_POOL_H
+
+#include <stdbool.h>
+
+/**
+ * A worker pool instance reference.
+ */
+
+struct pool;
+
+/**
+ * A task to be run by a worker pool.
+ *
+ * \param *pool		Pointer to the pool running the task.
+ * \param *data		Pointer to the data supplied with the task.
+ * \return		True if successful; False on failure.
+ */
+
+typedef bool (*pool_task)(struct pool *pool, void *data);
+
+/**
+ * Create a new worker pool. If threads are not available on the
+ * platform, or one or fewer are requested, the tasks will be run
+ * in turn from within pool_wait() by the calling thread. Any operations
+ * counted by the workers are added to the calling thread's statistics.
+ *
+ * \param threads	The number of worker threads to use.
+ * \return		Pointer to the new pool, or NULL on failure.
+ */
+
+struct pool *pool_create(int threads);
+
+/**
+ * Add a task to the queue of a worker pool. Tasks may themselves
+ * add further tasks to the pool that is running them.
+ *
+ * \param *pool		Pointer to the pool to take the task.
+ * \param task		The task to be run.
+ * \param *data		Pointer to data to pass to the task.
+ * \return		True if successful; False on failure.
+ */
+
+bool pool_submit(struct pool *pool, pool_task task, void *data);
+
+/**
+ * Wait for all of the tasks in a worker pool's queue to complete,
+ * including any that are added while waiting.
+ *
+ * \param *pool		Pointer to the pool to wait for.
+ * \return		True if all of the tasks succeeded; False if
+ *			any of them failed.
+ */
+
+bool pool_wait(struct pool *pool);
+
+/**
+ * Destroy a worker pool, stopping its threads. Any tasks which are
+ * still queued will be discarded.
+ *
+ * \param *pool		Pointer to the pool to destroy.
+ */
+
+void pool_destroy(struct pool *pool);
+
+#endif
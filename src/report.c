@@ -0,0 +1,386 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file report.c
+ *
+ * Structured Report Output, implementation.
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Local source headers. */
+
+#include "report.h"
+
+#include "msg.h"
+
+/**
+ * The size of the buffer in which records are collected.
+ */
+
+#define REPORT_BUFFER_SIZE (256 * 1024)
+
+/**
+ * The space left in the buffer at which it is written out, once the
+ * current record is complete.
+ */
+
+#define REPORT_FLUSH_MARGIN (4 * 1024)
+
+/**
+ * A structured report instance.
+ */
+
+struct report {
+	char				*manual;	/**< The name of the manual being reported on.	*/
+	char				*buffer;	/**< The buffer holding the pending records.	*/
+	size_t				size;		/**< The size of the buffer.			*/
+	size_t				used;		/**< The number of bytes held in the buffer.	*/
+	bool				fields;		/**< True if the record has any fields yet.	*/
+	bool				failed;		/**< True if the report could not be written.	*/
+};
+
+/* Static Function Prototypes. */
+
+static void report_add_key(struct report *report, char *key);
+static void report_append(struct report *report, char *format, ...);
+static void report_append_string(struct report *report, char *string);
+static bool report_reserve(struct report *report, size_t length);
+static bool report_flush(struct report *report);
+
+/**
+ * Create a new structured report for a manual.
+ *
+ * \param *manual	Pointer to the name of the manual, which is
+ *			included in every record.
+ * \return		Pointer to the new report, or NULL on failure.
+ */
+
+struct report *report_create(char *manual)
+{
+	struct report *report;
+
+	if (manual == NULL)
+		return NULL;
+
+	report = malloc(sizeof(struct report));
+	if (report == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return NULL;
+	}
+
+	report->buffer = malloc(REPORT_BUFFER_SIZE);
+	if (report->buffer == NULL) {
+		free(report);
+		msg_report(MSG_NO_MEMORY);
+		return NULL;
+	}
+
+	report->manual = manual;
+	report->size = REPORT_BUFFER_SIZE;
+	report->used = 0;
+	report->fields = false;
+	report->failed = false;
+
+	return report;
+}
+
+/**
+ * Destroy a structured report, writing out any records which are still
+ * held in its buffer.
+ *
+ * \param *report	Pointer to the report to destroy.
+ * \return		True if all of the records were written; False
+ *			on failure.
+ */
+
+bool report_destroy(struct report *report)
+{
+	bool success;
+
+	if (report == NULL)
+		return false;
+
+	success = report_flush(report);
+
+	free(report->buffer);
+	free(report);
+
+	return success;
+}
+
+/**
+ * Start a new record in a report.
+ *
+ * \param *report	Pointer to the report to add to.
+ * \param *record	Pointer to the type of the record.
+ */
+
+void report_start_record(struct report *report, char *record)
+{
+	if (report == NULL || record == NULL)
+		return;
+
+	report->fields = false;
+
+	report_append(report, "{");
+	report_add_string(report, "manual", report->manual);
+	report_add_string(report, "record", record);
+}
+
+/**
+ * Add a string field to the current record in a report.
+ *
+ * \param *report	Pointer to the report to add to.
+ * \param *key		Pointer to the name of the field.
+ * \param *value	Pointer to the value of the field.
+ */
+
+void report_add_string(struct report *report, char *key, char *value)
+{
+	if (report == NULL || key == NULL || value == NULL)
+		return;
+
+	report_add_key(report, key);
+	report_append_string(report, value);
+}
+
+/**
+ * Add an integer field to the current record in a report.
+ *
+ * \param *report	Pointer to the report to add to.
+ * \param *key		Pointer to the name of the field.
+ * \param value		The value of the field.
+ */
+
+void report_add_integer(struct report *report, char *key, int64_t value)
+{
+	if (report == NULL || key == NULL)
+		return;
+
+	report_add_key(report, key);
+	report_append(report, "%lld", (long long) value);
+}
+
+/**
+ * Add a boolean field to the current record in a report.
+ *
+ * \param *report	Pointer to the report to add to.
+ * \param *key		Pointer to the name of the field.
+ * \param value		The value of the field.
+ */
+
+void report_add_boolean(struct report *report, char *key, bool value)
+{
+	if (report == NULL || key == NULL)
+		return;
+
+	report_add_key(report, key);
+	report_append(report, "%s", (value) ? "true" : "false");
+}
+
+/**
+ * End the current record in a report, writing out the buffer if it
+ * is close to being full.
+ *
+ * \param *report	Pointer to the report to update.
+ * \return		True if successful; False if the record could not
+ *			be stored or written.
+ */
+
+bool report_end_record(struct report *report)
+{
+	if (report == NULL)
+		return false;
+
+	report_append(report, "}\n");
+
+	if (report->size - report->used < REPORT_FLUSH_MARGIN && !report_flush(report))
+		return false;
+
+	return !report->failed;
+}
+
+/**
+ * Add the key for a new field to the current record in a report,
+ * preceded by a separator if the record already has fields.
+ *
+ * \param *report	Pointer to the report to add to.
+ * \param *key		Pointer to the name of the field.
+ */
+
+static void report_add_key(struct report *report, char *key)
+{
+	if (report->fields)
+		report_append(report, ",");
+
+	report_append_string(report, key);
+	report_append(report, ":");
+
+	report->fields = true;
+}
+
+/**
+ * Append some formatted text to the buffer of a report, extending the
+ * buffer if required.
+ *
+ * \param *report	Pointer to the report to add to.
+ * \param *format	Pointer to the printf() format string.
+ * \param ...		Additional printf parameters as required.
+ */
+
+static void report_append(struct report *report, char *format, ...)
+{
+	va_list ap;
+	int length;
+
+	va_start(ap, format);
+	length = vsnprintf(report->buffer + report->used, report->size - report->used, format, ap);
+	va_end(ap);
+
+	if (length < 0) {
+		report->failed = true;
+		return;
+	}
+
+	/* If the text wasn't written in full, make room and try again. */
+
+	if ((size_t) length >= report->size - report->used) {
+		if (!report_reserve(report, length + 1))
+			return;
+
+		va_start(ap, format);
+		vsnprintf(report->buffer + report->used, report->size - report->used, format, ap);
+		va_end(ap);
+	}
+
+	report->used += length;
+}
+
+/**
+ * Append a string to the buffer of a report as a JSON string, with
+ * quotes and escapes. Names from RISC OS are in Latin-1, so any top-bit
+ * characters are converted into UTF-8 as they are copied.
+ *
+ * \param *report	Pointer to the report to add to.
+ * \param *string	Pointer to the string to append.
+ */
+
+static void report_append_string(struct report *report, char *string)
+{
+	char *out;
+
+	/* Each character could need six bytes once escaped, plus the quotes. */
+
+	for (out = string; *out != '\0'; out++);
+
+	if (!report_reserve(report, 6 * (out - string) + 3))
+		return;
+
+	out = report->buffer + report->used;
+
+	*out++ = '"';
+
+	for (; *string != '\0'; string++) {
+		if (*string == '"' || *string == '\\') {
+			*out++ = '\\';
+			*out++ = *string;
+		} else if ((unsigned char) *string < 0x20) {
+			out += sprintf(out, "\\u%04x", (unsigned char) *string);
+		} else if ((unsigned char) *string >= 0x80) {
+			*out++ = 0xc0 | ((unsigned char) *string >> 6);
+			*out++ = 0x80 | ((unsigned char) *string & 0x3f);
+		} else {
+			*out++ = *string;
+		}
+	}
+
+	*out++ = '"';
+
+	report->used = out - report->buffer;
+}
+
+/**
+ * Make sure that there is room for a given number of bytes in the buffer
+ * of a report, extending it if required.
+ *
+ * \param *report	Pointer to the report to check.
+ * \param length	The number of bytes required.
+ * \return		True if there is room; False on failure.
+ */
+
+static bool report_reserve(struct report *report, size_t length)
+{
+	char *buffer;
+	size_t size;
+
+	if (report->failed)
+		return false;
+
+	if (report->size - report->used >= length)
+		return true;
+
+	for (size = report->size; size - report->used < length; size *= 2);
+
+	buffer = realloc(report->buffer, size);
+	if (buffer == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		report->failed = true;
+		return false;
+	}
+
+	report->buffer = buffer;
+	report->size = size;
+
+	return true;
+}
+
+/**
+ * Write out the records held in the buffer of a report. Each write
+ * holds complete records, so that the lines from different reports
+ * are not mixed together.
+ *
+ * \param *report	Pointer to the report to flush.
+ * \return		True if successful; False on failure.
+ */
+
+static bool report_flush(struct report *report)
+{
+	if (report->used > 0 && !report->failed) {
+		if (fwrite(report->buffer, sizeof(char), report->used, stdout) != report->used || fflush(stdout) != 0) {
+			msg_report(MSG_REPORT_WRITE_FAILED);
+			report->failed = true;
+		}
+	}
+
+	report->used = 0;
+
+	return !report->failed;
+}
+
@@ -0,0 +1,129 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file report.h
+ *
+ * Structured Report Output, Interface.
+ *
+ * Writes the report for a manual to stdout as newline-delimited JSON, with
+ * one object per record. Records are collected in a large buffer, which is
+ * only written out between records, so that the lines from manuals being
+ * processed at once are never split.
+ */
+
+#ifndef STRONGEX_REPORT_H
+#define STRONGEX_REPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * The formats in which the report can be written.
+ */
+
+enum report_format {
+	REPORT_FORMAT_TEXT,		/**< Human-readable messages on stderr.		*/
+	REPORT_FORMAT_JSON		/**< One JSON object per line on stdout.	*/
+};
+
+/**
+ * A structured report instance reference.
+ */
+
+struct report;
+
+/**
+ * Create a new structured report for a manual.
+ *
+ * \param *manual	Pointer to the name of the manual, which is
+ *			included in every record.
+ * \return		Pointer to the new report, or NULL on failure.
+ */
+
+struct report *report_create(char *manual);
+
+/**
+ * Destroy a structured report, writing out any records which are still
+ * held in its buffer.
+ *
+ * \param *report	Pointer to the report to destroy.
+ * \return		True if all of the records were written; False
+ *			on failure.
+ */
+
+bool report_destroy(struct report *report);
+
+/**
+ * Start a new record in a report.
+ *
+ * \param *report	Pointer to the report to add to.
+ * \param *record	Pointer to the type of the record.
+ */
+
+void report_start_record(struct report *report, char *record);
+
+/**
+ * Add a string field to the current record in a report.
+ *
+ * \param *report	Pointer to the report to add to.
+ * \param *key		Pointer to the name of the field.
+ * \param *value	Pointer to the value of the field.
+ */
+
+void report_add_string(struct report *report, char *key, char *value);
+
+/**
+ * Add an integer field to the current record in a report.
+ *
+ * \param *report	Pointer to the report to add to.
+ * \param *key		Pointer to the name of the field.
+ * \param value		The value of the field.
+ */
+
+void report_add_integer(struct report *report, char *key, int64_t value);
+
+/**
+ * Add a boolean field to the current record in a report.
+ *
+ * \param *report	Pointer to the report to add to.
+ * \param *key		Pointer to the name of the field.
+ * \param value		The value of the field.
+ */
+
+void report_add_boolean(struct report *report, char *key, bool value);
+
+/**
+ * End the current record in a report, writing out the buffer if it
+ * is close to being full.
+ *
+ * \param *report	Pointer to the report to update.
+ * \return		True if successful; False if the record could not
+ *			be stored or written.
+ */
+
+bool report_end_record(struct report *report);
+
+#endif
+
@@ -0,0 +1,172 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file stack.c
+ *
+ * Work Stack, implementation.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Local source headers. */
+
+#include "stack.h"
+
+#include "msg.h"
+
+/**
+ * The number of items allocated when a stack is first used.
+ */
+
+#define STACK_INITIAL_CAPACITY 64
+
+/* Initialise an empty work stack.
+ *
+ * \param *stack	Pointer to the stack to initialise.
+ * \param item_size	The size of each item, in bytes.
+ */
+
+void stack_initialise(struct stack *stack, size_t item_size)
+{
+	if (stack == NULL)
+		return;
+
+	stack->items = NULL;
+	stack->item_size = item_size;
+	stack->count = 0;
+	stack->capacity = 0;
+}
+
+/* Push a copy of an item on to a work stack.
+ *
+ * \param *stack	Pointer to the stack to push on to.
+ * \param *item		Pointer to the item to be copied.
+ * \return		True if successful, false on failure.
+ */
+
+bool stack_push(struct stack *stack, void *item)
+{
+	char *items;
+	size_t capacity;
+
+	if (stack == NULL || item == NULL)
+		return false;
+
+	/* Double the size of the stack if it is full. */
+
+	if (stack->count >= stack->capacity) {
+		capacity = (stack->capacity > 0) ? stack->capacity * 2 : STACK_INITIAL_CAPACITY;
+
+		items = realloc(stack->items, capacity * stack->item_size);
+		if (items == NULL) {
+			msg_report(MSG_NO_MEMORY);
+			return false;
+		}
+
+		stack->items = items;
+		stack->capacity = capacity;
+	}
+
+	memcpy(stack->items + (stack->count++ * stack->item_size), item, stack->item_size);
+
+	return true;
+}
+
+/* Pop the top item from a work stack.
+ *
+ * \param *stack	Pointer to the stack to pop from.
+ * \param *item		Pointer to a block to take a copy of the item.
+ * \return		True if an item was popped; false if the stack was empty.
+ */
+
+bool stack_pop(struct stack *stack, void *item)
+{
+	if (stack == NULL || item == NULL || stack->count == 0)
+		return false;
+
+	memcpy(item, stack->items + (--stack->count * stack->item_size), stack->item_size);
+
+	return true;
+}
+
+/* Return the number of items on a work stack.
+ *
+ * \param *stack	Pointer to the stack of interest.
+ * \return		The number of items on the stack.
+ */
+
+size_t stack_count(struct stack *stack)
+{
+	return (stack != NULL) ? stack->count : 0;
+}
+
+/* Reverse the order of the items above a given depth on a work stack.
+ *
+ * The items are swapped a byte at a time, since they are usually small
+ * and this avoids needing a buffer for them.
+ *
+ * \param *stack	Pointer to the stack to update.
+ * \param depth		The number of items on the stack which are to be
+ *			left in place.
+ */
+
+void stack_reverse(struct stack *stack, size_t depth)
+{
+	char *low, *high, swap;
+	size_t byte;
+
+	if (stack == NULL || depth >= stack->count)
+		return;
+
+	low = stack->items + (depth * stack->item_size);
+	high = stack->items + ((stack->count - 1) * stack->item_size);
+
+	while (low < high) {
+		for (byte = 0; byte < stack->item_size; byte++) {
+			swap = low[byte];
+			low[byte] = high[byte];
+			high[byte] = swap;
+		}
+
+		low += stack->item_size;
+		high -= stack->item_size;
+	}
+}
+
+/* Free the memory used by a work stack, leaving it empty.
+ *
+ * \param *stack	Pointer to the stack to free.
+ */
+
+void stack_free(struct stack *stack)
+{
+	if (stack == NULL)
+		return;
+
+	free(stack->items);
+	stack_initialise(stack, stack->item_size);
+}
@@ -0,0 +1,110 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file stack.h
+ *
+ * Work Stack Interface.
+ *
+ * A work stack holds fixed-size items on the heap, so that trees and
+ * lists can be walked without recursion; it grows as required.
+ */
+
+#ifndef STRONGEX_STACK_H
+#define STRONGEX_STACK_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+/**
+ * A work stack instance.
+ */
+
+struct stack {
+	char			*items;		/**< Pointer to the items on the stack.			*/
+	size_t			item_size;	/**< The size of each item, in bytes.			*/
+	size_t			count;		/**< The number of items on the stack.			*/
+	size_t			capacity;	/**< The number of items allocated for the stack.	*/
+};
+
+/**
+ * Initialise an empty work stack. No memory is claimed until the first
+ * item is pushed.
+ *
+ * \param *stack	Pointer to the stack to initialise.
+ * \param item_size	The size of each item, in bytes.
+ */
+
+void stack_initialise(struct stack *stack, size_t item_size);
+
+/**
+ * Push a copy of an item on to a work stack.
+ *
+ * \param *stack	Pointer to the stack to push on to.
+ * \param *item		Pointer to the item to be copied.
+ * \return		True if successful, false on failure.
+ */
+
+bool stack_push(struct stack *stack, void *item);
+
+/**
+ * Pop the top item from a work stack.
+ *
+ * \param *stack	Pointer to the stack to pop from.
+ * \param *item		Pointer to a block to take a copy of the item.
+ * \return		True if an item was popped; false if the stack was empty.
+ */
+
+bool stack_pop(struct stack *stack, void *item);
+
+/**
+ * Return the number of items on a work stack.
+ *
+ * \param *stack	Pointer to the stack of interest.
+ * \return		The number of items on the stack.
+ */
+
+size_t stack_count(struct stack *stack);
+
+/**
+ * Reverse the order of the items above a given depth on a work stack, so
+ * that items pushed in the order that they should be processed will be
+ * popped in that order too.
+ *
+ * \param *stack	Pointer to the stack to update.
+ * \param depth		The number of items on the stack which are to be
+ *			left in place.
+ */
+
+void stack_reverse(struct stack *stack, size_t depth);
+
+/**
+ * Free the memory used by a work stack, leaving it empty.
+ *
+ * \param *stack	Pointer to the stack to free.
+ */
+
+void stack_free(struct stack *stack);
+
+#endif
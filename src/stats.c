@@ -0,0 +1,438 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file stats.c
+ *
+ * Processing Statistics, implementation.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef LINUX
+#include <pthread.h>
+#endif
+
+#ifdef RISCOS
+#include "oslib/os.h"
+#endif
+
+/* Local source headers. */
+
+#include "stats.h"
+
+#include "msg.h"
+
+/**
+ * The names of the phases, as used in the reports.
+ */
+
+static char *stats_phase_names[] = {
+	"load",
+	"parse",
+	"scan",
+	"compare",
+	"report",
+	"update"
+};
+
+/**
+ * The names of the counters, as used in the machine-readable output.
+ */
+
+static char *stats_counter_names[] = {
+	"bytes_mapped",
+	"bytes_loaded",
+	"bytes_read",
+	"bytes_written",
+	"files_read",
+	"files_written",
+	"files_deleted",
+	"files_renamed",
+	"dirs_scanned",
+	"dirs_created",
+	"dirs_deleted",
+	"syscalls"
+};
+
+#ifdef LINUX
+/**
+ * The statistics block for the current thread.
+ */
+
+static __thread struct stats *stats_current = NULL;
+
+/**
+ * Lock to serialise writes to the statistics file.
+ */
+
+static pthread_mutex_t stats_file_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+/**
+ * The statistics block for the program.
+ */
+
+static struct stats *stats_current = NULL;
+#endif
+
+/* Static Function Prototypes. */
+
+static double stats_get_wall_time(void);
+static double stats_get_cpu_time(void);
+static double stats_get_phase_cpu_time(struct stats *stats, int phase);
+static void stats_write_string(FILE *file, char *string);
+
+/**
+ * Initialise a block of statistics.
+ *
+ * \param *stats	Pointer to the block to initialise.
+ */
+
+void stats_initialise(struct stats *stats)
+{
+	int i;
+
+	if (stats == NULL)
+		return;
+
+	for (i = 0; i < STATS_COUNTER_COUNT; i++)
+		stats->counters[i] = 0;
+
+	for (i = 0; i < STATS_PHASE_COUNT; i++) {
+		stats->wall[i] = 0.0;
+		stats->cpu[i] = 0.0;
+		stats->task_cpu[i] = 0;
+	}
+
+	stats->phase = -1;
+	stats->wall_start = 0.0;
+	stats->cpu_start = 0.0;
+}
+
+/**
+ * Set the block of statistics which the calling thread's operations are
+ * counted against.
+ *
+ * \param *stats	Pointer to the block to use, or NULL for none.
+ */
+
+void stats_set_current(struct stats *stats)
+{
+	stats_current = stats;
+}
+
+/**
+ * Get the block of statistics which the calling thread's operations are
+ * being counted against.
+ *
+ * \return		Pointer to the current block, or NULL for none.
+ */
+
+struct stats *stats_get_current(void)
+{
+	return stats_current;
+}
+
+/**
+ * Add to one of the counters in the calling thread's current block of
+ * statistics, if there is one. This can be called from any thread.
+ *
+ * \param counter	The counter to update.
+ * \param amount	The amount to add to the counter.
+ */
+
+void stats_count(enum stats_counter counter, uint64_t amount)
+{
+	if (stats_current == NULL || counter < 0 || counter >= STATS_COUNTER_COUNT)
+		return;
+
+#ifdef LINUX
+	__atomic_fetch_add(stats_current->counters + counter, amount, __ATOMIC_RELAXED);
+#else
+	stats_current->counters[counter] += amount;
+#endif
+}
+
+/**
+ * Start a new phase, ending the current one if there is one.
+ *
+ * \param *stats	Pointer to the block to update, or NULL for none.
+ * \param phase		The phase to start.
+ */
+
+void stats_start_phase(struct stats *stats, enum stats_phase phase)
+{
+	if (stats == NULL || phase < 0 || phase >= STATS_PHASE_COUNT)
+		return;
+
+	stats_end_phase(stats);
+
+	stats->phase = phase;
+	stats->wall_start = stats_get_wall_time();
+	stats->cpu_start = stats_get_cpu_time();
+}
+
+/**
+ * End the current phase, if there is one.
+ *
+ * \param *stats	Pointer to the block to update, or NULL for none.
+ */
+
+void stats_end_phase(struct stats *stats)
+{
+	if (stats == NULL || stats->phase < 0)
+		return;
+
+	stats->wall[stats->phase] += stats_get_wall_time() - stats->wall_start;
+	stats->cpu[stats->phase] += stats_get_cpu_time() - stats->cpu_start;
+
+	stats->phase = -1;
+}
+
+/**
+ * Read the CPU time used so far by the calling thread, at the start of a
+ * task which it is carrying out on behalf of another thread.
+ *
+ * \return		The CPU time to pass to stats_end_task().
+ */
+
+uint64_t stats_start_task(void)
+{
+#ifdef LINUX
+	struct timespec now;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+	return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Add the CPU time used by the calling thread since the start of a task
+ * to the current phase of a block of statistics. This can be called from
+ * any thread.
+ *
+ * \param *stats	Pointer to the block to update, or NULL for none.
+ * \param start		The CPU time returned by stats_start_task().
+ */
+
+void stats_end_task(struct stats *stats, uint64_t start)
+{
+#ifdef LINUX
+	int phase;
+
+	if (stats == NULL)
+		return;
+
+	/* The phase only changes once the pool's tasks are complete. */
+
+	phase = stats->phase;
+	if (phase < 0)
+		return;
+
+	__atomic_fetch_add(stats->task_cpu + phase, stats_start_task() - start, __ATOMIC_RELAXED);
+#endif
+}
+
+/**
+ * Report a block of statistics to the user.
+ *
+ * \param *stats	Pointer to the block to report.
+ */
+
+void stats_report(struct stats *stats)
+{
+	double wall = 0.0, cpu = 0.0;
+	unsigned long long counters[STATS_COUNTER_COUNT];
+	int i;
+
+	if (stats == NULL)
+		return;
+
+	for (i = 0; i < STATS_PHASE_COUNT; i++) {
+		msg_report(MSG_STATS_PHASE, stats_phase_names[i], stats->wall[i] * 1000.0, stats_get_phase_cpu_time(stats, i) * 1000.0);
+
+		wall += stats->wall[i];
+		cpu += stats_get_phase_cpu_time(stats, i);
+	}
+
+	msg_report(MSG_STATS_TOTAL, wall * 1000.0, cpu * 1000.0);
+
+	/* Take a copy of the counters, in a form which printf() can use. */
+
+	for (i = 0; i < STATS_COUNTER_COUNT; i++)
+		counters[i] = stats->counters[i];
+
+	msg_report(MSG_STATS_MANUAL, counters[STATS_BYTES_MAPPED], counters[STATS_BYTES_LOADED]);
+	msg_report(MSG_STATS_DISC, counters[STATS_BYTES_READ], counters[STATS_FILES_READ],
+			counters[STATS_BYTES_WRITTEN], counters[STATS_FILES_WRITTEN]);
+	msg_report(MSG_STATS_OBJECTS, counters[STATS_FILES_DELETED], counters[STATS_FILES_RENAMED],
+			counters[STATS_DIRS_SCANNED], counters[STATS_DIRS_CREATED], counters[STATS_DIRS_DELETED]);
+	msg_report(MSG_STATS_SYSCALLS, counters[STATS_SYSCALLS]);
+}
+
+/**
+ * Append a block of statistics to a file, as a line of JSON.
+ *
+ * \param *stats	Pointer to the block to write.
+ * \param *filename	Pointer to the name of the file to append to.
+ * \param *source	Pointer to the name of the source manual.
+ * \param *output	Pointer to the name of the output folder.
+ * \param success	True if the manual was processed successfully.
+ * \return		True if successful; False on failure.
+ */
+
+bool stats_write(struct stats *stats, char *filename, char *source, char *output, bool success)
+{
+	FILE *file;
+	bool written = true;
+	int i;
+
+	if (stats == NULL || filename == NULL || source == NULL || output == NULL)
+		return false;
+
+#ifdef LINUX
+	pthread_mutex_lock(&stats_file_lock);
+#endif
+
+	file = fopen(filename, "a");
+
+	if (file != NULL) {
+		fprintf(file, "{\"source\":");
+		stats_write_string(file, source);
+		fprintf(file, ",\"output\":");
+		stats_write_string(file, output);
+		fprintf(file, ",\"success\":%s", (success) ? "true" : "false");
+
+		for (i = 0; i < STATS_PHASE_COUNT; i++)
+			fprintf(file, ",\"%s_wall_ms\":%.3f,\"%s_cpu_ms\":%.3f", stats_phase_names[i], stats->wall[i] * 1000.0,
+					stats_phase_names[i], stats_get_phase_cpu_time(stats, i) * 1000.0);
+
+		for (i = 0; i < STATS_COUNTER_COUNT; i++)
+			fprintf(file, ",\"%s\":%llu", stats_counter_names[i], (unsigned long long) stats->counters[i]);
+
+		fprintf(file, "}\n");
+
+		if (fclose(file) != 0)
+			written = false;
+	} else {
+		written = false;
+	}
+
+#ifdef LINUX
+	pthread_mutex_unlock(&stats_file_lock);
+#endif
+
+	if (!written)
+		msg_report(MSG_STATS_WRITE_FAILED, filename);
+
+	return written;
+}
+
+/**
+ * Write a string to a file as a JSON string, with quotes and escapes.
+ * Names from RISC OS are in Latin-1, so any top-bit characters are
+ * converted into UTF-8 as they are written.
+ *
+ * \param *file		The file to write to.
+ * \param *string	Pointer to the string to write.
+ */
+
+static void stats_write_string(FILE *file, char *string)
+{
+	fputc('"', file);
+
+	for (; *string != '\0'; string++) {
+		if (*string == '"' || *string == '\\')
+			fprintf(file, "\\%c", *string);
+		else if ((unsigned char) *string < 0x20)
+			fprintf(file, "\\u%04x", (unsigned char) *string);
+		else if ((unsigned char) *string >= 0x80)
+			fprintf(file, "%c%c", 0xc0 | ((unsigned char) *string >> 6), 0x80 | ((unsigned char) *string & 0x3f));
+		else
+			fputc(*string, file);
+	}
+
+	fputc('"', file);
+}
+
+/**
+ * Read the wall clock time.
+ *
+ * \return		The time, in seconds.
+ */
+
+static double stats_get_wall_time(void)
+{
+#ifdef LINUX
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double) now.tv_sec + (double) now.tv_nsec / 1000000000.0;
+#else
+	return (double) os_read_monotonic_time() / 100.0;
+#endif
+}
+
+/**
+ * Read the CPU time used by the calling thread. The time used by any pool
+ * workers is added separately, so that manuals processed at the same time
+ * by different threads don't include each other's time.
+ *
+ * \return		The time, in seconds.
+ */
+
+static double stats_get_cpu_time(void)
+{
+#ifdef LINUX
+	struct timespec now;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+	return (double) now.tv_sec + (double) now.tv_nsec / 1000000000.0;
+#else
+	return (double) clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/**
+ * Return the total CPU time used in a phase, by the thread which owns a
+ * block of statistics and by any workers which carried out tasks for it.
+ *
+ * \param *stats	Pointer to the block of interest.
+ * \param phase		The phase of interest.
+ * \return		The time, in seconds.
+ */
+
+static double stats_get_phase_cpu_time(struct stats *stats, int phase)
+{
+	return stats->cpu[phase] + (double) stats->task_cpu[phase] / 1000000000.0;
+}
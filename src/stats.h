@@ -0,0 +1,187 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file stats.h
+ *
+ * Processing Statistics, Interface.
+ *
+ * Records the time spent in each phase of processing a manual, and counts
+ * the file operations carried out along the way. A statistics block is
+ * made current for a thread with stats_set_current(), and any worker
+ * pools created by that thread pass it on to their workers, so that the
+ * counts for each manual are kept apart when several are processed at
+ * once.
+ */
+
+#ifndef STRONGEX_STATS_H
+#define STRONGEX_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * The phases of processing a manual.
+ */
+
+enum stats_phase {
+	STATS_PHASE_LOAD = 0,		/**< Loading the manual and the manifest.		*/
+	STATS_PHASE_PARSE,		/**< Parsing the contents of the manual.		*/
+	STATS_PHASE_SCAN,		/**< Scanning the disc folder.				*/
+	STATS_PHASE_COMPARE,		/**< Comparing the manual with the disc folder.		*/
+	STATS_PHASE_REPORT,		/**< Writing the report.				*/
+	STATS_PHASE_UPDATE,		/**< Updating the disc folder and the manifest.		*/
+	STATS_PHASE_COUNT
+};
+
+/**
+ * The operations which are counted.
+ */
+
+enum stats_counter {
+	STATS_BYTES_MAPPED = 0,		/**< Bytes of files memory mapped.			*/
+	STATS_BYTES_LOADED,		/**< Bytes of files read in to memory in one go.	*/
+	STATS_BYTES_READ,		/**< Bytes read from disc to compare or hash files.	*/
+	STATS_BYTES_WRITTEN,		/**< Bytes written to disc.				*/
+	STATS_FILES_READ,		/**< Files read to compare or hash their contents.	*/
+	STATS_FILES_WRITTEN,		/**< Files written.					*/
+	STATS_FILES_DELETED,		/**< Files deleted.					*/
+	STATS_FILES_RENAMED,		/**< Files renamed or retyped.				*/
+	STATS_DIRS_SCANNED,		/**< Directories scanned.				*/
+	STATS_DIRS_CREATED,		/**< Directories created.				*/
+	STATS_DIRS_DELETED,		/**< Directories deleted.				*/
+	STATS_SYSCALLS,			/**< File system calls issued.				*/
+	STATS_COUNTER_COUNT
+};
+
+/**
+ * A block of statistics for a manual.
+ */
+
+struct stats {
+	uint64_t	counters[STATS_COUNTER_COUNT];	/**< The operation counts.			*/
+	double		wall[STATS_PHASE_COUNT];	/**< The wall clock time of each phase, in seconds.	*/
+	double		cpu[STATS_PHASE_COUNT];		/**< The owning thread's CPU time of each phase, in seconds.	*/
+	uint64_t	task_cpu[STATS_PHASE_COUNT];	/**< The workers' CPU time of each phase, in ns.	*/
+	int		phase;				/**< The current phase, or -1 if none.		*/
+	double		wall_start;			/**< The wall clock time at the start of the phase.	*/
+	double		cpu_start;			/**< The CPU time at the start of the phase.		*/
+};
+
+/**
+ * Initialise a block of statistics.
+ *
+ * \param *stats	Pointer to the block to initialise.
+ */
+
+void stats_initialise(struct stats *stats);
+
+/**
+ * Set the block of statistics which the calling thread's operations are
+ * counted against.
+ *
+ * \param *stats	Pointer to the block to use, or NULL for none.
+ */
+
+void stats_set_current(struct stats *stats);
+
+/**
+ * Get the block of statistics which the calling thread's operations are
+ * being counted against.
+ *
+ * \return		Pointer to the current block, or NULL for none.
+ */
+
+struct stats *stats_get_current(void);
+
+/**
+ * Add to one of the counters in the calling thread's current block of
+ * statistics, if there is one. This can be called from any thread.
+ *
+ * \param counter	The counter to update.
+ * \param amount	The amount to add to the counter.
+ */
+
+void stats_count(enum stats_counter counter, uint64_t amount);
+
+/**
+ * Start a new phase, ending the current one if there is one.
+ *
+ * \param *stats	Pointer to the block to update, or NULL for none.
+ * \param phase		The phase to start.
+ */
+
+void stats_start_phase(struct stats *stats, enum stats_phase phase);
+
+/**
+ * End the current phase, if there is one.
+ *
+ * \param *stats	Pointer to the block to update, or NULL for none.
+ */
+
+void stats_end_phase(struct stats *stats);
+
+/**
+ * Read the CPU time used so far by the calling thread, at the start of a
+ * task which it is carrying out on behalf of another thread.
+ *
+ * \return		The CPU time to pass to stats_end_task().
+ */
+
+uint64_t stats_start_task(void);
+
+/**
+ * Add the CPU time used by the calling thread since the start of a task
+ * to the current phase of a block of statistics. This can be called from
+ * any thread.
+ *
+ * \param *stats	Pointer to the block to update, or NULL for none.
+ * \param start		The CPU time returned by stats_start_task().
+ */
+
+void stats_end_task(struct stats *stats, uint64_t start);
+
+/**
+ * Report a block of statistics to the user.
+ *
+ * \param *stats	Pointer to the block to report.
+ */
+
+void stats_report(struct stats *stats);
+
+/**
+ * Append a block of statistics to a file, as a line of JSON.
+ *
+ * \param *stats	Pointer to the block to write.
+ * \param *filename	Pointer to the name of the file to append to.
+ * \param *source	Pointer to the name of the source manual.
+ * \param *output	Pointer to the name of the output folder.
+ * \param success	True if the manual was processed successfully.
+ * \return		True if successful; False on failure.
+ */
+
+bool stats_write(struct stats *stats, char *filename, char *source, char *output, bool success);
+
+#endif
+
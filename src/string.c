@@ -28,6 +28,7 @@
  */
 
 #include <ctype.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 
@@ -35,6 +36,10 @@
 
 #include "string.h"
 
+/* Static Function Prototypes. */
+
+static bool string_match_element(char *pattern, char *text, char separator);
+static char *string_next_element(char *element, char separator);
 
 /* Perform a strcmp() case-insensitively on two strings, returning
  * a value less than, equal to or greater than zero depending on
@@ -127,3 +132,107 @@ void string_trim_right(char *buffer, char trim)
 	while (p > buffer && *(--p) == trim)
 		*p = '\0';
 }
+
+/**
+ * Match a path against a wildcard pattern, ignoring case. Within each
+ * element of the path, * matches any run of characters and ? matches any
+ * single character; an element of ** in the pattern matches any number of
+ * whole elements, including none.
+ *
+ * Only the most recent ** needs to be returned to on a mismatch, in the
+ * same way as for the * within an element, so no recursion is needed.
+ *
+ * \param *pattern	The pattern to match against.
+ * \param *path		The path to be matched.
+ * \param separator	The character separating the elements.
+ * \return		The outcome of the match.
+ */
+
+enum string_match string_match_path(char *pattern, char *path, char separator)
+{
+	char *star = NULL, *star_path = NULL;
+
+	if (pattern == NULL || path == NULL)
+		return STRING_MATCH_NONE;
+
+	while (path != NULL) {
+		if (pattern != NULL && pattern[0] == '*' && pattern[1] == '*' &&
+				(pattern[2] == separator || pattern[2] == '\0')) {
+			star = pattern;
+			star_path = path;
+			pattern = string_next_element(pattern, separator);
+		} else if (pattern != NULL && string_match_element(pattern, path, separator)) {
+			pattern = string_next_element(pattern, separator);
+			path = string_next_element(path, separator);
+		} else if (star != NULL) {
+			pattern = string_next_element(star, separator);
+			star_path = string_next_element(star_path, separator);
+			path = star_path;
+		} else {
+			return STRING_MATCH_NONE;
+		}
+	}
+
+	/* The whole path has been used up; any elements of the pattern which
+	 * are left over could match something within it.
+	 */
+
+	while (pattern != NULL && pattern[0] == '*' && pattern[1] == '*' &&
+			(pattern[2] == separator || pattern[2] == '\0'))
+		pattern = string_next_element(pattern, separator);
+
+	return (pattern == NULL) ? STRING_MATCH_FULL : STRING_MATCH_PARTIAL;
+}
+
+/**
+ * Match a single path element against a single pattern element, ignoring
+ * case. Each element runs up to the next separator or the end of the string.
+ *
+ * \param *pattern	The pattern element to match against.
+ * \param *text		The path element to be matched.
+ * \param separator	The character separating the elements.
+ * \return		True if the element matches; else false.
+ */
+
+static bool string_match_element(char *pattern, char *text, char separator)
+{
+	char *star = NULL, *star_text = NULL;
+
+	while (*text != '\0' && *text != separator) {
+		if (*pattern == '*') {
+			star = pattern++;
+			star_text = text;
+		} else if (*pattern != '\0' && *pattern != separator &&
+				(*pattern == '?' || toupper(*pattern) == toupper(*text))) {
+			pattern++;
+			text++;
+		} else if (star != NULL) {
+			pattern = star + 1;
+			text = ++star_text;
+		} else {
+			return false;
+		}
+	}
+
+	while (*pattern == '*')
+		pattern++;
+
+	return (*pattern == '\0' || *pattern == separator) ? true : false;
+}
+
+/**
+ * Find the start of the next element in a path or pattern.
+ *
+ * \param *element	Pointer to the current element.
+ * \param separator	The character separating the elements.
+ * \return		Pointer to the next element, or NULL if there are
+ *			no more.
+ */
+
+static char *string_next_element(char *element, char separator)
+{
+	while (*element != '\0' && *element != separator)
+		element++;
+
+	return (*element == separator) ? element + 1 : NULL;
+}
@@ -30,6 +30,16 @@
 #ifndef STRONGEX_STRING_H
 #define STRONGEX_STRING_H
 
+/**
+ * The possible outcomes of matching a path against a wildcard pattern.
+ */
+
+enum string_match {
+	STRING_MATCH_NONE,	/**< The path doesn't match, and nothing within it can.		*/
+	STRING_MATCH_PARTIAL,	/**< The path doesn't match, but something within it might.	*/
+	STRING_MATCH_FULL	/**< The path matches the pattern.				*/
+};
+
 /**
  * Perform a strcmp() case-insensitively on two strings, returning
  * a value less than, equal to or greater than zero depending on
@@ -77,5 +87,19 @@ void string_append(char *buffer, char *target, size_t length);
 
 void string_trim_right(char *buffer, char trim);
 
+/**
+ * Match a path against a wildcard pattern, ignoring case. Within each
+ * element of the path, * matches any run of characters and ? matches any
+ * single character; an element of ** in the pattern matches any number of
+ * whole elements, including none.
+ *
+ * \param *pattern	The pattern to match against.
+ * \param *path		The path to be matched.
+ * \param separator	The character separating the elements.
+ * \return		The outcome of the match.
+ */
+
+enum string_match string_match_path(char *pattern, char *path, char separator);
+
 #endif
 
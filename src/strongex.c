@@ -30,6 +30,7 @@
  * Options -v  - Produce verbose output
  */
 
+#include <ctype.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -38,13 +39,20 @@
 
 /* Local source headers. */
 
+#include "archive.h"
+#include "arena.h"
 #include "args.h"
 #include "disc.h"
 #include "files.h"
+#include "manifest.h"
 #include "msg.h"
 #include "objectdb.h"
+#include "pool.h"
+#include "report.h"
+#include "stats.h"
 #include "string.h"
 #include "stronghelp.h"
+#include "watch.h"
 
 /* OSLib source headers. */
 
@@ -55,9 +63,93 @@
 #define MAX_INPUT_LINE_LENGTH 1024
 #define MAX_LOCATION_TEXT 256
 
+/**
+ * The time, in ms, for which a watched manual and folder must be left
+ * alone before they are brought back into step.
+ */
+
+#define STRONGEX_WATCH_SETTLE 250
+
+/**
+ * The number of runs of a watched manual for which the same object database
+ * can be used, before it is rebuilt to release the memory it has collected.
+ */
+
+#define STRONGEX_WATCH_REUSES 64
+
+/**
+ * The options which apply to the processing of each manual.
+ */
+
+struct strongex_options {
+	bool			output_all;	/**< Should the report show all files, or only changed ones.	*/
+	enum report_format	format;		/**< The format in which to write the report.			*/
+	bool			update_disc;	/**< Should the disc folder be updated with any changes.	*/
+	bool			pack;		/**< Should the folder be packed into a manual instead.	*/
+	bool			update_manual;	/**< Should the manual be updated in place to match the disc.	*/
+	bool			validate;	/**< Should the manual's structure just be validated.		*/
+	bool			use_manifest;	/**< Should a manifest be kept alongside the disc folder.	*/
+	bool			watch;		/**< Should the folder be kept up to date with the manual.	*/
+	struct args_data	*includes;	/**< The patterns for the objects to include, or NULL for all.	*/
+	struct args_data	*excludes;	/**< The patterns for the objects to leave out, or NULL.	*/
+	int			threads;	/**< The number of threads to use within each manual.		*/
+	enum files_sync		sync;		/**< The policy for flushing written files to disc.		*/
+	bool			batch_io;	/**< Should file access be batched through io_uring.		*/
+	int			readahead;	/**< The number of files to prefetch ahead of comparisons.	*/
+	bool			stream;		/**< Should the manual be read as required, not loaded.	*/
+	bool			show_stats;	/**< Should statistics be reported for each manual.		*/
+	char			*stats_file;	/**< The file to append statistics to, or NULL for none.	*/
+};
+
+/**
+ * A manual to be processed as part of a batch.
+ */
+
+struct strongex_job {
+	char			*source_file;	/**< Pointer to the name of the file to read from.		*/
+	char			*output_folder;	/**< Pointer to the name of the folder to write to.		*/
+	struct strongex_options	*options;	/**< Pointer to the options to apply to the manual.		*/
+	bool			success;	/**< True if the manual was processed successfully.		*/
+
+	struct strongex_job	*next;		/**< Pointer to the next job in the batch, or NULL.		*/
+};
+
+/**
+ * The state carried between the runs when a manual is being watched. If
+ * the manual hasn't changed since the last run, its object database can
+ * be kept along with the manual itself, so that only the folder needs to
+ * be scanned again. The database is kept or dropped as a whole: any change
+ * to the manual means that it is read again in full.
+ */
+
+struct strongex_resync {
+	struct arena		*arena;		/**< The arena holding the manifest, or NULL.			*/
+	struct manifest		*manifest;	/**< The files written by the last run, or NULL for none.	*/
+	struct arena		*db_arena;	/**< The arena holding the kept database, or NULL.		*/
+	struct objectdb		*db;		/**< The database holding the manual read by the last run, or NULL.	*/
+	struct files_mapping	manual;		/**< The manual in memory, for the kept database.		*/
+	struct files_source	source;		/**< The manual being streamed, for the kept database.		*/
+	bool			stream;		/**< True if the kept database reads from the source.		*/
+	struct files_stat	stat;		/**< The catalogue information for the manual when it was read.	*/
+	bool			stat_known;	/**< True if the catalogue information could be read.		*/
+	int			reuses;		/**< The number of runs for which the database has been kept.	*/
+};
+
 /* Static Function Prototypes. */
 
-static bool strongex_process_file(char *source_file, char *output_folder, bool output_all, bool update_disc);
+static bool strongex_process_batch(char *batch_file, struct strongex_options *options, int jobs);
+static bool strongex_job_task(struct pool *pool, void *data);
+static bool strongex_read_batch_field(char **line, char **field);
+static bool strongex_watch_file(char *source_file, char *output_folder, struct strongex_options *options);
+static bool strongex_process_file(char *source_file, char *output_folder, struct strongex_options *options, struct strongex_resync *resync);
+static bool strongex_process_manual(struct files_mapping *manual, struct files_source *source, char *output_folder, struct objectdb *db, struct strongex_options *options, struct strongex_resync *resync, struct report *report, struct stats *stats);
+static bool strongex_record_resync(struct objectdb *db, struct strongex_resync *resync);
+static bool strongex_check_resync(char *source_file, struct strongex_resync *resync);
+static void strongex_release_resync(struct strongex_resync *resync);
+static bool strongex_set_filters(struct objectdb *db, struct strongex_options *options);
+static bool strongex_pack_folder(char *source_folder, char *output_file, struct strongex_options *options);
+static bool strongex_validate_file(char *source_file, struct strongex_options *options);
+static bool strongex_archive_file(char *source_file, char *archive_file, struct strongex_options *options);
 
 /**
  * The main program entry point.
@@ -71,15 +163,35 @@ int main(int argc, char *argv[])
 {
 	bool			param_error = false;
 	bool			output_help = false;
-	bool			output_all = false;
-	bool			update_disc = false;
 	bool			verbose_output = false;
+	bool			success;
+	int			jobs = 1;
 	char			*source_file = NULL;
 	char			*output_folder = NULL;
+	char			*batch_file = NULL;
+	char			*archive_file = NULL;
+	struct strongex_options	process_options;
 	struct args_option	*options;
 
 	/* Default processing options. */
 
+	process_options.output_all = false;
+	process_options.format = REPORT_FORMAT_TEXT;
+	process_options.update_disc = false;
+	process_options.pack = false;
+	process_options.update_manual = false;
+	process_options.validate = false;
+	process_options.use_manifest = false;
+	process_options.watch = false;
+	process_options.includes = NULL;
+	process_options.excludes = NULL;
+	process_options.threads = 1;
+	process_options.sync = FILES_SYNC_NONE;
+	process_options.batch_io = false;
+	process_options.readahead = 0;
+	process_options.stream = false;
+	process_options.show_stats = false;
+	process_options.stats_file = NULL;
 
 	/* Initialise the variable and procedure handlers. */
 
@@ -87,38 +199,152 @@ int main(int argc, char *argv[])
 	/* Decode the command line options. */
 
 	options = args_process_line(argc, argv,
-			"all/S,source/A,out/A,update/S,verbose/S,help/S");
+			"all/S,source,out,archive/K,batch/K,exclude/KM,format/K,include/KM,jobs/IK,manifest/S,pack/S,readahead/I,stats/S,statsfile/K,stream/S,sync/K,threads/I,update/S,update-manual/S,uring/S,validate/S,verbose/S,watch/S,help/S");
 	if (options == NULL)
 		param_error = true;
 
 	while (options != NULL) {
 		if (strcmp(options->name, "all") == 0) {
 			if (options->data != NULL && options->data->value.boolean == true)
-				output_all = true;
+				process_options.output_all = true;
+		} else if (strcmp(options->name, "archive") == 0) {
+			if (options->data != NULL && options->data->value.string != NULL)
+				archive_file = options->data->value.string;
+		} else if (strcmp(options->name, "batch") == 0) {
+			if (options->data != NULL && options->data->value.string != NULL)
+				batch_file = options->data->value.string;
+		} else if (strcmp(options->name, "exclude") == 0) {
+			process_options.excludes = options->data;
+		} else if (strcmp(options->name, "format") == 0) {
+			if (options->data != NULL && options->data->value.string != NULL) {
+				if (string_nocase_strcmp(options->data->value.string, "text") == 0)
+					process_options.format = REPORT_FORMAT_TEXT;
+				else if (string_nocase_strcmp(options->data->value.string, "json") == 0)
+					process_options.format = REPORT_FORMAT_JSON;
+				else
+					param_error = true;
+			}
 		} else if (strcmp(options->name, "help") == 0) {
 			if (options->data != NULL && options->data->value.boolean == true)
 				output_help = true;
+		} else if (strcmp(options->name, "include") == 0) {
+			process_options.includes = options->data;
+		} else if (strcmp(options->name, "jobs") == 0) {
+			if (options->data != NULL) {
+				if (options->data->value.integer > 0)
+					jobs = options->data->value.integer;
+				else
+					param_error = true;
+			}
+		} else if (strcmp(options->name, "manifest") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true)
+				process_options.use_manifest = true;
+		} else if (strcmp(options->name, "pack") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true)
+				process_options.pack = true;
+		} else if (strcmp(options->name, "readahead") == 0) {
+			if (options->data != NULL) {
+				if (options->data->value.integer >= 0)
+					process_options.readahead = options->data->value.integer;
+				else
+					param_error = true;
+			}
 		} else if (strcmp(options->name, "verbose") == 0) {
 			if (options->data != NULL && options->data->value.boolean == true)
 				verbose_output = true;
 		} else if (strcmp(options->name, "source") == 0) {
 			if (options->data != NULL && options->data->value.string != NULL)
 				source_file = options->data->value.string;
-			else
-				param_error = true;
 		} else if (strcmp(options->name, "out") == 0) {
 			if (options->data != NULL && options->data->value.string != NULL)
 				output_folder = options->data->value.string;
-			else
-				param_error = true;
+		} else if (strcmp(options->name, "stats") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true)
+				process_options.show_stats = true;
+		} else if (strcmp(options->name, "statsfile") == 0) {
+			if (options->data != NULL && options->data->value.string != NULL)
+				process_options.stats_file = options->data->value.string;
+		} else if (strcmp(options->name, "stream") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true)
+				process_options.stream = true;
+		} else if (strcmp(options->name, "sync") == 0) {
+			if (options->data != NULL && options->data->value.string != NULL) {
+				if (string_nocase_strcmp(options->data->value.string, "none") == 0)
+					process_options.sync = FILES_SYNC_NONE;
+				else if (string_nocase_strcmp(options->data->value.string, "file") == 0)
+					process_options.sync = FILES_SYNC_FILE;
+				else if (string_nocase_strcmp(options->data->value.string, "end") == 0)
+					process_options.sync = FILES_SYNC_END;
+				else
+					param_error = true;
+			}
+		} else if (strcmp(options->name, "threads") == 0) {
+			if (options->data != NULL) {
+				if (options->data->value.integer > 0)
+					process_options.threads = options->data->value.integer;
+				else
+					param_error = true;
+			}
 		} else if (strcmp(options->name, "update") == 0) {
 			if (options->data != NULL && options->data->value.boolean == true)
-				update_disc = true;
+				process_options.update_disc = true;
+		} else if (strcmp(options->name, "update-manual") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true)
+				process_options.update_manual = true;
+		} else if (strcmp(options->name, "uring") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true)
+				process_options.batch_io = true;
+		} else if (strcmp(options->name, "validate") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true)
+				process_options.validate = true;
+		} else if (strcmp(options->name, "watch") == 0) {
+			if (options->data != NULL && options->data->value.boolean == true)
+				process_options.watch = true;
 		}
 
 		options = options->next;
 	}
 
+	/* Watching a manual keeps its folder up to date, one manual at a time. */
+
+	if (process_options.watch) {
+		process_options.update_disc = true;
+
+		if (batch_file != NULL || process_options.pack)
+			param_error = true;
+	}
+
+	/* The manual and the disc folder can't both be updated. */
+
+	if (process_options.update_manual && (process_options.update_disc || process_options.pack))
+		param_error = true;
+
+	/* Validating a manual doesn't involve a disc folder at all. */
+
+	if (process_options.validate && (process_options.update_disc || process_options.update_manual || process_options.pack))
+		param_error = true;
+
+	/* A manual patched in place must hold everything, and is checked whole. */
+
+	if ((process_options.includes != NULL || process_options.excludes != NULL) && (process_options.update_manual || process_options.validate))
+		param_error = true;
+
+	/* An archive is written straight from the manual, without a folder. */
+
+	if (archive_file != NULL && (output_folder != NULL || batch_file != NULL || process_options.update_disc ||
+			process_options.update_manual || process_options.pack || process_options.validate ||
+			process_options.use_manifest))
+		param_error = true;
+
+	/* We need either a batch file, or a source and output folder. */
+
+	if (batch_file != NULL) {
+		if (source_file != NULL || output_folder != NULL)
+			param_error = true;
+	} else if (source_file == NULL || (output_folder == NULL && !process_options.validate && archive_file == NULL)) {
+		param_error = true;
+	}
+
 	msg_set_verbose(verbose_output);
 
 	if (param_error || output_help || verbose_output) {
@@ -128,25 +354,359 @@ int main(int argc, char *argv[])
 
 	if (param_error || output_help) {
 		printf("StrongHelp Manual Extractor -- Usage:\n");
-		printf("strongex <infile> -out <outfolder> [<options>]\n\n");
+		printf("strongex <infile> -out <outfolder> [<options>]\n");
+		printf("strongex -pack <infolder> -out <outfile> [<options>]\n");
+		printf("strongex <infile> -archive <outfile> [<options>]\n");
+		printf("strongex -validate <infile> [<options>]\n");
+		printf("strongex -batch <listfile> [<options>]\n\n");
 
 		printf(" -all                   Include unchanged files in the report.\n");
+		printf(" -archive <file>        Write manual contents to a tar, or Zip, archive <file>.\n");
+		printf(" -batch <file>          Process the manuals listed in <file>.\n");
+		printf(" -exclude <pattern>     Leave out the objects matching <pattern>; may be repeated.\n");
+		printf(" -format text|json      Write the report as text, or as JSON lines on stdout.\n");
 		printf(" -help                  Produce this help information.\n");
+		printf(" -include <pattern>     Only process the objects matching <pattern>; may be repeated.\n");
+		printf(" -jobs <n>              Process up to <n> manuals from a batch at once.\n");
+		printf(" -manifest              Quick-check files using a manifest next to the folder.\n");
 		printf(" -out <folder>          Write manual contents to <folder>.\n");
+		printf(" -pack                  Pack the contents of a folder into a manual.\n");
+		printf(" -readahead <n>         Prefetch <n> files ahead of each one being compared.\n");
+		printf(" -stats                 Report the time taken and files accessed for each manual.\n");
+		printf(" -statsfile <file>      Append the statistics for each manual to <file> as JSON.\n");
+		printf(" -stream                Read the manual from disc as required, instead of loading it.\n");
+		printf(" -sync none|file|end    Flush written files to disc never, each file, or at the end.\n");
+		printf(" -threads <n>           Use <n> threads to compare and update files.\n");
 		printf(" -update                Update the output folder to match the manual.\n");
+		printf(" -update-manual         Update the manual in place to match the output folder.\n");
+		printf(" -uring                 Batch file access through io_uring, on Linux.\n");
+		printf(" -validate              Check the structure of the manual, without a folder.\n");
 		printf(" -verbose               Generate verbose process information.\n");
+		printf(" -watch                 Keep the output folder up to date as the manual changes.\n");
 
 		return (output_help) ? EXIT_SUCCESS : EXIT_FAILURE;
 	}
 
 	/* Run the tokenisation. */
 
-	if (!strongex_process_file(source_file, output_folder, output_all, update_disc) || msg_errors())
+	if (batch_file != NULL)
+		success = strongex_process_batch(batch_file, &process_options, jobs);
+	else if (process_options.pack)
+		success = strongex_pack_folder(source_file, output_folder, &process_options);
+	else if (process_options.validate)
+		success = strongex_validate_file(source_file, &process_options);
+	else if (archive_file != NULL)
+		success = strongex_archive_file(source_file, archive_file, &process_options);
+	else if (process_options.watch)
+		success = strongex_watch_file(source_file, output_folder, &process_options);
+	else
+		success = strongex_process_file(source_file, output_folder, &process_options, NULL);
+
+	if (!success || msg_errors())
 		return EXIT_FAILURE;
 
 	return EXIT_SUCCESS;
 }
 
+/**
+ * Process a batch of StrongHelp files, listed in a text file. Each line of
+ * the file contains a source file and an output folder, separated by
+ * whitespace; either can be enclosed in double quotes if it contains
+ * spaces. Blank lines, and lines starting with a #, are ignored. When
+ * manuals are only being validated, the output folder can be left out.
+ *
+ * \param *batch_file		Pointer to the name of the file listing the manuals.
+ * \param *options		Pointer to the options to apply to each manual.
+ * \param jobs			The number of manuals to process at once.
+ * \return			True on success; false on failure.
+ */
+
+static bool strongex_process_batch(char *batch_file, struct strongex_options *options, int jobs)
+{
+	FILE			*in;
+	char			line[MAX_INPUT_LINE_LENGTH], *next, *source, *out, *extra;
+	struct arena		*arena;
+	struct strongex_job	*list = NULL, *tail = NULL, *job;
+	struct pool		*pool;
+	int			line_number = 0, total = 0, completed = 0;
+	bool			success = true;
+
+	if (batch_file == NULL || options == NULL)
+		return false;
+
+	arena = arena_create();
+	if (arena == NULL)
+		return false;
+
+	/* Read the list of manuals into memory. */
+
+	in = fopen(batch_file, "r");
+	if (in == NULL) {
+		msg_report(MSG_OPEN_FAILED, batch_file);
+		arena_destroy(arena);
+		return false;
+	}
+
+	while (success && fgets(line, MAX_INPUT_LINE_LENGTH, in) != NULL) {
+		line_number++;
+
+		if (strchr(line, '\n') == NULL && !feof(in)) {
+			msg_report(MSG_BATCH_LINE_LENGTH, line_number, batch_file);
+			success = false;
+			break;
+		}
+
+		next = line;
+
+		while (isspace((unsigned char) *next))
+			next++;
+
+		if (*next == '#')
+			continue;
+
+		/* A field with an unterminated quote is an error, and not the end of
+		 * the line, so all three fields are read before anything is checked.
+		 */
+
+		if (!strongex_read_batch_field(&next, &source) || !strongex_read_batch_field(&next, &out) ||
+				!strongex_read_batch_field(&next, &extra)) {
+			msg_report(MSG_BATCH_SYNTAX, line_number, batch_file);
+			success = false;
+			break;
+		}
+
+		if (source == NULL)
+			continue;
+
+		if (out == NULL && options->validate)
+			out = "";
+
+		if (out == NULL || extra != NULL) {
+			msg_report(MSG_BATCH_SYNTAX, line_number, batch_file);
+			success = false;
+			break;
+		}
+
+		job = arena_alloc(arena, sizeof(struct strongex_job));
+		if (job == NULL) {
+			success = false;
+			break;
+		}
+
+		job->source_file = arena_strdup(arena, source);
+		job->output_folder = arena_strdup(arena, out);
+		job->options = options;
+		job->success = false;
+		job->next = NULL;
+
+		if (job->source_file == NULL || job->output_folder == NULL) {
+			success = false;
+			break;
+		}
+
+		if (tail != NULL)
+			tail->next = job;
+		else
+			list = job;
+
+		tail = job;
+		total++;
+	}
+
+	fclose(in);
+
+	if (!success) {
+		arena_destroy(arena);
+		return false;
+	}
+
+	/* Process the manuals, sharing them out between the jobs. */
+
+	pool = pool_create(jobs);
+	if (pool == NULL) {
+		arena_destroy(arena);
+		return false;
+	}
+
+	for (job = list; job != NULL; job = job->next)
+		pool_submit(pool, strongex_job_task, job);
+
+	pool_wait(pool);
+	pool_destroy(pool);
+
+	for (job = list; job != NULL; job = job->next) {
+		if (job->success)
+			completed++;
+	}
+
+	msg_report(MSG_BATCH_SUMMARY, completed, total);
+
+	arena_destroy(arena);
+
+	return (completed == total) ? true : false;
+}
+
+/**
+ * A worker pool task to process one of the manuals in a batch.
+ *
+ * \param *pool			Pointer to the pool running the task.
+ * \param *data			Pointer to the job to be processed.
+ * \return			True on success; false on failure.
+ */
+
+static bool strongex_job_task(struct pool *pool, void *data)
+{
+	struct strongex_job *job = data;
+
+	if (job == NULL)
+		return false;
+
+	if (job->options->pack)
+		job->success = strongex_pack_folder(job->source_file, job->output_folder, job->options);
+	else if (job->options->validate)
+		job->success = strongex_validate_file(job->source_file, job->options);
+	else
+		job->success = strongex_process_file(job->source_file, job->output_folder, job->options, NULL);
+
+	return job->success;
+}
+
+/**
+ * Read a field from a line of a batch file, terminating it in place and
+ * updating the line pointer to point to the text following it.
+ *
+ * \param **line		Pointer to the pointer to the remaining line.
+ * \param **field		Pointer to a variable to take a pointer to the
+ *				field, or NULL if none remain.
+ * \return			True if successful; false if the field is badly
+ *				formed, as when a quote isn't closed.
+ */
+
+static bool strongex_read_batch_field(char **line, char **field)
+{
+	char *start, *end;
+
+	if (field == NULL)
+		return false;
+
+	*field = NULL;
+
+	if (line == NULL || *line == NULL)
+		return true;
+
+	start = *line;
+
+	while (isspace((unsigned char) *start))
+		start++;
+
+	if (*start == '\0')
+		return true;
+
+	if (*start == '"') {
+		end = strchr(++start, '"');
+		if (end == NULL)
+			return false;
+	} else {
+		end = start;
+
+		while (*end != '\0' && !isspace((unsigned char) *end))
+			end++;
+	}
+
+	*line = (*end != '\0') ? end + 1 : end;
+	*end = '\0';
+
+	*field = start;
+
+	return true;
+}
+
+/**
+ * Watch a StrongHelp file and its output folder, bringing the folder up
+ * to date with the manual whenever either of them changes. This only
+ * returns if the watch fails.
+ *
+ * The files written by the previous run are remembered in a manifest, so
+ * that any which haven't been touched since don't need to be read back to
+ * compare them. If only the folder has changed, the object database from
+ * the previous run is kept, so that the manual isn't read again. There's
+ * no tracking of which directories have changed, however: a manual which
+ * has changed is read again in full, and every run scans and compares the
+ * whole folder.
+ *
+ * \param *source_file		Pointer to the name of the file to watch.
+ * \param *output_folder	Pointer to the name of the folder to update.
+ * \param *options		Pointer to the options to apply.
+ * \return			False, once the watch has failed.
+ */
+
+static bool strongex_watch_file(char *source_file, char *output_folder, struct strongex_options *options)
+{
+	struct strongex_resync	resync;
+	struct watch		*watch;
+	unsigned		changes;
+
+	if (source_file == NULL || output_folder == NULL || options == NULL)
+		return false;
+
+	string_trim_right(output_folder, *FILES_PATH_SEPARATOR);
+
+	watch = watch_create(source_file, output_folder);
+	if (watch == NULL) {
+		msg_report(MSG_WATCH_FAILED, source_file);
+		return false;
+	}
+
+	resync.arena = NULL;
+	resync.manifest = NULL;
+	resync.db_arena = NULL;
+	resync.db = NULL;
+	resync.stream = false;
+	resync.stat_known = false;
+	resync.reuses = 0;
+
+	msg_report(MSG_WATCHING, source_file, output_folder);
+
+	/* A run which fails, perhaps because the manual was caught part way
+	 * through being written, is simply tried again on the next change. The
+	 * manual is loaded into memory or streamed, rather than being mapped,
+	 * so rewriting it during a run can't pull it out from under the run.
+	 */
+
+	do {
+		strongex_process_file(source_file, output_folder, options, &resync);
+
+		/* Anything which changed while the run was in progress is checked
+		 * again straight away, so that edits made to the folder at the same
+		 * time aren't lost amongst the run's own changes. Such a check finds
+		 * the run's own files intact and writes nothing, so it doesn't lead
+		 * to another one.
+		 */
+
+		watch_refresh(watch);
+
+		changes = watch_wait(watch, 0, STRONGEX_WATCH_SETTLE);
+		if (changes == WATCH_CHANGE_NONE) {
+			changes = watch_wait(watch, -1, STRONGEX_WATCH_SETTLE);
+
+			if (!(changes & WATCH_CHANGE_FAILED))
+				msg_report(MSG_WATCH_CHANGED);
+		}
+
+		/* The manual must be read again if it has changed. */
+
+		if (changes & WATCH_CHANGE_MANUAL)
+			strongex_release_resync(&resync);
+	} while (!(changes & WATCH_CHANGE_FAILED));
+
+	msg_report(MSG_WATCH_FAILED, source_file);
+
+	strongex_release_resync(&resync);
+	arena_destroy(resync.arena);
+	watch_destroy(watch);
+
+	return false;
+}
 
 /**
  * Process a StrongHelp file, reading the data from the source and
@@ -154,85 +714,630 @@ int main(int argc, char *argv[])
  *
  * \param *source_file		Pointer to the name of the file to read from.
  * \param *output_folder	Pointer to the name of the folder to write to.
- * \param output_all		Should the report show all files, or only changed ones.
- * \param update_disc		Should the disc folder be updated with any changes.
+ * \param *options		Pointer to the options to apply.
+ * \param *resync		Pointer to the state carried from a previous
+ *				run of a watched manual, or NULL for none.
  * \return			True on success; false on failure.
  */
 
-static bool strongex_process_file(char *source_file, char *output_folder, bool output_all, bool update_disc)
+static bool strongex_process_file(char *source_file, char *output_folder, struct strongex_options *options, struct strongex_resync *resync)
 {
-	FILE		*in;
-	size_t		length = 0;
-	int8_t		*buffer = NULL;
+	struct files_mapping	file_manual, *manual = &file_manual;
+	struct files_source	file_source, *source = &file_source;
+	struct arena		*arena = NULL;
+	struct objectdb		*db = NULL;
+	struct stats		stats, *run_stats = NULL;
+	struct report		*report = NULL;
+	bool			loaded, stream, success = false;
 
-	if (source_file == NULL || output_folder == NULL)
+	if (source_file == NULL || output_folder == NULL || options == NULL)
 		return false;
 
+	/* A manual which is to be updated in place is always streamed. */
+
+	stream = (options->stream || options->update_manual) ? true : false;
+
+	/* A watched manual is held with the state carried between its runs. */
+
+	if (resync != NULL) {
+		manual = &(resync->manual);
+		source = &(resync->source);
+	}
+
 	string_trim_right(output_folder, *FILES_PATH_SEPARATOR);
 
-	/* Open the file handle. */
+	/* Count the run's operations against its own statistics, if required. */
+
+	if (options->show_stats || options->stats_file != NULL) {
+		stats_initialise(&stats);
+		run_stats = &stats;
+	}
+
+	stats_set_current(run_stats);
+	stats_start_phase(run_stats, STATS_PHASE_LOAD);
+
+	/* Load the file into memory, or open it to be read as required. */
 
 	msg_report(MSG_EXTRACTING, source_file, output_folder);
 
-	in = fopen(source_file, "r");
-	if (in == NULL) {
-		msg_report(MSG_OPEN_FAILED, source_file);
-		return false;
+	/* A database kept from the previous run of a watched manual can only
+	 * be used if the manual is still the one that it was read from; if it
+	 * is read again, its details are noted before it is loaded, so that any
+	 * change made while loading it will be seen next time.
+	 */
+
+	if (resync != NULL && resync->db != NULL && !strongex_check_resync(source_file, resync))
+		strongex_release_resync(resync);
+
+	if (resync != NULL && resync->db == NULL)
+		resync->stat_known = files_read_stat(source_file, &(resync->stat));
+
+	if (resync != NULL && resync->db != NULL) {
+		loaded = true;
+	} else if (options->update_manual) {
+		loaded = files_open_source_for_update(source_file, source);
+	} else if (options->stream) {
+		loaded = files_open_source(source_file, source);
+		if (loaded)
+			msg_report(MSG_FILE_STREAMED);
+	} else if (resync != NULL) {
+		loaded = files_load_file(source_file, manual);
+	} else {
+		loaded = files_map_file(source_file, manual);
 	}
 
-	/* Get the size of the file. */
+	if (loaded) {
+		msg_report(MSG_FILE_SIZE, (stream) ? source->length : manual->length);
+
+		/* Set up an arena to hold the object database for this run, unless
+		 * there's one left from the previous run of a watched manual.
+		 */
+
+		if (resync != NULL && resync->db != NULL) {
+			arena = resync->db_arena;
+			db = resync->db;
+		} else {
+			arena = arena_create();
+			if (arena != NULL)
+				db = objectdb_create(arena);
+		}
+
+		/* A structured report collects its records for the manual in one place. */
+
+		if (options->format == REPORT_FORMAT_JSON)
+			report = report_create(source_file);
 
-	fseek(in, 0, SEEK_END);
-	length = ftell(in);
-	fseek(in, 0, SEEK_SET);
+		if (db != NULL && (report != NULL || options->format != REPORT_FORMAT_JSON))
+			success = strongex_process_manual((stream) ? NULL : manual, (stream) ? source : NULL,
+					output_folder, db, options, resync, report, run_stats);
 
-	/* Load the file into a memory buffer. */
+		if (report != NULL && !report_destroy(report))
+			success = false;
 
-	buffer = malloc(length);
+		/* Keep a watched manual's database for the next run if this one
+		 * succeeded, or release the memory used by the run in one go.
+		 */
 
-	if ((buffer != NULL) && (fread(buffer, sizeof(char), length, in) != length)) {
-		free(buffer);
-		buffer = NULL;
+		if (resync != NULL && success && db != NULL && resync->reuses < STRONGEX_WATCH_REUSES) {
+			resync->db_arena = arena;
+			resync->db = db;
+			resync->stream = stream;
+			resync->reuses++;
+		} else {
+			if (resync != NULL) {
+				resync->db_arena = NULL;
+				resync->db = NULL;
+				resync->reuses = 0;
+			}
+
+			objectdb_destroy(db);
+			arena_destroy(arena);
+
+			if (stream)
+				files_close_source(source);
+			else
+				files_unmap_file(manual);
+		}
 	}
 
-	fclose(in);
+	stats_end_phase(run_stats);
+	stats_set_current(NULL);
+
+	/* Report the statistics, whether or not the run succeeded. */
 
-	if (buffer == NULL) {
-		msg_report(MSG_LOAD_FAILED, source_file);
+	if (options->show_stats)
+		stats_report(run_stats);
+
+	if (options->stats_file != NULL && !stats_write(run_stats, options->stats_file, source_file, output_folder, success))
+		success = false;
+
+	if (!success)
 		return false;
+
+	msg_report(MSG_COMPLETE);
+
+	return true;
+}
+
+/**
+ * Process the contents of a StrongHelp manual which has been loaded into
+ * memory or opened for streaming, comparing it with the specified output
+ * folder and updating the folder if required.
+ *
+ * \param *manual		Pointer to the manual file in memory, or NULL.
+ * \param *source		Pointer to the manual file to be streamed, or NULL.
+ * \param *output_folder	Pointer to the name of the folder to write to.
+ * \param *db			Pointer to the object database to use.
+ * \param *options		Pointer to the options to apply.
+ * \param *resync		Pointer to the state carried from a previous
+ *				run of a watched manual, or NULL for none.
+ * \param *report		Pointer to the structured report to write to,
+ *				or NULL to report as text.
+ * \param *stats		Pointer to the statistics to record the phases
+ *				in, or NULL for none.
+ * \return			True on success; false on failure.
+ */
+
+static bool strongex_process_manual(struct files_mapping *manual, struct files_source *source, char *output_folder, struct objectdb *db, struct strongex_options *options, struct strongex_resync *resync, struct report *report, struct stats *stats)
+{
+	struct manifest	*manifest;
+	char		*manifest_file = NULL;
+	bool		success;
+
+	/* Load the manifest for the disc folder, if there is one. */
+
+	if (options->use_manifest) {
+		manifest_file = manifest_make_filename(output_folder, objectdb_get_arena(db));
+		if (manifest_file == NULL)
+			return false;
+
+		manifest = manifest_load(manifest_file, objectdb_get_arena(db));
+		if (manifest == NULL)
+			return false;
+
+		objectdb_set_manifest(db, manifest);
+	} else if (resync != NULL && resync->manifest != NULL) {
+		objectdb_set_manifest(db, resync->manifest);
 	}
 
-	msg_report(MSG_FILE_SIZE, length);
+	objectdb_set_batch_io(db, options->batch_io);
+	objectdb_set_readahead(db, options->readahead);
+	objectdb_set_source(db, source);
 
-	/* Process the contents of the StrongHelp manual file. */
+	/* Process the contents of the StrongHelp manual file, unless it is
+	 * already in a database kept from the previous run; in which case,
+	 * only the details of the disc folder need to be forgotten.
+	 */
 
-	msg_report(MSG_READ_STRONGHELP);
-	if (!stronghelp_initialise_file(buffer, length))
+	stats_start_phase(stats, STATS_PHASE_PARSE);
+
+	if (resync != NULL && resync->db == db) {
+		success = objectdb_reset_disc(db);
+	} else {
+		if (!strongex_set_filters(db, options))
+			return false;
+
+		msg_report(MSG_READ_STRONGHELP);
+
+		if (source != NULL)
+			success = stronghelp_initialise_source(db, source);
+		else
+			success = stronghelp_initialise_file(db, manual->data, manual->length);
+	}
+
+	if (!success)
 		return false;
 
 	/* Process the contents of the disc folder. */
 
+	stats_start_phase(stats, STATS_PHASE_SCAN);
+
 	msg_report(MSG_READ_DISC);
-	if (!disc_initialise_folder(output_folder))
+	if (!disc_initialise_folder(db, output_folder, options->threads))
 		return false;
 
 	/* Build a status report. */
 
+	stats_start_phase(stats, STATS_PHASE_COMPARE);
+
 	msg_report(MSG_COMPARING_DATA);
-	if (!objectdb_check_status())
+	if (!objectdb_check_status(db, options->threads))
 		return false;
 
+	/* Update the manual to match the disc folder, if required; the report
+	 * describes the changes needed to the folder, so it isn't written.
+	 */
+
+	if (options->update_manual) {
+		stats_start_phase(stats, STATS_PHASE_UPDATE);
+
+		msg_report(MSG_UPDATING_MANUAL);
+		return stronghelp_update_source(db, source, (options->sync != FILES_SYNC_NONE) ? true : false);
+	}
+
 	/* Write the status report. */
 
-	if (!objectdb_output_report(output_all))
+	stats_start_phase(stats, STATS_PHASE_REPORT);
+
+	if (!objectdb_output_report(db, options->output_all, report))
 		return false;
 
-	if (update_disc) {
+	/* The hashes are only listed as verbose output, so aren't worth
+	 * working out otherwise.
+	 */
+
+	if (msg_get_verbose() && !objectdb_output_hashes(db))
+		return false;
+
+	if (options->update_disc) {
+		stats_start_phase(stats, STATS_PHASE_UPDATE);
+
 		msg_report(MSG_UPDATING_DISC);
-		if (!objectdb_update())
+		if (!objectdb_update(db, options->threads, options->sync))
 			return false;
+
+		if (manifest_file != NULL && !objectdb_write_manifest(db, manifest_file))
+			return false;
+
+		if (manifest_file == NULL && resync != NULL && !strongex_record_resync(db, resync))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Remember the files in an output folder which has just been brought up
+ * to date, replacing the manifest carried from any previous run.
+ *
+ * \param *db			Pointer to the object database for the run.
+ * \param *resync		Pointer to the state to be updated.
+ * \return			True on success; false on failure.
+ */
+
+static bool strongex_record_resync(struct objectdb *db, struct strongex_resync *resync)
+{
+	struct manifest	*manifest = NULL;
+	struct arena	*arena;
+
+	/* The new manifest needs its own arena, as the run's is about to go. */
+
+	arena = arena_create();
+	if (arena != NULL)
+		manifest = manifest_create(arena);
+
+	if (manifest == NULL || !objectdb_record_manifest(db, manifest)) {
+		arena_destroy(arena);
+		return false;
+	}
+
+	arena_destroy(resync->arena);
+
+	resync->arena = arena;
+	resync->manifest = manifest;
+
+	return true;
+}
+
+/**
+ * Check that a watched manual hasn't changed since it was read, so that the
+ * object database kept from the previous run still describes it.
+ *
+ * \param *source_file		Pointer to the name of the manual.
+ * \param *resync		Pointer to the state carried from the previous run.
+ * \return			True if the manual is unchanged; false if it has
+ *				changed or can't be checked.
+ */
+
+static bool strongex_check_resync(char *source_file, struct strongex_resync *resync)
+{
+	struct files_stat stat;
+
+	if (!resync->stat_known || !files_read_stat(source_file, &stat))
+		return false;
+
+	return (stat.size == resync->stat.size && stat.modified == resync->stat.modified &&
+			stat.modified_ns == resync->stat.modified_ns && stat.inode == resync->stat.inode) ? true : false;
+}
+
+/**
+ * Release the object database and manual kept from the previous run of
+ * a watched manual, if there are any, so that the next run starts again.
+ *
+ * \param *resync		Pointer to the state to be released.
+ */
+
+static void strongex_release_resync(struct strongex_resync *resync)
+{
+	if (resync == NULL || resync->db == NULL)
+		return;
+
+	objectdb_destroy(resync->db);
+	arena_destroy(resync->db_arena);
+
+	if (resync->stream)
+		files_close_source(&(resync->source));
+	else
+		files_unmap_file(&(resync->manual));
+
+	resync->db_arena = NULL;
+	resync->db = NULL;
+	resync->reuses = 0;
+}
+
+/**
+ * Add the include and exclude patterns from the command line to an
+ * object database, before anything is added to it.
+ *
+ * \param *db			Pointer to the object database for the run.
+ * \param *options		Pointer to the options to apply.
+ * \return			True on success; false on failure.
+ */
+
+static bool strongex_set_filters(struct objectdb *db, struct strongex_options *options)
+{
+	struct args_data *pattern;
+
+	for (pattern = options->includes; pattern != NULL; pattern = pattern->next) {
+		if (!objectdb_add_filter(db, pattern->value.string, false))
+			return false;
+	}
+
+	for (pattern = options->excludes; pattern != NULL; pattern = pattern->next) {
+		if (!objectdb_add_filter(db, pattern->value.string, true))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Pack the contents of a folder on disc into a StrongHelp file, replacing
+ * any file which is already there.
+ *
+ * \param *source_folder	Pointer to the name of the folder to read from.
+ * \param *output_file		Pointer to the name of the file to write to.
+ * \param *options		Pointer to the options to apply.
+ * \return			True on success; false on failure.
+ */
+
+static bool strongex_pack_folder(char *source_folder, char *output_file, struct strongex_options *options)
+{
+	struct arena		*arena;
+	struct objectdb		*db = NULL;
+	struct stats		stats, *run_stats = NULL;
+	bool			success = false;
+
+	if (source_folder == NULL || output_file == NULL || options == NULL)
+		return false;
+
+	string_trim_right(source_folder, *FILES_PATH_SEPARATOR);
+
+	/* Count the run's operations against its own statistics, if required. */
+
+	if (options->show_stats || options->stats_file != NULL) {
+		stats_initialise(&stats);
+		run_stats = &stats;
+	}
+
+	stats_set_current(run_stats);
+
+	msg_report(MSG_PACKING, source_folder, output_file);
+
+	/* Set up an arena to hold the object database for this run. */
+
+	arena = arena_create();
+	if (arena != NULL)
+		db = objectdb_create(arena);
+
+	/* Read the folder into the database, then lay it out as a manual. */
+
+	if (db != NULL && strongex_set_filters(db, options)) {
+		stats_start_phase(run_stats, STATS_PHASE_SCAN);
+
+		msg_report(MSG_READ_DISC);
+		success = disc_initialise_folder(db, source_folder, options->threads);
+
+		if (success) {
+			stats_start_phase(run_stats, STATS_PHASE_UPDATE);
+
+			msg_report(MSG_WRITE_STRONGHELP);
+			success = stronghelp_pack_folder(db, output_file, (options->sync != FILES_SYNC_NONE) ? true : false);
+		}
 	}
 
+	/* Release the memory used by the run in one go. */
+
+	objectdb_destroy(db);
+	arena_destroy(arena);
+
+	stats_end_phase(run_stats);
+	stats_set_current(NULL);
+
+	/* Report the statistics, whether or not the run succeeded. */
+
+	if (options->show_stats)
+		stats_report(run_stats);
+
+	if (options->stats_file != NULL && !stats_write(run_stats, options->stats_file, source_folder, output_file, success))
+		success = false;
+
+	if (!success)
+		return false;
+
+	msg_report(MSG_COMPLETE);
+
+	return true;
+}
+
+/**
+ * Validate the structure of a StrongHelp file, without reference to
+ * any folder on disc.
+ *
+ * \param *source_file		Pointer to the name of the file to validate.
+ * \param *options		Pointer to the options to apply.
+ * \return			True if the file is valid; false if not, or on failure.
+ */
+
+static bool strongex_validate_file(char *source_file, struct strongex_options *options)
+{
+	struct files_mapping	manual;
+	struct stats		stats, *run_stats = NULL;
+	bool			success = false;
+
+	if (source_file == NULL || options == NULL)
+		return false;
+
+	/* Count the run's operations against its own statistics, if required. */
+
+	if (options->show_stats || options->stats_file != NULL) {
+		stats_initialise(&stats);
+		run_stats = &stats;
+	}
+
+	stats_set_current(run_stats);
+	stats_start_phase(run_stats, STATS_PHASE_LOAD);
+
+	msg_report(MSG_VALIDATING, source_file);
+
+	/* Map the file into memory, and check its blocks in place. */
+
+	if (files_map_file(source_file, &manual)) {
+		msg_report(MSG_FILE_SIZE, manual.length);
+
+		stats_start_phase(run_stats, STATS_PHASE_PARSE);
+
+		success = stronghelp_validate_file(manual.data, manual.length);
+
+		files_unmap_file(&manual);
+	}
+
+	stats_end_phase(run_stats);
+	stats_set_current(NULL);
+
+	/* Report the statistics, whether or not the run succeeded. */
+
+	if (options->show_stats)
+		stats_report(run_stats);
+
+	if (options->stats_file != NULL && !stats_write(run_stats, options->stats_file, source_file, "", success))
+		success = false;
+
+	if (!success)
+		return false;
+
+	msg_report(MSG_COMPLETE);
+
+	return true;
+}
+
+/**
+ * Write the contents of a StrongHelp file out to a tar or Zip archive,
+ * straight from the manual in memory, or as it's read when streaming.
+ *
+ * \param *source_file		Pointer to the name of the file to read from.
+ * \param *archive_file		Pointer to the name of the archive to write.
+ * \param *options		Pointer to the options to apply.
+ * \return			True on success; false on failure.
+ */
+
+static bool strongex_archive_file(char *source_file, char *archive_file, struct strongex_options *options)
+{
+	struct files_mapping	manual;
+	struct files_source	source;
+	struct arena		*arena;
+	struct objectdb		*db = NULL;
+	struct archive		*archive;
+	struct stats		stats, *run_stats = NULL;
+	bool			loaded, success = false;
+
+	if (source_file == NULL || archive_file == NULL || options == NULL)
+		return false;
+
+	/* Count the run's operations against its own statistics, if required. */
+
+	if (options->show_stats || options->stats_file != NULL) {
+		stats_initialise(&stats);
+		run_stats = &stats;
+	}
+
+	stats_set_current(run_stats);
+	stats_start_phase(run_stats, STATS_PHASE_LOAD);
+
+	msg_report(MSG_ARCHIVING, source_file, archive_file);
+
+	/* Load the file into memory, or open it to be read as required. */
+
+	if (options->stream) {
+		loaded = files_open_source(source_file, &source);
+		if (loaded)
+			msg_report(MSG_FILE_STREAMED);
+	} else {
+		loaded = files_map_file(source_file, &manual);
+	}
+
+	if (loaded) {
+		msg_report(MSG_FILE_SIZE, (options->stream) ? source.length : manual.length);
+
+		/* Set up an arena to hold the object database for this run. */
+
+		arena = arena_create();
+		if (arena != NULL)
+			db = objectdb_create(arena);
+
+		if (db != NULL && strongex_set_filters(db, options)) {
+			objectdb_set_source(db, (options->stream) ? &source : NULL);
+
+			stats_start_phase(run_stats, STATS_PHASE_PARSE);
+
+			msg_report(MSG_READ_STRONGHELP);
+
+			if (options->stream)
+				success = stronghelp_initialise_source(db, &source);
+			else
+				success = stronghelp_initialise_file(db, manual.data, manual.length);
+
+			/* Stream the files straight from the database into the archive. */
+
+			if (success) {
+				stats_start_phase(run_stats, STATS_PHASE_UPDATE);
+
+				msg_report(MSG_WRITING_ARCHIVE);
+
+				archive = archive_open(archive_file, archive_choose_format(archive_file));
+
+				success = (archive != NULL) ? true : false;
+
+				if (success)
+					success = archive_close(archive, objectdb_write_archive(db, archive));
+			}
+		}
+
+		/* Release the memory used by the run in one go. */
+
+		objectdb_destroy(db);
+		arena_destroy(arena);
+
+		if (options->stream)
+			files_close_source(&source);
+		else
+			files_unmap_file(&manual);
+	}
+
+	stats_end_phase(run_stats);
+	stats_set_current(NULL);
+
+	/* Report the statistics, whether or not the run succeeded. */
+
+	if (options->show_stats)
+		stats_report(run_stats);
+
+	if (options->stats_file != NULL && !stats_write(run_stats, options->stats_file, source_file, archive_file, success))
+		success = false;
+
+	if (!success)
+		return false;
+
 	msg_report(MSG_COMPLETE);
 
 	return true;
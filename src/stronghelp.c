@@ -29,6 +29,7 @@
 
 #include <ctype.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -38,8 +39,12 @@
 
 #include "stronghelp.h"
 
+#include "arena.h"
+#include "files.h"
+#include "hash.h"
 #include "msg.h"
 #include "objectdb.h"
+#include "stack.h"
 
 /* Magic Words used in file blocks. */
 
@@ -48,6 +53,26 @@
 #define STRONGHELP_DATA_WORD (0x41544144)
 #define STRONGHELP_FREE_WORD (0x45455246)
 
+/* The amount of the file read for the root directory entry, when streaming. */
+
+#define STRONGHELP_ROOT_BLOCK_SIZE 256
+
+/* The StrongHelp version number written into packed manuals. */
+
+#define STRONGHELP_PACK_VERSION (280)
+
+/* The largest manual which can be packed, given the signed offsets. */
+
+#define STRONGHELP_PACK_MAX_LENGTH ((size_t) INT32_MAX)
+
+/* The size of the blocks used to copy files into a manual being updated. */
+
+#define STRONGHELP_COPY_BLOCK_SIZE (64 * 1024)
+
+/* The RISC OS filetype of a StrongHelp manual. */
+
+#define STRONGHELP_FILETYPE (0x3d6)
+
 /* Object attribute flags. */
 
 #define STRONGHELP_ATTRIBUTE_OWNER_READ (0x0001)
@@ -57,6 +82,10 @@
 #define STRONGHELP_ATTRIBUTE_PUBLIC_WRITE (0x0010)
 #define STRONGHELP_ATTRIBUTE_DIRECTORY (0x0100)
 
+/* The attributes given to the objects in a packed manual. */
+
+#define STRONGHELP_PACK_ATTRIBUTES (STRONGHELP_ATTRIBUTE_OWNER_READ | STRONGHELP_ATTRIBUTE_OWNER_WRITE | STRONGHELP_ATTRIBUTE_PUBLIC_READ)
+
 /**
  * A StrongHelp file root block.
  */
@@ -112,47 +141,521 @@ struct stronghelp_file_free_block {
 	int32_t		next_offset;
 }; 
 
-/* Global Variables */
+/**
+ * The context for a StrongHelp manual being processed.
+ */
+
+struct stronghelp_file {
+	int8_t			*root;		/**< Pointer to the root of the manual, or NULL if streamed.	*/
+	struct files_source	*source;	/**< The file to read a streamed manual from, or NULL.	*/
+	int32_t			length;		/**< The length of the StrongHelp manual.		*/
+	struct objectdb		*db;		/**< The object database to add the contents to.	*/
+	uint32_t		*visited;	/**< Bitmap of the words where blocks have been read.	*/
+};
+
+/**
+ * A block of directory entries waiting to be processed.
+ */
+
+struct stronghelp_pending {
+	int32_t			offset;		/**< The file offset of the first entry.		*/
+	int32_t			length;		/**< The length of the entries in the block.		*/
+	struct objectdb_object	*object;	/**< The Object DB entry for the directory.		*/
+};
 
 /**
- * Pointer to the root of the StrongHelp manual.
+ * The context for a StrongHelp manual being packed from a disc folder.
  */
-static int8_t *stronghelp_file_root = NULL;
+
+struct stronghelp_pack {
+	int8_t			*buffer;	/**< Pointer to the buffer holding the manual.		*/
+	size_t			length;		/**< The length of the manual.				*/
+	size_t			next;		/**< The offset of the next block to be laid out.	*/
+	int			directories;	/**< The number of directories packed.			*/
+	int			files;		/**< The number of files packed.			*/
+};
 
 /**
- * The length of the StrongHelp manual.
+ * An object waiting to be laid out in a manual being packed.
  */
-static int32_t stronghelp_file_length = 0;
 
-/* Static Function Prototypes */
+struct stronghelp_pack_pending {
+	struct objectdb_object		*object;	/**< The Object DB entry for the object.		*/
+	struct stronghelp_file_dir_entry *entry;	/**< The object's entry in its parent.			*/
+	bool				is_dir;		/**< True if the object is a directory.			*/
+};
+
+/**
+ * A free block in a StrongHelp manual being updated in place.
+ */
+
+struct stronghelp_space {
+	int32_t			offset;		/**< The offset of the block within the file.		*/
+	int32_t			size;		/**< The size of the block, including its header.	*/
+	int32_t			file_size;	/**< The size in the block's header on disc, or 0.	*/
+	int32_t			file_next;	/**< The next offset in the block's header on disc.	*/
+	struct stronghelp_space	*next;		/**< The next free block in the file, or NULL.		*/
+};
+
+/**
+ * The context for a StrongHelp manual being updated in place.
+ */
+
+struct stronghelp_update {
+	struct stronghelp_file	file;		/**< The manual being updated.				*/
+	struct stronghelp_space	*free;		/**< The free blocks in the file, in offset order.	*/
+	int32_t			end_word;	/**< The offset of the zero word ending the file, or -1.	*/
+	size_t			written;	/**< The number of bytes written to the file.		*/
+};
+
+/**
+ * A directory waiting to be processed in a manual being updated in place.
+ */
+
+struct stronghelp_update_pending {
+	struct objectdb_object		*dir;		/**< The Object DB entry for the directory, or NULL.	*/
+	struct stronghelp_file_dir_entry entry;		/**< A copy of the directory's entry in its parent.	*/
+	int32_t				position;	/**< The file offset of the entry, or -1 if it's new.	*/
+};
 
-static bool stronghelp_process_object(struct stronghelp_file_dir_entry *entry, struct objectdb_object *parent);
-static bool stronghelp_process_directory_entries(int32_t offset, size_t length, struct objectdb_object *object);
+/**
+ * The context for a StrongHelp manual being validated. The coverage of
+ * the file is tracked a word at a time, since all blocks are word aligned.
+ */
+
+struct stronghelp_validate {
+	int8_t			*root;		/**< Pointer to the root of the manual in memory.	*/
+	int32_t			length;		/**< The length of the StrongHelp manual.		*/
+	uint32_t		*coverage;	/**< Bitmap of the words used by a block.		*/
+	uint32_t		*starts;	/**< Bitmap of the words at which a block starts.	*/
+	struct stack		pending;	/**< Stack of directory blocks still to be checked.	*/
+	int			directories;	/**< The number of directory blocks found.		*/
+	int			files;		/**< The number of data blocks found.			*/
+	int			free_blocks;	/**< The number of free blocks found.			*/
+	int			problems;	/**< The number of problems found.			*/
+};
 
-static int32_t stronghelp_walk_free_space(int32_t offset);
-static void *stronghelp_get_block_address(int32_t offset, size_t min_size);
+/* Static Function Prototypes */
+
+static bool stronghelp_process_file(struct stronghelp_file *file);
+static bool stronghelp_process_object(struct stronghelp_file *file, struct stronghelp_file_dir_entry *entry, struct objectdb_object *parent, struct stack *pending);
+static bool stronghelp_process_directory_entries(struct stronghelp_file *file, int32_t offset, size_t length, struct objectdb_object *object, struct stack *pending);
+static bool stronghelp_mark_visited(struct stronghelp_file *file, int32_t offset);
+
+static int32_t stronghelp_walk_free_space(struct stronghelp_file *file, int32_t offset);
+static void *stronghelp_get_block_address(struct stronghelp_file *file, int32_t offset, size_t min_size, void *buffer);
+static struct stronghelp_file_dir_entry *stronghelp_get_entry_address(struct stronghelp_file *file, int8_t *block, int32_t start, int32_t offset);
+static int8_t *stronghelp_load_block(struct stronghelp_file *file, int32_t offset, int32_t length);
+
+static bool stronghelp_measure_directory(struct objectdb_object *dir, size_t *length);
+static bool stronghelp_measure_directory_entries(struct objectdb_object *dir, size_t *length, struct stack *pending);
+static bool stronghelp_pack_directory(struct stronghelp_pack *pack, struct objectdb_object *dir, struct stronghelp_file_dir_entry *entry);
+static bool stronghelp_pack_directory_block(struct stronghelp_pack *pack, struct objectdb_object *dir, struct stronghelp_file_dir_entry *entry, struct stack *pending);
+static bool stronghelp_pack_file(struct stronghelp_pack *pack, struct objectdb_object *object, struct stronghelp_file_dir_entry *entry);
+static void stronghelp_set_entry(struct stronghelp_file_dir_entry *entry, size_t offset, uint32_t filetype, size_t size, int32_t flags);
+static size_t stronghelp_get_entry_size(char *name);
+static bool stronghelp_add_length(size_t *length, size_t size);
+
+static bool stronghelp_update_directory(struct stronghelp_update *update, struct objectdb_object *dir, struct stronghelp_file_dir_entry *entry, int32_t position);
+static bool stronghelp_update_directory_block(struct stronghelp_update *update, struct stronghelp_update_pending *item, struct stack *pending);
+static bool stronghelp_update_file(struct stronghelp_update *update, struct objectdb_object *object, struct stronghelp_file_dir_entry *entry);
+static bool stronghelp_claim_directory(struct stronghelp_update *update, struct objectdb_object *dir, struct stronghelp_file_dir_entry *entry, struct stack *pending);
+static bool stronghelp_add_directory(struct stronghelp_update *update, struct stronghelp_update_pending *item, struct stack *pending);
+static bool stronghelp_add_file(struct stronghelp_update *update, struct objectdb_object *object, struct stronghelp_file_dir_entry *entry);
+static bool stronghelp_add_entries(struct stronghelp_update *update, struct objectdb_object *dir, int8_t *block, int32_t *length, bool existing, struct stack *pending);
+static bool stronghelp_write_file(struct stronghelp_update *update, struct objectdb_object *object, struct stronghelp_file_dir_entry *entry, int32_t capacity);
+static bool stronghelp_release_directory(struct stronghelp_update *update, struct objectdb_object *dir, struct stronghelp_file_dir_entry *entry);
+static bool stronghelp_release_directory_block(struct stronghelp_update *update, struct stronghelp_update_pending *item, struct stack *pending);
+static bool stronghelp_release_file(struct stronghelp_update *update, struct objectdb_object *object, struct stronghelp_file_dir_entry *entry);
+static int8_t *stronghelp_load_directory(struct stronghelp_update *update, struct stronghelp_file_dir_entry *entry, struct stronghelp_file_dir_block *header);
+static struct objectdb_object *stronghelp_find_object(struct objectdb_object *dir, struct stronghelp_file_dir_entry *entry, bool *is_dir);
+static void stronghelp_set_entry_type(struct stronghelp_file_dir_entry *entry, uint32_t filetype);
+static int32_t stronghelp_get_child_entries_size(struct objectdb_object *dir, bool existing);
+static bool stronghelp_write_bytes(struct stronghelp_update *update, int32_t offset, void *data, size_t length);
+static bool stronghelp_read_free_space(struct stronghelp_update *update, int32_t offset);
+static bool stronghelp_find_end_word(struct stronghelp_update *update);
+static int32_t stronghelp_allocate_space(struct stronghelp_update *update, int32_t size, int32_t *allocated);
+static bool stronghelp_release_space(struct stronghelp_update *update, int32_t offset, int32_t size);
+static bool stronghelp_can_release_space(struct stronghelp_update *update, int32_t offset, int32_t size);
+static void stronghelp_insert_space(struct stronghelp_update *update, struct stronghelp_space *space);
+static bool stronghelp_close_gaps(struct stronghelp_update *update, bool *moved);
+static bool stronghelp_find_gap(struct stronghelp_update *update, int32_t offset);
+static bool stronghelp_move_block(struct stronghelp_update *update, int32_t position, struct stronghelp_file_dir_entry *entry, bool is_dir);
+static bool stronghelp_push_entries(struct stronghelp_update *update, struct stronghelp_file_dir_entry *entry, struct stack *pending, struct stronghelp_file_dir_block *header);
+static bool stronghelp_write_free_space(struct stronghelp_update *update, int32_t free_offset);
+static void stronghelp_free_space_list(struct stronghelp_update *update);
+
+static void stronghelp_validate_free_space(struct stronghelp_validate *validate, int32_t offset);
+static void stronghelp_validate_directory(struct stronghelp_validate *validate, int32_t offset);
+static int32_t stronghelp_validate_block(struct stronghelp_validate *validate, int32_t offset, int32_t magic, size_t min_size, char *type);
+static bool stronghelp_mark_block(struct stronghelp_validate *validate, int32_t offset, int32_t size, char *type);
+static void stronghelp_report_gaps(struct stronghelp_validate *validate);
 
 
 /* Initialise a StrongHelp file and roughly validate its
  * contents.
  *
- * \param *file		Pointer to the file in memory.
+ * \param *db		Pointer to the object database to add the contents to.
+ * \param *data		Pointer to the file in memory.
  * \param length	The length of the file.
  * \return		True if successful, false on failure.
  */
 
-bool stronghelp_initialise_file(int8_t *file, size_t length)
+bool stronghelp_initialise_file(struct objectdb *db, int8_t *data, size_t length)
+{
+	struct stronghelp_file file;
+
+	file.root = data;
+	file.source = NULL;
+	file.length = length;
+	file.db = db;
+	file.visited = NULL;
+
+	return stronghelp_process_file(&file);
+}
+
+/* Initialise a StrongHelp file which is to be streamed from disc, and
+ * roughly validate its contents.
+ *
+ * \param *db		Pointer to the object database to add the contents to.
+ * \param *source	Pointer to the file to read the manual from.
+ * \return		True if successful, false on failure.
+ */
+
+bool stronghelp_initialise_source(struct objectdb *db, struct files_source *source)
+{
+	struct stronghelp_file file;
+
+	if (source == NULL) {
+		msg_report(MSG_NO_FILE);
+		return false;
+	}
+
+	file.root = NULL;
+	file.source = source;
+	file.length = source->length;
+	file.db = db;
+	file.visited = NULL;
+
+	return stronghelp_process_file(&file);
+}
+
+/* Pack the contents of a disc folder, as read into an object database
+ * by disc_initialise_folder(), into a StrongHelp file.
+ *
+ * The size of the manual is worked out first, so that it can be laid out
+ * in a single buffer in one pass over the database: each directory block
+ * is followed by the blocks of the objects that it contains, in the order
+ * of their entries. The contents of files are read straight into place,
+ * and the finished manual is then written out in one go.
+ *
+ * \param *db		Pointer to the object database holding the folder.
+ * \param *filename	Pointer to the name of the file to write.
+ * \param sync		True to flush the file to disc before returning.
+ * \return		True if successful, false on failure.
+ */
+
+bool stronghelp_pack_folder(struct objectdb *db, char *filename, bool sync)
 {
 	struct stronghelp_file_root *header;
 	struct stronghelp_file_dir_entry *root;
-	int32_t free_space = 0;
+	struct objectdb_object *dir;
+	struct stronghelp_pack pack;
+	size_t header_size;
+	bool success;
+
+	if (filename == NULL)
+		return false;
+
+	dir = objectdb_get_root(db);
+	if (dir == NULL) {
+		msg_report(MSG_MISSING_ROOT);
+		return false;
+	}
+
+	/* Work out how big the manual will be. */
+
+	header_size = sizeof(struct stronghelp_file_root) + stronghelp_get_entry_size("$");
+
+	pack.length = header_size;
+
+	if (!stronghelp_measure_directory(dir, &(pack.length)))
+		return false;
+
+	/* Lay out the manual in a zeroed buffer, so that any padding is clean. */
+
+	pack.buffer = calloc(pack.length, sizeof(int8_t));
+	if (pack.buffer == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	pack.next = header_size;
+	pack.directories = 0;
+	pack.files = 0;
+
+	header = (struct stronghelp_file_root *) pack.buffer;
+
+	header->help = STRONGHELP_FILE_WORD;
+	header->size = header_size;
+	header->version = STRONGHELP_PACK_VERSION;
+	header->free_offset = -1;
+
+	root = (struct stronghelp_file_dir_entry *) (pack.buffer + sizeof(struct stronghelp_file_root));
+	memcpy(root->filename, "$", 2);
+
+	success = stronghelp_pack_directory(&pack, dir, root);
+
+	if (success && pack.next != pack.length) {
+		msg_report(MSG_OFFSET_RANGE, (int) pack.next, 0, (int) pack.length);
+		success = false;
+	}
+
+	/* Write the manual out to disc. */
+
+	if (success) {
+		msg_report(MSG_PACK_SUMMARY, pack.directories, pack.files, (int) pack.length);
+		success = files_write_file(filename, (char *) pack.buffer, pack.length, STRONGHELP_FILETYPE, sync);
+	}
+
+	free(pack.buffer);
+
+	return success;
+}
+
+/* Update a StrongHelp file in place, so that its contents match those of
+ * the disc folder that it has been compared with.
+ *
+ * Only the data blocks of files which have changed, and the directory
+ * blocks whose entries have changed, are written. Space for new and
+ * larger blocks is taken from the free space list, using the smallest
+ * block which will fit, and released blocks are returned to the list
+ * and merged with their neighbours; the file is only extended when
+ * there is no free block big enough, and is cut back if it ends with
+ * free space.
+ *
+ * \param *db		Pointer to the object database holding the manual
+ *			and the folder, once objectdb_check_status() has
+ *			been used to compare them.
+ * \param *source	Pointer to the manual, opened for update.
+ * \param sync		True to flush the file to disc before returning.
+ * \return		True if successful, false on failure.
+ */
+
+bool stronghelp_update_source(struct objectdb *db, struct files_source *source, bool sync)
+{
+	struct stronghelp_file_root header;
+	struct stronghelp_file_dir_entry root;
+	struct objectdb_object *dir;
+	struct stronghelp_update update;
+	bool success, moved;
+
+	if (source == NULL) {
+		msg_report(MSG_NO_FILE);
+		return false;
+	}
+
+	dir = objectdb_get_root(db);
+	if (dir == NULL) {
+		msg_report(MSG_MISSING_ROOT);
+		return false;
+	}
+
+	update.file.root = NULL;
+	update.file.source = source;
+	update.file.length = source->length;
+	update.file.db = db;
+	update.file.visited = NULL;
+	update.free = NULL;
+	update.end_word = -1;
+	update.written = 0;
+
+	/* Read the header, the free space list and the root directory entry. */
+
+	if (stronghelp_get_block_address(&(update.file), 0, sizeof(struct stronghelp_file_root), &header) == NULL)
+		return false;
+
+	if (stronghelp_get_block_address(&(update.file), 16, sizeof(struct stronghelp_file_dir_entry), &root) == NULL) {
+		msg_report(MSG_MISSING_ROOT);
+		return false;
+	}
+
+	success = stronghelp_read_free_space(&update, header.free_offset) && stronghelp_find_end_word(&update);
+
+	/* Update the contents, including the root entry if its block moves. */
+
+	if (success)
+		success = stronghelp_update_directory(&update, dir, &root, 16);
+
+	/* Close up any gaps too small to be free blocks; each pass can leave
+	 * new ones further on, so keep going until nothing moves.
+	 */
+
+	moved = true;
+
+	while (success && moved)
+		success = stronghelp_close_gaps(&update, &moved);
+
+	/* Write the free space list back out, trimming the end of the file. */
 
-	stronghelp_file_root = file;
-	stronghelp_file_length = length;
+	if (success)
+		success = stronghelp_write_free_space(&update, header.free_offset);
+
+	stronghelp_free_space_list(&update);
+
+	if (success && sync && !files_sync_source(source))
+		success = false;
+
+	if (success)
+		msg_report(MSG_PATCH_SUMMARY, (int) update.written, update.file.length);
+
+	return success;
+}
+
+/* Validate the structure of a StrongHelp file, without extracting its
+ * contents.
+ *
+ * The free space list is followed first, and then the directory tree
+ * from the root, marking the words used by each block in a coverage
+ * bitmap as it is reached; only block headers and directory entries are
+ * read. A block which lands on words already marked overlaps another,
+ * and a free block which starts where an earlier one did means that the
+ * list has looped. Finally, a single pass over the bitmap finds any
+ * regions of the file which no block accounts for.
+ *
+ * \param *data		Pointer to the file in memory.
+ * \param length	The length of the file.
+ * \return		True if the file is valid; false if not, or on failure.
+ */
+
+bool stronghelp_validate_file(int8_t *data, size_t length)
+{
+	struct stronghelp_validate validate;
+	struct stronghelp_file_root *header;
+	struct stronghelp_file_dir_entry *root;
+	size_t words, header_size;
+	int32_t offset;
+
+	if (data == NULL) {
+		msg_report(MSG_NO_FILE);
+		return false;
+	}
+
+	if (length > STRONGHELP_PACK_MAX_LENGTH) {
+		msg_report(MSG_BAD_SIZE, (int) length);
+		return false;
+	}
+
+	if (length < sizeof(struct stronghelp_file_root) + sizeof(struct stronghelp_file_dir_entry)) {
+		msg_report(MSG_MISSING_ROOT);
+		return false;
+	}
+
+	header = (struct stronghelp_file_root *) data;
+
+	if (header->help != STRONGHELP_FILE_WORD) {
+		msg_report(MSG_BAD_FILE_MAGIC, header->help);
+		return false;
+	}
+
+	validate.root = data;
+	validate.length = length;
+	stack_initialise(&(validate.pending), sizeof(int32_t));
+	validate.directories = 0;
+	validate.files = 0;
+	validate.free_blocks = 0;
+	validate.problems = 0;
+
+	words = (length + 3) / 4;
+
+	validate.coverage = calloc((words + 31) / 32, sizeof(uint32_t));
+	validate.starts = calloc((words + 31) / 32, sizeof(uint32_t));
+
+	if (validate.coverage == NULL || validate.starts == NULL) {
+		free(validate.coverage);
+		free(validate.starts);
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	/* The header runs on to the end of the root entry's name. */
+
+	root = (struct stronghelp_file_dir_entry *) (data + sizeof(struct stronghelp_file_root));
+
+	offset = sizeof(struct stronghelp_file_root) + offsetof(struct stronghelp_file_dir_entry, filename);
+	while (offset < validate.length && data[offset] != '\0')
+		offset++;
+
+	if (offset >= validate.length) {
+		msg_report(MSG_VALIDATE_BAD_ENTRY, (int) sizeof(struct stronghelp_file_root));
+		validate.problems++;
+		header_size = length;
+	} else {
+		header_size = sizeof(struct stronghelp_file_root) + stronghelp_get_entry_size(root->filename);
+		if (header->size > header_size && header->size <= length)
+			header_size = header->size;
+	}
+
+	stronghelp_mark_block(&validate, 0, header_size, "HELP");
+
+	/* Check the free space, and then the directory tree. */
+
+	stronghelp_validate_free_space(&validate, header->free_offset);
+
+	if (offset < validate.length)
+		stronghelp_validate_directory(&validate, root->object_offset);
+
+	while (stack_pop(&(validate.pending), &offset))
+		stronghelp_validate_directory(&validate, offset);
+
+	stronghelp_report_gaps(&validate);
+
+	free(validate.coverage);
+	free(validate.starts);
+	stack_free(&(validate.pending));
+
+	msg_report(MSG_VALIDATE_SUMMARY, validate.directories, validate.files, validate.free_blocks, validate.problems);
+
+	return (validate.problems == 0) ? true : false;
+}
+
+/**
+ * Process a StrongHelp file, validating its header and free space and
+ * then adding its contents to the object database.
+ *
+ * Directory blocks from a streamed file are read into memory while their
+ * entries are processed, and released once done; only the offsets of the
+ * files within it are kept in the database, and their contents are left
+ * to be hashed if and when the hashes are needed.
+ *
+ * Subdirectories are not processed as they are found, but pushed on to a
+ * stack of pending blocks which is worked through until it is empty, so
+ * the depth of the tree is limited by the heap and not the C stack. The
+ * start of each free block and directory block is marked in a bitmap as
+ * it is read, so that loops in the file can be spotted. A directory block
+ * which is reached from more than one entry is rejected in the same way,
+ * as a chain of shared blocks could otherwise be visited very many times.
+ *
+ * \param *file		Pointer to the file to process.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_process_file(struct stronghelp_file *file)
+{
+	struct stronghelp_file_root header_block, *header;
+	struct stronghelp_file_dir_entry *root;
+	struct stronghelp_pending next;
+	struct stack pending;
+	int8_t *block = NULL;
+	int32_t free_space = 0;
+	size_t words;
+	bool success;
 
 	/* Validate the file header. */
 
-	header = stronghelp_get_block_address(0, sizeof(struct stronghelp_file_root));
+	header = stronghelp_get_block_address(file, 0, sizeof(struct stronghelp_file_root), &header_block);
+	if (header == NULL)
+		return false;
 
 	msg_report(MSG_STRONG_HEADER_MAGIC_WORD, header->help);
 	msg_report(MSG_STRONG_VERSION, header->version);
@@ -164,44 +667,118 @@ bool stronghelp_initialise_file(int8_t *file, size_t length)
 		return false;
 	}	
 
-	/* Validate the free space list. */
+	/* Blocks are at least three words long, so one bit per word is
+	 * enough to tell them apart.
+	 */
+
+	words = (file->length / 4 + 32) / 32;
+
+	file->visited = calloc(words, sizeof(uint32_t));
+	if (file->visited == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
 
-	free_space = stronghelp_walk_free_space(header->free_offset);
+	/* Validate the free space list, and then forget the blocks that it
+	 * visited, so that they don't clash with the directories.
+	 */
+
+	free_space = stronghelp_walk_free_space(file, header->free_offset);
 
 	msg_report(MSG_STRONG_FREE_TOTAL_SIZE, free_space);
 
-	/* Validate the directory entries. */
+	memset(file->visited, 0, words * sizeof(uint32_t));
+
+	/* Validate the directory entries; a streamed file needs the root entry
+	 * to be read in, along with enough of what follows to hold its name.
+	 */
 
-	root = stronghelp_get_block_address(16, sizeof(struct stronghelp_file_dir_entry));
+	if (file->root == NULL) {
+		block = stronghelp_load_block(file, 16, STRONGHELP_ROOT_BLOCK_SIZE);
+		if (block == NULL) {
+			free(file->visited);
+			file->visited = NULL;
+			msg_report(MSG_MISSING_ROOT);
+			return false;
+		}
+	}
+
+	root = stronghelp_get_entry_address(file, block, 16, 16);
 	if (root == NULL) {
+		free(block);
+		free(file->visited);
+		file->visited = NULL;
 		msg_report(MSG_MISSING_ROOT);
 		return false;
 	}
 
-	return stronghelp_process_object(root, NULL);
+	stack_initialise(&pending, sizeof(struct stronghelp_pending));
+
+	success = stronghelp_process_object(file, root, NULL, &pending);
+
+	free(block);
+
+	/* Work through the directories found, until there are none left. */
+
+	while (success && stack_pop(&pending, &next))
+		success = stronghelp_process_directory_entries(file, next.offset, next.length, next.object, &pending);
+
+	stack_free(&pending);
+
+	free(file->visited);
+	file->visited = NULL;
+
+	return success;
 }
 
 /**
- * Process an object.
+ * Process an object. Files are added to the database straight away, while
+ * the entries of directories are pushed on to the stack of pending blocks
+ * to be processed later.
  *
+ * \param *file		Pointer to the file being processed.
  * \param *entry	Pointer to the directory entry for the object.
  * \param *parent	Pointer to the Object DB entry for the parent, or NULL.
+ * \param *pending	Pointer to the stack of pending directory blocks.
  * \return		True if successful, false on failure.
  */
 
-static bool stronghelp_process_object(struct stronghelp_file_dir_entry *entry, struct objectdb_object *parent)
+static bool stronghelp_process_object(struct stronghelp_file *file, struct stronghelp_file_dir_entry *entry, struct objectdb_object *parent, struct stack *pending)
 {
-	struct stronghelp_file_data_block *data;
-	struct stronghelp_file_dir_block *dir;
+	struct stronghelp_pending next;
+	struct stronghelp_file_data_block data_block, *data;
+	struct stronghelp_file_dir_block dir_block, *dir;
 	struct objectdb_object *object = NULL;
-	uint32_t filetype;
+	uint32_t filetype, hash = HASH_CRC32C_INITIAL;
+	char *name, *contents = NULL;
 
 	if (entry == NULL)
 		return false;
 
-	/* Start by assuming that the object is a file, since that has a smaller header. */
+	/* The directory blocks of a streamed file are released once they have
+	 * been processed, so the name must be copied.
+	 */
+
+	if (file->root != NULL)
+		name = entry->filename;
+	else
+		name = arena_strdup(objectdb_get_arena(file->db), entry->filename);
+
+	if (name == NULL)
+		return false;
+
+	/* Start by assuming that the object is a file, since that has a smaller
+	 * header. Anything left out by the filters is skipped without its data
+	 * being looked at, and directories without being descended into. All
+	 * blocks start on a word boundary, which the visited bitmap relies on.
+	 */
+
+	if ((entry->object_offset & 3) != 0) {
+		msg_report(MSG_BAD_OFFSET, entry->object_offset);
+		return false;
+	}
 
-	data = stronghelp_get_block_address(entry->object_offset, sizeof(struct stronghelp_file_data_block));
+	data = stronghelp_get_block_address(file, entry->object_offset, sizeof(struct stronghelp_file_data_block), &data_block);
 	if (data == NULL)
 		return false;
 
@@ -210,8 +787,11 @@ static bool stronghelp_process_object(struct stronghelp_file_dir_entry *entry, s
 	if (entry->object_offset == 0 && data->data == STRONGHELP_FILE_WORD) {
 		/* A special case, as some empty files have an offset of zero and no data.
 		 * We point the data pointer to the start of the file in memory, as it won't
-		 * be read from due to its zero length.
+		 * be read from due to its zero length; a streamed file is left at offset 0.
 		 */
+		if (!objectdb_filter_object(file->db, parent, name, false))
+			return true;
+
 		filetype = (entry->load_address >> 8) & 0xfff;
 
 		if (entry->size == 0)
@@ -222,10 +802,16 @@ static bool stronghelp_process_object(struct stronghelp_file_dir_entry *entry, s
 		if (entry->flags & STRONGHELP_ATTRIBUTE_DIRECTORY)
 			msg_report(MSG_STRONG_BAD_FILE_ATTRIBUTE, entry->filename, entry->flags);
 
-		object = objectdb_add_stronghelp_file(parent, entry->filename, 0, filetype, (char *) data);
+		if (file->root != NULL)
+			contents = (char *) data;
+
+		object = objectdb_add_stronghelp_file(file->db, parent, name, 0, filetype, contents, 0, &hash);
 		if (object == NULL)
 			return false;
 	} else if (data->data == STRONGHELP_DATA_WORD) {
+		if (!objectdb_filter_object(file->db, parent, name, false))
+			return true;
+
 		filetype = (entry->load_address >> 8) & 0xfff;
 
 		if (entry->size == data->size)
@@ -236,23 +822,58 @@ static bool stronghelp_process_object(struct stronghelp_file_dir_entry *entry, s
 		if (entry->flags & STRONGHELP_ATTRIBUTE_DIRECTORY)
 			msg_report(MSG_STRONG_BAD_FILE_ATTRIBUTE, entry->filename, entry->flags);
 
-		object = objectdb_add_stronghelp_file(parent, entry->filename, entry->size - 8, filetype, (char *) (data + 1));
+		/* The data will be read later on, so it must all be within the file. */
+
+		if (entry->size < (int32_t) sizeof(struct stronghelp_file_data_block) || entry->size > file->length - entry->object_offset) {
+			msg_report(MSG_OFFSET_RANGE, entry->object_offset, entry->size, file->length);
+			return false;
+		}
+
+		/* Data in memory is cheap to hash straight away, but hashing a
+		 * streamed file would mean reading all of it; that is left until
+		 * a hash is actually needed.
+		 */
+
+		if (file->root != NULL) {
+			contents = (char *) (data + 1);
+			hash = hash_crc32c(HASH_CRC32C_INITIAL, contents, entry->size - 8);
+		}
+
+		object = objectdb_add_stronghelp_file(file->db, parent, name, entry->size - 8, filetype, contents,
+				entry->object_offset + sizeof(struct stronghelp_file_data_block), (file->root != NULL) ? &hash : NULL);
 		if (object == NULL)
 			return false;
 	} else if (data->data == STRONGHELP_DIR_WORD) {
-		object = objectdb_add_stronghelp_directory(parent, entry->filename);
+		if (!objectdb_filter_object(file->db, parent, name, true))
+			return true;
+
+		object = objectdb_add_stronghelp_directory(file->db, parent, name);
 		if (object == NULL)
 			return false;
 
-		dir = (struct stronghelp_file_dir_block *) data;
+		dir = stronghelp_get_block_address(file, entry->object_offset, sizeof(struct stronghelp_file_dir_block), &dir_block);
+		if (dir == NULL)
+			return false;
 
 		msg_report(MSG_STRONG_DIRECTORY, entry->filename, entry->size, dir->size, dir->used);
 
 		if (!(entry->flags & STRONGHELP_ATTRIBUTE_DIRECTORY))
 			msg_report(MSG_STRONG_BAD_DIR_ATTRIBUTE, entry->filename, entry->flags);
 
-		if (!stronghelp_process_directory_entries(entry->object_offset + sizeof(struct stronghelp_file_dir_block),
-				dir->used - sizeof(struct stronghelp_file_dir_block), object))
+		/* A directory which has been seen before is either shared with
+		 * another entry, or contains itself; neither is allowed.
+		 */
+
+		if (!stronghelp_mark_visited(file, entry->object_offset)) {
+			msg_report(MSG_DIRECTORY_SHARED, entry->filename, entry->object_offset);
+			return false;
+		}
+
+		next.offset = entry->object_offset + sizeof(struct stronghelp_file_dir_block);
+		next.length = dir->used - sizeof(struct stronghelp_file_dir_block);
+		next.object = object;
+
+		if (!stack_push(pending, &next))
 			return false;
 	} else {
 		msg_report(MSG_BAD_OBJECT_MAGIC, data->data);
@@ -263,19 +884,25 @@ static bool stronghelp_process_object(struct stronghelp_file_dir_entry *entry, s
 }
 
 /**
- * Process a block of directory entries, recursing down into any
- * subdirectories.
+ * Process a block of directory entries, pushing any subdirectories on to
+ * the stack of pending blocks. These are left so that they will be taken
+ * off in the order in which their entries appear.
  *
+ * \param *file		Pointer to the file being processed.
  * \param offset	The file offset of the first entry.
  * \param length	The length of the data in the block.
  * \param *object	Pointer to the Object DB entry for the directory.
+ * \param *pending	Pointer to the stack of pending directory blocks.
  * \return		True if successful, false on failure.
  */
 
-static bool stronghelp_process_directory_entries(int32_t offset, size_t length, struct objectdb_object *object)
+static bool stronghelp_process_directory_entries(struct stronghelp_file *file, int32_t offset, size_t length, struct objectdb_object *object, struct stack *pending)
 {
 	struct stronghelp_file_dir_entry *entry;
-	int32_t end;
+	int8_t *block = NULL;
+	int32_t start, end;
+	size_t depth;
+	bool success = true;
 
 	/* Validate the offset and length. */
 
@@ -293,77 +920,142 @@ static bool stronghelp_process_directory_entries(int32_t offset, size_t length,
 
 	end = offset + length;
 
-	if (end >= stronghelp_file_length) {
-		msg_report(MSG_OFFSET_RANGE, offset, length, stronghelp_file_length);
+	if (end > file->length) {
+		msg_report(MSG_OFFSET_RANGE, offset, length, file->length);
 		return false;
 	}
 
+	/* A streamed file needs the block of entries to be read in. */
+
+	start = offset;
+
+	if (file->root == NULL && end > start) {
+		block = stronghelp_load_block(file, start, end - start);
+		if (block == NULL)
+			return false;
+	}
+
 	/* Process the entries. */
 
-	while (offset < end) {
-		entry = stronghelp_get_block_address(offset, sizeof(struct stronghelp_file_dir_entry));
+	depth = stack_count(pending);
+
+	while (success && offset < end) {
+		entry = stronghelp_get_entry_address(file, block, start, offset);
 		if (entry == NULL) {
 			msg_report(MSG_BAD_DIR_ENTRY);
-			return false;
-		}
+			success = false;
+		} else if (!stronghelp_process_object(file, entry, object, pending)) {
+			success = false;
+		} else {
+			/* The struct is padded to 4 bytes, so there's no need to add 3 to this. */
 
-		if (!stronghelp_process_object(entry, object))
-			return false;
+			offset += ((int) (sizeof(struct stronghelp_file_dir_entry) + strlen(entry->filename))) & ~3;
+		}
+	}
 
-		/* The struct is padded to 4 bytes, so there's no need to add 3 to this. */
+	stack_reverse(pending, depth);
 
-		offset += ((int) (sizeof(struct stronghelp_file_dir_entry) + strlen(entry->filename))) & ~3;
-	}
+	free(block);
 
-	return true;
+	return success;
 }
 
 /**
  * Walk through the free space in the file, adding up the size of the
- * blocks on the way.
+ * blocks on the way. The walk stops at the first block which has been
+ * visited before, since the list would otherwise loop forever.
  *
+ * \param *file		Pointer to the file being processed.
  * \param *offset	Offset to the free space block to process.
  * \return		The amount of free space in the block and
  *			any blocks that are linked from it.
  */
-static int32_t stronghelp_walk_free_space(int32_t offset)
+static int32_t stronghelp_walk_free_space(struct stronghelp_file *file, int32_t offset)
 {
-	struct stronghelp_file_free_block *free;
+	struct stronghelp_file_free_block free_block, *free;
+	int32_t total = 0;
 
-	/* Exit if the pointer is -1. */
+	/* The list ends with a pointer of -1. */
 
-	if (offset < 0)
-		return 0;
+	while (offset >= 0) {
+		/* Extract details of the block. */
 
-	/* Extract details of the block. */
+		if ((offset & 3) != 0) {
+			msg_report(MSG_BAD_OFFSET, offset);
+			break;
+		}
 
-	free = stronghelp_get_block_address(offset, sizeof(struct stronghelp_file_free_block));
-	if (free == NULL)
-		return 0;
+		free = stronghelp_get_block_address(file, offset, sizeof(struct stronghelp_file_free_block), &free_block);
+		if (free == NULL)
+			break;
+
+		if (!stronghelp_mark_visited(file, offset)) {
+			msg_report(MSG_FREE_SPACE_LOOP, offset);
+			break;
+		}
 
-	msg_report(MSG_STRONG_FREE_MAGIC_WORD, free->free);
-	msg_report(MSG_STRONG_FREE_SIZE, free->free_size);
-	msg_report(MSG_STRONG_FREE_NEXT_OFFSET, free->next_offset);
+		msg_report(MSG_STRONG_FREE_MAGIC_WORD, free->free);
+		msg_report(MSG_STRONG_FREE_SIZE, free->free_size);
+		msg_report(MSG_STRONG_FREE_NEXT_OFFSET, free->next_offset);
 
-	if (free->free != STRONGHELP_FREE_WORD) {
-		msg_report(MSG_BAD_FREE_MAGIC, free->free);
-		return 0;
+		if (free->free != STRONGHELP_FREE_WORD) {
+			msg_report(MSG_BAD_FREE_MAGIC, free->free);
+			break;
+		}
+
+		total += free->free_size;
+		offset = free->next_offset;
 	}
 
-	return stronghelp_walk_free_space(free->next_offset) + free->free_size;
+	return total;
+}
+
+/**
+ * Mark the start of a block as having been visited while processing a
+ * file, so that loops in the file's structure can be spotted.
+ *
+ * \param *file		Pointer to the file being processed.
+ * \param offset	The offset of the block, which must be in the file
+ *			and on a word boundary.
+ * \return		True if the block was marked; false if it had
+ *			already been visited.
+ */
+
+static bool stronghelp_mark_visited(struct stronghelp_file *file, int32_t offset)
+{
+	uint32_t bit;
+	size_t word;
+
+	if (file->visited == NULL)
+		return true;
+
+	word = (offset / 4) / 32;
+	bit = 1u << ((offset / 4) & 31);
+
+	if (file->visited[word] & bit)
+		return false;
+
+	file->visited[word] |= bit;
+
+	return true;
 }
 
 /**
- * Return an address for an offset in the current file.
+ * Return an address for an offset in a file. If the file is in memory,
+ * this is the address of the block within it; otherwise, the block is
+ * read into the buffer supplied.
  *
+ * \param *file		Pointer to the file being processed.
  * \param offset	The offset value to translate.
  * \param min_size	The minimum size of the block.
+ * \param *buffer	Pointer to a buffer of at least min_size bytes to
+ *			read the block into, if the file is streamed.
  * \return		Pointer to the block, or NULL on failure.
  */
 
-static void *stronghelp_get_block_address(int32_t offset, size_t min_size)
+static void *stronghelp_get_block_address(struct stronghelp_file *file, int32_t offset, size_t min_size, void *buffer)
 {
-	if (stronghelp_file_root == NULL) {
+	if (file == NULL || (file->root == NULL && (file->source == NULL || buffer == NULL))) {
 		msg_report(MSG_NO_FILE);
 		return NULL;
 	}
@@ -378,10 +1070,2001 @@ static void *stronghelp_get_block_address(int32_t offset, size_t min_size)
 		return NULL;
 	}
 
-	if (offset + min_size >= stronghelp_file_length) {
-		msg_report(MSG_OFFSET_RANGE, offset, min_size, stronghelp_file_length);
+	if (offset + min_size > file->length) {
+		msg_report(MSG_OFFSET_RANGE, offset, min_size, file->length);
+		return NULL;
+	}
+
+	if (file->root == NULL)
+		return files_read_source(file->source, offset, buffer, min_size) ? buffer : NULL;
+
+	return file->root + offset;
+}
+
+/**
+ * Return the address of a directory entry in a file. If the file is in
+ * memory, this is the address of the entry within it; otherwise, it is
+ * the address within a block previously read using stronghelp_load_block().
+ *
+ * \param *file		Pointer to the file being processed.
+ * \param *block	Pointer to the block holding the entry, or NULL if
+ *			the file is in memory.
+ * \param start		The offset of the block within the file.
+ * \param offset	The offset of the entry within the file.
+ * \return		Pointer to the entry, or NULL on failure.
+ */
+
+static struct stronghelp_file_dir_entry *stronghelp_get_entry_address(struct stronghelp_file *file, int8_t *block, int32_t start, int32_t offset)
+{
+	if (block == NULL)
+		return stronghelp_get_block_address(file, offset, sizeof(struct stronghelp_file_dir_entry), NULL);
+
+	if (offset < start) {
+		msg_report(MSG_BAD_OFFSET, offset);
+		return NULL;
+	}
+
+	if (offset + sizeof(struct stronghelp_file_dir_entry) > file->length) {
+		msg_report(MSG_OFFSET_RANGE, offset, sizeof(struct stronghelp_file_dir_entry), file->length);
+		return NULL;
+	}
+
+	return (struct stronghelp_file_dir_entry *) (block + (offset - start));
+}
+
+/**
+ * Read a block of directory entries from a streamed file into memory. As
+ * with a file in memory, the last entry may extend beyond the end of the
+ * block, so a full entry's worth of extra data is read, and the buffer
+ * is padded with zeros so that any names will be terminated.
+ *
+ * The block is allocated using malloc(), and must be freed with free()
+ * after use.
+ *
+ * \param *file		Pointer to the file being processed.
+ * \param offset	The offset of the block within the file.
+ * \param length	The length of the block.
+ * \return		Pointer to the block, or NULL on failure.
+ */
+
+static int8_t *stronghelp_load_block(struct stronghelp_file *file, int32_t offset, int32_t length)
+{
+	int8_t *block;
+	size_t size, available;
+
+	if (offset < 0) {
+		msg_report(MSG_BAD_OFFSET, offset);
+		return NULL;
+	}
+
+	if (offset >= file->length) {
+		msg_report(MSG_OFFSET_RANGE, offset, length, file->length);
+		return NULL;
+	}
+
+	size = length + sizeof(struct stronghelp_file_dir_entry);
+
+	available = file->length - offset;
+	if (available > size)
+		available = size;
+
+	block = calloc(size + 1, sizeof(int8_t));
+	if (block == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return NULL;
+	}
+
+	if (!files_read_source(file->source, offset, block, available)) {
+		free(block);
 		return NULL;
 	}
 
-	return stronghelp_file_root + offset;
+	return block;
+}
+
+/**
+ * Add up the space that a directory will take in a packed manual,
+ * including the blocks for all of the objects within it.
+ *
+ * \param *dir		Pointer to the directory to measure.
+ * \param *length	Pointer to the length to add the space to.
+ * \return		True if successful, false if the manual is too big.
+ */
+
+static bool stronghelp_measure_directory(struct objectdb_object *dir, size_t *length)
+{
+	struct stack pending;
+	bool success;
+
+	stack_initialise(&pending, sizeof(struct objectdb_object *));
+
+	success = stack_push(&pending, &dir);
+
+	while (success && stack_pop(&pending, &dir))
+		success = stronghelp_measure_directory_entries(dir, length, &pending);
+
+	stack_free(&pending);
+
+	return success;
+}
+
+/**
+ * Add up the space that a directory block and its files will take in a
+ * packed manual, pushing any subdirectories on to the stack of pending
+ * directories to be measured in turn.
+ *
+ * \param *dir		Pointer to the directory to measure.
+ * \param *length	Pointer to the length to add the space to.
+ * \param *pending	Pointer to the stack of pending directories.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_measure_directory_entries(struct objectdb_object *dir, size_t *length, struct stack *pending)
+{
+	struct objectdb_object *object;
+	size_t size;
+
+	if (!stronghelp_add_length(length, sizeof(struct stronghelp_file_dir_block)))
+		return false;
+
+	for (object = objectdb_get_first_file(dir); object != NULL; object = objectdb_get_next_object(object)) {
+		if (!objectdb_get_disc_details(object, &size, NULL))
+			continue;
+
+		if (!stronghelp_add_length(length, stronghelp_get_entry_size(objectdb_get_name(object))))
+			return false;
+
+		/* Empty files don't need a data block. */
+
+		if (size == 0)
+			continue;
+
+		if (size > STRONGHELP_PACK_MAX_LENGTH) {
+			msg_report(MSG_PACK_TOO_LARGE);
+			return false;
+		}
+
+		if (!stronghelp_add_length(length, (sizeof(struct stronghelp_file_data_block) + size + 3) & ~3))
+			return false;
+	}
+
+	for (object = objectdb_get_first_directory(dir); object != NULL; object = objectdb_get_next_object(object)) {
+		if (!objectdb_get_disc_details(object, NULL, NULL))
+			continue;
+
+		if (!stronghelp_add_length(length, stronghelp_get_entry_size(objectdb_get_name(object))))
+			return false;
+
+		if (!stack_push(pending, &object))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Lay out a directory in a packed manual, followed by the objects within
+ * it, filling in its directory entry in the parent. Each block follows
+ * the one before it in the order of a depth-first walk of the tree.
+ *
+ * \param *pack		Pointer to the manual being packed.
+ * \param *dir		Pointer to the directory to lay out.
+ * \param *entry	Pointer to the directory's entry in its parent.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_pack_directory(struct stronghelp_pack *pack, struct objectdb_object *dir, struct stronghelp_file_dir_entry *entry)
+{
+	struct stronghelp_pack_pending next;
+	struct stack pending;
+	bool success;
+
+	stack_initialise(&pending, sizeof(struct stronghelp_pack_pending));
+
+	next.object = dir;
+	next.entry = entry;
+	next.is_dir = true;
+
+	success = stack_push(&pending, &next);
+
+	while (success && stack_pop(&pending, &next)) {
+		if (next.is_dir)
+			success = stronghelp_pack_directory_block(pack, next.object, next.entry, &pending);
+		else
+			success = stronghelp_pack_file(pack, next.object, next.entry);
+	}
+
+	stack_free(&pending);
+
+	return success;
+}
+
+/**
+ * Lay out a directory block in a packed manual, filling in its directory
+ * entry in the parent and the names of its own entries. The objects are
+ * pushed on to the stack of pending objects, so that they will be taken
+ * off in the order in which their entries appear.
+ *
+ * \param *pack		Pointer to the manual being packed.
+ * \param *dir		Pointer to the directory to lay out.
+ * \param *entry	Pointer to the directory's entry in its parent.
+ * \param *pending	Pointer to the stack of pending objects.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_pack_directory_block(struct stronghelp_pack *pack, struct objectdb_object *dir, struct stronghelp_file_dir_entry *entry, struct stack *pending)
+{
+	struct stronghelp_file_dir_block *block;
+	struct stronghelp_pack_pending item;
+	struct objectdb_object *file, *child, *object;
+	size_t offset, size, next, depth;
+	bool success = true;
+	char *name;
+
+	/* Work out the size of the directory block. */
+
+	size = sizeof(struct stronghelp_file_dir_block);
+
+	for (object = objectdb_get_first_file(dir); object != NULL; object = objectdb_get_next_object(object)) {
+		if (objectdb_get_disc_details(object, NULL, NULL))
+			size += stronghelp_get_entry_size(objectdb_get_name(object));
+	}
+
+	for (object = objectdb_get_first_directory(dir); object != NULL; object = objectdb_get_next_object(object)) {
+		if (objectdb_get_disc_details(object, NULL, NULL))
+			size += stronghelp_get_entry_size(objectdb_get_name(object));
+	}
+
+	offset = pack->next;
+	pack->next += size;
+
+	block = (struct stronghelp_file_dir_block *) (pack->buffer + offset);
+
+	block->dir = STRONGHELP_DIR_WORD;
+	block->size = size;
+	block->used = size;
+
+	stronghelp_set_entry(entry, offset, OBJECTDB_TYPE_DIRECTORY, size, STRONGHELP_PACK_ATTRIBUTES | STRONGHELP_ATTRIBUTE_DIRECTORY);
+
+	pack->directories++;
+
+	/* Queue the objects, merging the sorted lists of files and
+	 * subdirectories so that the entries are in alphabetical order.
+	 */
+
+	next = offset + sizeof(struct stronghelp_file_dir_block);
+	depth = stack_count(pending);
+
+	file = objectdb_get_first_file(dir);
+	child = objectdb_get_first_directory(dir);
+
+	while (success && (file != NULL || child != NULL)) {
+		item.is_dir = (file == NULL || (child != NULL && strcmp(objectdb_get_name(child), objectdb_get_name(file)) < 0));
+
+		if (item.is_dir) {
+			object = child;
+			child = objectdb_get_next_object(child);
+		} else {
+			object = file;
+			file = objectdb_get_next_object(file);
+		}
+
+		if (!objectdb_get_disc_details(object, NULL, NULL))
+			continue;
+
+		name = objectdb_get_name(object);
+
+		/* The name runs on past the end of the entry structure. */
+
+		item.object = object;
+		item.entry = (struct stronghelp_file_dir_entry *) (pack->buffer + next);
+		memcpy(pack->buffer + next + offsetof(struct stronghelp_file_dir_entry, filename), name, strlen(name) + 1);
+		next += stronghelp_get_entry_size(name);
+
+		success = stack_push(pending, &item);
+	}
+
+	stack_reverse(pending, depth);
+
+	return success;
+}
+
+/**
+ * Lay out a file in a packed manual, reading its contents from disc
+ * into the data block and filling in its directory entry in the parent.
+ *
+ * \param *pack		Pointer to the manual being packed.
+ * \param *object	Pointer to the file to lay out.
+ * \param *entry	Pointer to the file's entry in its parent.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_pack_file(struct stronghelp_pack *pack, struct objectdb_object *object, struct stronghelp_file_dir_entry *entry)
+{
+	struct stronghelp_file_data_block *data;
+	struct files_source source;
+	uint32_t filetype;
+	size_t offset, size;
+	bool success;
+	char *path;
+
+	if (!objectdb_get_disc_details(object, &size, &filetype))
+		return false;
+
+	pack->files++;
+
+	/* Empty files have no data block, and an offset of zero. */
+
+	if (size == 0) {
+		stronghelp_set_entry(entry, 0, filetype, 0, STRONGHELP_PACK_ATTRIBUTES);
+		return true;
+	}
+
+	offset = pack->next;
+	pack->next += (sizeof(struct stronghelp_file_data_block) + size + 3) & ~3;
+
+	data = (struct stronghelp_file_data_block *) (pack->buffer + offset);
+
+	data->data = STRONGHELP_DATA_WORD;
+	data->size = sizeof(struct stronghelp_file_data_block) + size;
+
+	stronghelp_set_entry(entry, offset, filetype, data->size, STRONGHELP_PACK_ATTRIBUTES);
+
+	/* Read the contents of the file into place. */
+
+	path = objectdb_get_path(object, OBJECTDB_PATH_TYPE_DISC);
+	if (path == NULL)
+		return false;
+
+	success = files_open_source(path, &source);
+
+	if (success) {
+		if (source.length != size) {
+			msg_report(MSG_PACK_FILE_CHANGED, path);
+			success = false;
+		} else {
+			success = files_read_source(&source, 0, data + 1, size);
+		}
+
+		files_close_source(&source);
+	}
+
+	free(path);
+
+	return success;
+}
+
+/**
+ * Fill in a directory entry in a packed manual.
+ *
+ * \param *entry	Pointer to the entry to fill in.
+ * \param offset	The offset of the object's block.
+ * \param filetype	The filetype of the object.
+ * \param size		The size of the object's block.
+ * \param flags		The object's attributes.
+ */
+
+static void stronghelp_set_entry(struct stronghelp_file_dir_entry *entry, size_t offset, uint32_t filetype, size_t size, int32_t flags)
+{
+	entry->object_offset = offset;
+	entry->load_address = (filetype == OBJECTDB_TYPE_DIRECTORY) ? 0 : 0xfff00000 | ((filetype & 0xfff) << 8);
+	entry->exec_address = 0;
+	entry->size = size;
+	entry->flags = flags;
+	entry->reserved = 0;
+}
+
+/**
+ * Return the space taken by a directory entry, including its name
+ * and the terminator, padded to a word boundary.
+ *
+ * \param *name		Pointer to the name of the object.
+ * \return		The size of the entry, in bytes.
+ */
+
+static size_t stronghelp_get_entry_size(char *name)
+{
+	return (sizeof(struct stronghelp_file_dir_entry) + strlen(name)) & ~3;
+}
+
+/**
+ * Add some space to the length of a packed manual, checking that the
+ * manual doesn't become too large to address.
+ *
+ * \param *length	Pointer to the length to update.
+ * \param size		The space to add, in bytes.
+ * \return		True if successful, false if the manual is too big.
+ */
+
+static bool stronghelp_add_length(size_t *length, size_t size)
+{
+	if (size > STRONGHELP_PACK_MAX_LENGTH - *length) {
+		msg_report(MSG_PACK_TOO_LARGE);
+		return false;
+	}
+
+	*length += size;
+
+	return true;
+}
+
+/**
+ * Update a directory in a manual, and the objects within it, to match
+ * the disc folder. Each directory block is rewritten in place if its new
+ * entries will fit, and moved to a new block if not; its subdirectories
+ * are then dealt with in turn, once the block has found its final home.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param *dir		Pointer to the directory to update.
+ * \param *entry	Pointer to the directory's entry in its parent.
+ * \param position	The file offset of the directory's entry, which will
+ *			be rewritten if the block moves.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_update_directory(struct stronghelp_update *update, struct objectdb_object *dir, struct stronghelp_file_dir_entry *entry, int32_t position)
+{
+	struct stronghelp_update_pending next;
+	struct stack pending;
+	bool success;
+
+	stack_initialise(&pending, sizeof(struct stronghelp_update_pending));
+
+	next.dir = dir;
+	next.entry = *entry;
+	next.position = position;
+
+	success = stack_push(&pending, &next);
+
+	/* New directories are queued with no entry position, since their
+	 * entries were filled in when their blocks were claimed.
+	 */
+
+	while (success && stack_pop(&pending, &next)) {
+		if (next.position < 0)
+			success = stronghelp_add_directory(update, &next, &pending);
+		else
+			success = stronghelp_update_directory_block(update, &next, &pending);
+	}
+
+	stack_free(&pending);
+
+	return success;
+}
+
+/**
+ * Update a directory block in a manual, and the files within it, to match
+ * the disc folder. The block is rewritten in place if its new entries will
+ * fit, and moved to a new block if not, in which case the directory's entry
+ * in its parent is rewritten. Its subdirectories are then pushed on to the
+ * stack of pending directories, to be updated in turn.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param *item		Pointer to the directory to update.
+ * \param *pending	Pointer to the stack of pending directories.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_update_directory_block(struct stronghelp_update *update, struct stronghelp_update_pending *item, struct stack *pending)
+{
+	struct stronghelp_file_dir_block header, *block_header;
+	struct stronghelp_file_dir_entry *entry, *old_entry, *new_entry;
+	struct stronghelp_update_pending next;
+	struct objectdb_object *object;
+	int8_t *old_block, *new_block;
+	int32_t position, length, existing, size, first, last, compare, offset, allocated;
+	size_t depth;
+	bool success = true, is_dir;
+
+	entry = &(item->entry);
+
+	old_block = stronghelp_load_directory(update, entry, &header);
+	if (old_block == NULL)
+		return false;
+
+	/* The new block can hold at most the old entries and the new ones. */
+
+	new_block = calloc(header.used + stronghelp_get_child_entries_size(item->dir, false) + sizeof(struct stronghelp_file_dir_entry), sizeof(int8_t));
+	if (new_block == NULL) {
+		free(old_block);
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	memcpy(new_block, old_block, sizeof(struct stronghelp_file_dir_block));
+	length = sizeof(struct stronghelp_file_dir_block);
+
+	depth = stack_count(pending);
+
+	/* Update the existing entries, in their original order, dropping any
+	 * whose objects are no longer on disc. Subdirectories are left until
+	 * the block's location is known.
+	 */
+
+	for (position = sizeof(struct stronghelp_file_dir_block); success && position < header.used; position += size) {
+		old_entry = (struct stronghelp_file_dir_entry *) (old_block + position);
+		size = stronghelp_get_entry_size(old_entry->filename);
+
+		object = stronghelp_find_object(item->dir, old_entry, &is_dir);
+
+		if (object != NULL && !objectdb_get_disc_details(object, NULL, NULL)) {
+			if (is_dir)
+				success = stronghelp_release_directory(update, object, old_entry);
+			else
+				success = stronghelp_release_file(update, object, old_entry);
+
+			continue;
+		}
+
+		new_entry = (struct stronghelp_file_dir_entry *) (new_block + length);
+		memcpy(new_entry, old_entry, size);
+		length += size;
+
+		if (object != NULL && !is_dir)
+			success = stronghelp_update_file(update, object, new_entry);
+	}
+
+	existing = length;
+
+	/* Add entries for any new objects on to the end. */
+
+	if (success)
+		success = stronghelp_add_entries(update, item->dir, new_block, &length, false, pending);
+
+	/* Write the block back, either in place or in a new location. */
+
+	block_header = (struct stronghelp_file_dir_block *) new_block;
+
+	if (success && length <= header.size) {
+		block_header->used = length;
+
+		/* Only write the part of the block which has changed; anything
+		 * beyond the old entries has changed by definition.
+		 */
+
+		compare = (length < header.used) ? length : header.used;
+
+		for (first = 0; first < compare && new_block[first] == old_block[first]; first++);
+
+		if (length > compare)
+			last = length;
+		else
+			for (last = length; last > first && new_block[last - 1] == old_block[last - 1]; last--);
+
+		if (last > first)
+			success = stronghelp_write_bytes(update, entry->object_offset + first, new_block + first, last - first);
+	} else if (success) {
+		offset = stronghelp_allocate_space(update, length, &allocated);
+
+		if (offset < 0) {
+			success = false;
+		} else {
+			block_header->size = allocated;
+			block_header->used = length;
+
+			success = stronghelp_write_bytes(update, offset, new_block, length) &&
+					stronghelp_release_space(update, entry->object_offset, header.size);
+
+			entry->object_offset = offset;
+			entry->size = allocated;
+
+			if (success)
+				success = stronghelp_write_bytes(update, item->position, entry, offsetof(struct stronghelp_file_dir_entry, filename));
+		}
+	}
+
+	/* Queue the existing subdirectories, now that their entries are in
+	 * their final positions.
+	 */
+
+	for (position = sizeof(struct stronghelp_file_dir_block); success && position < existing; position += size) {
+		new_entry = (struct stronghelp_file_dir_entry *) (new_block + position);
+		size = stronghelp_get_entry_size(new_entry->filename);
+
+		object = stronghelp_find_object(item->dir, new_entry, &is_dir);
+		if (object == NULL || !is_dir)
+			continue;
+
+		next.dir = object;
+		next.entry = *new_entry;
+		next.position = entry->object_offset + position;
+
+		success = stack_push(pending, &next);
+	}
+
+	stack_reverse(pending, depth);
+
+	free(new_block);
+	free(old_block);
+
+	return success;
+}
+
+/**
+ * Update a file in a manual to match the disc folder, changing its type
+ * or rewriting its contents as required.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param *object	Pointer to the file to update.
+ * \param *entry	Pointer to the file's entry in its parent, which
+ *			will be updated to match.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_update_file(struct stronghelp_update *update, struct objectdb_object *object, struct stronghelp_file_dir_entry *entry)
+{
+	uint32_t filetype;
+
+	if (!objectdb_get_disc_details(object, NULL, &filetype))
+		return false;
+
+	if (objectdb_get_contents_matched(object)) {
+		stronghelp_set_entry_type(entry, filetype);
+		return true;
+	}
+
+	return stronghelp_write_file(update, object, entry, (entry->object_offset != 0) ? (entry->size + 3) & ~3 : 0);
+}
+
+/**
+ * Claim a block for a new directory in a manual, filling in its entry in
+ * the parent, and push it on to the stack of pending directories so that
+ * its contents can be added in turn. Claiming the block first means that
+ * it comes ahead of its contents.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param *dir		Pointer to the directory to add.
+ * \param *entry	Pointer to the directory's entry in its parent,
+ *			which will be filled in.
+ * \param *pending	Pointer to the stack of pending directories.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_claim_directory(struct stronghelp_update *update, struct objectdb_object *dir, struct stronghelp_file_dir_entry *entry, struct stack *pending)
+{
+	struct stronghelp_update_pending next;
+	int32_t size, offset, allocated;
+
+	size = sizeof(struct stronghelp_file_dir_block) + stronghelp_get_child_entries_size(dir, true);
+
+	offset = stronghelp_allocate_space(update, size, &allocated);
+	if (offset < 0)
+		return false;
+
+	stronghelp_set_entry(entry, offset, OBJECTDB_TYPE_DIRECTORY, allocated, STRONGHELP_PACK_ATTRIBUTES | STRONGHELP_ATTRIBUTE_DIRECTORY);
+
+	next.dir = dir;
+	next.entry = *entry;
+	next.position = -1;
+
+	return stack_push(pending, &next);
+}
+
+/**
+ * Write the block for a new directory in a manual, whose space has been
+ * claimed by stronghelp_claim_directory(), adding all of its contents.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param *item		Pointer to the directory to add.
+ * \param *pending	Pointer to the stack of pending directories.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_add_directory(struct stronghelp_update *update, struct stronghelp_update_pending *item, struct stack *pending)
+{
+	struct stronghelp_file_dir_block *header;
+	int32_t length, size;
+	int8_t *block;
+	bool success;
+
+	size = sizeof(struct stronghelp_file_dir_block) + stronghelp_get_child_entries_size(item->dir, true);
+
+	block = calloc(size + sizeof(struct stronghelp_file_dir_entry), sizeof(int8_t));
+	if (block == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	header = (struct stronghelp_file_dir_block *) block;
+
+	header->dir = STRONGHELP_DIR_WORD;
+	header->size = item->entry.size;
+	header->used = size;
+
+	length = sizeof(struct stronghelp_file_dir_block);
+
+	success = stronghelp_add_entries(update, item->dir, block, &length, true, pending);
+
+	if (success)
+		success = stronghelp_write_bytes(update, item->entry.object_offset, block, size);
+
+	free(block);
+
+	return success;
+}
+
+/**
+ * Add a new file to a manual. If the file has been moved from elsewhere
+ * in the manual, the existing data block is used; otherwise, the contents
+ * are copied in from disc.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param *object	Pointer to the file to add.
+ * \param *entry	Pointer to the file's entry in its parent, which
+ *			will be filled in.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_add_file(struct stronghelp_update *update, struct objectdb_object *object, struct stronghelp_file_dir_entry *entry)
+{
+	size_t size, moved_size, moved_offset;
+	uint32_t filetype;
+
+	if (!objectdb_get_disc_details(object, &size, &filetype))
+		return false;
+
+	stronghelp_set_entry(entry, 0, filetype, 0, STRONGHELP_PACK_ATTRIBUTES);
+
+	if (objectdb_get_stronghelp_details(objectdb_get_moved(object), &moved_size, NULL, &moved_offset) &&
+			moved_size > 0 && moved_size == size) {
+		entry->object_offset = moved_offset - sizeof(struct stronghelp_file_data_block);
+		entry->size = moved_size + sizeof(struct stronghelp_file_data_block);
+		return true;
+	}
+
+	return stronghelp_write_file(update, object, entry, 0);
+}
+
+/**
+ * Add entries to a directory block for the objects in a directory which
+ * are on disc but not in the manual, adding the files themselves to the
+ * manual as they are reached. Blocks are claimed for subdirectories, which
+ * are pushed on to the stack of pending directories to be filled in later.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param *dir		Pointer to the directory holding the objects.
+ * \param *block	Pointer to the directory block, which must have
+ *			space for the new entries.
+ * \param *length	Pointer to the used length of the block, which
+ *			will be updated.
+ * \param existing	True to add all of the objects on disc; False to
+ *			only add those which aren't in the manual.
+ * \param *pending	Pointer to the stack of pending directories.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_add_entries(struct stronghelp_update *update, struct objectdb_object *dir, int8_t *block, int32_t *length, bool existing, struct stack *pending)
+{
+	struct stronghelp_file_dir_entry *entry;
+	struct objectdb_object *object;
+	bool success = true;
+	char *name;
+
+	for (object = objectdb_get_first_file(dir); success && object != NULL; object = objectdb_get_next_object(object)) {
+		if (!objectdb_get_disc_details(object, NULL, NULL) || (!existing && objectdb_get_stronghelp_details(object, NULL, NULL, NULL)))
+			continue;
+
+		name = objectdb_get_name(object);
+
+		entry = (struct stronghelp_file_dir_entry *) (block + *length);
+		memcpy(block + *length + offsetof(struct stronghelp_file_dir_entry, filename), name, strlen(name) + 1);
+		*length += stronghelp_get_entry_size(name);
+
+		success = stronghelp_add_file(update, object, entry);
+	}
+
+	for (object = objectdb_get_first_directory(dir); success && object != NULL; object = objectdb_get_next_object(object)) {
+		if (!objectdb_get_disc_details(object, NULL, NULL) || (!existing && objectdb_get_stronghelp_details(object, NULL, NULL, NULL)))
+			continue;
+
+		name = objectdb_get_name(object);
+
+		entry = (struct stronghelp_file_dir_entry *) (block + *length);
+		memcpy(block + *length + offsetof(struct stronghelp_file_dir_entry, filename), name, strlen(name) + 1);
+		*length += stronghelp_get_entry_size(name);
+
+		success = stronghelp_claim_directory(update, object, entry, pending);
+	}
+
+	return success;
+}
+
+/**
+ * Write the contents of a file into a manual from disc, reusing its
+ * existing data block if the new contents will fit.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param *object	Pointer to the file to write.
+ * \param *entry	Pointer to the file's entry in its parent, which
+ *			will be updated to match.
+ * \param capacity	The size of the file's existing data block, or
+ *			zero if it doesn't have one.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_write_file(struct stronghelp_update *update, struct objectdb_object *object, struct stronghelp_file_dir_entry *entry, int32_t capacity)
+{
+	struct stronghelp_file_data_block *header;
+	struct files_source source;
+	size_t size, done = 0, chunk, fill, start, data;
+	int32_t offset, needed;
+	uint32_t filetype;
+	int8_t *buffer;
+	bool success;
+	char *path;
+
+	if (!objectdb_get_disc_details(object, &size, &filetype))
+		return false;
+
+	stronghelp_set_entry_type(entry, filetype);
+
+	/* Empty files don't need a data block, but one which is too small to
+	 * be given back as free space is kept; it can only hold the header.
+	 */
+
+	if (size == 0) {
+		if (!stronghelp_can_release_space(update, entry->object_offset, capacity))
+			return true;
+
+		success = stronghelp_release_space(update, entry->object_offset, capacity);
+
+		entry->object_offset = 0;
+		entry->size = 0;
+
+		return success;
+	}
+
+	if (size > STRONGHELP_PACK_MAX_LENGTH - sizeof(struct stronghelp_file_data_block) - 3) {
+		msg_report(MSG_PACK_TOO_LARGE);
+		return false;
+	}
+
+	/* Find a data block for the file, releasing anything that isn't needed.
+	 * A data block can't hold any slack, so the file only stays where it
+	 * is if the end of the block can be given back as free space; if not,
+	 * it is moved to a block which it fits exactly.
+	 */
+
+	needed = (sizeof(struct stronghelp_file_data_block) + size + 3) & ~3;
+
+	if (needed <= capacity && stronghelp_can_release_space(update, entry->object_offset + needed, capacity - needed)) {
+		offset = entry->object_offset;
+
+		if (!stronghelp_release_space(update, offset + needed, capacity - needed))
+			return false;
+	} else {
+		if (!stronghelp_release_space(update, entry->object_offset, capacity))
+			return false;
+
+		offset = stronghelp_allocate_space(update, needed, NULL);
+		if (offset < 0)
+			return false;
+	}
+
+	entry->object_offset = offset;
+	entry->size = sizeof(struct stronghelp_file_data_block) + size;
+
+	/* Copy the file's contents in from disc, a block at a time. */
+
+	path = objectdb_get_path(object, OBJECTDB_PATH_TYPE_DISC);
+	if (path == NULL)
+		return false;
+
+	buffer = malloc(STRONGHELP_COPY_BLOCK_SIZE);
+	if (buffer == NULL) {
+		free(path);
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	success = files_open_source(path, &source);
+
+	if (success && source.length != size) {
+		msg_report(MSG_PACK_FILE_CHANGED, path);
+		success = false;
+	}
+
+	while (success && done < (size_t) needed) {
+		chunk = needed - done;
+		if (chunk > STRONGHELP_COPY_BLOCK_SIZE)
+			chunk = STRONGHELP_COPY_BLOCK_SIZE;
+
+		memset(buffer, 0, chunk);
+		fill = 0;
+
+		if (done == 0) {
+			header = (struct stronghelp_file_data_block *) buffer;
+			header->data = STRONGHELP_DATA_WORD;
+			header->size = entry->size;
+			fill = sizeof(struct stronghelp_file_data_block);
+		}
+
+		/* Work out how much of the chunk comes from the file, before the padding. */
+
+		start = done + fill - sizeof(struct stronghelp_file_data_block);
+		data = (start < size) ? size - start : 0;
+		if (data > chunk - fill)
+			data = chunk - fill;
+
+		if (data > 0)
+			success = files_read_source(&source, start, buffer + fill, data);
+
+		if (success)
+			success = stronghelp_write_bytes(update, offset + done, buffer, chunk);
+
+		done += chunk;
+	}
+
+	files_close_source(&source);
+
+	free(buffer);
+	free(path);
+
+	return success;
+}
+
+/**
+ * Release the blocks used by a directory which is no longer on disc,
+ * along with those of its contents.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param *dir		Pointer to the directory to release, or NULL if it
+ *			isn't in the database.
+ * \param *entry	Pointer to the directory's entry in its parent.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_release_directory(struct stronghelp_update *update, struct objectdb_object *dir, struct stronghelp_file_dir_entry *entry)
+{
+	struct stronghelp_update_pending next;
+	struct stack pending;
+	bool success;
+
+	stack_initialise(&pending, sizeof(struct stronghelp_update_pending));
+
+	next.dir = dir;
+	next.entry = *entry;
+	next.position = -1;
+
+	success = stack_push(&pending, &next);
+
+	while (success && stack_pop(&pending, &next))
+		success = stronghelp_release_directory_block(update, &next, &pending);
+
+	stack_free(&pending);
+
+	return success;
+}
+
+/**
+ * Release a directory block which is no longer on disc, along with the
+ * data blocks of its files, pushing any subdirectories on to the stack
+ * of pending directories to be released in turn.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param *item		Pointer to the directory to release.
+ * \param *pending	Pointer to the stack of pending directories.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_release_directory_block(struct stronghelp_update *update, struct stronghelp_update_pending *item, struct stack *pending)
+{
+	struct stronghelp_file_dir_block header;
+	struct stronghelp_file_dir_entry *child;
+	struct stronghelp_update_pending next;
+	struct objectdb_object *object;
+	int32_t position;
+	int8_t *block;
+	bool success = true, is_dir;
+
+	block = stronghelp_load_directory(update, &(item->entry), &header);
+	if (block == NULL)
+		return false;
+
+	for (position = sizeof(struct stronghelp_file_dir_block); success && position < header.used; position += stronghelp_get_entry_size(child->filename)) {
+		child = (struct stronghelp_file_dir_entry *) (block + position);
+		object = stronghelp_find_object(item->dir, child, &is_dir);
+
+		if (is_dir) {
+			next.dir = object;
+			next.entry = *child;
+			next.position = -1;
+
+			success = stack_push(pending, &next);
+		} else {
+			success = stronghelp_release_file(update, object, child);
+		}
+	}
+
+	if (success)
+		success = stronghelp_release_space(update, item->entry.object_offset, header.size);
+
+	free(block);
+
+	return success;
+}
+
+/**
+ * Release the data block used by a file which is no longer on disc, unless
+ * the file has been moved and the block is being used in its new location.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param *object	Pointer to the file to release, or NULL if it isn't
+ *			in the database.
+ * \param *entry	Pointer to the file's entry in its parent.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_release_file(struct stronghelp_update *update, struct objectdb_object *object, struct stronghelp_file_dir_entry *entry)
+{
+	size_t size;
+
+	if (entry->object_offset == 0)
+		return true;
+
+	if (objectdb_get_moved(object) != NULL && objectdb_get_stronghelp_details(object, &size, NULL, NULL) && size > 0)
+		return true;
+
+	return stronghelp_release_space(update, entry->object_offset, (entry->size + 3) & ~3);
+}
+
+/**
+ * Read a directory block from a manual being updated into memory.
+ *
+ * The block is allocated using malloc(), and must be freed with free()
+ * after use.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param *entry	Pointer to the directory's entry in its parent.
+ * \param *header	Pointer to a block to take the directory header.
+ * \return		Pointer to the block, or NULL on failure.
+ */
+
+static int8_t *stronghelp_load_directory(struct stronghelp_update *update, struct stronghelp_file_dir_entry *entry, struct stronghelp_file_dir_block *header)
+{
+	if (stronghelp_get_block_address(&(update->file), entry->object_offset, sizeof(struct stronghelp_file_dir_block), header) == NULL)
+		return NULL;
+
+	if (header->dir != STRONGHELP_DIR_WORD) {
+		msg_report(MSG_BAD_OBJECT_MAGIC, header->dir);
+		return NULL;
+	}
+
+	if (header->used < (int32_t) sizeof(struct stronghelp_file_dir_block) || header->used > header->size) {
+		msg_report(MSG_BAD_SIZE, header->used);
+		return NULL;
+	}
+
+	return stronghelp_load_block(&(update->file), entry->object_offset, header->used);
+}
+
+/**
+ * Find the object in the database corresponding to a directory entry in
+ * the manual, looking for a directory or a file first according to the
+ * entry's attributes.
+ *
+ * \param *dir		Pointer to the directory holding the entry, or NULL.
+ * \param *entry	Pointer to the entry.
+ * \param *is_dir	Pointer to a variable to set to True if the object
+ *			is a directory; False if not.
+ * \return		Pointer to the object, or NULL if not found.
+ */
+
+static struct objectdb_object *stronghelp_find_object(struct objectdb_object *dir, struct stronghelp_file_dir_entry *entry, bool *is_dir)
+{
+	struct objectdb_object *object;
+
+	*is_dir = (entry->flags & STRONGHELP_ATTRIBUTE_DIRECTORY) ? true : false;
+
+	object = (*is_dir) ? objectdb_find_directory(dir, entry->filename) : objectdb_find_file(dir, entry->filename);
+
+	if (object == NULL) {
+		object = (*is_dir) ? objectdb_find_file(dir, entry->filename) : objectdb_find_directory(dir, entry->filename);
+
+		if (object != NULL)
+			*is_dir = !(*is_dir);
+	}
+
+	return object;
+}
+
+/**
+ * Set the filetype in a file's directory entry, keeping the rest of the
+ * load address if it holds a filetype and datestamp.
+ *
+ * \param *entry	Pointer to the entry to update.
+ * \param filetype	The new filetype.
+ */
+
+static void stronghelp_set_entry_type(struct stronghelp_file_dir_entry *entry, uint32_t filetype)
+{
+	if ((entry->load_address & 0xfff00000) == 0xfff00000)
+		entry->load_address = (entry->load_address & 0xfff000ff) | ((filetype & 0xfff) << 8);
+	else
+		entry->load_address = 0xfff00000 | ((filetype & 0xfff) << 8);
+}
+
+/**
+ * Add up the space needed for the entries of the objects in a directory
+ * which are on disc.
+ *
+ * \param *dir		Pointer to the directory of interest.
+ * \param existing	True to include all of the objects on disc; False
+ *			to only include those which aren't in the manual.
+ * \return		The size of the entries, in bytes.
+ */
+
+static int32_t stronghelp_get_child_entries_size(struct objectdb_object *dir, bool existing)
+{
+	struct objectdb_object *object;
+	int32_t size = 0;
+
+	for (object = objectdb_get_first_file(dir); object != NULL; object = objectdb_get_next_object(object)) {
+		if (objectdb_get_disc_details(object, NULL, NULL) && (existing || !objectdb_get_stronghelp_details(object, NULL, NULL, NULL)))
+			size += stronghelp_get_entry_size(objectdb_get_name(object));
+	}
+
+	for (object = objectdb_get_first_directory(dir); object != NULL; object = objectdb_get_next_object(object)) {
+		if (objectdb_get_disc_details(object, NULL, NULL) && (existing || !objectdb_get_stronghelp_details(object, NULL, NULL, NULL)))
+			size += stronghelp_get_entry_size(objectdb_get_name(object));
+	}
+
+	return size;
+}
+
+/**
+ * Write a block of data into a manual being updated.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param offset	The offset to write the data at.
+ * \param *data		Pointer to the data to write.
+ * \param length	The length of the data.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_write_bytes(struct stronghelp_update *update, int32_t offset, void *data, size_t length)
+{
+	if (!files_write_source(update->file.source, offset, data, length))
+		return false;
+
+	update->written += length;
+
+	if (offset + length > update->file.length)
+		update->file.length = offset + length;
+
+	return true;
+}
+
+/**
+ * Read the free space list of a manual being updated, so that its blocks
+ * can be allocated. The list in the file need not be in order, but the
+ * blocks are held in order of offset so that neighbours can be merged.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param offset	The offset of the first free block, or -1 if none.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_read_free_space(struct stronghelp_update *update, int32_t offset)
+{
+	struct stronghelp_file_free_block block;
+	struct stronghelp_space *space;
+	int32_t count = 0;
+
+	while (offset >= 0) {
+		if (stronghelp_get_block_address(&(update->file), offset, sizeof(struct stronghelp_file_free_block), &block) == NULL)
+			return false;
+
+		if (block.free != STRONGHELP_FREE_WORD) {
+			msg_report(MSG_BAD_FREE_MAGIC, block.free);
+			return false;
+		}
+
+		/* A list which runs off the end of the file, or loops back on itself, can't be trusted. */
+
+		if (block.free_size < (int32_t) sizeof(struct stronghelp_file_free_block) || block.free_size > update->file.length - offset ||
+				++count > update->file.length / (int32_t) sizeof(struct stronghelp_file_free_block)) {
+			msg_report(MSG_OFFSET_RANGE, offset, block.free_size, update->file.length);
+			return false;
+		}
+
+		space = malloc(sizeof(struct stronghelp_space));
+		if (space == NULL) {
+			msg_report(MSG_NO_MEMORY);
+			return false;
+		}
+
+		space->offset = offset;
+		space->size = block.free_size;
+		space->file_size = block.free_size;
+		space->file_next = block.next_offset;
+
+		stronghelp_insert_space(update, space);
+
+		offset = block.next_offset;
+	}
+
+	return true;
+}
+
+/**
+ * Look for the zero word which StrongHelp leaves at the end of a manual,
+ * outside of any block, so that it can be built over if the file has to
+ * be extended rather than being left behind as a gap. This must be done
+ * before anything in the file has been changed.
+ *
+ * \param *update	Pointer to the manual being updated, whose free
+ *			space list has been read.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_find_end_word(struct stronghelp_update *update)
+{
+	struct stronghelp_file_dir_entry entry;
+	struct stronghelp_file_dir_block header;
+	struct stronghelp_space *space;
+	struct stack pending;
+	int32_t word, position, length = update->file.length;
+	bool success = true, covered = false;
+
+	update->end_word = -1;
+
+	if (length < (int32_t) (sizeof(struct stronghelp_file_root) + sizeof(struct stronghelp_file_dir_entry) + sizeof(int32_t)) || (length & 3) != 0)
+		return true;
+
+	if (stronghelp_get_block_address(&(update->file), length - sizeof(int32_t), sizeof(int32_t), &word) == NULL)
+		return false;
+
+	if (word != 0)
+		return true;
+
+	for (space = update->free; space != NULL; space = space->next) {
+		if (space->offset + space->size >= length)
+			return true;
+	}
+
+	/* Check that the word isn't part of a block in the tree. */
+
+	stack_initialise(&pending, sizeof(int32_t));
+
+	position = 16;
+	success = stack_push(&pending, &position);
+
+	while (success && !covered && stack_pop(&pending, &position)) {
+		if (stronghelp_get_block_address(&(update->file), position, sizeof(struct stronghelp_file_dir_entry), &entry) == NULL) {
+			success = false;
+		} else if (entry.object_offset == 0) {
+			continue;
+		} else if (entry.flags & STRONGHELP_ATTRIBUTE_DIRECTORY || position == 16) {
+			success = stronghelp_push_entries(update, &entry, &pending, &header);
+			covered = (entry.object_offset + header.size >= length) ? true : false;
+		} else {
+			covered = (entry.object_offset + ((entry.size + 3) & ~3) >= length) ? true : false;
+		}
+	}
+
+	stack_free(&pending);
+
+	if (success && !covered)
+		update->end_word = length - sizeof(int32_t);
+
+	return success;
+}
+
+/**
+ * Allocate a block from the free space in a manual being updated, using
+ * the smallest free block which is big enough. If there isn't one, the
+ * file is extended, starting from any free block at the end.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param size		The size of the block required.
+ * \param *allocated	Pointer to a variable to take the size of the
+ *			block allocated, which may be slightly larger
+ *			than requested if splitting the free block would
+ *			leave too little to form a new one; or NULL if
+ *			the block must be exactly the size requested.
+ * \return		The offset of the block, or -1 on failure.
+ */
+
+static int32_t stronghelp_allocate_space(struct stronghelp_update *update, int32_t size, int32_t *allocated)
+{
+	struct stronghelp_space **link, **best = NULL, *space;
+	int32_t offset, spare;
+
+	/* A free block which would leave too little to form a new one can
+	 * only be used if the caller can take the extra space.
+	 */
+
+	for (link = &(update->free); *link != NULL; link = &((*link)->next)) {
+		spare = (*link)->size - size;
+
+		if (spare < 0 || (allocated == NULL && spare > 0 && spare < (int32_t) sizeof(struct stronghelp_file_free_block)))
+			continue;
+
+		if (best == NULL || (*link)->size < (*best)->size)
+			best = link;
+	}
+
+	/* Take the block from the start of the best fit, if there is one. */
+
+	if (best != NULL) {
+		space = *best;
+		offset = space->offset;
+
+		if (space->size - size >= (int32_t) sizeof(struct stronghelp_file_free_block)) {
+			space->offset += size;
+			space->size -= size;
+			space->file_size = 0;
+		} else {
+			*best = space->next;
+			size = space->size;
+			free(space);
+		}
+
+		if (allocated != NULL)
+			*allocated = size;
+
+		return offset;
+	}
+
+	/* Otherwise, extend the file, building over any zero word that
+	 * StrongHelp left at the end.
+	 */
+
+	offset = update->file.length;
+
+	for (link = &(update->free); *link != NULL && (*link)->next != NULL; link = &((*link)->next));
+
+	if (*link != NULL && (*link)->offset + (*link)->size == update->file.length) {
+		offset = (*link)->offset;
+		free(*link);
+		*link = NULL;
+	} else if (update->end_word >= 0 && update->end_word + (int32_t) sizeof(int32_t) == update->file.length) {
+		offset = update->end_word;
+	}
+
+	update->end_word = -1;
+
+	if ((size_t) size > STRONGHELP_PACK_MAX_LENGTH - offset) {
+		msg_report(MSG_PACK_TOO_LARGE);
+		return -1;
+	}
+
+	update->file.length = offset + size;
+
+	if (allocated != NULL)
+		*allocated = size;
+
+	return offset;
+}
+
+/**
+ * Return a block to the free space in a manual being updated, merging it
+ * with any neighbouring free blocks.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param offset	The offset of the block to release.
+ * \param size		The size of the block, which may be zero.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_release_space(struct stronghelp_update *update, int32_t offset, int32_t size)
+{
+	struct stronghelp_space *space;
+
+	if (size <= 0)
+		return true;
+
+	if (offset < 0 || size > update->file.length - offset) {
+		msg_report(MSG_OFFSET_RANGE, offset, size, update->file.length);
+		return false;
+	}
+
+	space = malloc(sizeof(struct stronghelp_space));
+	if (space == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	space->offset = offset;
+	space->size = size;
+	space->file_size = 0;
+	space->file_next = 0;
+
+	stronghelp_insert_space(update, space);
+
+	return true;
+}
+
+/**
+ * Test whether a block can be returned to the free space in a manual being
+ * updated without leaving a gap which the file format can't describe: it
+ * must be big enough to hold a free block header, or touch a free block
+ * which it can be merged with.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param offset	The offset of the block to release.
+ * \param size		The size of the block, which may be zero.
+ * \return		True if the block can be released; else False.
+ */
+
+static bool stronghelp_can_release_space(struct stronghelp_update *update, int32_t offset, int32_t size)
+{
+	struct stronghelp_space *space;
+
+	if (size <= 0 || size >= (int32_t) sizeof(struct stronghelp_file_free_block))
+		return true;
+
+	for (space = update->free; space != NULL && space->offset <= offset + size; space = space->next) {
+		if (space->offset == offset + size || space->offset + space->size == offset)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Insert a block into the ordered list of free space in a manual being
+ * updated, merging it with its neighbours if they touch. A block which
+ * is too small to hold a free block header is kept in the list, so that
+ * it can be merged with later on, but is never written out.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param *space	Pointer to the block to insert, which becomes
+ *			owned by the list.
+ */
+
+static void stronghelp_insert_space(struct stronghelp_update *update, struct stronghelp_space *space)
+{
+	struct stronghelp_space **link = &(update->free), **previous = NULL, *following;
+	int32_t end;
+
+	while (*link != NULL && (*link)->offset < space->offset) {
+		previous = link;
+		link = &((*link)->next);
+	}
+
+	space->next = *link;
+	*link = space;
+
+	/* Merge with the following block... */
+
+	following = space->next;
+
+	if (following != NULL && space->offset + space->size >= following->offset) {
+		end = following->offset + following->size;
+		if (end > space->offset + space->size)
+			space->size = end - space->offset;
+
+		space->next = following->next;
+		free(following);
+	}
+
+	/* ...and then with the previous one. */
+
+	if (previous != NULL && (*previous)->offset + (*previous)->size >= space->offset) {
+		end = space->offset + space->size;
+		if (end > (*previous)->offset + (*previous)->size)
+			(*previous)->size = end - (*previous)->offset;
+
+		(*previous)->next = space->next;
+		free(space);
+	}
+}
+
+/**
+ * Make a pass over the directory tree of a manual being updated, moving
+ * any block which follows a gap too small to be a free block to a new
+ * location, so that the gap can be merged with the space that it leaves.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param *moved	Pointer to a variable to be set to True if any
+ *			blocks were moved; otherwise False.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_close_gaps(struct stronghelp_update *update, bool *moved)
+{
+	struct stronghelp_file_dir_entry entry;
+	struct stronghelp_file_dir_block header;
+	struct stronghelp_file_data_block data;
+	struct stronghelp_space *space;
+	struct stack pending;
+	int32_t position;
+	bool success = true, is_dir;
+
+	*moved = false;
+
+	/* Most updates leave no gaps, so there's usually nothing to do. */
+
+	for (space = update->free; space != NULL; space = space->next) {
+		if (space->size < (int32_t) sizeof(struct stronghelp_file_free_block) && space->offset + space->size < update->file.length)
+			break;
+	}
+
+	if (space == NULL)
+		return true;
+
+	/* Walk the tree using the file offsets of the entries, starting from
+	 * the root, as each block's entry must be updated when it moves.
+	 */
+
+	stack_initialise(&pending, sizeof(int32_t));
+
+	position = 16;
+	success = stack_push(&pending, &position);
+
+	while (success && stack_pop(&pending, &position)) {
+		if (stronghelp_get_block_address(&(update->file), position, sizeof(struct stronghelp_file_dir_entry), &entry) == NULL) {
+			success = false;
+			break;
+		}
+
+		if (entry.object_offset == 0)
+			continue;
+
+		if (stronghelp_get_block_address(&(update->file), entry.object_offset, sizeof(struct stronghelp_file_data_block), &data) == NULL) {
+			success = false;
+			break;
+		}
+
+		is_dir = (data.data == STRONGHELP_DIR_WORD) ? true : false;
+
+		if (stronghelp_find_gap(update, entry.object_offset)) {
+			success = stronghelp_move_block(update, position, &entry, is_dir);
+			*moved = true;
+		}
+
+		if (success && is_dir)
+			success = stronghelp_push_entries(update, &entry, &pending, &header);
+	}
+
+	stack_free(&pending);
+
+	return success;
+}
+
+/**
+ * Read a directory block from a manual being updated, and push the file
+ * offsets of its entries on to a stack, so that they can be visited in
+ * turn.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param *entry	Pointer to the directory's entry in its parent.
+ * \param *pending	Pointer to the stack to take the entry offsets.
+ * \param *header	Pointer to a block to take the directory header.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_push_entries(struct stronghelp_update *update, struct stronghelp_file_dir_entry *entry, struct stack *pending, struct stronghelp_file_dir_block *header)
+{
+	struct stronghelp_file_dir_entry *child;
+	int32_t offset, position;
+	int8_t *block;
+	bool success = true;
+
+	block = stronghelp_load_directory(update, entry, header);
+	if (block == NULL)
+		return false;
+
+	for (offset = sizeof(struct stronghelp_file_dir_block); success && offset < header->used; offset += stronghelp_get_entry_size(child->filename)) {
+		child = (struct stronghelp_file_dir_entry *) (block + offset);
+		position = entry->object_offset + offset;
+		success = stack_push(pending, &position);
+	}
+
+	free(block);
+
+	return success;
+}
+
+/**
+ * Test whether a block in a manual being updated follows straight on from
+ * a gap which is too small to be a free block.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param offset	The offset of the block.
+ * \return		True if the block follows a gap; else False.
+ */
+
+static bool stronghelp_find_gap(struct stronghelp_update *update, int32_t offset)
+{
+	struct stronghelp_space *space;
+
+	for (space = update->free; space != NULL && space->offset < offset; space = space->next) {
+		if (space->offset + space->size == offset && space->size < (int32_t) sizeof(struct stronghelp_file_free_block))
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Move a block in a manual being updated to a new location, and release
+ * the space that it used.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param position	The offset of the block's entry within the file.
+ * \param *entry	Pointer to a copy of the block's entry, which will
+ *			be updated and written back.
+ * \param is_dir	True if the block is a directory; False for data.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_move_block(struct stronghelp_update *update, int32_t position, struct stronghelp_file_dir_entry *entry, bool is_dir)
+{
+	struct stronghelp_file_dir_block header;
+	int32_t size, offset, allocated, done, chunk;
+	int8_t *buffer;
+	bool success = true;
+
+	/* A directory can take any slack in its block, but data can't. */
+
+	if (is_dir) {
+		if (stronghelp_get_block_address(&(update->file), entry->object_offset, sizeof(struct stronghelp_file_dir_block), &header) == NULL)
+			return false;
+
+		size = header.size;
+	} else {
+		size = (entry->size + 3) & ~3;
+	}
+
+	if (size < (int32_t) sizeof(struct stronghelp_file_data_block) || size > update->file.length - entry->object_offset) {
+		msg_report(MSG_OFFSET_RANGE, entry->object_offset, size, update->file.length);
+		return false;
+	}
+
+	offset = stronghelp_allocate_space(update, size, is_dir ? &allocated : NULL);
+	if (offset < 0)
+		return false;
+
+	buffer = malloc(STRONGHELP_COPY_BLOCK_SIZE);
+	if (buffer == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return false;
+	}
+
+	for (done = 0; success && done < size; done += chunk) {
+		chunk = size - done;
+		if (chunk > STRONGHELP_COPY_BLOCK_SIZE)
+			chunk = STRONGHELP_COPY_BLOCK_SIZE;
+
+		success = files_read_source(update->file.source, entry->object_offset + done, buffer, chunk) &&
+				stronghelp_write_bytes(update, offset + done, buffer, chunk);
+	}
+
+	free(buffer);
+
+	if (success && is_dir && allocated != size) {
+		header.size = allocated;
+		success = stronghelp_write_bytes(update, offset, &header, sizeof(struct stronghelp_file_dir_block));
+		entry->size = allocated;
+	}
+
+	if (success)
+		success = stronghelp_release_space(update, entry->object_offset, size);
+
+	entry->object_offset = offset;
+
+	if (success)
+		success = stronghelp_write_bytes(update, position, entry, offsetof(struct stronghelp_file_dir_entry, filename));
+
+	return success;
+}
+
+/**
+ * Write the free space list of a manual being updated back to the file,
+ * after cutting the file back to remove any free space from its end. Only
+ * blocks whose headers have changed are written.
+ *
+ * \param *update	Pointer to the manual being updated.
+ * \param free_offset	The offset of the first free block recorded in
+ *			the file's header.
+ * \return		True if successful, false on failure.
+ */
+
+static bool stronghelp_write_free_space(struct stronghelp_update *update, int32_t free_offset)
+{
+	struct stronghelp_file_free_block block;
+	struct stronghelp_space **link, *space;
+	int32_t first;
+
+	/* Trim any free space from the end of the file. */
+
+	for (link = &(update->free); *link != NULL && (*link)->next != NULL; link = &((*link)->next));
+
+	if (*link != NULL && (*link)->offset + (*link)->size >= update->file.length) {
+		if (!files_truncate_source(update->file.source, (*link)->offset))
+			return false;
+
+		update->file.length = (*link)->offset;
+		free(*link);
+		*link = NULL;
+	}
+
+	/* Any gaps which are too small to hold a header can't be listed. */
+
+	link = &(update->free);
+
+	while (*link != NULL) {
+		if ((*link)->size < (int32_t) sizeof(struct stronghelp_file_free_block)) {
+			space = *link;
+			*link = space->next;
+			free(space);
+		} else {
+			link = &((*link)->next);
+		}
+	}
+
+	/* Write out the headers which have changed, and then the start of the list. */
+
+	for (space = update->free; space != NULL; space = space->next) {
+		block.free = STRONGHELP_FREE_WORD;
+		block.free_size = space->size;
+		block.next_offset = (space->next != NULL) ? space->next->offset : -1;
+
+		if (space->file_size == block.free_size && space->file_next == block.next_offset)
+			continue;
+
+		if (!stronghelp_write_bytes(update, space->offset, &block, sizeof(struct stronghelp_file_free_block)))
+			return false;
+	}
+
+	first = (update->free != NULL) ? update->free->offset : -1;
+
+	if (first != free_offset && !stronghelp_write_bytes(update, offsetof(struct stronghelp_file_root, free_offset), &first, sizeof(int32_t)))
+		return false;
+
+	return true;
+}
+
+/**
+ * Free the list of free space held for a manual being updated.
+ *
+ * \param *update	Pointer to the manual being updated.
+ */
+
+static void stronghelp_free_space_list(struct stronghelp_update *update)
+{
+	struct stronghelp_space *space;
+
+	while (update->free != NULL) {
+		space = update->free;
+		update->free = space->next;
+		free(space);
+	}
+}
+
+/**
+ * Follow the free space list of a manual being validated, marking each
+ * of its blocks as used.
+ *
+ * \param *validate	Pointer to the manual being validated.
+ * \param offset	The offset of the first free block, or -1 for none.
+ */
+
+static void stronghelp_validate_free_space(struct stronghelp_validate *validate, int32_t offset)
+{
+	struct stronghelp_file_free_block *block;
+	int32_t size;
+
+	while (offset != -1) {
+		/* Only free blocks have been marked so far, so any block which
+		 * has been seen before must be an earlier part of the list.
+		 */
+
+		if (offset >= 0 && offset <= validate->length - (int32_t) sizeof(int32_t) && (offset & 3) == 0 &&
+				*((int32_t *) (validate->root + offset)) == STRONGHELP_FREE_WORD &&
+				(validate->starts[(offset / 4) / 32] & (1u << ((offset / 4) & 31)))) {
+			msg_report(MSG_FREE_SPACE_LOOP, offset);
+			validate->problems++;
+			return;
+		}
+
+		size = stronghelp_validate_block(validate, offset, STRONGHELP_FREE_WORD, sizeof(struct stronghelp_file_free_block), "FREE");
+		if (size == 0)
+			return;
+
+		validate->free_blocks++;
+
+		block = (struct stronghelp_file_free_block *) (validate->root + offset);
+		offset = block->next_offset;
+	}
+}
+
+/**
+ * Check the entries in a directory block of a manual being validated,
+ * marking the blocks of any files that it contains and pushing any
+ * subdirectories on to the stack to be checked in turn.
+ *
+ * \param *validate	Pointer to the manual being validated.
+ * \param offset	The offset of the directory block.
+ */
+
+static void stronghelp_validate_directory(struct stronghelp_validate *validate, int32_t offset)
+{
+	struct stronghelp_file_dir_block *block;
+	struct stronghelp_file_dir_entry *entry;
+	int32_t size, position, end, name, magic;
+
+	size = stronghelp_validate_block(validate, offset, STRONGHELP_DIR_WORD, sizeof(struct stronghelp_file_dir_block), "DIR$");
+	if (size == 0)
+		return;
+
+	validate->directories++;
+
+	block = (struct stronghelp_file_dir_block *) (validate->root + offset);
+
+	if (block->used < (int32_t) sizeof(struct stronghelp_file_dir_block) || block->used > size) {
+		msg_report(MSG_VALIDATE_BAD_BLOCK, "DIR$", offset);
+		validate->problems++;
+		return;
+	}
+
+	position = offset + sizeof(struct stronghelp_file_dir_block);
+	end = offset + block->used;
+
+	while (position < end) {
+		/* The entry, including its name, must be within the block. */
+
+		name = position + offsetof(struct stronghelp_file_dir_entry, filename);
+
+		if (name >= end) {
+			msg_report(MSG_VALIDATE_BAD_ENTRY, position);
+			validate->problems++;
+			return;
+		}
+
+		while (name < end && validate->root[name] != '\0')
+			name++;
+
+		if (name >= end) {
+			msg_report(MSG_VALIDATE_BAD_ENTRY, position);
+			validate->problems++;
+			return;
+		}
+
+		entry = (struct stronghelp_file_dir_entry *) (validate->root + position);
+		position += stronghelp_get_entry_size(entry->filename);
+
+		/* Empty files can have no data block; otherwise, check just the
+		 * magic word to see what sort of object the entry points to.
+		 */
+
+		if (entry->object_offset == 0)
+			continue;
+
+		if (entry->object_offset > 0 && (entry->object_offset & 3) == 0 &&
+				entry->object_offset <= validate->length - (int32_t) sizeof(int32_t))
+			magic = *((int32_t *) (validate->root + entry->object_offset));
+		else
+			magic = 0;
+
+		if (magic == STRONGHELP_DIR_WORD) {
+			if (!stack_push(&(validate->pending), &(entry->object_offset))) {
+				validate->problems++;
+				return;
+			}
+		} else if (stronghelp_validate_block(validate, entry->object_offset, STRONGHELP_DATA_WORD,
+				sizeof(struct stronghelp_file_data_block), "DATA") != 0) {
+			validate->files++;
+		}
+	}
+}
+
+/**
+ * Check a block in a manual being validated, and mark it as used.
+ *
+ * \param *validate	Pointer to the manual being validated.
+ * \param offset	The offset of the block.
+ * \param magic		The magic word that the block should start with.
+ * \param min_size	The size of the block's header.
+ * \param *type		Pointer to the name of the type of block, for reports.
+ * \return		The size of the block, or 0 if it is not valid.
+ */
+
+static int32_t stronghelp_validate_block(struct stronghelp_validate *validate, int32_t offset, int32_t magic, size_t min_size, char *type)
+{
+	int32_t *block;
+
+	if (offset < 0 || (offset & 3) != 0 || offset > validate->length - (int32_t) min_size) {
+		msg_report(MSG_VALIDATE_BAD_BLOCK, type, offset);
+		validate->problems++;
+		return 0;
+	}
+
+	/* Every block has its magic word followed by its size. */
+
+	block = (int32_t *) (validate->root + offset);
+
+	if (block[0] != magic || block[1] < (int32_t) min_size || block[1] > validate->length - offset) {
+		msg_report(MSG_VALIDATE_BAD_BLOCK, type, offset);
+		validate->problems++;
+		return 0;
+	}
+
+	if (!stronghelp_mark_block(validate, offset, block[1], type))
+		return 0;
+
+	return block[1];
+}
+
+/**
+ * Mark the words used by a block in a manual being validated, reporting
+ * any overlap with blocks which have already been marked.
+ *
+ * \param *validate	Pointer to the manual being validated.
+ * \param offset	The offset of the block, which must be word aligned.
+ * \param size		The size of the block, which must be within the file.
+ * \param *type		Pointer to the name of the type of block, for reports.
+ * \return		True if the block was marked; false if it overlaps.
+ */
+
+static bool stronghelp_mark_block(struct stronghelp_validate *validate, int32_t offset, int32_t size, char *type)
+{
+	size_t word, first, last;
+	bool overlap = false;
+
+	first = offset / 4;
+	last = (offset + size + 3) / 4;
+
+	for (word = first; word < last && !overlap; word++) {
+		if (validate->coverage[word / 32] & (1u << (word & 31)))
+			overlap = true;
+	}
+
+	if (overlap) {
+		msg_report(MSG_VALIDATE_OVERLAP, type, offset);
+		validate->problems++;
+		return false;
+	}
+
+	for (word = first; word < last; word++)
+		validate->coverage[word / 32] |= 1u << (word & 31);
+
+	validate->starts[first / 32] |= 1u << (first & 31);
+
+	return true;
+}
+
+/**
+ * Report any regions of a manual being validated which are not used by
+ * any of the blocks that have been marked.
+ *
+ * \param *validate	Pointer to the manual being validated.
+ */
+
+static void stronghelp_report_gaps(struct stronghelp_validate *validate)
+{
+	size_t word, words, start;
+
+	words = (validate->length + 3) / 4;
+	word = 0;
+
+	while (word < words) {
+		/* Skip whole bitmap words where everything is in use. */
+
+		if ((word & 31) == 0 && validate->coverage[word / 32] == 0xffffffffu) {
+			word += 32;
+			continue;
+		}
+
+		if (validate->coverage[word / 32] & (1u << (word & 31))) {
+			word++;
+			continue;
+		}
+
+		start = word;
+
+		while (word < words && !(validate->coverage[word / 32] & (1u << (word & 31))))
+			word++;
+
+		/* StrongHelp leaves a zero word at the end of the file. */
+
+		if (word == words && start * 4 + 4 == (size_t) validate->length && *((int32_t *) (validate->root + start * 4)) == 0)
+			continue;
+
+		msg_report(MSG_VALIDATE_UNREACHABLE, (int) (((word < words) ? word * 4 : validate->length) - start * 4), (int) (start * 4));
+		validate->problems++;
+	}
 }
@@ -34,14 +34,68 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#include "files.h"
+#include "objectdb.h"
+
 /* Initialise a StrongHelp file and roughly validate its
  * contents.
  *
- * \param *file		Pointer to the file in memory.
+ * \param *db		Pointer to the object database to add the contents to.
+ * \param *data		Pointer to the file in memory.
  * \param length	The length of the file.
  * \return		True if successful, false on failure.
  */
 
-bool stronghelp_initialise_file(int8_t *file, size_t length);
+bool stronghelp_initialise_file(struct objectdb *db, int8_t *data, size_t length);
+
+/* Initialise a StrongHelp file which is to be streamed from disc, and
+ * roughly validate its contents. Only the directory structure is held in
+ * memory, and the contents of files are read from the source as required.
+ *
+ * \param *db		Pointer to the object database to add the contents to.
+ * \param *source	Pointer to the file to read the manual from.
+ * \return		True if successful, false on failure.
+ */
+
+bool stronghelp_initialise_source(struct objectdb *db, struct files_source *source);
+
+/* Pack the contents of a disc folder, as read into an object database
+ * by disc_initialise_folder(), into a StrongHelp file. The manual is laid
+ * out in memory and written to disc in one go.
+ *
+ * \param *db		Pointer to the object database holding the folder.
+ * \param *filename	Pointer to the name of the file to write.
+ * \param sync		True to flush the file to disc before returning.
+ * \return		True if successful, false on failure.
+ */
+
+bool stronghelp_pack_folder(struct objectdb *db, char *filename, bool sync);
+
+/* Update a StrongHelp file in place, so that its contents match those of
+ * the disc folder that it has been compared with. Only the blocks which
+ * have changed are written, with space being found from the free space
+ * list where possible.
+ *
+ * \param *db		Pointer to the object database holding the manual
+ *			and the folder, once objectdb_check_status() has
+ *			been used to compare them.
+ * \param *source	Pointer to the manual, opened for update.
+ * \param sync		True to flush the file to disc before returning.
+ * \return		True if successful, false on failure.
+ */
+
+bool stronghelp_update_source(struct objectdb *db, struct files_source *source, bool sync);
+
+/* Validate the structure of a StrongHelp file, without extracting its
+ * contents. Every block reachable from the directory tree or the free
+ * space list is checked and marked in a coverage map, so that any
+ * overlapping blocks, free space loops and unused regions are reported.
+ *
+ * \param *data		Pointer to the file in memory.
+ * \param length	The length of the file.
+ * \return		True if the file is valid; false if not, or on failure.
+ */
+
+bool stronghelp_validate_file(int8_t *data, size_t length);
 
 #endif
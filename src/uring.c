@@ -0,0 +1,475 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file uring.c
+ *
+ * Linux io_uring Submission Queue, implementation.
+ *
+ * The rings are driven directly through the system calls, so that there
+ * is no dependency on liburing.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* io_uring needs the kernel headers; without them, everything falls back. */
+
+#if defined(LINUX) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define URING_AVAILABLE
+#endif
+#endif
+
+#ifdef URING_AVAILABLE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/* Local source headers. */
+
+#include "uring.h"
+
+#include "stats.h"
+
+#ifdef URING_AVAILABLE
+
+/**
+ * An io_uring instance.
+ */
+
+struct uring {
+	int			fd;		/**< The io_uring file descriptor.			*/
+	unsigned		entries;	/**< The number of submission queue entries.		*/
+	unsigned		queued;		/**< The number of operations awaiting submission.	*/
+	unsigned		outstanding;	/**< The number of operations not yet collected.	*/
+
+	void			*sq_ring;	/**< The mapped submission queue ring.			*/
+	size_t			sq_ring_size;	/**< The size of the submission queue ring mapping.	*/
+	void			*cq_ring;	/**< The mapped completion queue ring.			*/
+	size_t			cq_ring_size;	/**< The size of the completion queue ring mapping.	*/
+	struct io_uring_sqe	*sqes;		/**< The mapped submission queue entries.		*/
+	size_t			sqes_size;	/**< The size of the submission entries mapping.	*/
+
+	unsigned		*sq_tail;	/**< The submission queue tail index.			*/
+	unsigned		*sq_mask;	/**< The submission queue index mask.			*/
+	unsigned		*sq_array;	/**< The submission queue index array.			*/
+	unsigned		*cq_head;	/**< The completion queue head index.			*/
+	unsigned		*cq_tail;	/**< The completion queue tail index.			*/
+	unsigned		*cq_mask;	/**< The completion queue index mask.			*/
+	struct io_uring_cqe	*cqes;		/**< The completion queue entries.			*/
+};
+
+/* Static Function Prototypes. */
+
+static struct io_uring_sqe *uring_get_entry(struct uring *ring, int opcode, int fd, uint64_t user_data);
+
+#endif
+
+/**
+ * Create a new io_uring instance.
+ *
+ * \param entries	The maximum number of operations to have queued or
+ *			in progress at once.
+ * \return		Pointer to the new instance, or NULL if io_uring
+ *			isn't available.
+ */
+
+struct uring *uring_create(unsigned entries)
+{
+#ifdef URING_AVAILABLE
+	struct io_uring_params params;
+	struct uring *ring;
+	char *sq, *cq;
+
+	ring = malloc(sizeof(struct uring));
+	if (ring == NULL)
+		return NULL;
+
+	memset(&params, 0, sizeof(struct io_uring_params));
+
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	stats_count(STATS_SYSCALLS, 1);
+	if (ring->fd < 0) {
+		free(ring);
+		return NULL;
+	}
+
+	ring->entries = params.sq_entries;
+	ring->queued = 0;
+	ring->outstanding = 0;
+
+	/* Map the two rings and the submission queue entries. */
+
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+	if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED || ring->sqes == MAP_FAILED) {
+		if (ring->sq_ring != MAP_FAILED)
+			munmap(ring->sq_ring, ring->sq_ring_size);
+		if (ring->cq_ring != MAP_FAILED)
+			munmap(ring->cq_ring, ring->cq_ring_size);
+		if (ring->sqes != MAP_FAILED)
+			munmap(ring->sqes, ring->sqes_size);
+		close(ring->fd);
+		free(ring);
+		return NULL;
+	}
+
+	sq = ring->sq_ring;
+	cq = ring->cq_ring;
+
+	ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+	ring->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+	ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+	ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+	ring->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+	return ring;
+#else
+	return NULL;
+#endif
+}
+
+/**
+ * Destroy an io_uring instance. Any operations in progress should have
+ * been waited for first.
+ *
+ * \param *ring		Pointer to the instance to destroy.
+ */
+
+void uring_destroy(struct uring *ring)
+{
+#ifdef URING_AVAILABLE
+	if (ring == NULL)
+		return;
+
+	munmap(ring->sq_ring, ring->sq_ring_size);
+	munmap(ring->cq_ring, ring->cq_ring_size);
+	munmap(ring->sqes, ring->sqes_size);
+	close(ring->fd);
+	free(ring);
+#endif
+}
+
+/**
+ * Queue an openat() operation, relative to the current directory.
+ *
+ * \param *ring		Pointer to the instance to queue the operation on.
+ * \param *path		Pointer to the path to open, which must remain
+ *			valid until the operation has completed.
+ * \param flags		The open flags.
+ * \param mode		The mode for any file created.
+ * \param user_data	The value to return with the completion.
+ * \return		True if queued; False if the queue is full.
+ */
+
+bool uring_queue_open(struct uring *ring, char *path, int flags, unsigned mode, uint64_t user_data)
+{
+#ifdef URING_AVAILABLE
+	struct io_uring_sqe *sqe;
+
+	sqe = uring_get_entry(ring, IORING_OP_OPENAT, AT_FDCWD, user_data);
+	if (sqe == NULL)
+		return false;
+
+	sqe->addr = (uintptr_t) path;
+	sqe->len = mode;
+	sqe->open_flags = flags;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Queue a pread() operation.
+ *
+ * \param *ring		Pointer to the instance to queue the operation on.
+ * \param fd		The file descriptor to read from.
+ * \param *buffer	Pointer to the buffer to read into.
+ * \param length	The number of bytes to read.
+ * \param offset	The offset into the file to read from.
+ * \param user_data	The value to return with the completion.
+ * \return		True if queued; False if the queue is full.
+ */
+
+bool uring_queue_read(struct uring *ring, int fd, void *buffer, unsigned length, uint64_t offset, uint64_t user_data)
+{
+#ifdef URING_AVAILABLE
+	struct io_uring_sqe *sqe;
+
+	sqe = uring_get_entry(ring, IORING_OP_READ, fd, user_data);
+	if (sqe == NULL)
+		return false;
+
+	sqe->addr = (uintptr_t) buffer;
+	sqe->len = length;
+	sqe->off = offset;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Queue a pwrite() operation.
+ *
+ * \param *ring		Pointer to the instance to queue the operation on.
+ * \param fd		The file descriptor to write to.
+ * \param *buffer	Pointer to the data to be written.
+ * \param length	The number of bytes to write.
+ * \param offset	The offset into the file to write to.
+ * \param user_data	The value to return with the completion.
+ * \return		True if queued; False if the queue is full.
+ */
+
+bool uring_queue_write(struct uring *ring, int fd, void *buffer, unsigned length, uint64_t offset, uint64_t user_data)
+{
+#ifdef URING_AVAILABLE
+	struct io_uring_sqe *sqe;
+
+	sqe = uring_get_entry(ring, IORING_OP_WRITE, fd, user_data);
+	if (sqe == NULL)
+		return false;
+
+	sqe->addr = (uintptr_t) buffer;
+	sqe->len = length;
+	sqe->off = offset;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Queue an fsync() operation.
+ *
+ * \param *ring		Pointer to the instance to queue the operation on.
+ * \param fd		The file descriptor to flush.
+ * \param user_data	The value to return with the completion.
+ * \return		True if queued; False if the queue is full.
+ */
+
+bool uring_queue_fsync(struct uring *ring, int fd, uint64_t user_data)
+{
+#ifdef URING_AVAILABLE
+	return (uring_get_entry(ring, IORING_OP_FSYNC, fd, user_data) != NULL) ? true : false;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Queue a close() operation.
+ *
+ * \param *ring		Pointer to the instance to queue the operation on.
+ * \param fd		The file descriptor to close.
+ * \param user_data	The value to return with the completion.
+ * \return		True if queued; False if the queue is full.
+ */
+
+bool uring_queue_close(struct uring *ring, int fd, uint64_t user_data)
+{
+#ifdef URING_AVAILABLE
+	return (uring_get_entry(ring, IORING_OP_CLOSE, fd, user_data) != NULL) ? true : false;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Queue an unlink() operation, relative to the current directory.
+ *
+ * \param *ring		Pointer to the instance to queue the operation on.
+ * \param *path		Pointer to the path to unlink, which must remain
+ *			valid until the operation has completed.
+ * \param user_data	The value to return with the completion.
+ * \return		True if queued; False if the queue is full.
+ */
+
+bool uring_queue_unlink(struct uring *ring, char *path, uint64_t user_data)
+{
+#ifdef URING_AVAILABLE
+	struct io_uring_sqe *sqe;
+
+	sqe = uring_get_entry(ring, IORING_OP_UNLINKAT, AT_FDCWD, user_data);
+	if (sqe == NULL)
+		return false;
+
+	sqe->addr = (uintptr_t) path;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Submit all of the queued operations to the kernel, and wait for them
+ * and any others still in progress to complete.
+ *
+ * \param *ring		Pointer to the instance to submit.
+ * \return		True if successful; False on failure.
+ */
+
+bool uring_submit_and_wait(struct uring *ring)
+{
+#ifdef URING_AVAILABLE
+	unsigned available;
+	int result;
+
+	if (ring == NULL)
+		return false;
+
+	for (;;) {
+		available = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE) - *(ring->cq_head);
+
+		if (ring->queued == 0 && available >= ring->outstanding)
+			return true;
+
+		result = syscall(__NR_io_uring_enter, ring->fd, ring->queued, ring->outstanding,
+				IORING_ENTER_GETEVENTS, NULL, 0);
+		stats_count(STATS_SYSCALLS, 1);
+
+		if (result < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		ring->queued -= result;
+	}
+#else
+	return false;
+#endif
+}
+
+/**
+ * Collect the next completed operation.
+ *
+ * \param *ring		Pointer to the instance to collect from.
+ * \param *user_data	Pointer to a variable to take the operation's value.
+ * \param *result	Pointer to a variable to take the operation's result,
+ *			which is a negative errno value on failure.
+ * \return		True if a completion was collected; False if there
+ *			are no more.
+ */
+
+bool uring_next_completion(struct uring *ring, uint64_t *user_data, int *result)
+{
+#ifdef URING_AVAILABLE
+	struct io_uring_cqe *cqe;
+	unsigned head;
+
+	if (ring == NULL)
+		return false;
+
+	head = *(ring->cq_head);
+
+	if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+		return false;
+
+	cqe = &(ring->cqes[head & *(ring->cq_mask)]);
+
+	if (user_data != NULL)
+		*user_data = cqe->user_data;
+
+	if (result != NULL)
+		*result = cqe->res;
+
+	__atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+	ring->outstanding--;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+#ifdef URING_AVAILABLE
+
+/**
+ * Claim the next submission queue entry, and fill in the common fields.
+ * The entry is made visible to the kernel straight away, but won't be
+ * acted on until the next call to uring_submit_and_wait().
+ *
+ * \param *ring		Pointer to the instance to claim the entry from.
+ * \param opcode	The operation to be carried out.
+ * \param fd		The file descriptor for the operation.
+ * \param user_data	The value to return with the completion.
+ * \return		Pointer to the entry, or NULL if the queue is full.
+ */
+
+static struct io_uring_sqe *uring_get_entry(struct uring *ring, int opcode, int fd, uint64_t user_data)
+{
+	struct io_uring_sqe *sqe;
+	unsigned tail, index;
+
+	/* Keep the number in flight within the size of the queue, so that
+	 * the completion queue (which is twice the size) can never overflow.
+	 */
+
+	if (ring == NULL || ring->outstanding >= ring->entries)
+		return NULL;
+
+	tail = *(ring->sq_tail);
+	index = tail & *(ring->sq_mask);
+
+	sqe = &(ring->sqes[index]);
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->user_data = user_data;
+
+	ring->sq_array[index] = index;
+
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	ring->queued++;
+	ring->outstanding++;
+
+	return sqe;
+}
+
+#endif
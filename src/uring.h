@@ -0,0 +1,169 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file uring.h
+ *
+ * Linux io_uring Submission Queue Interface.
+ *
+ * A minimal wrapper around the io_uring system calls, allowing batches of
+ * file operations to be submitted to the kernel in a single call. Where
+ * io_uring isn't available, either at build time or on the running kernel,
+ * uring_create() will return NULL and the callers must fall back to the
+ * standard system calls.
+ */
+
+#ifndef STRONGEX_URING_H
+#define STRONGEX_URING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * An io_uring instance reference.
+ */
+
+struct uring;
+
+/**
+ * Create a new io_uring instance.
+ *
+ * \param entries	The maximum number of operations to have queued or
+ *			in progress at once.
+ * \return		Pointer to the new instance, or NULL if io_uring
+ *			isn't available.
+ */
+
+struct uring *uring_create(unsigned entries);
+
+/**
+ * Destroy an io_uring instance. Any operations in progress should have
+ * been waited for first.
+ *
+ * \param *ring		Pointer to the instance to destroy.
+ */
+
+void uring_destroy(struct uring *ring);
+
+/**
+ * Queue an openat() operation, relative to the current directory.
+ *
+ * \param *ring		Pointer to the instance to queue the operation on.
+ * \param *path		Pointer to the path to open, which must remain
+ *			valid until the operation has completed.
+ * \param flags		The open flags.
+ * \param mode		The mode for any file created.
+ * \param user_data	The value to return with the completion.
+ * \return		True if queued; False if the queue is full.
+ */
+
+bool uring_queue_open(struct uring *ring, char *path, int flags, unsigned mode, uint64_t user_data);
+
+/**
+ * Queue a pread() operation.
+ *
+ * \param *ring		Pointer to the instance to queue the operation on.
+ * \param fd		The file descriptor to read from.
+ * \param *buffer	Pointer to the buffer to read into.
+ * \param length	The number of bytes to read.
+ * \param offset	The offset into the file to read from.
+ * \param user_data	The value to return with the completion.
+ * \return		True if queued; False if the queue is full.
+ */
+
+bool uring_queue_read(struct uring *ring, int fd, void *buffer, unsigned length, uint64_t offset, uint64_t user_data);
+
+/**
+ * Queue a pwrite() operation.
+ *
+ * \param *ring		Pointer to the instance to queue the operation on.
+ * \param fd		The file descriptor to write to.
+ * \param *buffer	Pointer to the data to be written.
+ * \param length	The number of bytes to write.
+ * \param offset	The offset into the file to write to.
+ * \param user_data	The value to return with the completion.
+ * \return		True if queued; False if the queue is full.
+ */
+
+bool uring_queue_write(struct uring *ring, int fd, void *buffer, unsigned length, uint64_t offset, uint64_t user_data);
+
+/**
+ * Queue an fsync() operation.
+ *
+ * \param *ring		Pointer to the instance to queue the operation on.
+ * \param fd		The file descriptor to flush.
+ * \param user_data	The value to return with the completion.
+ * \return		True if queued; False if the queue is full.
+ */
+
+bool uring_queue_fsync(struct uring *ring, int fd, uint64_t user_data);
+
+/**
+ * Queue a close() operation.
+ *
+ * \param *ring		Pointer to the instance to queue the operation on.
+ * \param fd		The file descriptor to close.
+ * \param user_data	The value to return with the completion.
+ * \return		True if queued; False if the queue is full.
+ */
+
+bool uring_queue_close(struct uring *ring, int fd, uint64_t user_data);
+
+/**
+ * Queue an unlink() operation, relative to the current directory.
+ *
+ * \param *ring		Pointer to the instance to queue the operation on.
+ * \param *path		Pointer to the path to unlink, which must remain
+ *			valid until the operation has completed.
+ * \param user_data	The value to return with the completion.
+ * \return		True if queued; False if the queue is full.
+ */
+
+bool uring_queue_unlink(struct uring *ring, char *path, uint64_t user_data);
+
+/**
+ * Submit all of the queued operations to the kernel, and wait for them
+ * and any others still in progress to complete.
+ *
+ * \param *ring		Pointer to the instance to submit.
+ * \return		True if successful; False on failure.
+ */
+
+bool uring_submit_and_wait(struct uring *ring);
+
+/**
+ * Collect the next completed operation.
+ *
+ * \param *ring		Pointer to the instance to collect from.
+ * \param *user_data	Pointer to a variable to take the operation's value.
+ * \param *result	Pointer to a variable to take the operation's result,
+ *			which is a negative errno value on failure.
+ * \return		True if a completion was collected; False if there
+ *			are no more.
+ */
+
+bool uring_next_completion(struct uring *ring, uint64_t *user_data, int *result);
+
+#endif
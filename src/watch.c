@@ -0,0 +1,384 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file watch.c
+ *
+ * Change Watching, implementation.
+ *
+ * The manual is watched through its parent directory, so that it is still
+ * seen if it is replaced by a new file -- as most editors and build tools
+ * do -- rather than being written in place. Every directory within the
+ * folder has its own watch, as inotify does not watch whole trees.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* inotify needs the kernel headers; without them, nothing can be watched. */
+
+#if defined(LINUX) && defined(__has_include)
+#if __has_include(<sys/inotify.h>)
+#define WATCH_AVAILABLE
+#endif
+#endif
+
+#ifdef WATCH_AVAILABLE
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/* Local source headers. */
+
+#include "watch.h"
+
+#include "msg.h"
+#include "stack.h"
+#include "stats.h"
+
+#ifdef WATCH_AVAILABLE
+
+/**
+ * The events which indicate that the manual has changed. A manual which is
+ * rewritten in place is seen as soon as it is modified, instead of waiting
+ * for it to be closed.
+ */
+
+#define WATCH_MANUAL_EVENTS (IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_ATTRIB)
+
+/**
+ * The events which indicate that something in the folder has changed.
+ */
+
+#define WATCH_FOLDER_EVENTS (IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/**
+ * The size of the buffer used to read events from the kernel.
+ */
+
+#define WATCH_BUFFER_SIZE 4096
+
+/**
+ * A change watcher instance.
+ */
+
+struct watch {
+	int			fd;		/**< The inotify file descriptor.			*/
+	int			manual_wd;	/**< The watch on the manual's parent directory.	*/
+	char			*manual_leaf;	/**< The leafname of the manual.			*/
+	char			*folder;	/**< The path of the folder.				*/
+};
+
+/* Static Function Prototypes. */
+
+static void watch_add_folder(struct watch *watch, char *path, struct stack *pending);
+static char *watch_join_path(char *path, char *name);
+
+#endif
+
+/**
+ * Create a new change watcher for a StrongHelp manual and a disc folder.
+ *
+ * \param *manual	Pointer to the path of the manual to watch.
+ * \param *folder	Pointer to the path of the folder to watch.
+ * \return		Pointer to the new watcher, or NULL if watching
+ *			isn't available.
+ */
+
+struct watch *watch_create(char *manual, char *folder)
+{
+#ifdef WATCH_AVAILABLE
+	struct watch *watch;
+	char *parent, *leaf;
+
+	if (manual == NULL || folder == NULL)
+		return NULL;
+
+	watch = malloc(sizeof(struct watch));
+	if (watch == NULL)
+		return NULL;
+
+	watch->manual_wd = -1;
+	watch->manual_leaf = NULL;
+	watch->folder = strdup(folder);
+	parent = strdup(manual);
+
+	watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	stats_count(STATS_SYSCALLS, 1);
+
+	if (watch->fd < 0 || watch->folder == NULL || parent == NULL) {
+		free(parent);
+		watch_destroy(watch);
+		return NULL;
+	}
+
+	/* Split the manual's path into its parent directory and leafname. */
+
+	leaf = strrchr(parent, '/');
+	if (leaf == NULL) {
+		watch->manual_leaf = strdup(parent);
+		strcpy(parent, ".");
+	} else {
+		watch->manual_leaf = strdup(leaf + 1);
+		*leaf = '\0';
+		if (leaf == parent)
+			strcpy(parent, "/");
+	}
+
+	if (watch->manual_leaf != NULL) {
+		watch->manual_wd = inotify_add_watch(watch->fd, parent, WATCH_MANUAL_EVENTS);
+		stats_count(STATS_SYSCALLS, 1);
+	}
+
+	free(parent);
+
+	if (watch->manual_wd < 0) {
+		watch_destroy(watch);
+		return NULL;
+	}
+
+	watch_refresh(watch);
+
+	return watch;
+#else
+	return NULL;
+#endif
+}
+
+/**
+ * Destroy a change watcher.
+ *
+ * \param *watch	Pointer to the watcher to destroy.
+ */
+
+void watch_destroy(struct watch *watch)
+{
+#ifdef WATCH_AVAILABLE
+	if (watch == NULL)
+		return;
+
+	if (watch->fd >= 0)
+		close(watch->fd);
+
+	free(watch->manual_leaf);
+	free(watch->folder);
+	free(watch);
+#endif
+}
+
+/**
+ * Watch any directories which have been added to the folder since the
+ * watcher was created or last refreshed. Directories which have been
+ * removed are forgotten by the kernel automatically.
+ *
+ * \param *watch	Pointer to the watcher to refresh.
+ */
+
+void watch_refresh(struct watch *watch)
+{
+#ifdef WATCH_AVAILABLE
+	struct stack pending;
+	char *path;
+
+	if (watch == NULL)
+		return;
+
+	/* Adding a watch to a directory which already has one just returns
+	 * the existing watch, so the whole tree can be walked again.
+	 */
+
+	stack_initialise(&pending, sizeof(char *));
+
+	path = strdup(watch->folder);
+	if (path == NULL || !stack_push(&pending, &path))
+		free(path);
+
+	while (stack_pop(&pending, &path)) {
+		watch_add_folder(watch, path, &pending);
+		free(path);
+	}
+
+	stack_free(&pending);
+#endif
+}
+
+/**
+ * Wait for changes to the manual or the folder. Once a change has been
+ * seen, the wait continues until there have been no further changes for
+ * the settle period, so that an editor saving a file in several steps
+ * is only reported once.
+ *
+ * \param *watch	Pointer to the watcher to wait on.
+ * \param timeout	The time to wait for a first change, in ms, or -1
+ *			to wait forever; 0 checks without waiting.
+ * \param settle	The period without changes to wait for, in ms.
+ * \return		The combination of enum watch_change values seen.
+ */
+
+unsigned watch_wait(struct watch *watch, int timeout, int settle)
+{
+#ifdef WATCH_AVAILABLE
+	char buffer[WATCH_BUFFER_SIZE] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *event;
+	unsigned changes = WATCH_CHANGE_NONE;
+	struct pollfd poll_fd;
+	ssize_t length, offset;
+	int ready;
+
+	if (watch == NULL)
+		return WATCH_CHANGE_FAILED;
+
+	while (true) {
+		poll_fd.fd = watch->fd;
+		poll_fd.events = POLLIN;
+		poll_fd.revents = 0;
+
+		ready = poll(&poll_fd, 1, timeout);
+		stats_count(STATS_SYSCALLS, 1);
+
+		if (ready < 0 && errno == EINTR)
+			continue;
+		else if (ready < 0)
+			return changes | WATCH_CHANGE_FAILED;
+		else if (ready == 0)
+			return changes;
+
+		length = read(watch->fd, buffer, WATCH_BUFFER_SIZE);
+		stats_count(STATS_SYSCALLS, 1);
+
+		if (length < 0 && (errno == EAGAIN || errno == EINTR))
+			continue;
+		else if (length <= 0)
+			return changes | WATCH_CHANGE_FAILED;
+
+		for (offset = 0; offset < length; offset += sizeof(struct inotify_event) + event->len) {
+			event = (struct inotify_event *) (buffer + offset);
+
+			/* If events have been lost, anything could have changed. */
+
+			if (event->mask & IN_Q_OVERFLOW)
+				changes |= WATCH_CHANGE_MANUAL | WATCH_CHANGE_FOLDER;
+			else if (event->mask & IN_IGNORED)
+				continue;
+			else if (event->wd != watch->manual_wd)
+				changes |= WATCH_CHANGE_FOLDER;
+			else if (event->len > 0 && strcmp(event->name, watch->manual_leaf) == 0)
+				changes |= WATCH_CHANGE_MANUAL;
+		}
+
+		if (changes != WATCH_CHANGE_NONE)
+			timeout = settle;
+	}
+#else
+	return WATCH_CHANGE_FAILED;
+#endif
+}
+
+#ifdef WATCH_AVAILABLE
+
+/**
+ * Watch a single directory within the folder, and queue any directories
+ * within it to be watched in turn.
+ *
+ * \param *watch	Pointer to the watcher to add the directory to.
+ * \param *path		Pointer to the path of the directory.
+ * \param *pending	Pointer to the stack of directories to be watched,
+ *			which takes ownership of any paths pushed on to it.
+ */
+
+static void watch_add_folder(struct watch *watch, char *path, struct stack *pending)
+{
+	struct dirent *entry;
+	char *child;
+	DIR *dir;
+
+	/* Directories which have gone away since they were found don't matter,
+	 * as there's nothing left in them to be changed.
+	 */
+
+	stats_count(STATS_SYSCALLS, 1);
+	if (inotify_add_watch(watch->fd, path, WATCH_FOLDER_EVENTS | IN_ONLYDIR) < 0) {
+		if (errno != ENOENT && errno != ENOTDIR)
+			msg_report(MSG_WATCH_DIR_FAILED, path);
+		return;
+	}
+
+	dir = opendir(path);
+	stats_count(STATS_SYSCALLS, 1);
+	if (dir == NULL)
+		return;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+
+		if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN)
+			continue;
+
+		/* Anything of unknown type is tried, and IN_ONLYDIR rejects it
+		 * if it turns out not to be a directory.
+		 */
+
+		child = watch_join_path(path, entry->d_name);
+		if (child == NULL || !stack_push(pending, &child))
+			free(child);
+	}
+
+	closedir(dir);
+}
+
+/**
+ * Join a name on to the end of a path.
+ *
+ * \param *path		Pointer to the path.
+ * \param *name		Pointer to the name to add.
+ * \return		Pointer to the new path, which must be freed after
+ *			use, or NULL on failure.
+ */
+
+static char *watch_join_path(char *path, char *name)
+{
+	size_t length;
+	char *joined;
+
+	length = strlen(path) + strlen(name) + 2;
+
+	joined = malloc(length);
+	if (joined == NULL) {
+		msg_report(MSG_NO_MEMORY);
+		return NULL;
+	}
+
+	snprintf(joined, length, "%s/%s", path, name);
+
+	return joined;
+}
+
+#endif
+
@@ -0,0 +1,103 @@
+/* Copyright 2021, Stephen Fryatt (info@stevefryatt.org.uk)
+ *
+ * This file is part of Strong Extract:
+ *
+ *   http://www.stevefryatt.org.uk/risc-os/
+ *
+ * Licensed under the EUPL, Version 1.2 only (the "Licence");
+ * You may not use this work except in compliance with the
+ * Licence.
+ *
+ * You may obtain a copy of the Licence at:
+ *
+ *   http://joinup.ec.europa.eu/software/page/eupl
+ *
+ * Unless required by applicable law or agreed to in
+ * writing, software distributed under the Licence is
+ * distributed on an "AS IS" basis, WITHOUT WARRANTIES
+ * OR CONDITIONS OF ANY KIND, either express or implied.
+ *
+ * See the Licence for the specific language governing
+ * permissions and limitations under the Licence.
+ */
+
+
+/**
+ * \file watch.h
+ *
+ * Change Watching Interface.
+ *
+ * A wrapper around Linux's inotify, allowing a StrongHelp manual and the
+ * folder extracted from it to be watched for changes. Where inotify isn't
+ * available, either at build time or on the running kernel, watch_create()
+ * will return NULL.
+ */
+
+#ifndef STRONGEX_WATCH_H
+#define STRONGEX_WATCH_H
+
+#include <stdbool.h>
+
+/**
+ * The kinds of change which can be reported by watch_wait().
+ */
+
+enum watch_change {
+	WATCH_CHANGE_NONE = 0,		/**< Nothing has changed.					*/
+	WATCH_CHANGE_MANUAL = 1,	/**< The StrongHelp manual has been written or replaced.	*/
+	WATCH_CHANGE_FOLDER = 2,	/**< Something within the disc folder has changed.		*/
+	WATCH_CHANGE_FAILED = 4		/**< The watch has failed, and can't be used any more.		*/
+};
+
+/**
+ * A change watcher instance reference.
+ */
+
+struct watch;
+
+/**
+ * Create a new change watcher for a StrongHelp manual and a disc folder.
+ *
+ * \param *manual	Pointer to the path of the manual to watch.
+ * \param *folder	Pointer to the path of the folder to watch.
+ * \return		Pointer to the new watcher, or NULL if watching
+ *			isn't available.
+ */
+
+struct watch *watch_create(char *manual, char *folder);
+
+/**
+ * Destroy a change watcher.
+ *
+ * \param *watch	Pointer to the watcher to destroy.
+ */
+
+void watch_destroy(struct watch *watch);
+
+/**
+ * Watch any directories which have been added to the folder since the
+ * watcher was created or last refreshed. Directories which have been
+ * removed are forgotten by the kernel automatically.
+ *
+ * \param *watch	Pointer to the watcher to refresh.
+ */
+
+void watch_refresh(struct watch *watch);
+
+/**
+ * Wait for changes to the manual or the folder. Once a change has been
+ * seen, the wait continues until there have been no further changes for
+ * the settle period, so that an editor saving a file in several steps
+ * is only reported once.
+ *
+ * \param *watch	Pointer to the watcher to wait on.
+ * \param timeout	The time to wait for a first change, in ms, or -1
+ *			to wait forever; 0 checks without waiting.
+ * \param settle	The period without changes to wait for, in ms.
+ * \return		The combination of enum watch_change values seen.
+ */
+
+unsigned watch_wait(struct watch *watch, int timeout, int settle);
+
+#endif
+